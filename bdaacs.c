@@ -0,0 +1,642 @@
+/*
+ * bdaacs.c: Parallel AACS decryption of aligned units
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+
+#include <libbluray/bluray-version.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+# include <wmmintrin.h>
+# define AES_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+# include <arm_neon.h>
+# define AES_ARM
+#endif
+
+#include "bddiscid.h"
+#include "bdsched.h"
+#include "bdstats.h"
+#include "m2ts.h"
+
+#include "bdaacs.h"
+
+#define CHUNK_UNITS  8      // units a worker takes at a time
+
+// IV of the AES-CBC encryption of aligned units
+static const uint8_t UnitIv[16] = {
+  0x0b, 0xa0, 0xf8, 0xdd, 0xfe, 0xa6, 0x1f, 0xb3,
+  0xd8, 0xdf, 0x9f, 0x56, 0x6a, 0x05, 0x0f, 0x78
+};
+
+// --- portable AES -----------------------------------------------------
+
+static uint8_t Sbox[256], InvSbox[256];
+static uint8_t Mul2[256], Mul3[256], Mul9[256], Mul11[256], Mul13[256], Mul14[256];
+
+static uint8_t GfMul(uint8_t a, uint8_t b)
+{
+  uint8_t p = 0;
+  while (b) {
+    if (b & 1)
+      p ^= a;
+    a = (a << 1) ^ (a & 0x80 ? 0x1b : 0);
+    b >>= 1;
+  }
+  return p;
+}
+
+static inline uint8_t Rotl8(uint8_t x, int n)
+{
+  return (x << n) | (x >> (8 - n));
+}
+
+static bool InitTables(void)
+{
+  // walk GF(2^8) with generator 3: q is the inverse of p
+  uint8_t p = 1, q = 1;
+  do {
+    p = p ^ (p << 1) ^ (p & 0x80 ? 0x1b : 0);
+    q ^= q << 1;
+    q ^= q << 2;
+    q ^= q << 4;
+    if (q & 0x80)
+      q ^= 0x09;
+    Sbox[p] = q ^ Rotl8(q, 1) ^ Rotl8(q, 2) ^ Rotl8(q, 3) ^ Rotl8(q, 4) ^ 0x63;
+  } while (p != 1);
+  Sbox[0] = 0x63;
+
+  for (int i = 0; i < 256; i++) {
+    InvSbox[Sbox[i]] = i;
+    Mul2[i]  = GfMul(i, 2);
+    Mul3[i]  = GfMul(i, 3);
+    Mul9[i]  = GfMul(i, 9);
+    Mul11[i] = GfMul(i, 11);
+    Mul13[i] = GfMul(i, 13);
+    Mul14[i] = GfMul(i, 14);
+  }
+  return true;
+}
+
+static bool tablesReady = InitTables();
+static bool portable = false;
+
+static void InvMixColumns(uint8_t *s)
+{
+  for (int c = 0; c < 16; c += 4) {
+    uint8_t a0 = s[c], a1 = s[c + 1], a2 = s[c + 2], a3 = s[c + 3];
+    s[c]     = Mul14[a0] ^ Mul11[a1] ^ Mul13[a2] ^ Mul9[a3];
+    s[c + 1] = Mul9[a0]  ^ Mul14[a1] ^ Mul11[a2] ^ Mul13[a3];
+    s[c + 2] = Mul13[a0] ^ Mul9[a1]  ^ Mul14[a2] ^ Mul11[a3];
+    s[c + 3] = Mul11[a0] ^ Mul13[a1] ^ Mul9[a2]  ^ Mul14[a3];
+  }
+}
+
+static void EncryptBlock(const uint8_t ek[11][16], const uint8_t *In, uint8_t *Out)
+{
+  uint8_t s[16], t[16];
+  for (int i = 0; i < 16; i++)
+    s[i] = In[i] ^ ek[0][i];
+
+  for (int r = 1; r <= 10; r++) {
+    // SubBytes and ShiftRows (state is column major)
+    for (int c = 0; c < 4; c++)
+      for (int row = 0; row < 4; row++)
+        t[c * 4 + row] = Sbox[s[((c + row) & 3) * 4 + row]];
+    if (r < 10) {
+      for (int c = 0; c < 16; c += 4) {
+        uint8_t a0 = t[c], a1 = t[c + 1], a2 = t[c + 2], a3 = t[c + 3];
+        s[c]     = Mul2[a0] ^ Mul3[a1] ^ a2 ^ a3;
+        s[c + 1] = a0 ^ Mul2[a1] ^ Mul3[a2] ^ a3;
+        s[c + 2] = a0 ^ a1 ^ Mul2[a2] ^ Mul3[a3];
+        s[c + 3] = Mul3[a0] ^ a1 ^ a2 ^ Mul2[a3];
+      }
+    } else
+      memcpy(s, t, 16);
+    for (int i = 0; i < 16; i++)
+      s[i] ^= ek[r][i];
+  }
+  memcpy(Out, s, 16);
+}
+
+static void DecryptBlock(const uint8_t dk[11][16], const uint8_t *In, uint8_t *Out)
+{
+  // equivalent inverse cipher (FIPS-197 5.3.5)
+  uint8_t s[16], t[16];
+  for (int i = 0; i < 16; i++)
+    s[i] = In[i] ^ dk[0][i];
+
+  for (int r = 1; r <= 10; r++) {
+    for (int c = 0; c < 4; c++)
+      for (int row = 0; row < 4; row++)
+        t[((c + row) & 3) * 4 + row] = InvSbox[s[c * 4 + row]];
+    if (r < 10)
+      InvMixColumns(t);
+    for (int i = 0; i < 16; i++)
+      s[i] = t[i] ^ dk[r][i];
+  }
+  memcpy(Out, s, 16);
+}
+
+// --- AES instructions -------------------------------------------------
+
+#ifdef AES_X86
+
+#define K(r) _mm_load_si128((const __m128i *)k[r])
+
+__attribute__((target("aes,sse2")))
+static void NiEncryptCbc(const uint8_t k[11][16], uint8_t *Data, int Length, const uint8_t *Iv)
+{
+  __m128i prev = _mm_loadu_si128((const __m128i *)Iv);
+  for (int i = 0; i < Length; i += 16) {
+    __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(Data + i)), prev);
+    b = _mm_xor_si128(b, K(0));
+    for (int r = 1; r < 10; r++)
+      b = _mm_aesenc_si128(b, K(r));
+    prev = _mm_aesenclast_si128(b, K(10));
+    _mm_storeu_si128((__m128i *)(Data + i), prev);
+  }
+}
+
+__attribute__((target("aes,sse2")))
+static void NiDecryptCbc(const uint8_t k[11][16], uint8_t *Data, int Length, const uint8_t *Iv)
+{
+  // CBC decryption is parallel: four blocks in flight
+  __m128i prev = _mm_loadu_si128((const __m128i *)Iv);
+  int i = 0;
+  for (; i + 64 <= Length; i += 64) {
+    __m128i c0 = _mm_loadu_si128((const __m128i *)(Data + i));
+    __m128i c1 = _mm_loadu_si128((const __m128i *)(Data + i + 16));
+    __m128i c2 = _mm_loadu_si128((const __m128i *)(Data + i + 32));
+    __m128i c3 = _mm_loadu_si128((const __m128i *)(Data + i + 48));
+    __m128i b0 = _mm_xor_si128(c0, K(0));
+    __m128i b1 = _mm_xor_si128(c1, K(0));
+    __m128i b2 = _mm_xor_si128(c2, K(0));
+    __m128i b3 = _mm_xor_si128(c3, K(0));
+    for (int r = 1; r < 10; r++) {
+      __m128i key = K(r);
+      b0 = _mm_aesdec_si128(b0, key);
+      b1 = _mm_aesdec_si128(b1, key);
+      b2 = _mm_aesdec_si128(b2, key);
+      b3 = _mm_aesdec_si128(b3, key);
+    }
+    b0 = _mm_aesdeclast_si128(b0, K(10));
+    b1 = _mm_aesdeclast_si128(b1, K(10));
+    b2 = _mm_aesdeclast_si128(b2, K(10));
+    b3 = _mm_aesdeclast_si128(b3, K(10));
+    _mm_storeu_si128((__m128i *)(Data + i),      _mm_xor_si128(b0, prev));
+    _mm_storeu_si128((__m128i *)(Data + i + 16), _mm_xor_si128(b1, c0));
+    _mm_storeu_si128((__m128i *)(Data + i + 32), _mm_xor_si128(b2, c1));
+    _mm_storeu_si128((__m128i *)(Data + i + 48), _mm_xor_si128(b3, c2));
+    prev = c3;
+  }
+  for (; i < Length; i += 16) {
+    __m128i c = _mm_loadu_si128((const __m128i *)(Data + i));
+    __m128i b = _mm_xor_si128(c, K(0));
+    for (int r = 1; r < 10; r++)
+      b = _mm_aesdec_si128(b, K(r));
+    b = _mm_aesdeclast_si128(b, K(10));
+    _mm_storeu_si128((__m128i *)(Data + i), _mm_xor_si128(b, prev));
+    prev = c;
+  }
+}
+
+#undef K
+
+#endif // AES_X86
+
+#ifdef AES_ARM
+
+static void ArmEncryptCbc(const uint8_t k[11][16], uint8_t *Data, int Length, const uint8_t *Iv)
+{
+  uint8x16_t prev = vld1q_u8(Iv);
+  for (int i = 0; i < Length; i += 16) {
+    uint8x16_t b = veorq_u8(vld1q_u8(Data + i), prev);
+    for (int r = 0; r < 9; r++)
+      b = vaesmcq_u8(vaeseq_u8(b, vld1q_u8(k[r])));
+    prev = veorq_u8(vaeseq_u8(b, vld1q_u8(k[9])), vld1q_u8(k[10]));
+    vst1q_u8(Data + i, prev);
+  }
+}
+
+static void ArmDecryptCbc(const uint8_t k[11][16], uint8_t *Data, int Length, const uint8_t *Iv)
+{
+  uint8x16_t prev = vld1q_u8(Iv);
+  for (int i = 0; i < Length; i += 16) {
+    uint8x16_t c = vld1q_u8(Data + i);
+    uint8x16_t b = c;
+    for (int r = 0; r < 9; r++)
+      b = vaesimcq_u8(vaesdq_u8(b, vld1q_u8(k[r])));
+    b = veorq_u8(vaesdq_u8(b, vld1q_u8(k[9])), vld1q_u8(k[10]));
+    vst1q_u8(Data + i, veorq_u8(b, prev));
+    prev = c;
+  }
+}
+
+#endif // AES_ARM
+
+// --- cBDAes -----------------------------------------------------------
+
+cBDAes::cBDAes(const uint8_t Key[16])
+{
+  memcpy(ek[0], Key, 16);
+  uint8_t rcon = 1;
+  for (int r = 1; r <= 10; r++) {
+    const uint8_t *p = ek[r - 1];
+    uint8_t t[4] = { Sbox[p[13]], Sbox[p[14]], Sbox[p[15]], Sbox[p[12]] };
+    t[0] ^= rcon;
+    rcon = Mul2[rcon];
+    for (int i = 0; i < 4; i++)
+      ek[r][i] = p[i] ^ t[i];
+    for (int i = 4; i < 16; i++)
+      ek[r][i] = p[i] ^ ek[r][i - 4];
+  }
+
+  memcpy(dk[0], ek[10], 16);
+  for (int r = 1; r < 10; r++) {
+    memcpy(dk[r], ek[10 - r], 16);
+    InvMixColumns(dk[r]);
+  }
+  memcpy(dk[10], ek[0], 16);
+
+  accelerated = Available() && !portable;
+}
+
+bool cBDAes::Available(void)
+{
+#if defined(AES_X86)
+  unsigned int a, b, c, d;
+  return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_AES);
+#elif defined(AES_ARM)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void cBDAes::SetPortable(bool On)
+{
+  portable = On;
+}
+
+void cBDAes::Encrypt(const uint8_t In[16], uint8_t Out[16]) const
+{
+  EncryptBlock(ek, In, Out);
+}
+
+void cBDAes::EncryptCbc(uint8_t *Data, int Length, const uint8_t Iv[16]) const
+{
+#if defined(AES_X86)
+  if (accelerated)
+    return NiEncryptCbc(ek, Data, Length, Iv);
+#elif defined(AES_ARM)
+  if (accelerated)
+    return ArmEncryptCbc(ek, Data, Length, Iv);
+#endif
+  const uint8_t *prev = Iv;
+  for (int i = 0; i < Length; i += 16) {
+    for (int j = 0; j < 16; j++)
+      Data[i + j] ^= prev[j];
+    EncryptBlock(ek, Data + i, Data + i);
+    prev = Data + i;
+  }
+}
+
+void cBDAes::DecryptCbc(uint8_t *Data, int Length, const uint8_t Iv[16]) const
+{
+#if defined(AES_X86)
+  if (accelerated)
+    return NiDecryptCbc(dk, Data, Length, Iv);
+#elif defined(AES_ARM)
+  if (accelerated)
+    return ArmDecryptCbc(dk, Data, Length, Iv);
+#endif
+  uint8_t prev[16], c[16];
+  memcpy(prev, Iv, 16);
+  for (int i = 0; i < Length; i += 16) {
+    memcpy(c, Data + i, 16);
+    DecryptBlock(dk, Data + i, Data + i);
+    for (int j = 0; j < 16; j++)
+      Data[i + j] ^= prev[j];
+    memcpy(prev, c, 16);
+  }
+}
+
+// --- cBDAacsWorker ----------------------------------------------------
+
+class cBDAacsWorker : public cBDThread {
+private:
+  cBDAacs *aacs;
+protected:
+  virtual void Action(void);
+public:
+  cBDAacsWorker(cBDAacs *Aacs) : cBDThread("BluRay AACS"), aacs(Aacs) {}
+  virtual ~cBDAacsWorker() { Cancel(); }
+};
+
+void cBDAacsWorker::Action(void)
+{
+  cBDStats::Attach("aacs");
+
+  int seen = 0, sched = -1;
+  aacs->mutex.Lock();
+  while (Running()) {
+    if (sched != aacs->schedGeneration) {
+      sched = aacs->schedGeneration;
+      BDApplyPlayerSched("BluRay AACS");
+    }
+    if (!aacs->jobData || aacs->jobId == seen) {
+      aacs->work.TimedWait(aacs->mutex, 100);
+      continue;
+    }
+    seen = aacs->jobId;
+    aacs->active++;
+    aacs->mutex.Unlock();
+    aacs->Process();
+    aacs->mutex.Lock();
+    aacs->active--;
+    aacs->done.Broadcast();
+  }
+  aacs->mutex.Unlock();
+}
+
+// --- cBDAacs ----------------------------------------------------------
+
+cBDAacs::cBDAacs(const uint8_t UnitKey[16], int Threads)
+:unitKey(UnitKey)
+{
+  threads = Threads > 0 ? Threads : 0;
+  jobData = NULL;
+  jobUnits = jobId = 0;
+  next = finished = decrypted = failed = 0;
+  active = 0;
+  schedGeneration = 0;
+  units = failures = 0;
+
+  workers = new cBDAacsWorker*[threads + 1];
+  for (int i = 0; i < threads; i++) {
+    workers[i] = new cBDAacsWorker(this);
+    workers[i]->Start();
+  }
+}
+
+cBDAacs::~cBDAacs()
+{
+  for (int i = 0; i < threads; i++)
+    delete workers[i];
+  delete[] workers;
+  if (units)
+    syslog(LOG_INFO, "BluRay: AACS: %llu units decrypted in %d threads (%s), %llu left to libaacs",
+           (unsigned long long)units, threads + 1, unitKey.Accelerated() ? "AES instructions" : "portable AES",
+           (unsigned long long)failures);
+}
+
+int cBDAacs::DecryptUnit(const cBDAes &Key, uint8_t *Unit)
+{
+  // copy permission indicator: clear units are not encrypted
+  if (!(Unit[0] & 0xc0))
+    return 0;
+
+  uint8_t iv[16], key[16];
+  memcpy(iv, UnitIv, 16);
+  Key.Encrypt(Unit, key);
+  for (int i = 0; i < 16; i++)
+    key[i] ^= Unit[i];
+  cBDAes block(key);
+  block.DecryptCbc(Unit + 16, ALIGNED_UNIT_SIZE - 16, iv);
+
+  for (int i = 0; i < ALIGNED_UNIT_SIZE; i += M2TS_SIZE) {
+    if (Unit[i + 4] != 0x47) {
+      // wrong key or not a stream: leave it to libaacs
+      block.EncryptCbc(Unit + 16, ALIGNED_UNIT_SIZE - 16, iv);
+      return -1;
+    }
+  }
+  Unit[0] &= ~0xc0;
+  return 1;
+}
+
+void cBDAacs::EncryptUnit(const cBDAes &Key, uint8_t *Unit)
+{
+  Unit[0] |= 0xc0;
+  uint8_t key[16];
+  Key.Encrypt(Unit, key);
+  for (int i = 0; i < 16; i++)
+    key[i] ^= Unit[i];
+  cBDAes block(key);
+  block.EncryptCbc(Unit + 16, ALIGNED_UNIT_SIZE - 16, UnitIv);
+}
+
+void cBDAacs::Process(void)
+{
+  for (;;) {
+    int first = __sync_fetch_and_add(&next, CHUNK_UNITS);
+    if (first >= jobUnits)
+      break;
+    int n = jobUnits - first < CHUNK_UNITS ? jobUnits - first : CHUNK_UNITS;
+    int ok = 0, bad = 0;
+    for (int i = 0; i < n; i++) {
+      int r = DecryptUnit(unitKey, jobData + (first + i) * ALIGNED_UNIT_SIZE);
+      ok += r > 0;
+      bad += r < 0;
+    }
+    __sync_fetch_and_add(&decrypted, ok);
+    __sync_fetch_and_add(&failed, bad);
+    __sync_fetch_and_add(&finished, n);
+  }
+}
+
+int cBDAacs::Decrypt(uint8_t *Data, int Count)
+{
+  cBDMutexLock lock(mutex);
+
+  jobData = Data;
+  jobUnits = Count;
+  next = finished = decrypted = failed = 0;
+  jobId++;
+  if (threads > 0 && Count > CHUNK_UNITS)
+    work.Broadcast();
+
+  // the calling thread works too
+  mutex.Unlock();
+  Process();
+  mutex.Lock();
+
+  // units in order: return when all are done
+  while (finished < jobUnits || active > 0)
+    done.TimedWait(mutex, 100);
+  jobData = NULL;
+
+  units += decrypted;
+  failures += failed;
+  cBDStats::Count(bcAacsUnits, decrypted);
+  return decrypted;
+}
+
+// --- key lookup -------------------------------------------------------
+
+static uint8_t *LoadFile(const char *Root, const char *Name, int &Length)
+{
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", Root, Name);
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+  uint8_t *data = (uint8_t *)malloc(1024 * 1024);
+  Length = data ? fread(data, 1, 1024 * 1024, f) : 0;
+  fclose(f);
+  return data;
+}
+
+static bool ParseKey(const char *s, uint8_t Key[16])
+{
+  while (*s == ' ' || *s == '\t')
+    s++;
+  if (strncasecmp(s, "0x", 2))
+    return false;
+  s += 2;
+  for (int i = 0; i < 16; i++) {
+    unsigned int b;
+    if (sscanf(s + 2 * i, "%2x", &b) != 1)
+      return false;
+    Key[i] = b;
+  }
+  return true;
+}
+
+// Value of the field "| Tag |" of a KEYDB.cfg entry
+static const char *Field(const char *Entry, char Tag)
+{
+  for (const char *p = strchr(Entry, '|'); p; p = strchr(p + 1, '|')) {
+    const char *q = p + 1;
+    while (*q == ' ' || *q == '\t')
+      q++;
+    if (*q != Tag)
+      continue;
+    q++;
+    while (*q == ' ' || *q == '\t')
+      q++;
+    if (*q == '|')
+      return q + 1;
+  }
+  return NULL;
+}
+
+// Unit key (U) or volume unique key (V) of disc DiscId in libaacs's key
+// database. Returns 'U', 'V' or 0; 'M' for several unit keys.
+static char FindKey(const char *DiscId, uint8_t Key[16])
+{
+  char paths[3][1024];
+  const char *xdg = getenv("XDG_CONFIG_HOME");
+  const char *home = getenv("HOME");
+  snprintf(paths[0], sizeof(paths[0]), "%s/aacs/KEYDB.cfg", xdg ? xdg : "");
+  snprintf(paths[1], sizeof(paths[1]), "%s/.config/aacs/KEYDB.cfg", home ? home : "");
+  snprintf(paths[2], sizeof(paths[2]), "/etc/xdg/aacs/KEYDB.cfg");
+
+  char found = 0;
+  for (int i = 0; i < 3 && !found; i++) {
+    if ((i == 0 && !xdg) || (i == 1 && !home))
+      continue;
+    FILE *f = fopen(paths[i], "r");
+    if (!f)
+      continue;
+    char line[8192];
+    while (!found && fgets(line, sizeof(line), f)) {
+      const char *p = line;
+      while (*p == ' ' || *p == '\t')
+        p++;
+      if (strncasecmp(p, "0x", 2) || strncasecmp(p + 2, DiscId, 40))
+        continue;
+      const char *u = Field(p, 'U');
+      const char *v = Field(p, 'V');
+      if (u) {
+        while (*u == ' ' || *u == '\t')
+          u++;
+        if (!strncmp(u, "1-", 2) && ParseKey(u + 2, Key))
+          found = strstr(u, "2-0x") || strstr(u, "2-0X") ? 'M' : 'U';
+      }
+      if (!found && v && ParseKey(v, Key))
+        found = 'V';
+    }
+    fclose(f);
+  }
+  return found;
+}
+
+// Volume unique key from the media key and volume ID libaacs found
+static bool MediaKey(BLURAY *Bd, uint8_t Vuk[16])
+{
+#if BLURAY_VERSION >= BLURAY_VERSION_CODE(1, 0, 0)
+  const uint8_t *mk = Bd ? bd_get_aacs_data(Bd, BD_AACS_MEDIA_KEY) : NULL;
+  const uint8_t *vid = Bd ? bd_get_aacs_data(Bd, BD_AACS_MEDIA_VID) : NULL;
+  if (!mk || !vid)
+    return false;
+  // AES-G: VUK = AES-128D(MK, VID) xor VID, a CBC block with VID as IV
+  memcpy(Vuk, vid, 16);
+  cBDAes(mk).DecryptCbc(Vuk, 16, vid);
+  return true;
+#else
+  return false;
+#endif
+}
+
+cBDAacs *cBDAacs::Open(const char *Root, int Threads, BLURAY *Bd)
+{
+  int len;
+  uint8_t *ukf = LoadFile(Root, "AACS/Unit_Key_RO.inf", len);
+  if (!ukf)
+    return NULL;  // not protected
+
+  cBDAacs *aacs = NULL;
+  int cert = 0;
+  uint8_t *cc = LoadFile(Root, "AACS/Content000.cer", cert);
+  uint32_t ukPos = len >= 4 ? (ukf[0] << 24) | (ukf[1] << 16) | (ukf[2] << 8) | ukf[3] : 0;
+  int keys = len >= 4 && ukPos + 2 <= (uint32_t)len ? (ukf[ukPos] << 8) | ukf[ukPos + 1] : 0;
+
+  static const char * const files[] = { "AACS/Unit_Key_RO.inf", NULL };
+  char id[41];
+  uint8_t key[16];
+  char kind = 0;
+  const char *source = "KEYDB.cfg";
+
+  if (cc && cert > 1 && (cc[1] & 0x80))
+    syslog(LOG_INFO, "BluRay: AACS: bus encryption, decrypted by libaacs");
+  else if (keys != 1)
+    syslog(LOG_INFO, "BluRay: AACS: %d CPS units, decrypted by libaacs", keys);
+  else if (MediaKey(Bd, key)) {
+    kind = 'V';
+    source = "media key";
+  } else if (!BDFileHash(Root, files, id))
+    syslog(LOG_ERR, "BluRay: AACS: can't read Unit_Key_RO.inf, decrypted by libaacs");
+  else if (!(kind = FindKey(id, key)) || kind == 'M') {
+    syslog(LOG_INFO, "BluRay: AACS: no unit key for %s in KEYDB.cfg, decrypted by libaacs", id);
+    kind = 0;
+  }
+
+  if (kind == 'V' && ukPos + 64 > (uint32_t)len)
+    syslog(LOG_ERR, "BluRay: AACS: Unit_Key_RO.inf too short");
+  else if (kind) {
+    if (kind == 'V') {
+      // the unit key is encrypted with the volume unique key
+      uint8_t vuk[16], zero[16] = { 0 };
+      memcpy(vuk, key, 16);
+      memcpy(key, ukf + ukPos + 48, 16);
+      cBDAes(vuk).DecryptCbc(key, 16, zero);
+    }
+    aacs = new cBDAacs(key, Threads);
+    syslog(LOG_INFO, "BluRay: AACS: decrypting in %d threads (%s, key from %s)", Threads + 1,
+           aacs->unitKey.Accelerated() ? "AES instructions" : "portable AES", source);
+  }
+
+  free(cc);
+  free(ukf);
+  return aacs;
+}
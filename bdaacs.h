@@ -0,0 +1,102 @@
+/*
+ * bdaacs.h: Parallel AACS decryption of aligned units
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDAACS_H
+#define _BDAACS_H
+
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+#include "bdthread.h"
+
+// --- cBDAes -----------------------------------------------------------
+
+// AES-128 with AES-NI (x86) or the ARMv8 crypto extension when the CPU
+// has it, else portable C.
+
+class cBDAes {
+private:
+  uint8_t ek[11][16] __attribute__((aligned(16)));   // encryption round keys
+  uint8_t dk[11][16] __attribute__((aligned(16)));   // decryption round keys (equivalent inverse cipher)
+  bool accelerated;
+
+public:
+  cBDAes(const uint8_t Key[16]);
+
+  void Encrypt(const uint8_t In[16], uint8_t Out[16]) const;
+  // In place, Length a multiple of 16
+  void EncryptCbc(uint8_t *Data, int Length, const uint8_t Iv[16]) const;
+  void DecryptCbc(uint8_t *Data, int Length, const uint8_t Iv[16]) const;
+
+  bool Accelerated(void) const { return accelerated; }
+  // CPU support of AES instructions
+  static bool Available(void);
+  // Use the portable code even if the CPU has AES instructions (benchmark)
+  static void SetPortable(bool On);
+};
+
+// --- cBDAacs ----------------------------------------------------------
+
+// Decrypts aligned units of AACS protected stream files before libbluray
+// gets them, on a pool of worker threads. Units are independent: the
+// key of a unit is derived from its first 16 bytes, the rest is
+// AES-CBC. Decrypted units have their copy permission bits cleared, so
+// libaacs passes them through; a unit that doesn't decrypt to TS packets
+// is left as it was, for libaacs.
+
+class cBDAacsWorker;
+
+class cBDAacs {
+  friend class cBDAacsWorker;
+private:
+  cBDAes unitKey;
+  int threads;
+  cBDAacsWorker **workers;
+
+  cBDMutex   mutex;
+  cBDCondVar work, done;
+  uint8_t   *jobData;
+  int        jobUnits;
+  int        jobId;
+  volatile int next;            // next unit to take
+  volatile int finished;        // units processed
+  volatile int decrypted;
+  volatile int failed;
+  int        active;            // workers in Process()
+  volatile int schedGeneration; // BDPlayerSched changes
+
+  void Process(void);
+
+public:
+  uint64_t units, failures;
+
+  // Threads: workers in addition to the calling thread
+  cBDAacs(const uint8_t UnitKey[16], int Threads);
+  ~cBDAacs();
+
+  // The unit key of the disc folder at Root, decrypted from
+  // AACS/Unit_Key_RO.inf with the volume unique key. That is derived from
+  // the media key and volume ID libaacs found for Bd (opened on Root),
+  // else taken from libaacs's key database (KEYDB.cfg: unit key or volume
+  // unique key). NULL if the disc is not protected, has several CPS units
+  // or bus encryption, or the key is not known: libaacs decrypts then.
+  static cBDAacs *Open(const char *Root, int Threads, BLURAY *Bd = NULL);
+
+  // BDPlayerSched changed: the workers apply it again
+  void Reschedule(void) { __sync_add_and_fetch(&schedGeneration, 1); }
+  // Decrypt Count units at Data in place, returns units decrypted
+  int Decrypt(uint8_t *Data, int Count);
+
+  // Single units with the unit key Key. DecryptUnit() returns 1 if
+  // decrypted, 0 if the unit is not encrypted, -1 if it doesn't decrypt
+  // to TS packets (left unchanged).
+  static int  DecryptUnit(const cBDAes &Key, uint8_t *Unit);
+  static void EncryptUnit(const cBDAes &Key, uint8_t *Unit);
+};
+
+#endif //_BDAACS_H
@@ -0,0 +1,172 @@
+/*
+ * bdangle.c: Prefetch of alternate angles
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "bdindex.h"
+#include "bdstats.h"
+#include "m2ts.h"
+
+#include "bdangle.h"
+
+#define RATE_WINDOW     (4 * 1024 * 1024)   // bytes per read rate sample
+#define MAX_UNIT_SIZE   (32 * 1024 * 1024)  // limit for a single prefetch
+
+cBDAnglePrefetch::cBDAnglePrefetch(const char *Path)
+{
+  path = strdup(Path);
+  playlist = clip = -1;
+  angles = 0;
+  readRate = clipRate = 0;
+  windowBytes = windowUs = 0;
+  for (int i = 0; i < BD_MAX_ANGLES; i++) {
+    angle[i].cl = NULL;
+    angle[i].fd = -1;
+  }
+}
+
+cBDAnglePrefetch::~cBDAnglePrefetch()
+{
+  Close();
+  free(path);
+}
+
+void cBDAnglePrefetch::Close(void)
+{
+  for (int i = 0; i < BD_MAX_ANGLES; i++) {
+    if (angle[i].cl)
+      bd_free_clpi(angle[i].cl);
+    if (angle[i].fd >= 0)
+      close(angle[i].fd);
+    angle[i].cl = NULL;
+    angle[i].fd = -1;
+  }
+  playlist = clip = -1;
+  angles = 0;
+}
+
+void cBDAnglePrefetch::Open(BLURAY *Bd, const BLURAY_TITLE_INFO *Info, int Clip)
+{
+  Close();
+
+  playlist = Info->playlist;
+  clip = Clip;
+  angles = Info->angle_count < BD_MAX_ANGLES ? Info->angle_count : BD_MAX_ANGLES;
+
+  const BLURAY_CLIP_INFO &ci = Info->clips[Clip];
+  clipRate = ci.out_time > ci.in_time ? ci.pkt_count * (double)M2TS_SIZE * 90000 / (ci.out_time - ci.in_time) : 0;
+
+  int opened = 0;
+  for (int a = 0; a < angles; a++) {
+    BLURAY_TITLE_INFO *info = bd_get_playlist_info(Bd, playlist, a);
+    if (info && (unsigned)Clip < info->clip_count) {
+      char name[1024];
+      snprintf(name, sizeof(name), "%s/BDMV/CLIPINF/%s.clpi", path, info->clips[Clip].clip_id);
+      angle[a].cl = bd_read_clpi(name);
+      snprintf(name, sizeof(name), "%s/BDMV/STREAM/%s.m2ts", path, info->clips[Clip].clip_id);
+      angle[a].fd = angle[a].cl ? open(name, O_RDONLY) : -1;
+      angle[a].from = angle[a].until = 0;
+      opened += angle[a].fd >= 0;
+    }
+    if (info)
+      bd_free_title_info(info);
+  }
+
+  syslog(LOG_INFO, "BluRay: %05d.mpls clip %d: %d angles, %d prefetchable, %.1f Mbit/s",
+         playlist, clip, angles, opened, clipRate * 8 / 1e6);
+}
+
+bool cBDAnglePrefetch::NextUnit(sAngle &A, uint64_t Pts, uint32_t &Start, uint32_t &End, uint64_t &StartPts)
+{
+  const CLPI_EP_MAP_ENTRY *ep = BDVideoEpMap(A.cl, 0x1011);
+  if (!ep)
+    return false;
+
+  bool found = false;
+  int c = 0;
+  for (int f = 0; f < ep->num_ep_fine; f++) {
+    while (c + 1 < ep->num_ep_coarse && ep->coarse[c + 1].ref_ep_fine_id <= f)
+      c++;
+    if (!ep->fine[f].is_angle_change_point)
+      continue;
+    uint64_t pts;
+    uint32_t spn;
+    BDEpEntry(ep, c, f, pts, spn);
+    if (found) {
+      End = spn;
+      return true;
+    }
+    if (pts > Pts) {
+      Start = spn;
+      StartPts = pts;
+      found = true;
+    }
+  }
+
+  // last unit of the clip
+  End = A.cl->clip.num_source_packets;
+  return found && End > Start;
+}
+
+void cBDAnglePrefetch::ReadDone(int Bytes, uint64_t Us)
+{
+  windowBytes += Bytes;
+  windowUs += Us;
+  if (windowBytes >= RATE_WINDOW && windowUs > 0) {
+    double rate = windowBytes * 1e6 / windowUs;
+    readRate = readRate > 0 ? (readRate * 3 + rate) / 4 : rate;
+    windowBytes = windowUs = 0;
+  }
+}
+
+void cBDAnglePrefetch::Update(BLURAY *Bd, const BLURAY_TITLE_INFO *Info, int Clip, int Angle)
+{
+  if (!Info || Info->angle_count < 2 || Clip < 0 || (unsigned)Clip >= Info->clip_count)
+    return;
+
+  if (playlist != (int)Info->playlist || clip != Clip)
+    Open(Bd, Info, Clip);
+
+  // alternate angles the drive can read besides the playing one
+  if (clipRate <= 0 || readRate <= 0)
+    return;
+  int spare = int(readRate / clipRate) - 1;
+  if (spare > angles - 1)
+    spare = angles - 1;
+  if (spare < 1)
+    return;
+
+  const BLURAY_CLIP_INFO &ci = Info->clips[Clip];
+  uint64_t now = bd_tell_time(Bd);
+  uint64_t pts = now > ci.start_time ? now - ci.start_time + ci.in_time : ci.in_time;
+
+  for (int i = 1; i <= spare; i++) {
+    sAngle &a = angle[(Angle + i) % angles];
+    if (a.fd < 0 || (pts >= a.from && pts < a.until))
+      continue;  // unit ahead already prefetched
+
+    uint32_t start, end;
+    uint64_t startPts;
+    if (!NextUnit(a, pts, start, end, startPts)) {
+      a.from = pts;
+      a.until = (uint64_t)-1;  // no more change points in this clip
+      continue;
+    }
+    if ((uint64_t)(end - start) * M2TS_SIZE > MAX_UNIT_SIZE)
+      end = start + MAX_UNIT_SIZE / M2TS_SIZE;
+
+    posix_fadvise(a.fd, (off_t)start * M2TS_SIZE, (off_t)(end - start) * M2TS_SIZE, POSIX_FADV_WILLNEED);
+    cBDStats::Count(bcPrefetchBytes, (uint64_t)(end - start) * M2TS_SIZE);
+    a.from = pts;
+    a.until = startPts;
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ * bdangle.h: Prefetch of alternate angles
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDANGLE_H
+#define _BDANGLE_H
+
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+#define BD_MAX_ANGLES  9
+
+struct clpi_cl;
+
+// --- cBDAnglePrefetch -------------------------------------------------
+
+// The angles of a multi-angle playitem are separate clips, interleaved
+// on the disc in units that start at angle change points. An angle
+// switch takes effect at the next change point; the unit of the new
+// angle starting there is read ahead into the page cache
+// (posix_fadvise), so the switch doesn't wait for the drive.
+//
+// Units are prefetched only when the drive is fast enough to read the
+// playing angle and the prefetched ones, starting with the next angle.
+// Needs a mounted disc (BDMV folder); does nothing for images or devices.
+
+class cBDAnglePrefetch {
+private:
+  char   *path;
+  int     playlist, clip;
+  int     angles;
+  double  readRate;               // bytes/s of the drive, averaged
+  double  clipRate;               // bytes/s of the playing clip
+  uint64_t windowBytes, windowUs;
+
+  struct sAngle {
+    struct clpi_cl *cl;
+    int      fd;
+    uint64_t from, until;         // clip time range covered by the last prefetch
+  } angle[BD_MAX_ANGLES];
+
+  void Close(void);
+  void Open(BLURAY *Bd, const BLURAY_TITLE_INFO *Info, int Clip);
+  // First unit starting after Pts: source packets [Start, End)
+  bool NextUnit(sAngle &A, uint64_t Pts, uint32_t &Start, uint32_t &End, uint64_t &StartPts);
+
+public:
+  // Path: mount point of the disc
+  cBDAnglePrefetch(const char *Path);
+  ~cBDAnglePrefetch();
+
+  // Called after each read: Bytes read in Us microseconds
+  void ReadDone(int Bytes, uint64_t Us);
+  // Prefetch the next units of alternate angles
+  void Update(BLURAY *Bd, const BLURAY_TITLE_INFO *Info, int Clip, int Angle);
+  // Forget cached clip information (playlist changed)
+  void Reset(void) { Close(); }
+};
+
+#endif //_BDANGLE_H
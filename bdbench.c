@@ -0,0 +1,1863 @@
+/*
+ * bdbench.c: Headless benchmark for the BluRay read / filter / feed pipeline
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "bdaacs.h"
+#include "bdangle.h"
+#include "bdcore.h"
+#include "bdcover.h"
+#include "bdindex.h"
+#include "bdlibrary.h"
+#include "bdpg.h"
+#include "bdreadahead.h"
+#include "bdredraw.h"
+#include "bdsched.h"
+#include "bdserver.h"
+#include "bdstage.h"
+#include "bdstats.h"
+#include "bdthread.h"
+#include "bdtrace.h"
+#include "bdunit.h"
+
+// --- cBenchSink -------------------------------------------------------
+
+// Models the decoder buffer of an output device:
+// Buffer bytes of space, drained at Rate bytes/s (0 = unlimited).
+
+class cBenchSink : public cBDSink {
+private:
+  int64_t  size;
+  int64_t  rate;
+  double   level;
+  uint64_t last;
+  bool     filled;
+
+  void Drain(void) {
+    uint64_t now = cBDStats::Now();
+    if (rate > 0) {
+      level -= (double)rate * (now - last) / 1000000;
+      if (level < 0) {
+        if (filled)
+          underruns++;
+        filled = false;
+        level = 0;
+      }
+    } else {
+      level = 0;
+    }
+    last = now;
+  }
+
+public:
+  uint64_t stalls;     // sink full
+  uint64_t underruns;  // decoder buffer ran empty (rate limited only)
+
+  cBenchSink(int64_t Size, int64_t Rate) : size(Size), rate(Rate), level(0), filled(false), stalls(0), underruns(0) { last = cBDStats::Now(); }
+
+  virtual int Feed(const uint8_t *Data, int Length) {
+    Drain();
+    if (level + Length > size)
+      return 0;
+    level += Length;
+    filled = true;
+    return Length;
+  }
+
+  virtual bool Poll(int TimeoutMs) {
+    Drain();
+    if (level + TS_SIZE <= size)
+      return true;
+    stalls++;
+    int64_t waitUs = rate > 0 ? (int64_t)((level + TS_SIZE - size) * 1000000 / rate) : 0;
+    if (waitUs > TimeoutMs * 1000)
+      waitUs = TimeoutMs * 1000;
+    usleep(waitUs);
+    Drain();
+    return level + TS_SIZE <= size;
+  }
+
+  void Clear(void) { level = 0; filled = false; }
+};
+
+// --- cBenchSource -----------------------------------------------------
+
+class cBenchSource {
+public:
+  virtual ~cBenchSource() {}
+  virtual int  Read(uint8_t *Buffer, int Size) = 0; // bytes, 0 at end, < 0 on error
+  virtual bool Seek(int Seconds) = 0;
+  virtual int  Duration(void) = 0;                  // seconds
+  virtual int  Time(void) { return -1; }            // current position, seconds
+  virtual bool NextAngle(void) { return false; }
+};
+
+// Synthetic m2ts stream: video, audio, PG and IG PIDs at a fixed bitrate
+
+class cSyntheticSource : public cBenchSource {
+private:
+  uint64_t bitrate;
+  int      pgShare, igShare;  // 1/1000
+  int      atsStep;           // 27MHz ticks per packet, 0 = no ATS
+  uint64_t packets, total;
+  uint32_t ats;
+  uint8_t  cc[0x2000];
+  uint32_t rnd;
+
+  uint16_t NextPid(void) {
+    rnd = rnd * 1103515245 + 12345;
+    int r = (rnd >> 8) % 1000;
+    if (r < pgShare)           return 0x1200;
+    if (r < pgShare + igShare) return 0x1400;
+    if (r < pgShare + igShare + 100) return 0x1100;
+    if (r < pgShare + igShare + 102) return 0x0000;
+    return 0x1011;
+  }
+
+public:
+  cSyntheticSource(uint64_t Bitrate, int Seconds, int PgShare, int IgShare, bool Ats) {
+    bitrate = Bitrate;
+    pgShare = PgShare;
+    igShare = IgShare;
+    total   = Bitrate / 8 * Seconds / M2TS_SIZE;
+    atsStep = Ats ? (int)(27000000ULL * TS_SIZE * 8 / Bitrate) : 0;
+    packets = 0;
+    ats     = 0;
+    rnd     = 1;
+    memset(cc, 0, sizeof(cc));
+  }
+
+  virtual int Read(uint8_t *Buffer, int Size) {
+    cBDStatTimer timer(bhRead);
+    int n = 0;
+    for (; n + M2TS_SIZE <= Size && packets < total; n += M2TS_SIZE, packets++) {
+      uint8_t *p = Buffer + n;
+      uint16_t pid = NextPid();
+      ats = (ats + atsStep) & 0x3fffffff;
+      p[0] = ats >> 24; p[1] = ats >> 16; p[2] = ats >> 8; p[3] = ats;
+      p[4] = 0x47;
+      p[5] = pid >> 8;
+      p[6] = pid;
+      p[7] = 0x10 | (cc[pid]++ & 0x0f);
+      memset(p + 8, 0xff, TS_SIZE - 4);
+    }
+    cBDStats::Count(bcReadCalls);
+    cBDStats::Count(bcReadBytes, n);
+    return n;
+  }
+
+  virtual bool Seek(int Seconds) {
+    cBDStatTimer timer(bhSeek);
+    cBDStats::Count(bcSeeks);
+    packets = bitrate / 8 * Seconds / M2TS_SIZE;
+    if (packets > total)
+      packets = total;
+    return true;
+  }
+
+  virtual int Duration(void) { return total * M2TS_SIZE * 8 / bitrate; }
+};
+
+// Real BDMV folder through the playback core
+
+class cBDMVSource : public cBenchSource {
+private:
+  cBDCore *core;
+
+public:
+  cBDMVSource(cBDCore *Core) : core(Core) {}
+  virtual ~cBDMVSource() { delete core; }
+
+  static cBDMVSource *Open(const char *Path) {
+    cBDCore *core = cBDCore::Open(Path, 0);
+    if (!core) {
+      fprintf(stderr, "no playable title in %s\n", Path);
+      return NULL;
+    }
+    core->SetAnglePrefetch(new cBDAnglePrefetch(Path));
+    return new cBDMVSource(core);
+  }
+
+  virtual int Read(uint8_t *Buffer, int Size) {
+    int r;
+    do {
+      r = core->ReadUnit(Buffer, Size);
+    } while (r == 0 && !core->EndOfTitle());
+    return r;
+  }
+
+  virtual bool Seek(int Seconds) { core->Seek(Seconds); return true; }
+  virtual int  Time(void) { return core->TellTime(); }
+  virtual bool NextAngle(void) {
+    return core->Angles() > 1 && core->SelectAngle((core->Angle() + 1) % core->Angles());
+  }
+  virtual int  Duration(void) {
+    const BLURAY_TITLE_INFO *info = core->TitleInfo();
+    return info ? info->duration / 90000 : 0;
+  }
+};
+
+// --- load generators --------------------------------------------------
+
+// Competing load for stress runs: a busy CPU thread, or a thread
+// writing and re-reading a large file.
+
+class cCpuLoad : public cBDThread {
+protected:
+  virtual void Action(void) {
+    volatile uint32_t x = 1;
+    while (Running())
+      for (int i = 0; i < 1000000; i++)
+        x = x * 1103515245 + 12345;
+  }
+public:
+  cCpuLoad(void) : cBDThread("cpu load") {}
+  virtual ~cCpuLoad() { Cancel(); }
+};
+
+class cDiskLoad : public cBDThread {
+private:
+  char *file;
+protected:
+  virtual void Action(void) {
+    const int chunk = 1024 * 1024, chunks = 256;
+    uint8_t *buf = (uint8_t *)malloc(chunk);
+    memset(buf, 0x5a, chunk);
+    int fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+      perror(file);
+      free(buf);
+      return;
+    }
+    unlink(file);
+    while (Running()) {
+      lseek(fd, 0, SEEK_SET);
+      for (int i = 0; i < chunks && Running(); i++)
+        if (write(fd, buf, chunk) != chunk)
+          break;
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      lseek(fd, 0, SEEK_SET);
+      for (int i = 0; i < chunks && Running(); i++)
+        if (read(fd, buf, chunk) != chunk)
+          break;
+    }
+    close(fd);
+    free(buf);
+  }
+public:
+  cDiskLoad(const char *Dir) : cBDThread("disk load") {
+    if (asprintf(&file, "%s/bdbench.%d.tmp", Dir, (int)getpid()) < 0)
+      file = NULL;
+  }
+  virtual ~cDiskLoad() { Cancel(); free(file); }
+};
+
+// --- main -------------------------------------------------------------
+
+static double CpuSeconds(void)
+{
+  // pipeline thread only, not the load generators
+  struct rusage ru;
+  getrusage(RUSAGE_THREAD, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// Frame index from the EP map compared to a scan of the whole stream
+
+static int IndexBench(const char *Path)
+{
+  cBDCore *core = cBDCore::Open(Path, 0);
+  if (!core) {
+    fprintf(stderr, "no playable title in %s\n", Path);
+    return 1;
+  }
+
+  // title info is available after the first read
+  uint8_t *buf = (uint8_t *)malloc(32 * ALIGNED_UNIT_SIZE);
+  while (!core->TitleInfo() && core->ReadUnit(buf, ALIGNED_UNIT_SIZE) >= 0 && !core->EndOfTitle())
+    ;
+  const BLURAY_TITLE_INFO *info = core->TitleInfo();
+  if (!info) {
+    fprintf(stderr, "no title info\n");
+    free(buf);
+    delete core;
+    return 1;
+  }
+
+  const int runs = 10;
+  cBDIndex index;
+  uint64_t t0 = cBDStats::Now();
+  for (int i = 0; i < runs; i++)
+    index.Build(core->Handle(), info);
+  uint64_t indexTime = (cBDStats::Now() - t0) / runs;
+
+  uint16_t vpid = info->clip_count && info->clips[0].video_stream_count ? info->clips[0].video_streams[0].pid : 0x1011;
+  uint64_t bytes = 0, frames = 0;
+  t0 = cBDStats::Now();
+  core->Seek(0);
+  for (;;) {
+    int r = core->ReadUnit(buf, 32 * ALIGNED_UNIT_SIZE);
+    if (r < 0 || (r == 0 && core->EndOfTitle()))
+      break;
+    for (int i = 0; i + M2TS_SIZE <= r; i += M2TS_SIZE) {
+      const uint8_t *pkt = buf + i;
+      if (M2tsPid(pkt) == vpid && (pkt[4 + 1] & 0x40))
+        frames++;
+    }
+    bytes += r;
+  }
+  uint64_t scanTime = cBDStats::Now() - t0;
+
+  printf("title duration:   %.1f s, %.3f fps\n", info->duration / 90000.0, index.FramesPerSecond());
+  printf("EP map index:     %d entry points, %d frames, %.3f ms\n", index.Count(), index.Frames(), indexTime / 1000.0);
+  printf("stream scan:      %llu frames (PES starts), %llu bytes, %.3f s\n",
+         (unsigned long long)frames, (unsigned long long)bytes, scanTime / 1e6);
+  if (indexTime > 0)
+    printf("speedup:          %.0fx\n", (double)scanTime / indexTime);
+
+  free(buf);
+  delete core;
+  return 0;
+}
+
+// --- PG benchmark -----------------------------------------------------
+
+// Synthetic PG stream: display sets with two subtitle lines (text-like
+// objects of 1280x80 pixels on a 1920x1080 video), each followed by a
+// display set that clears the screen.
+
+class cPgStream {
+private:
+  uint8_t *data;
+  int length, size;
+  int cc;
+
+  void Grow(int Bytes) {
+    if (length + Bytes > size) {
+      size = 2 * (length + Bytes);
+      data = (uint8_t *)realloc(data, size);
+    }
+  }
+
+public:
+  cPgStream(void) : data(NULL), length(0), size(0), cc(0) {}
+  ~cPgStream() { free(data); }
+
+  const uint8_t *Data(void) { return data; }
+  int Packets(void) { return length / TS_SIZE; }
+
+  // One segment per PES packet, split into TS packets of PID 0x1200
+  void Segment(int64_t Pts, int Type, const uint8_t *Payload, int Length) {
+    int pesLength = 3 + 5 + 3 + Length;
+    uint8_t *pes = (uint8_t *)malloc(6 + pesLength);
+    uint8_t *p = pes;
+    *p++ = 0; *p++ = 0; *p++ = 1; *p++ = 0xbd;
+    *p++ = pesLength >> 8; *p++ = pesLength;
+    *p++ = 0x81; *p++ = 0x80; *p++ = 5;
+    *p++ = 0x21 | ((Pts >> 29) & 0x0e); *p++ = Pts >> 22; *p++ = 0x01 | ((Pts >> 14) & 0xfe); *p++ = Pts >> 7; *p++ = 0x01 | ((Pts << 1) & 0xfe);
+    *p++ = Type; *p++ = Length >> 8; *p++ = Length;
+    memcpy(p, Payload, Length);
+
+    int total = 6 + pesLength;
+    for (int done = 0; done < total; ) {
+      Grow(TS_SIZE);
+      uint8_t *ts = data + length;
+      int n = total - done < TS_SIZE - 4 ? total - done : TS_SIZE - 4;
+      ts[0] = 0x47;
+      ts[1] = (done ? 0 : 0x40) | 0x12;
+      ts[2] = 0x00;
+      if (n < TS_SIZE - 4) {
+        // stuffing in the adaptation field
+        int af = TS_SIZE - 4 - n;
+        ts[3] = 0x30 | (cc++ & 0x0f);
+        ts[4] = af - 1;
+        if (af > 1) {
+          ts[5] = 0;
+          memset(ts + 6, 0xff, af - 2);
+        }
+      } else {
+        ts[3] = 0x10 | (cc++ & 0x0f);
+      }
+      memcpy(ts + TS_SIZE - n, pes + done, n);
+      done += n;
+      length += TS_SIZE;
+    }
+    free(pes);
+  }
+};
+
+static int PgEncodeRle(const uint8_t *Pixels, int Width, int Height, uint8_t *Out)
+{
+  uint8_t *o = Out;
+  for (int y = 0; y < Height; y++) {
+    const uint8_t *line = Pixels + y * Width;
+    for (int x = 0; x < Width; ) {
+      int c = line[x], run = 1;
+      while (x + run < Width && line[x + run] == c && run < 16383)
+        run++;
+      if (c && run <= 2) {
+        for (int i = 0; i < run; i++)
+          *o++ = c;
+      } else {
+        *o++ = 0;
+        int f = (c ? 0x80 : 0) | (run >= 64 ? 0x40 : 0);
+        if (run >= 64) {
+          *o++ = f | (run >> 8);
+          *o++ = run;
+        } else {
+          *o++ = f | run;
+        }
+        if (c)
+          *o++ = c;
+      }
+      x += run;
+    }
+    *o++ = 0;
+    *o++ = 0;
+  }
+  return o - Out;
+}
+
+// Text-like bitmap: glyphs of 4x6 blocks, white with a black outline
+static void PgText(uint8_t *Pixels, int Width, int Height, unsigned Seed)
+{
+  memset(Pixels, 0, Width * Height);
+  const int cell = 28, block = 5, top = 15;
+  for (int g = 0; g < Width / cell; g++) {
+    unsigned bits = (Seed * 2654435761u) ^ (g * 40503u);
+    bits ^= bits >> 13;
+    bits *= 0x5bd1e995;
+    for (int b = 0; b < 24; b++) {
+      if (!((bits >> b) & 1))
+        continue;
+      int x0 = g * cell + 2 + (b % 4) * block, y0 = top + (b / 4) * (block + 3);
+      for (int y = y0 - 2; y < y0 + block + 2; y++)
+        for (int x = x0 - 2; x < x0 + block + 2; x++) {
+          if (x < 0 || y < 0 || x >= Width || y >= Height)
+            continue;
+          bool inside = x >= x0 && x < x0 + block && y >= y0 && y < y0 + block;
+          uint8_t &p = Pixels[y * Width + x];
+          if (inside)
+            p = 1;
+          else if (!p)
+            p = 2;
+        }
+    }
+  }
+}
+
+static void PgDisplaySet(cPgStream &Stream, int64_t Pts, unsigned Seed, bool Clear)
+{
+  const int w = 1280, h = 80;
+  uint8_t buf[64];
+  uint8_t *p = buf;
+
+  // PCS: 1920x1080, epoch start, palette 0
+  int objects = Clear ? 0 : 2;
+  *p++ = 1920 >> 8; *p++ = 1920 & 0xff; *p++ = 1080 >> 8; *p++ = 1080 & 0xff;
+  *p++ = 0x10; *p++ = Seed >> 8; *p++ = Seed; *p++ = Clear ? 0x00 : 0x80;
+  *p++ = 0; *p++ = 0; *p++ = objects;
+  for (int i = 0; i < objects; i++) {
+    int x = 320, y = 880 + i * 90;
+    *p++ = 0; *p++ = i; *p++ = 0; *p++ = 0;
+    *p++ = x >> 8; *p++ = x; *p++ = y >> 8; *p++ = y;
+  }
+  Stream.Segment(Pts, 0x16, buf, p - buf);
+
+  // WDS: one window around both lines
+  p = buf;
+  *p++ = 1; *p++ = 0;
+  *p++ = 320 >> 8; *p++ = 320 & 0xff; *p++ = 880 >> 8; *p++ = 880 & 0xff;
+  *p++ = w >> 8; *p++ = w & 0xff; *p++ = (2 * h + 10) >> 8; *p++ = (2 * h + 10) & 0xff;
+  Stream.Segment(Pts, 0x17, buf, p - buf);
+
+  if (!Clear) {
+    // PDS: transparent, white, black, grays
+    static const uint8_t pds[] = { 0, 0,
+      1, 235, 128, 128, 255,  2, 16, 128, 128, 255,  3, 180, 128, 128, 200,  4, 100, 128, 128, 200 };
+    Stream.Segment(Pts, 0x14, pds, sizeof(pds));
+
+    // ODS, split at segment size limit
+    uint8_t *pixels = (uint8_t *)malloc(w * h);
+    uint8_t *rle = (uint8_t *)malloc(w * h * 3 + 4 * h + 11);
+    for (int i = 0; i < objects; i++) {
+      PgText(pixels, w, h, Seed * 2 + i);
+      int len = PgEncodeRle(pixels, w, h, rle + 11);
+      int total = len + 4;
+      for (int done = 0; done < len; ) {
+        bool first = !done;
+        int head = first ? 11 : 4;
+        int n = len - done < 65000 - head ? len - done : 65000 - head;
+        uint8_t *seg = rle + 11 + done - head;
+        uint8_t save[11];
+        memcpy(save, seg, head);
+        seg[0] = 0; seg[1] = i; seg[2] = 0;
+        seg[3] = (first ? 0x80 : 0) | (done + n == len ? 0x40 : 0);
+        if (first) {
+          seg[4] = total >> 16; seg[5] = total >> 8; seg[6] = total;
+          seg[7] = w >> 8; seg[8] = w & 0xff; seg[9] = h >> 8; seg[10] = h;
+        }
+        Stream.Segment(Pts, 0x15, seg, head + n);
+        memcpy(seg, save, head);
+        done += n;
+      }
+    }
+    free(rle);
+    free(pixels);
+  }
+
+  Stream.Segment(Pts, 0x80, buf, 0);
+}
+
+// Decoding cost per display set, for new subtitles (bitmaps decoded)
+// and for repeated ones (taken from the bitmap cache)
+
+static void PgBench(int Events)
+{
+  for (int pass = 0; pass < 2; pass++) {
+    bool repeat = pass == 1;
+    cPgStream stream;
+    for (int i = 0; i < Events; i++) {
+      PgDisplaySet(stream, i * 2 * 90000, repeat ? 1 : i + 1, false);
+      PgDisplaySet(stream, i * 2 * 90000 + 135000, 0, true);
+    }
+
+    cBDPgParser parser;
+    sBDPgComposition c;
+    uint64_t pixels = 0;
+    double cpu0 = CpuSeconds();
+    for (int i = 0; i < stream.Packets(); i++) {
+      if (parser.Packet(stream.Data() + i * TS_SIZE) && parser.Get(c)) {
+        for (int o = 0; o < c.objectCount; o++)
+          pixels += c.objects[o].width * c.objects[o].height;
+        parser.Release(c);
+      }
+    }
+    double cpu = CpuSeconds() - cpu0;
+
+    printf("PG %-9s %llu display sets (%d with text), %.1f us CPU per subtitle, %.0f Mpixel/s, %llu cache hits\n",
+           repeat ? "repeated:" : "new:", (unsigned long long)parser.displaySets, Events,
+           cpu * 1e6 / Events, cpu > 0 ? pixels / cpu / 1e6 : 0, (unsigned long long)parser.cacheHits);
+  }
+}
+
+// Cover thumbnail from a cold JPEG decode compared to the thumbnail cache
+
+static int CoverBench(const char *Path)
+{
+  char image[1024];
+  if (!BDCoverFile(Path, NULL, image, sizeof(image))) {
+    fprintf(stderr, "no cover image in %s/BDMV/META/DL\n", Path);
+    return 1;
+  }
+
+  char dir[] = "/tmp/bdbench-covers-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror(dir);
+    return 1;
+  }
+
+  const int runs = 20;
+  int w = 0, h = 0;
+  bool hit;
+  uint64_t t0 = cBDStats::Now();
+  for (int i = 0; i < runs; i++)
+    free(cBDCoverCache::Thumbnail(NULL, Path, NULL, BD_COVER_WIDTH, BD_COVER_HEIGHT, w, h, hit));
+  uint64_t decode = (cBDStats::Now() - t0) / runs;
+
+  // first call writes the cache file
+  free(cBDCoverCache::Thumbnail(dir, Path, NULL, BD_COVER_WIDTH, BD_COVER_HEIGHT, w, h, hit));
+  t0 = cBDStats::Now();
+  int hits = 0;
+  for (int i = 0; i < runs; i++) {
+    free(cBDCoverCache::Thumbnail(dir, Path, NULL, BD_COVER_WIDTH, BD_COVER_HEIGHT, w, h, hit));
+    hits += hit;
+  }
+  uint64_t cached = (cBDStats::Now() - t0) / runs;
+
+  struct stat st;
+  stat(image, &st);
+  printf("cover %s (%lld bytes) -> %dx%d thumbnail (%d bytes)\n", image, (long long)st.st_size, w, h, w * h * 3 + 12);
+  printf("cold decode:   %6llu us\n", (unsigned long long)decode);
+  printf("cache hit:     %6llu us (%d/%d hits)\n", (unsigned long long)cached, hits, runs);
+
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if (system(cmd))
+    fprintf(stderr, "can't remove %s\n", dir);
+  return 0;
+}
+
+// Library index: build, sort and T9 search latency with synthetic titles
+
+static void LibraryBench(int Entries)
+{
+  static const char *words[] = {
+    "The", "Dark", "Knight", "Return", "Star", "Wars", "Lord", "Rings", "Blade", "Runner",
+    "Alien", "Matrix", "Godfather", "Part", "Toy", "Story", "Back", "Future", "Jurassic", "Park",
+    "Mission", "Impossible", "Planet", "Earth", "Music", "Live", "Concert", "Night", "Day", "Summer",
+    "Winter", "Ocean", "River", "Wild", "West", "City", "Lights", "Heat", "Fargo", "Vertigo",
+  };
+  const int nwords = sizeof(words) / sizeof(words[0]);
+
+  cBDLibrary library;
+  srand(1);
+  uint64_t t0 = cBDStats::Now();
+  for (int i = 0; i < Entries; i++) {
+    char title[128], folder[32], root[192];
+    int n = 1 + rand() % 4, len = 0;
+    for (int w = 0; w < n; w++)
+      len += snprintf(title + len, sizeof(title) - len, "%s%s", w ? " " : "", words[rand() % nwords]);
+    snprintf(title + len, sizeof(title) - len, " %d", i);
+    snprintf(folder, sizeof(folder), "shelf%03d", i / 500);
+    snprintf(root, sizeof(root), "/video/bluray/%s/%s", folder, title);
+    library.Add(root, folder, title, 1300000000 + rand() % 300000000, 5400 + rand() % 3600);
+  }
+  uint64_t build = cBDStats::Now() - t0;
+
+  uint64_t sorts[BD_LIBRARY_SORTS + 1];
+  for (int s = 0; s <= BD_LIBRARY_SORTS; s++) {
+    t0 = cBDStats::Now();
+    library.SetOrder(eBDLibrarySort(s % BD_LIBRARY_SORTS), s == BD_LIBRARY_SORTS);
+    library.Rows();
+    sorts[s] = cBDStats::Now() - t0;
+  }
+  library.SetOrder(lsTitle, false);
+
+  // type the first digits of random titles, one view page per key
+  const int queries = 1000, page = 15;
+  uint64_t total[5] = { 0 }, worst[5] = { 0 }, matches[5] = { 0 };
+  int keys[5] = { 0 };
+  t0 = cBDStats::Now();
+  library.Search("2");  // T9 keys sorted on first use
+  uint64_t keySort = cBDStats::Now() - t0;
+  for (int q = 0; q < queries; q++) {
+    char key[256], digits[8];
+    cBDLibrary::Keys(library.Title(rand() % Entries), key, sizeof(key));
+    library.Search("");
+    for (int n = 1; n <= 4 && key[n - 1]; n++) {
+      memcpy(digits, key, n);
+      digits[n] = 0;
+      uint64_t t = cBDStats::Now();
+      library.Search(digits);
+      int rows = library.Rows();
+      for (int r = 0; r < page && r < rows; r++)
+        library.Row(r);
+      t = cBDStats::Now() - t;
+      total[n] += t;
+      keys[n]++;
+      matches[n] += rows;
+      if (t > worst[n])
+        worst[n] = t;
+    }
+  }
+  library.Search("");
+
+  printf("library of %d discs: built in %.1f ms, %.0f bytes per disc\n",
+         Entries, build / 1000.0, (double)library.Memory() / Entries);
+  printf("sort by title %.1f ms, date %.1f ms, runtime %.1f ms, title by folder %.1f ms, T9 keys %.1f ms\n",
+         sorts[lsTitle] / 1000.0, sorts[lsAdded] / 1000.0, sorts[lsRuntime] / 1000.0,
+         sorts[BD_LIBRARY_SORTS] / 1000.0, keySort / 1000.0);
+  for (int n = 1; n <= 4; n++) {
+    if (keys[n])
+      printf("search digit %d: %7.1f us average, %7llu us max, %8.0f matches\n", n,
+             (double)total[n] / keys[n], (unsigned long long)worst[n], (double)matches[n] / keys[n]);
+  }
+}
+
+// --- read-ahead benchmark ---------------------------------------------
+
+// Local stand-in for a network mount: each storage request takes
+// Latency plus its size at Throughput (the real read included).
+
+class cDelayedReadAhead : public cBDReadAhead {
+private:
+  int    latencyUs;
+  double throughput;
+protected:
+  virtual ssize_t ReadAt(int Fd, uint8_t *Buffer, int Size, uint64_t Offset) {
+    uint64_t t = cBDStats::Now();
+    ssize_t r = cBDReadAhead::ReadAt(Fd, Buffer, Size, Offset);
+    int64_t us = latencyUs + (r > 0 ? r : 0) * 1e6 / throughput - (cBDStats::Now() - t);
+    if (us > 0)
+      usleep(us);
+    storageRequests++;
+    storageBytes += r > 0 ? r : 0;
+    return r;
+  }
+public:
+  uint64_t storageRequests, storageBytes;
+  cDelayedReadAhead(const char *Root, const sBDReadAheadConfig &Config, int LatencyUs, double Throughput)
+  : cBDReadAhead(Root, Config), latencyUs(LatencyUs), throughput(Throughput), storageRequests(0), storageBytes(0) {}
+};
+
+// Plays the stream file of Root from storage with LatencyUs and
+// Throughput through a decoder buffer of DecoderBytes: libbluray's 6 KB
+// reads, at the bitrate of the stream
+
+static void ReadAheadRun(const char *Root, int Seconds, int LatencyUs, double Throughput,
+                         double Bitrate, int DecoderBytes, int MaxSeconds)
+{
+  sBDReadAheadConfig config = { Seconds, 64, 0, 0 };
+  cDelayedReadAhead ra(Root, config, LatencyUs, Throughput);
+  ra.SetBitrate(Bitrate);
+  BD_FILE_H *f = ra.OpenFile("BDMV/STREAM/00000.m2ts");
+  if (!f) {
+    fprintf(stderr, "can't open the stream file in %s\n", Root);
+    return;
+  }
+
+  uint8_t buf[ALIGNED_UNIT_SIZE];
+  uint64_t pos = 0, stall = 0, stalls = 0, start = cBDStats::Now(), play0 = 0;
+  uint64_t limit = start + (uint64_t)MaxSeconds * 1000000;
+  for (;;) {
+    // the device takes a unit when the decoder buffer has room for it
+    if (play0) {
+      int64_t ahead = pos + sizeof(buf) > (uint64_t)DecoderBytes ? pos + sizeof(buf) - DecoderBytes : 0;
+      uint64_t feed = play0 + stall + (uint64_t)(ahead * 1e6 / Bitrate);
+      uint64_t now = cBDStats::Now();
+      if (feed > now)
+        usleep(feed - now);
+    }
+    int r = f->read(f, buf, sizeof(buf));
+    uint64_t now = cBDStats::Now();
+    if (r <= 0 || now > limit)
+      break;
+    pos += r;
+    if (!play0) {
+      play0 = now;
+      continue;
+    }
+    // late for playback: the picture froze until now
+    uint64_t needed = play0 + stall + (uint64_t)(pos * 1e6 / Bitrate);
+    if (now > needed) {
+      stall += now - needed;
+      stalls++;
+    }
+  }
+  f->close(f);
+
+  double played = pos / Bitrate;
+  char mode[16];
+  snprintf(mode, sizeof(mode), Seconds > 0 ? "%ds:" : "off:", Seconds);
+  printf("read-ahead %-4s startup %6.1f ms, played %5.1f s, stalled %6.2f s (%5.1f%%) in %6llu stalls, "
+         "%6llu requests of %4.0f KB\n",
+         mode,
+         play0 ? (play0 - start) / 1000.0 : 0, played, stall / 1e6, played > 0 ? stall / 1e4 / played : 0,
+         (unsigned long long)stalls, (unsigned long long)ra.storageRequests,
+         ra.storageRequests ? ra.storageBytes / 1024.0 / ra.storageRequests : 0);
+  if (Seconds > 0)
+    printf("  estimated latency %.2f ms, throughput %.1f Mbit/s -> requests of %d KB, %d KB buffered\n",
+           ra.Model().Latency() * 1000, ra.Model().Throughput() * 8 / 1e6, ra.RequestSize() / 1024, ra.Depth() / 1024);
+}
+
+// A disc folder with a synthetic stream file on storage with Net
+// ("MS[:MBIT]") latency and throughput, played without and with
+// read-ahead of Seconds
+
+static int ReadAheadBench(const char *Net, int Seconds, double Mbit, int DecoderBytes)
+{
+  double latencyMs = atof(Net), netMbit = 100;
+  const char *p = strchr(Net, ':');
+  if (p)
+    netMbit = atof(p + 1);
+  if (latencyMs < 0 || netMbit <= 0 || Seconds < 1) {
+    fprintf(stderr, "bad storage or read-ahead parameters\n");
+    return 2;
+  }
+
+  char dir[] = "/tmp/bdbench-net-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror(dir);
+    return 1;
+  }
+  char path[256];
+  snprintf(path, sizeof(path), "%s/BDMV", dir);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/BDMV/STREAM", dir);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/BDMV/STREAM/00000.m2ts", dir);
+
+  // 20 s of the stream are enough to settle
+  const int streamSeconds = 20;
+  cSyntheticSource src((uint64_t)(Mbit * 1000000), streamSeconds, 10, 5, true);
+  FILE *fp = fopen(path, "w");
+  uint8_t *buf = (uint8_t *)malloc(32 * ALIGNED_UNIT_SIZE);
+  int r;
+  while (fp && (r = src.Read(buf, 32 * ALIGNED_UNIT_SIZE)) > 0)
+    fwrite(buf, 1, r, fp);
+  free(buf);
+  if (!fp || fclose(fp)) {
+    perror(path);
+    return 1;
+  }
+
+  printf("storage: %.1f ms latency, %.0f Mbit/s; stream %.0f Mbit/s, %d s\n", latencyMs, netMbit, Mbit, streamSeconds);
+  // without read-ahead each 6 KB read is a request: give up after twice the stream length
+  ReadAheadRun(dir, 0, (int)(latencyMs * 1000), netMbit * 1e6 / 8, Mbit * 1e6 / 8, DecoderBytes, 2 * streamSeconds);
+  ReadAheadRun(dir, Seconds, (int)(latencyMs * 1000), netMbit * 1e6 / 8, Mbit * 1e6 / 8, DecoderBytes, 2 * streamSeconds);
+
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if (system(cmd))
+    fprintf(stderr, "can't remove %s\n", dir);
+  return 0;
+}
+
+// --- pause / resume benchmark ----------------------------------------
+
+// Optical drive model: requests take Latency plus their size at
+// Throughput; after IdleUs without requests the drive spins down and the
+// next request waits SpinUpUs first. One request at a time.
+
+class cDriveReadAhead : public cBDReadAhead {
+private:
+  cBDMutex drive;
+  uint64_t lastIo;
+  int      idleUs, spinUpUs;
+protected:
+  virtual ssize_t ReadAt(int Fd, uint8_t *Buffer, int Size, uint64_t Offset) {
+    cBDMutexLock lock(drive);
+    if (lastIo && cBDStats::Now() - lastIo > (uint64_t)idleUs) {
+      spinUps++;
+      usleep(spinUpUs);
+    }
+    uint64_t t = cBDStats::Now();
+    ssize_t r = cBDReadAhead::ReadAt(Fd, Buffer, Size, Offset);
+    int64_t us = 500 + (r > 0 ? r : 0) * 1e6 / (36 * 1e6) - (cBDStats::Now() - t);
+    if (us > 0)
+      usleep(us);
+    lastIo = cBDStats::Now();
+    return r;
+  }
+public:
+  int spinUps;
+  cDriveReadAhead(const char *Root, const sBDReadAheadConfig &Config, int IdleUs, int SpinUpUs)
+  : cBDReadAhead(Root, Config), lastIo(0), idleUs(IdleUs), spinUpUs(SpinUpUs), spinUps(0) {}
+};
+
+// Plays PlaySeconds of the stream file of Root, pauses for PauseSeconds
+// and plays on: the latency of the first read after resuming and the
+// time the picture froze afterwards (decoder buffer of DecoderBytes)
+
+static void ResumeRun(const char *Root, const sBDReadAheadConfig &Config, double Bitrate, int DecoderBytes,
+                      int PlaySeconds, int PauseSeconds, int IdleUs, int SpinUpUs)
+{
+  cDriveReadAhead ra(Root, Config, IdleUs, SpinUpUs);
+  ra.SetBitrate(Bitrate);
+  BD_FILE_H *f = ra.OpenFile("BDMV/STREAM/00000.m2ts");
+  if (!f) {
+    fprintf(stderr, "can't open the stream file in %s\n", Root);
+    return;
+  }
+
+  uint8_t buf[ALIGNED_UNIT_SIZE];
+  uint64_t pos = 0, stall = 0, play0 = 0, resumed = 0, resumeLatency = 0, pauseAt = (uint64_t)(PlaySeconds * Bitrate);
+  uint64_t end = (uint64_t)((2 * PlaySeconds) * Bitrate);
+  while (pos < end) {
+    if (play0) {
+      int64_t ahead = pos + sizeof(buf) > (uint64_t)DecoderBytes ? pos + sizeof(buf) - DecoderBytes : 0;
+      uint64_t feed = play0 + stall + (uint64_t)(ahead * 1e6 / Bitrate);
+      uint64_t now = cBDStats::Now();
+      if (feed > now)
+        usleep(feed - now);
+    }
+    if (!resumed && pos >= pauseAt) {
+      // the decoder buffer is full, the device frozen
+      ra.SetPaused(true);
+      sleep(PauseSeconds);
+      ra.SetPaused(false);
+      play0 += (uint64_t)PauseSeconds * 1000000;
+      resumed = cBDStats::Now();
+    }
+    int r = f->read(f, buf, sizeof(buf));
+    uint64_t now = cBDStats::Now();
+    if (r <= 0)
+      break;
+    pos += r;
+    if (!play0) {
+      play0 = now;
+      continue;
+    }
+    if (resumed && !resumeLatency)
+      resumeLatency = now - resumed;
+    uint64_t needed = play0 + stall + (uint64_t)(pos * 1e6 / Bitrate);
+    if (now > needed) {
+      // only stalls after the pause count
+      if (resumed)
+        stall += now - needed;
+      else
+        play0 += now - needed;
+    }
+  }
+  f->close(f);
+
+  char mode[32];
+  if (Config.pauseSeconds > 0)
+    snprintf(mode, sizeof(mode), "%ds, paused %ds:", Config.seconds, Config.pauseSeconds);
+  else
+    snprintf(mode, sizeof(mode), Config.seconds > 0 ? "%ds:" : "off:", Config.seconds);
+  printf("read-ahead %-16s resume to next data %7.1f ms, picture frozen %6.2f s after resume, %d spin-ups\n",
+         mode, resumeLatency / 1000.0, stall / 1e6, ra.spinUps);
+}
+
+// A disc folder with a synthetic stream on the drive model, paused for
+// Spec ("PAUSE[:SPINUP_MS]") seconds: without read-ahead, with Seconds of
+// read-ahead and with a pause buffer
+
+static int ResumeBench(const char *Spec, int Seconds, double Mbit, int DecoderBytes)
+{
+  int pauseSeconds = atoi(Spec), spinUpMs = 3000;
+  const char *p = strchr(Spec, ':');
+  if (p)
+    spinUpMs = atoi(p + 1);
+  if (pauseSeconds < 2 || spinUpMs < 0 || Seconds < 1) {
+    fprintf(stderr, "bad pause or read-ahead parameters\n");
+    return 2;
+  }
+  // the drive spins down after half the pause
+  const int playSeconds = 5, bufferSeconds = 20;
+  int idleUs = pauseSeconds * 1000000 / 2;
+
+  char dir[] = "/tmp/bdbench-drive-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror(dir);
+    return 1;
+  }
+  char path[256];
+  snprintf(path, sizeof(path), "%s/BDMV", dir);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/BDMV/STREAM", dir);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/BDMV/STREAM/00000.m2ts", dir);
+
+  // played before and after the pause, and what the pause buffer holds
+  cSyntheticSource src((uint64_t)(Mbit * 1000000), 2 * playSeconds + bufferSeconds, 10, 5, true);
+  FILE *fp = fopen(path, "w");
+  uint8_t *buf = (uint8_t *)malloc(32 * ALIGNED_UNIT_SIZE);
+  int r;
+  while (fp && (r = src.Read(buf, 32 * ALIGNED_UNIT_SIZE)) > 0)
+    fwrite(buf, 1, r, fp);
+  free(buf);
+  if (!fp || fclose(fp)) {
+    perror(path);
+    return 1;
+  }
+
+  printf("drive: 36 MB/s, spins down after %d s idle, %d ms spin-up; stream %.0f Mbit/s, "
+         "%d s played, %d s paused, %d s played\n",
+         idleUs / 1000000, spinUpMs, Mbit, playSeconds, pauseSeconds, playSeconds);
+  sBDReadAheadConfig off = { 0, 64, 0, 0 };
+  sBDReadAheadConfig normal = { Seconds, 64, 0, 0 };
+  sBDReadAheadConfig deep = { Seconds, 256, 0, bufferSeconds };
+  ResumeRun(dir, off,    Mbit * 1e6 / 8, DecoderBytes, playSeconds, pauseSeconds, idleUs, spinUpMs * 1000);
+  ResumeRun(dir, normal, Mbit * 1e6 / 8, DecoderBytes, playSeconds, pauseSeconds, idleUs, spinUpMs * 1000);
+  ResumeRun(dir, deep,   Mbit * 1e6 / 8, DecoderBytes, playSeconds, pauseSeconds, idleUs, spinUpMs * 1000);
+
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if (system(cmd))
+    fprintf(stderr, "can't remove %s\n", dir);
+  return 0;
+}
+
+// --- staging benchmark ------------------------------------------------
+
+// Optical drive shared by playback and the staging copier: a request
+// that doesn't continue the previous one seeks (SeekUs), data comes at
+// 36 MB/s
+
+class cSeekingDrive {
+private:
+  cBDMutex mutex;
+  int      seekUs;
+  int      lastFd;
+  uint64_t lastEnd;
+public:
+  int seeks;
+  cSeekingDrive(int SeekUs) : seekUs(SeekUs), lastFd(-1), lastEnd(0), seeks(0) {}
+  ssize_t Read(int Fd, uint8_t *Buffer, int Size, uint64_t Offset) {
+    cBDMutexLock lock(mutex);
+    uint64_t t = cBDStats::Now();
+    ssize_t r = pread(Fd, Buffer, Size, Offset);
+    int64_t us = (r > 0 ? r : 0) * 1e6 / (36 * 1e6) - (cBDStats::Now() - t);
+    if (Fd != lastFd || Offset != lastEnd) {
+      us += seekUs;
+      seeks++;
+    }
+    if (us > 0)
+      usleep(us);
+    lastFd = Fd;
+    lastEnd = Offset + (r > 0 ? r : 0);
+    return r;
+  }
+};
+
+class cDriveStage : public cBDStage {
+private:
+  cSeekingDrive &drive;
+protected:
+  virtual ssize_t ReadDisc(int Fd, uint8_t *Buffer, int Size, uint64_t Offset) { return drive.Read(Fd, Buffer, Size, Offset); }
+public:
+  cDriveStage(const sBDStageConfig &Config, const char *Root, const char *Dir, cSeekingDrive &Drive)
+  : cBDStage(Config, Root, Dir), drive(Drive) {}
+};
+
+class cDriveFiles : public cBDReadAhead {
+private:
+  cSeekingDrive &drive;
+protected:
+  virtual ssize_t ReadAt(int Fd, uint8_t *Buffer, int Size, uint64_t Offset) { return drive.Read(Fd, Buffer, Size, Offset); }
+public:
+  cDriveFiles(const char *Root, const sBDReadAheadConfig &Config, cSeekingDrive &Drive)
+  : cBDReadAhead(Root, Config), drive(Drive) {}
+};
+
+// Plays PlaySeconds of the stream, then seeks Seeks times to random
+// positions and rewatches the start: time to 1 MB after each seek
+
+static void StageRun(const char *Root, const char *CacheDir, bool Staging, int SeekUs, double Bitrate,
+                     int PlaySeconds, int Seeks)
+{
+  cSeekingDrive drive(SeekUs);
+  sBDReadAheadConfig config = { 2, 64, 0, 0 };
+  cDriveFiles files(Root, config, drive);
+  files.SetBitrate(Bitrate);
+  sBDStageConfig stageConfig = { 1024 };
+  if (Staging) {
+    files.SetStage(new cDriveStage(stageConfig, Root, CacheDir, drive));
+    files.Stage()->AddClip("00000");
+  }
+  BD_FILE_H *f = files.OpenFile("BDMV/STREAM/00000.m2ts");
+  if (!f) {
+    fprintf(stderr, "can't open the stream file in %s\n", Root);
+    return;
+  }
+
+  // playback at the stream rate
+  uint8_t *buf = (uint8_t *)malloc(1024 * 1024);
+  uint64_t start = cBDStats::Now(), pos = 0;
+  while (pos < PlaySeconds * Bitrate) {
+    int r = f->read(f, buf, ALIGNED_UNIT_SIZE);
+    if (r <= 0)
+      break;
+    pos += r;
+    uint64_t due = start + (uint64_t)(pos * 1e6 / Bitrate), now = cBDStats::Now();
+    if (due > now)
+      usleep(due - now);
+  }
+
+  uint64_t staged = 0, total = 0;
+  if (Staging)
+    files.Stage()->Progress(staged, total);
+  int seeks0 = drive.seeks;
+
+  uint64_t size = (uint64_t)f->seek(f, 0, SEEK_END);
+  uint64_t worst = 0, sum = 0;
+  uint32_t rnd = 7;
+  for (int i = 0; i <= Seeks; i++) {
+    // the last one rewatches the start
+    rnd = rnd * 1103515245 + 12345;
+    uint64_t to = i < Seeks ? ((uint64_t)(rnd >> 8) * (size / 0x1000000)) % (size - 1024 * 1024) : 0;
+    to -= to % ALIGNED_UNIT_SIZE;
+    uint64_t t = cBDStats::Now();
+    f->seek(f, to, SEEK_SET);
+    int n = 0;
+    while (n + ALIGNED_UNIT_SIZE <= 1024 * 1024) {
+      int r = f->read(f, buf + n, ALIGNED_UNIT_SIZE);
+      if (r <= 0)
+        break;
+      n += r;
+    }
+    t = cBDStats::Now() - t;
+    sum += t;
+    if (t > worst)
+      worst = t;
+  }
+  f->close(f);
+  free(buf);
+
+  double ratio = Staging ? files.Stage()->HitRatio() : 0;
+  printf("%-10s staged %4llu of %4llu MB after %d s, seek to 1 MB: avg %6.1f ms, max %6.1f ms, "
+         "%3d drive seeks, %3.0f%% of reads from the cache\n",
+         Staging ? "staging:" : "disc only:", (unsigned long long)(staged >> 20), (unsigned long long)(total >> 20),
+         PlaySeconds, sum / 1000.0 / (Seeks + 1), worst / 1000.0, drive.seeks - seeks0, ratio * 100);
+}
+
+// A disc folder with Seconds of synthetic stream on a drive with SeekMs
+// seek time, played with and without staging
+
+static int StageBench(int SeekMs, int Seconds, double Mbit)
+{
+  if (SeekMs < 0 || Seconds < 10) {
+    fprintf(stderr, "bad seek time or stream length\n");
+    return 2;
+  }
+  char dir[] = "/tmp/bdbench-stage-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror(dir);
+    return 1;
+  }
+  char path[256];
+  snprintf(path, sizeof(path), "%s/BDMV", dir);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/BDMV/STREAM", dir);
+  mkdir(path, 0700);
+  snprintf(path, sizeof(path), "%s/cache", dir);
+  mkdir(path, 0700);
+  // the disc id
+  snprintf(path, sizeof(path), "%s/BDMV/index.bdmv", dir);
+  FILE *fp = fopen(path, "w");
+  if (fp) {
+    fprintf(fp, "INDX0200 %s", dir);
+    fclose(fp);
+  }
+
+  snprintf(path, sizeof(path), "%s/BDMV/STREAM/00000.m2ts", dir);
+  cSyntheticSource src((uint64_t)(Mbit * 1000000), Seconds, 10, 5, true);
+  fp = fopen(path, "w");
+  uint8_t *buf = (uint8_t *)malloc(32 * ALIGNED_UNIT_SIZE);
+  int r;
+  while (fp && (r = src.Read(buf, 32 * ALIGNED_UNIT_SIZE)) > 0)
+    fwrite(buf, 1, r, fp);
+  free(buf);
+  if (!fp || fclose(fp)) {
+    perror(path);
+    return 1;
+  }
+
+  int play = Seconds / 3;
+  printf("drive: %d ms seek, 36 MB/s; stream %.0f Mbit/s, %d s; %d s played, then 20 seeks and back to the start\n",
+         SeekMs, Mbit, Seconds, play);
+  snprintf(path, sizeof(path), "%s/cache", dir);
+  StageRun(dir, path, false, SeekMs * 1000, Mbit * 1e6 / 8, play, 20);
+  StageRun(dir, path, true,  SeekMs * 1000, Mbit * 1e6 / 8, play, 20);
+
+  char cmd[128];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if (system(cmd))
+    fprintf(stderr, "can't remove %s\n", dir);
+  return 0;
+}
+
+// --- progress display benchmark --------------------------------------
+
+// Replays Seconds of the progress display on a virtual clock: the control
+// ticks TickHz times per second (VDR with fast response), the title plays
+// at 24 frames/s, a chapter starts every 5 minutes and a key changes the
+// play mode every 20 s. Counts the flushes and title strings of drawing
+// on every index change (as before) and of cBDRedraw at MaxRate.
+
+static void RedrawBench(int Seconds, int TickHz, int MaxRate)
+{
+  const double fps = 24000.0 / 1001;
+  const int total = (int)(2 * 3600 * fps);
+  uint64_t oldFlushes = 0, oldTitles = 0, newTitles = 0, modes = 0;
+  int lastCurrent = -1, lastTotal = -1;
+  cBDRedraw redraw(MaxRate);
+
+  for (uint64_t tick = 0; tick < (uint64_t)Seconds * TickHz; tick++) {
+    uint64_t now = tick * 1000000 / TickHz;
+    int current = (int)(now * fps / 1000000);
+    int chapter = 1 + (int)(now / 300000000);
+
+    // before: SetTotal, SetProgress and the title each flushed
+    if (current != lastCurrent || total != lastTotal) {
+      oldFlushes += 1 + (tick > 0) + (total != lastTotal && tick > 0);
+      oldTitles++;
+      lastCurrent = current;
+    }
+    lastTotal = total;
+
+    redraw.SetIndex(current, total, fps);
+    redraw.SetPosition(800, 0, chapter, 0, 1);
+    if (tick && tick % (20 * TickHz) == 0) {
+      redraw.Mark(rfMode);
+      modes++;
+    }
+    int fields = redraw.Due(now);
+    if (fields) {
+      newTitles += (fields & rfTitle) != 0;
+      redraw.Drawn(now);
+    }
+  }
+
+  printf("%d s of playback, %d ticks/s, %llu mode changes\n", Seconds, TickHz, (unsigned long long)modes);
+  printf("before:      %6.1f flushes/s, %7llu title strings\n",
+         (double)oldFlushes / Seconds, (unsigned long long)oldTitles);
+  printf("coalesced:   %6.1f flushes/s, %7llu title strings (%s)\n",
+         (double)redraw.draws / Seconds, (unsigned long long)newTitles, MaxRate > 0 ? "rate limited" : "no limit");
+}
+
+// --- fan-out benchmark -----------------------------------------------
+
+// Passes a ring to the framer as a plain sink: every packet is copied
+// into the ring, as before buffers were shared
+
+class cCopySink : public cBDSink {
+private:
+  cBDSink &sink;
+public:
+  cCopySink(cBDSink &Sink) : sink(Sink) {}
+  virtual int  Feed(const uint8_t *Data, int Length) { return sink.Feed(Data, Length); }
+  virtual bool Poll(int TimeoutMs) { return sink.Poll(TimeoutMs); }
+};
+
+// A streaming client: gets the data with Read() (a copy) or Peek() (in
+// place) and "sends" it, copied into a socket buffer as the kernel does
+
+class cFanoutClient : public cBDThread {
+private:
+  cBDStreamRing &ring;
+  int id;
+  bool copy;
+protected:
+  virtual void Action(void) {
+    uint8_t *buf = (uint8_t *)malloc(64 * TS_SIZE);
+    uint8_t *socket = (uint8_t *)malloc(64 * TS_SIZE);
+    struct iovec iov[64];
+    for (;;) {
+      int n, count = 1;
+      cBDUnit *unit = NULL;
+      if (copy) {
+        n = ring.Read(id, buf, 64 * TS_SIZE, 100);
+        iov[0].iov_base = buf;
+        iov[0].iov_len = n > 0 ? n : 0;
+      } else {
+        count = 64;
+        n = ring.Peek(id, iov, count, unit, 100);
+      }
+      if (n < 0)
+        break;
+      uint8_t *p = socket;
+      for (int v = 0; v < count; v++) {
+        memcpy(p, iov[v].iov_base, iov[v].iov_len);
+        p += iov[v].iov_len;
+      }
+      sum += socket[0];
+      if (unit)
+        ring.Release(id, unit, n);
+      bytes += n;
+    }
+    free(socket);
+    free(buf);
+    ring.Detach(id);
+    finished = true;
+  }
+public:
+  uint64_t bytes, sum;
+  volatile bool finished;
+  cFanoutClient(cBDStreamRing &Ring, bool Copy) : cBDThread("bench client"), ring(Ring), copy(Copy), bytes(0), sum(0), finished(false) { id = ring.Attach(); }
+};
+
+static double ProcessCpuSeconds(void)
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// Synthetic stream (Bitrate bits/s, Seconds) read as fast as possible
+// through the framer into a stream ring read by Clients threads
+
+static void FanoutRun(int Clients, bool Copy, uint64_t Bitrate, int Seconds, int Pg, int Ig, int Units)
+{
+  cSyntheticSource src(Bitrate, Seconds, Pg, Ig, true);
+  cM2tsFramer framer(Units * ALIGNED_UNIT_SIZE);
+  cBDStreamRing ring(16 * 1024 * 1024, 10000);
+  cCopySink copySink(ring);
+  cBDSink &sink = Copy ? (cBDSink &)copySink : (cBDSink &)ring;
+
+  cFanoutClient **clients = new cFanoutClient*[Clients];
+  for (int i = 0; i < Clients; i++) {
+    clients[i] = new cFanoutClient(ring, Copy);
+    clients[i]->Start();
+  }
+
+  uint64_t copied0 = cBDStats::Total(bcCopiedBytes);
+  double cpu0 = ProcessCpuSeconds();
+  uint64_t t0 = cBDStats::Now(), bytes = 0;
+
+  for (;;) {
+    if (!framer.Pending()) {
+      int free;
+      uint8_t *space = framer.Space(free);
+      int r = src.Read(space, free - free % ALIGNED_UNIT_SIZE);
+      if (r <= 0)
+        break;
+      bytes += r;
+      framer.Put(r);
+    }
+    if (ring.Poll(10) && !framer.Feed(sink))
+      break;
+  }
+  while (framer.Pending()) {
+    if (ring.Poll(10))
+      framer.Feed(sink);
+  }
+  ring.SetEof();
+
+  uint64_t received = 0;
+  for (int i = 0; i < Clients; i++) {
+    while (!clients[i]->finished)
+      usleep(1000);
+    received += clients[i]->bytes;
+    delete clients[i];
+  }
+  delete[] clients;
+
+  double wall = (cBDStats::Now() - t0) / 1e6;
+  double cpu = ProcessCpuSeconds() - cpu0;
+  uint64_t copied = cBDStats::Total(bcCopiedBytes) - copied0;
+  const cBDUnitPool *pool = framer.Pool();
+  printf("%-9s %6.0f MB/s read, %7.0f MB/s to clients, copied %7.0f MB/s (%.2f bytes per byte read), "
+         "CPU %.2f ms per MB read, read buffers: %llu allocated, %d in use at most\n",
+         Copy ? "copy:" : "zero-copy:", bytes / wall / 1e6, received / wall / 1e6, copied / wall / 1e6,
+         bytes ? (double)copied / bytes : 0, bytes ? cpu * 1000 / (bytes / 1e6) : 0,
+         (unsigned long long)pool->allocated, pool->peak);
+}
+
+static void FanoutBench(int Clients, uint64_t Bitrate, int Seconds, int Pg, int Ig, int Units)
+{
+  printf("%d clients, %d s stream at %.0f Mbit/s, %d KB reads\n", Clients, Seconds, Bitrate / 1e6,
+         Units * ALIGNED_UNIT_SIZE / 1024);
+  FanoutRun(Clients, true,  Bitrate, Seconds, Pg, Ig, Units);
+  FanoutRun(Clients, false, Bitrate, Seconds, Pg, Ig, Units);
+}
+
+// --- AACS benchmark ---------------------------------------------------
+
+// FIPS-197 appendix C.1
+
+static bool AesKnownAnswer(void)
+{
+  uint8_t key[16], in[16], out[16];
+  static const uint8_t expect[16] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+  };
+  for (int i = 0; i < 16; i++) {
+    key[i] = i;
+    in[i] = i * 0x11;
+  }
+  cBDAes aes(key);
+  aes.Encrypt(in, out);
+  if (memcmp(out, expect, 16))
+    return false;
+  uint8_t iv[16] = { 0 };
+  aes.DecryptCbc(out, 16, iv);
+  return !memcmp(out, in, 16);
+}
+
+static bool AacsRun(const char *Name, int Threads, bool Portable, const uint8_t *UnitKey,
+                    const uint8_t *Clear, const uint8_t *Encrypted, uint8_t *Work, int Units)
+{
+  cBDAes::SetPortable(Portable);
+  cBDAacs aacs(UnitKey, Threads - 1);
+  memcpy(Work, Encrypted, (size_t)Units * ALIGNED_UNIT_SIZE);
+
+  uint64_t t0 = cBDStats::Now();
+  // in read-ahead requests of 1 MB
+  int n = 0;
+  for (int i = 0; i < Units; i += 170)
+    n += aacs.Decrypt(Work + (size_t)i * ALIGNED_UNIT_SIZE, Units - i < 170 ? Units - i : 170);
+  double wall = (cBDStats::Now() - t0) / 1e6;
+
+  bool ok = n == Units && !memcmp(Work, Clear, (size_t)Units * ALIGNED_UNIT_SIZE);
+  printf("%-18s %2d thread%s %7.0f MB/s  %s\n", Name, Threads, Threads > 1 ? "s" : " ",
+         (double)Units * ALIGNED_UNIT_SIZE / wall / 1e6, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+static int AacsBench(int Threads, int Mbytes)
+{
+  bool accel = cBDAes::Available();
+
+  cBDAes::SetPortable(true);
+  bool kat = AesKnownAnswer();
+  cBDAes::SetPortable(false);
+  if (accel)
+    kat = AesKnownAnswer() && kat;
+  printf("AES-128 known answer test: %s\n", kat ? "ok" : "FAILED");
+  if (!kat)
+    return 1;
+
+  int units = Mbytes * 1000000 / ALIGNED_UNIT_SIZE;
+  size_t size = (size_t)units * ALIGNED_UNIT_SIZE;
+  uint8_t *clear = (uint8_t *)malloc(size);
+  uint8_t *encrypted = (uint8_t *)malloc(size);
+  uint8_t *work = (uint8_t *)malloc(size);
+  if (!clear || !encrypted || !work) {
+    fprintf(stderr, "bdbench: out of memory\n");
+    return 1;
+  }
+
+  cSyntheticSource src(40000000, Mbytes * 8 / 40 + 1, 10, 5, true);
+  src.Read(clear, size);
+  for (size_t i = 0; i + 12 < size; i += 8)
+    clear[i + 12] ^= i * 2654435761U;  // payload that is not constant
+  for (size_t i = 0; i < size; i += M2TS_SIZE) {
+    clear[i + 4] = 0x47;
+    clear[i] &= 0x3f;
+  }
+
+  static const uint8_t unitKey[16] = {
+    0x3a, 0x91, 0x07, 0xc4, 0x5e, 0xd2, 0x68, 0x1b, 0xf0, 0x2d, 0x83, 0x46, 0xb9, 0x7c, 0xe5, 0x10
+  };
+  cBDAes key(unitKey);
+  memcpy(encrypted, clear, size);
+  for (int i = 0; i < units; i++)
+    cBDAacs::EncryptUnit(key, encrypted + (size_t)i * ALIGNED_UNIT_SIZE);
+
+  printf("%d MB of aligned units, AES instructions: %s\n", Mbytes, accel ? "yes" : "no");
+  bool ok = AacsRun("portable AES:", 1, true, unitKey, clear, encrypted, work, units);
+  if (Threads > 1)
+    ok = AacsRun("portable AES:", Threads, true, unitKey, clear, encrypted, work, units) && ok;
+  if (accel) {
+    ok = AacsRun("AES instructions:", 1, false, unitKey, clear, encrypted, work, units) && ok;
+    if (Threads > 1)
+      ok = AacsRun("AES instructions:", Threads, false, unitKey, clear, encrypted, work, units) && ok;
+  }
+
+  free(clear);
+  free(encrypted);
+  free(work);
+  return ok ? 0 : 1;
+}
+
+// --- tracing benchmark ------------------------------------------------
+
+// The bench sink with the player's spans (PlayTs() per packet, DevicePoll())
+
+class cTracedSink : public cBenchSink {
+public:
+  cTracedSink(int64_t Size, int64_t Rate) : cBenchSink(Size, Rate) {}
+
+  virtual int Feed(const uint8_t *Data, int Length) {
+    BD_TRACE_SPAN(btPlayTs);
+    return cBenchSink::Feed(Data, Length);
+  }
+  virtual bool Poll(int TimeoutMs) {
+    BD_TRACE_SPAN(btPoll);
+    return cBenchSink::Poll(TimeoutMs);
+  }
+};
+
+static double TraceRun(const char *Name, int Seconds, double Mbit, int Units)
+{
+  cSyntheticSource src((uint64_t)(Mbit * 1000000), Seconds, 10, 5, true);
+  cTracedSink sink(1024 * 1024, 0);
+  cM2tsFramer framer(Units * ALIGNED_UNIT_SIZE);
+  uint64_t bytes = 0;
+
+  double cpu0 = CpuSeconds();
+  uint64_t t0 = cBDStats::Now();
+  for (;;) {
+    if (!framer.Pending()) {
+      int free;
+      uint8_t *space = framer.Space(free);
+      int r;
+      {
+        BD_TRACE_SPAN(btRead);
+        r = src.Read(space, free - free % ALIGNED_UNIT_SIZE);
+      }
+      if (r <= 0)
+        break;
+      bytes += r;
+      framer.Put(r);
+    }
+    if (sink.Poll(10) && !framer.Feed(sink))
+      break;
+  }
+  double elapsed = (cBDStats::Now() - t0) / 1e6;
+  double cpu = CpuSeconds() - cpu0;
+
+  printf("%-18s %8.1f MB/s, %.2f s CPU\n", Name, bytes / elapsed / 1e6, cpu);
+  return cpu;
+}
+
+static int TraceBench(int Seconds, double Mbit, int Units)
+{
+  cBDStats::Attach("bench");
+  printf("%d s of %.0f Mbit/s through the pipeline, %d aligned units per read\n", Seconds, Mbit, Units);
+
+#ifndef BD_TRACE
+  printf("built without tracing, the spans compile to nothing (make BDTRACE=1 to compare)\n");
+  TraceRun("no tracing:", Seconds, Mbit, Units);
+  return 0;
+#else
+  const int spans = 10000000;
+
+  double off = TraceRun("tracing off:", Seconds, Mbit, Units);
+  cBDTrace::Enable(true);
+  double on = TraceRun("tracing on:", Seconds, Mbit, Units);
+  printf("overhead:          %+8.1f%% CPU, %.2f%% of a CPU at %.0f Mbit/s\n",
+         off > 0 ? (on - off) * 100 / off : 0, (on - off) * 100 / Seconds, Mbit);
+
+  // cost per span: short spans are timed but not kept
+  for (int keep = 0; keep < 2; keep++) {
+    uint64_t t0 = cBDStats::Now();
+    for (int i = 0; i < spans; i++) {
+      if (keep)
+        cBDTrace::Span(btPlayTs, (uint64_t)i * 100, (uint64_t)i * 100 + 50);
+      else {
+        BD_TRACE_SPAN(btPlayTs);
+      }
+    }
+    printf("%-18s %8.1f ns per span\n", keep ? "span kept:" : "span not kept:",
+           (cBDStats::Now() - t0) * 1000.0 / spans);
+  }
+  cBDTrace::Enable(false);
+
+  char file[] = "/tmp/bdbench-trace-XXXXXX";
+  int fd = mkstemp(file);
+  if (fd < 0) {
+    perror("bdbench: mkstemp");
+    return 1;
+  }
+  close(fd);
+  uint64_t t0 = cBDStats::Now();
+  bool ok = cBDTrace::Dump(file);
+  uint64_t dumpUs = cBDStats::Now() - t0;
+  struct stat st;
+  if (ok && stat(file, &st) == 0)
+    printf("dump:              %8.1f ms, %lld kB of JSON\n", dumpUs / 1000.0, (long long)st.st_size / 1024);
+  else
+    fprintf(stderr, "bdbench: can't write trace\n");
+  unlink(file);
+  return ok ? 0 : 1;
+#endif
+}
+
+static void Usage(void)
+{
+  fprintf(stderr,
+    "usage: bdbench [options] [BDMV folder]\n"
+    "  -b MBIT,  --bitrate=MBIT   synthetic stream bitrate (default 40)\n"
+    "  -t SEC,   --seconds=SEC    synthetic stream length (default 600)\n"
+    "  -g N,     --pg=N           PG share of packets in 1/1000 (default 10)\n"
+    "  -i N,     --ig=N           IG share of packets in 1/1000 (default 5)\n"
+    "  -a,       --no-ats         synthetic stream without arrival timestamps\n"
+    "  -B KB,    --buffer=KB      modeled decoder buffer (default 1024)\n"
+    "  -r MBIT,  --rate=MBIT      modeled decoder consumption (default unlimited)\n"
+    "  -s N,     --seeks=N        random seeks after playback (default 20)\n"
+    "  -u N,     --units=N        aligned units per read (default 1)\n"
+    "  -S,       --stats          print pipeline statistics\n"
+    "  -c N,     --load-cpu=N     run N busy threads during the benchmark\n"
+    "  -d DIR,   --load-disk=DIR  write and re-read a large file in DIR during the benchmark\n"
+    "  -P SPEC,  --sched=SPEC     pipeline scheduling: fifo:PRIO, rr:PRIO or nice:N\n"
+    "  -C LIST,  --cpus=LIST      run pipeline on CPUs in LIST\n"
+    "  -I SPEC,  --ioprio=SPEC    pipeline I/O priority: rt:LEVEL, be:LEVEL or idle\n"
+    "  -x,       --index          compare EP map frame index with a stream scan (BDMV folder only)\n"
+    "  -A SEC,   --angles=SEC     switch to the next angle every SEC seconds of playback (BDMV folder only)\n"
+    "  -G N,     --pg-decode=N    decode N synthetic PG subtitles and report the CPU cost\n"
+    "  -J,       --covers         cover thumbnail: cold JPEG decode vs. thumbnail cache (BDMV folder only)\n"
+    "  -L N,     --library=N      library index of N synthetic discs: sort and T9 search latency\n"
+    "  -N MS[:MBIT], --net=MS[:MBIT]  play a synthetic stream (-b) from storage with MS latency per\n"
+    "                             request and MBIT throughput (default 100), without and with read-ahead\n"
+    "  -R SEC,   --read-ahead=SEC read-ahead for -N and -W in seconds of playback (default 4)\n"
+    "  -W SEC[:MS], --pause=SEC[:MS]  pause a synthetic stream (-b) on a drive model with MS spin-up\n"
+    "                             (default 3000) for SEC seconds: resume latency without and with pause buffer\n"
+    "  -F N,     --fanout=N       stream the synthetic stream to N clients, with copies vs. shared buffers\n"
+    "  -O N,     --osd-rate=N     progress display redraws of -t seconds playback, on every change vs. at most N/s\n"
+    "  -K MS,    --stage=MS       seeks in a synthetic stream (-b, -t) on a drive with MS seek time,\n"
+    "                             without and with staging\n"
+    "  -E N,     --aacs=N         AACS unit decryption of 256 MB: portable vs. AES instructions, 1 vs. N threads\n"
+    "  -X,       --trace          pipeline throughput of -t seconds of -b with tracing off vs. on, span\n"
+    "                             and dump cost (build with BDTRACE=1)\n");
+}
+
+int main(int argc, char *argv[])
+{
+  static const struct option long_options[] = {
+    { "bitrate", required_argument, NULL, 'b' },
+    { "seconds", required_argument, NULL, 't' },
+    { "pg",      required_argument, NULL, 'g' },
+    { "ig",      required_argument, NULL, 'i' },
+    { "no-ats",  no_argument,       NULL, 'a' },
+    { "buffer",  required_argument, NULL, 'B' },
+    { "rate",    required_argument, NULL, 'r' },
+    { "seeks",   required_argument, NULL, 's' },
+    { "units",   required_argument, NULL, 'u' },
+    { "stats",   no_argument,       NULL, 'S' },
+    { "load-cpu",  required_argument, NULL, 'c' },
+    { "load-disk", required_argument, NULL, 'd' },
+    { "sched",   required_argument, NULL, 'P' },
+    { "cpus",    required_argument, NULL, 'C' },
+    { "ioprio",  required_argument, NULL, 'I' },
+    { "index",   no_argument,       NULL, 'x' },
+    { "angles",  required_argument, NULL, 'A' },
+    { "pg-decode", required_argument, NULL, 'G' },
+    { "covers",  no_argument,       NULL, 'J' },
+    { "library", required_argument, NULL, 'L' },
+    { "net",     required_argument, NULL, 'N' },
+    { "read-ahead", required_argument, NULL, 'R' },
+    { "pause",   required_argument, NULL, 'W' },
+    { "fanout",  required_argument, NULL, 'F' },
+    { "osd-rate", required_argument, NULL, 'O' },
+    { "aacs",    required_argument, NULL, 'E' },
+    { "stage",   required_argument, NULL, 'K' },
+    { "trace",   no_argument,       NULL, 'X' },
+    { NULL,      no_argument,       NULL,  0  }
+  };
+
+  double bitrate = 40, rate = 0;
+  int seconds = 600, pg = 10, ig = 5, buffer = 1024, seeks = 20, units = 1;
+  bool ats = true, stats = false, indexBench = false, coverBench = false, traceBench = false;
+  int cpuLoad = 0, angleSwitch = 0, pgEvents = 0, libraryEntries = 0, readAhead = 4, fanout = 0, osdRate = -1;
+  int aacsThreads = 0, stageSeekMs = -1;
+  const char *diskLoad = NULL, *net = NULL, *pause = NULL;
+  sBDSchedParams sched = { spDefault, 0, 0, icDefault, 0 };
+
+  int c;
+  while ((c = getopt_long(argc, argv, "b:t:g:i:aB:r:s:u:Sc:d:P:C:I:xA:G:JL:N:R:F:O:E:W:K:X", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'b': bitrate = atof(optarg); break;
+      case 't': seconds = atoi(optarg); break;
+      case 'g': pg      = atoi(optarg); break;
+      case 'i': ig      = atoi(optarg); break;
+      case 'a': ats     = false;        break;
+      case 'B': buffer  = atoi(optarg); break;
+      case 'r': rate    = atof(optarg); break;
+      case 's': seeks   = atoi(optarg); break;
+      case 'u': units   = atoi(optarg); break;
+      case 'S': stats   = true;         break;
+      case 'c': cpuLoad = atoi(optarg); break;
+      case 'd': diskLoad = optarg;      break;
+      case 'x': indexBench = true;      break;
+      case 'A': angleSwitch = atoi(optarg); break;
+      case 'G': pgEvents = atoi(optarg); break;
+      case 'J': coverBench = true;      break;
+      case 'L': libraryEntries = atoi(optarg); break;
+      case 'N': net = optarg;           break;
+      case 'W': pause = optarg;         break;
+      case 'R': readAhead = atoi(optarg); break;
+      case 'F': fanout = atoi(optarg);  break;
+      case 'O': osdRate = atoi(optarg); break;
+      case 'E': aacsThreads = atoi(optarg); break;
+      case 'K': stageSeekMs = atoi(optarg); break;
+      case 'X': traceBench = true;      break;
+      case 'P': if (!BDParseSched(optarg, sched))  { Usage(); return 2; } break;
+      case 'C': if (!BDParseCpus(optarg, sched))   { Usage(); return 2; } break;
+      case 'I': if (!BDParseIoPrio(optarg, sched)) { Usage(); return 2; } break;
+      default:  Usage(); return 2;
+    }
+  }
+
+  if (indexBench) {
+    if (optind >= argc) {
+      Usage();
+      return 2;
+    }
+    return IndexBench(argv[optind]);
+  }
+
+  if (coverBench) {
+    if (optind >= argc) {
+      Usage();
+      return 2;
+    }
+    return CoverBench(argv[optind]);
+  }
+
+  if (libraryEntries > 0) {
+    LibraryBench(libraryEntries);
+    return 0;
+  }
+
+  if (net)
+    return ReadAheadBench(net, readAhead, bitrate, buffer * 1024);
+
+  if (pause)
+    return ResumeBench(pause, readAhead, bitrate, buffer * 1024);
+
+  if (stageSeekMs >= 0)
+    return StageBench(stageSeekMs, seconds, bitrate);
+
+  if (osdRate >= 0) {
+    if (seconds <= 0) {
+      Usage();
+      return 2;
+    }
+    RedrawBench(seconds, 100, osdRate);
+    return 0;
+  }
+
+  if (traceBench) {
+    if (seconds <= 0 || bitrate <= 0 || units < 1) {
+      Usage();
+      return 2;
+    }
+    return TraceBench(seconds, bitrate, units);
+  }
+
+  if (aacsThreads > 0) {
+    int r = AacsBench(aacsThreads, 256);
+    if (stats)
+      cBDStats::Report(stdout);
+    return r;
+  }
+
+  if (fanout > 0) {
+    if (fanout > BD_SERVER_MAX_CLIENTS || units < 1) {
+      Usage();
+      return 2;
+    }
+    FanoutBench(fanout, (uint64_t)(bitrate * 1000000), seconds, pg, ig, units);
+    if (stats)
+      cBDStats::Report(stdout);
+    return 0;
+  }
+
+  if (pgEvents > 0) {
+    PgBench(pgEvents);
+    if (stats)
+      cBDStats::Report(stdout);
+    return 0;
+  }
+
+  cBenchSource *src;
+  if (optind < argc) {
+    src = cBDMVSource::Open(argv[optind]);
+    if (!src)
+      return 1;
+  } else {
+    if (bitrate <= 0 || seconds <= 0 || pg < 0 || ig < 0 || pg + ig > 800 || units < 1) {
+      Usage();
+      return 2;
+    }
+    src = new cSyntheticSource((uint64_t)(bitrate * 1000000), seconds, pg, ig, ats);
+  }
+
+  cBenchSink sink((int64_t)buffer * 1024, (int64_t)(rate * 1000000 / 8));
+  cM2tsFramer framer(units * ALIGNED_UNIT_SIZE);
+  uint64_t bytes = 0;
+
+  cBDStats::Attach("bench");
+
+  /* competing load */
+
+  cBDThread **load = new cBDThread*[cpuLoad + 1];
+  int loads = 0;
+  for (int i = 0; i < cpuLoad; i++)
+    load[loads++] = new cCpuLoad;
+  if (diskLoad)
+    load[loads++] = new cDiskLoad(diskLoad);
+  for (int i = 0; i < loads; i++)
+    load[i]->Start();
+
+  // after starting the load: new threads inherit scheduling and affinity
+  if (!BDApplySched(sched, "bdbench"))
+    fprintf(stderr, "scheduling settings not fully applied (see syslog)\n");
+
+  /* playback */
+
+  double cpu0 = CpuSeconds();
+  uint64_t t0 = cBDStats::Now();
+  int nextSwitch = angleSwitch, switches = 0;
+
+  for (;;) {
+    if (!framer.Pending()) {
+      int free;
+      uint8_t *space = framer.Space(free);
+      int r = src->Read(space, free - free % ALIGNED_UNIT_SIZE);
+      if (r < 0) {
+        fprintf(stderr, "read error\n");
+        break;
+      }
+      if (r == 0)
+        break;
+      bytes += r;
+      framer.Put(r);
+
+      if (angleSwitch > 0 && src->Time() >= nextSwitch) {
+        switches += src->NextAngle();
+        nextSwitch += angleSwitch;
+      }
+    }
+
+    if (sink.Poll(10)) {
+      if (!framer.Feed(sink))
+        break;
+    } else {
+      cBDStats::Count(bcPollTimeouts);
+    }
+  }
+
+  uint64_t elapsed = cBDStats::Now() - t0;
+  double cpu = CpuSeconds() - cpu0;
+
+  for (int i = 0; i < loads; i++)
+    delete load[i];
+  delete[] load;
+
+  /* seeks */
+
+  uint64_t seekTotal = 0, seekMax = 0;
+  int duration = src->Duration();
+  srand(1);
+  for (int i = 0; i < seeks && duration > 0; i++) {
+    uint64_t start = cBDStats::Now();
+    src->Seek(rand() % duration);
+    sink.Clear();
+    framer.Clear();
+    int free;
+    uint8_t *space = framer.Space(free);
+    int r = src->Read(space, ALIGNED_UNIT_SIZE);
+    if (r > 0) {
+      framer.Put(r);
+      framer.Feed(sink);
+    }
+    uint64_t t = cBDStats::Now() - start;
+    seekTotal += t;
+    if (t > seekMax)
+      seekMax = t;
+  }
+
+  /* report */
+
+  double secs = elapsed / 1e6;
+  double mbit = bytes * 8 / 1e6;
+  uint64_t packets = bytes / M2TS_SIZE;
+
+  printf("bytes read:       %llu\n", (unsigned long long)bytes);
+  printf("elapsed:          %.3f s\n", secs);
+  printf("packets/s:        %.0f\n", secs > 0 ? packets / secs : 0);
+  printf("throughput:       %.1f Mbit/s\n", secs > 0 ? mbit / secs : 0);
+  printf("CPU per Mbit:     %.3f ms\n", mbit > 0 ? cpu * 1000 / mbit : 0);
+  printf("sink stalls:      %llu\n", (unsigned long long)sink.stalls);
+  if (rate > 0)
+    printf("sink underruns:   %llu\n", (unsigned long long)sink.underruns);
+  printf("resyncs:          %llu (%llu bytes dropped)\n", (unsigned long long)framer.resyncs, (unsigned long long)framer.droppedBytes);
+  printf("carry-overs:      %llu\n", (unsigned long long)framer.carryOvers);
+  if (seeks > 0 && duration > 0)
+    printf("seek latency:     avg %.3f ms, max %.3f ms\n", seekTotal / 1000.0 / seeks, seekMax / 1000.0);
+  if (angleSwitch > 0) {
+    const sBDStatBlock *b = cBDStats::Block();
+    uint64_t n = 0;
+    for (int i = 0; i < BD_HIST_BUCKETS; i++)
+      n += b->hist[bhAngle][i];
+    printf("angle switches:   %d requested, %llu done", switches, (unsigned long long)n);
+    if (n > 0)
+      printf(", latency avg %.3f ms, max %.3f ms", b->histSum[bhAngle] / 1000.0 / n, b->histMax[bhAngle] / 1000.0);
+    printf(", %llu bytes prefetched\n", (unsigned long long)b->counter[bcPrefetchBytes]);
+  }
+
+  if (stats)
+    cBDStats::Report(stdout);
+
+  delete src;
+  return 0;
+}
@@ -0,0 +1,652 @@
+/*
+ * bdcore.c: BluRay playback core (disc, titles, events, read loop)
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <libbluray/keys.h>
+#include <libbluray/meta_data.h>
+
+#include "bdangle.h"
+#include "bdoverlay.h"
+#include "bdreadahead.h"
+#include "bdstage.h"
+#include "bdstats.h"
+#include "bdtrace.h"
+
+#include "bdcore.h"
+
+#define IDLE_SLEEP_US  10000  // nothing to read (menu, still frame)
+#define RATE_WINDOW    (4 * 1024 * 1024)  // bytes per bitrate sample
+#define MIN_RATE       (32 * 1024)        // bytes/s, samples outside are jumps
+#define MAX_RATE       (16 * 1024 * 1024)
+
+// Disc folders through the read-ahead if it is on, else libbluray's own file access
+static BLURAY *OpenDisc(const char *Path, cBDReadAhead *&ReadAhead)
+{
+  ReadAhead = NULL;
+  if (BDReadAheadConfig.seconds > 0 || BDReadAheadConfig.aacsThreads > 0 || BDReadAheadConfig.pauseSeconds > 0 ||
+      BDStageConfig.maxMB > 0) {
+    ReadAhead = new cBDReadAhead(Path, BDReadAheadConfig);
+    BLURAY *bd = ReadAhead->Open();
+    if (bd)
+      return bd;
+    delete ReadAhead;
+    ReadAhead = NULL;
+  }
+  return bd_open(Path, NULL);
+}
+
+static void CloseDisc(BLURAY *Bd, cBDReadAhead *ReadAhead)
+{
+  bd_close(Bd);
+  delete ReadAhead;
+}
+
+// Enter Stage, false if the listener cancelled
+static bool OpenStage(cBDOpenListener *Listener, eBDOpenStage Stage)
+{
+  if (!Listener)
+    return true;
+  if (Listener->OpenCancelled()) {
+    syslog(LOG_INFO, "BluRay: opening cancelled");
+    return false;
+  }
+  Listener->OpenStage(Stage);
+  return true;
+}
+
+cBDCore::cBDCore(BLURAY *Bd, cBDReadAhead *ReadAhead)
+:framer(ALIGNED_UNIT_SIZE)
+{
+  bd = Bd;
+  readAhead = ReadAhead;
+  rateStart = -1;
+  rateBytes = 0;
+  title_info = NULL;
+  listener = NULL;
+  recovery = NULL;
+  prefetch = NULL;
+  overlay = NULL;
+  readSize = ALIGNED_UNIT_SIZE;
+  current_playlist = -1;
+  current_clip = 0;
+  current_chapter = -1;
+  current_angle = 0;
+  requested_angle = -1;
+  angleRequestTime = 0;
+  end_of_title = false;
+  read_error = false;
+  resumeTime = 0;
+  navigation = false;
+  menu_active = false;
+  popup_available = false;
+  still = false;
+  stillUntil = 0;
+  idle = false;
+}
+
+cBDCore::~cBDCore()
+{
+  delete recovery;
+  delete prefetch;
+  SetOverlay(NULL);
+
+  if (title_info) {
+    bd_free_title_info(title_info);
+    title_info = NULL;
+  }
+
+  if (bd) {
+    bd_close(bd);
+    bd = NULL;
+  }
+  // after the disc, libbluray closes its files through it
+  delete readAhead;
+}
+
+int cBDCore::MainTitle(BLURAY *Bd, int MinTitleLength)
+{
+  /* load title list */
+  unsigned num_title_idx = bd_get_titles(Bd, TITLES_RELEVANT, MinTitleLength);
+  if (num_title_idx < 1) {
+    syslog(LOG_ERR, "BluRay: no titles found");
+    return -1;
+  }
+  syslog(LOG_INFO, "BluRay: %d titles", num_title_idx);
+
+  /* guess the main title */
+
+  unsigned title_idx = 0;
+  uint64_t duration = 0;
+  int playlist = 99999;
+
+  for (unsigned i = 0; i < num_title_idx; i++) {
+    BLURAY_TITLE_INFO *info = bd_get_title_info(Bd, i, 0);
+    if (info) {
+      if (info->duration > duration) {
+        title_idx = i;
+        duration  = info->duration;
+        playlist  = info->playlist;
+      }
+      bd_free_title_info(info);
+    }
+  }
+  syslog(LOG_INFO, "BluRay main title: #%d (%05d.mpls)", title_idx, playlist);
+
+  return title_idx;
+}
+
+// HDMV navigation (first play, disc menus) is possible: no BD-J titles
+static bool HasNavigation(BLURAY *Bd)
+{
+  const BLURAY_DISC_INFO *info = bd_get_disc_info(Bd);
+  if (!info || !info->bluray_detected || info->num_bdj_titles || !info->num_hdmv_titles) {
+    syslog(LOG_INFO, "BluRay: no HDMV navigation (%u HDMV, %u BD-J titles)",
+           info ? info->num_hdmv_titles : 0, info ? info->num_bdj_titles : 0);
+    return false;
+  }
+  return true;
+}
+
+cBDCore *cBDCore::Open(const char *Path, int MinTitleLength, int Title, cBDOpenListener *Listener, bool Menus)
+{
+  /* open disc */
+  if (!OpenStage(Listener, boOpen))
+    return NULL;
+  cBDReadAhead *readAhead;
+  BLURAY *bd = OpenDisc(Path, readAhead);
+  if (!bd) {
+    syslog(LOG_INFO, "opening BluRay disc %s failed", Path);
+    return NULL;
+  }
+
+  if (!OpenStage(Listener, boTitles)) {
+    CloseDisc(bd, readAhead);
+    return NULL;
+  }
+
+  /* first play, if the disc has menus */
+  if (Menus && Title < 0 && HasNavigation(bd)) {
+    bd_get_event(bd, NULL);
+    if (bd_play(bd) > 0) {
+      const BLURAY_DISC_INFO *info = bd_get_disc_info(bd);
+      syslog(LOG_INFO, "BluRay: HDMV navigation, %u titles%s", info->num_hdmv_titles,
+             info->top_menu_supported ? ", top menu" : "");
+      cBDCore *core = new cBDCore(bd, readAhead);
+      core->navigation = true;
+      return core;
+    }
+    // the handle may be left in navigation mode: start over for the main title
+    syslog(LOG_ERR, "bd_play() failed");
+    CloseDisc(bd, readAhead);
+    bd = OpenDisc(Path, readAhead);
+    if (!bd) {
+      syslog(LOG_INFO, "opening BluRay disc %s failed", Path);
+      return NULL;
+    }
+  }
+
+  if (Title < 0) {
+    Title = MainTitle(bd, MinTitleLength);
+  } else if (bd_get_titles(bd, TITLES_RELEVANT, MinTitleLength) <= (unsigned)Title) {
+    syslog(LOG_ERR, "BluRay: no title %d", Title);
+    Title = -1;
+  }
+  if (Title < 0) {
+    CloseDisc(bd, readAhead);
+    return NULL;
+  }
+
+  /* init event queue */
+  bd_get_event(bd, NULL);
+
+  /* select playlist */
+  if (bd_select_title(bd, Title) <= 0) {
+    syslog(LOG_ERR, "bd_select_title(%d) failed", Title);
+    CloseDisc(bd, readAhead);
+    return NULL;
+  }
+
+  return new cBDCore(bd, readAhead);
+}
+
+void cBDCore::SetRecovery(cBDRecovery *Recovery)
+{
+  if (recovery != Recovery) {
+    delete recovery;
+    recovery = Recovery;
+    if (recovery)
+      recovery->SetReadAhead(readAhead);
+  }
+}
+
+void cBDCore::Reconfigure(void)
+{
+  if (readAhead) {
+    readAhead->SetConfig(BDReadAheadConfig);
+    if (readAhead->Stage())
+      readAhead->Stage()->SetMaxMB(BDStageConfig.maxMB);
+    readAhead->Reschedule();
+  }
+  if (recovery)
+    recovery->SetConfig(BDRecoveryConfig);
+}
+
+void cBDCore::SetStage(cBDStage *Stage)
+{
+  if (!readAhead) {
+    delete Stage;
+    return;
+  }
+  readAhead->SetStage(Stage);
+  if (Stage)
+    Stage->SetClips(title_info);
+}
+
+void cBDCore::SetAnglePrefetch(cBDAnglePrefetch *Prefetch)
+{
+  if (prefetch != Prefetch) {
+    delete prefetch;
+    prefetch = Prefetch;
+  }
+}
+
+void cBDCore::SetOverlay(cBDOverlay *Overlay)
+{
+  if (overlay != Overlay) {
+    if (overlay) {
+      overlay->Detach(bd);
+      delete overlay;
+    }
+    overlay = Overlay;
+    if (overlay)
+      overlay->Attach(bd);
+  }
+}
+
+cBDCore *cBDCore::OpenPlaylist(const char *Path, int Playlist)
+{
+  cBDReadAhead *readAhead;
+  BLURAY *bd = OpenDisc(Path, readAhead);
+  if (!bd) {
+    syslog(LOG_INFO, "opening BluRay disc %s failed", Path);
+    return NULL;
+  }
+
+  bd_get_titles(bd, TITLES_ALL, 0);
+  bd_get_event(bd, NULL);
+
+  if (!bd_select_playlist(bd, Playlist)) {
+    syslog(LOG_ERR, "bd_select_playlist(%d) failed", Playlist);
+    CloseDisc(bd, readAhead);
+    return NULL;
+  }
+
+  return new cBDCore(bd, readAhead);
+}
+
+double cBDCore::FramesPerSecond(const BLURAY_TITLE_INFO *Info)
+{
+  if (!Info || Info->clip_count < 1 || Info->clips[0].video_stream_count < 1)
+    return 0;
+
+  switch (Info->clips[0].video_streams[0].rate) {
+    case BLURAY_VIDEO_RATE_24000_1001: return 24000.0 / 1001;
+    case BLURAY_VIDEO_RATE_24:         return 24;
+    case BLURAY_VIDEO_RATE_25:         return 25;
+    case BLURAY_VIDEO_RATE_30000_1001: return 30000.0 / 1001;
+    case BLURAY_VIDEO_RATE_50:         return 50;
+    case BLURAY_VIDEO_RATE_60000_1001: return 60000.0 / 1001;
+    default:                           return 0;
+  }
+}
+
+const char *cBDCore::DiscName(void)
+{
+  const struct meta_dl *meta_data = bd_get_meta(bd);
+  if (meta_data && meta_data->di_name && strlen(meta_data->di_name) > 1)
+    return meta_data->di_name;
+  return NULL;
+}
+
+void cBDCore::HandleEvents(BD_EVENT *ev)
+{
+  if (ev->event == BD_EVENT_NONE)
+    return;
+
+  cBDStatTimer timer(bhEvents);
+  BD_TRACE_SPAN(btEvents);
+
+  while (ev->event != BD_EVENT_NONE) {
+
+    cBDStats::Count(bcEvents);
+
+    switch (ev->event) {
+
+    case BD_EVENT_TITLE:
+      if (navigation)
+        syslog(LOG_INFO, "BluRay: title %d", ev->param);
+      break;
+
+    case BD_EVENT_MENU:
+      if (menu_active != !!ev->param) {
+        menu_active = ev->param;
+        if (listener)
+          listener->MenuChanged(menu_active);
+      }
+      break;
+
+    case BD_EVENT_POPUP:
+      popup_available = ev->param;
+      break;
+
+    case BD_EVENT_SEEK:
+      // a navigation command jumped; our own seeks flush before seeking
+      if (navigation && listener)
+        listener->Discontinuity();
+      break;
+
+    case BD_EVENT_STILL_TIME:
+      // repeated while the still lasts; param: seconds, 0 = until input
+      if (!still) {
+        still = true;
+        stillUntil = ev->param ? cBDStats::Now() + ev->param * 1000000ULL : 0;
+      }
+      idle = true;
+      break;
+
+    case BD_EVENT_IDLE:
+      idle = true;
+      break;
+
+    case BD_EVENT_ANGLE:
+      // PSR 3: angle number 1...
+      if (ev->param < 1)
+        break;
+      if (requested_angle >= 0) {
+        uint64_t latency = cBDStats::Now() - angleRequestTime;
+        cBDStats::Time(bhAngle, latency);
+        syslog(LOG_INFO, "BluRay: angle %d -> %d after %llu ms", current_angle + 1, ev->param,
+               (unsigned long long)(latency / 1000));
+      }
+      current_angle = ev->param - 1;
+      requested_angle = -1;
+      if (listener)
+        listener->AngleChanged(current_angle);
+      break;
+
+    case BD_EVENT_PLAYLIST:
+      if (title_info) {
+        bd_free_title_info(title_info);
+        title_info = NULL;
+      }
+      title_info = bd_get_playlist_info(bd, ev->param, 0);
+      current_playlist = ev->param;
+      current_chapter = -1;
+      current_clip = -1;
+      current_angle = bd_get_current_angle(bd);
+      requested_angle = -1;
+      if (prefetch)
+        prefetch->Reset();
+      if (readAhead && readAhead->Stage())
+        readAhead->Stage()->SetClips(title_info);
+      if (listener)
+        listener->PlaylistChanged(current_playlist);
+      break;
+
+    case BD_EVENT_PLAYITEM:
+      current_clip = ev->param;
+      if (listener)
+        listener->ClipChanged(current_clip);
+      break;
+
+    case BD_EVENT_CHAPTER:
+      current_chapter = ev->param;
+      if (listener)
+        listener->ChapterChanged(current_chapter);
+      break;
+
+    case BD_EVENT_READ_ERROR:
+      syslog(LOG_ERR, "BluRay: read error event");
+      read_error = true;
+      break;
+
+    case BD_EVENT_END_OF_TITLE:
+      syslog(LOG_INFO, "END_OF_TITLE");
+      end_of_title = true;
+      if (listener)
+        listener->EndOfTitle();
+      break;
+
+    default:
+      break;
+    }
+
+    /* get next event */
+    if (!bd_get_event(bd, ev))
+      break;
+  }
+}
+
+int cBDCore::ReadUnit(uint8_t *Buffer, int Size)
+{
+  BD_EVENT ev = {0, 0};
+
+  if (still && stillUntil && cBDStats::Now() >= stillUntil) {
+    bd_read_skip_still(bd);
+    still = false;
+  }
+  idle = false;
+
+  if (recovery)
+    recovery->SkipKnown(bd, current_playlist);
+  uint64_t pos = bd_tell(bd);
+
+  uint64_t start = cBDStats::Now();
+  int r = bd_read_ext(bd, Buffer, Size, &ev);
+  uint64_t elapsed = cBDStats::Now() - start;
+  cBDStats::Time(bhRead, elapsed);
+  BD_TRACE_EVENT(btRead, start, start + elapsed);
+  cBDStats::Count(bcReadCalls);
+
+  if (r == 0) {
+    if (ev.event == BD_EVENT_NONE) {
+      // title without video
+      usleep(3000);
+    }
+  } else if (r < 0) {
+    // ERROR
+    syslog(LOG_ERR, "bd_read() error");
+    cBDStats::Count(bcReadErrors);
+    read_error = false;
+    if (!recovery || !recovery->Failed(bd, current_playlist, pos))
+      return r;
+    return 0;
+  }
+  cBDStats::Count(bcReadBytes, r);
+  if (r > 0)
+    still = false;
+  if (r > 0 && resumeTime) {
+    cBDStats::Time(bhResume, cBDStats::Now() - resumeTime);
+    resumeTime = 0;
+  }
+
+  HandleEvents(&ev);
+  if (r == 0 && idle)
+    usleep(IDLE_SLEEP_US);
+
+  if (readAhead && r > 0)
+    UpdateBitrate(r);
+
+  if (prefetch && r > 0 && Angles() > 1) {
+    prefetch->ReadDone(r, elapsed);
+    prefetch->Update(bd, title_info, current_clip, current_angle);
+  }
+
+  if (recovery) {
+    // a blocking read can't be aborted: the slow region is remembered
+    // (skipped next time), its data is used; a failed read skips ahead
+    bool slow = recovery->ReadTimeoutMs() > 0 && elapsed > (uint64_t)recovery->ReadTimeoutMs() * 1000;
+    if (slow)
+      syslog(LOG_ERR, "BluRay: read took %llu ms", (unsigned long long)(elapsed / 1000));
+    if (read_error || (slow && r == 0)) {
+      if (!recovery->Failed(bd, current_playlist, pos + r) && r == 0)
+        r = -1;
+    } else if (slow)
+      recovery->Slow(bd, current_playlist, pos, pos + r);
+    else if (r > 0)
+      recovery->Succeeded();
+  }
+  read_error = false;
+
+  return r;
+}
+
+void cBDCore::Pause(bool On)
+{
+  if (readAhead)
+    readAhead->SetPaused(On);
+  resumeTime = On ? 0 : cBDStats::Now();
+}
+
+void cBDCore::UpdateBitrate(int Bytes)
+{
+  // bytes per second of title time, the read-ahead buffers that much per second
+  int64_t time = bd_tell_time(bd);
+  if (rateStart < 0 || time < rateStart) {
+    rateStart = time;
+    rateBytes = 0;
+    return;
+  }
+  rateBytes += Bytes;
+  if (rateBytes >= RATE_WINDOW && time > rateStart) {
+    double rate = rateBytes * 90000.0 / (time - rateStart);
+    if (rate >= MIN_RATE && rate <= MAX_RATE)
+      readAhead->SetBitrate(rate);
+    rateStart = time;
+    rateBytes = 0;
+  }
+}
+
+void cBDCore::SetReadSize(int Bytes)
+{
+  Bytes -= Bytes % ALIGNED_UNIT_SIZE;
+  if (Bytes < ALIGNED_UNIT_SIZE)
+    Bytes = ALIGNED_UNIT_SIZE;
+
+  if (Bytes != readSize) {
+    readSize = Bytes;
+    framer.Resize(readSize);
+  }
+}
+
+bool cBDCore::Read(void)
+{
+  if (framer.Pending())
+    return true;
+
+  int free;
+  uint8_t *space = framer.Space(free);
+  int r = ReadUnit(space, free < readSize ? free : readSize);
+  if (r < 0)
+    return false;
+
+  framer.Put(r);
+  return true;
+}
+
+bool cBDCore::SelectPlaylist(int Playlist)
+{
+  Empty();
+  end_of_title = false;
+
+  bool ok = bd_select_playlist(bd, Playlist);
+  syslog(LOG_INFO, "bd_select_playlist -> %s", ok ? "OK" : "FAIL");
+  return ok;
+}
+
+void cBDCore::Seek(int Seconds)
+{
+  cBDStatTimer timer(bhSeek);
+  BD_TRACE_SPAN(btSeek);
+  cBDStats::Count(bcSeeks);
+
+  Empty();
+  uint64_t tick = Seconds;
+  tick *= 90000;
+
+  syslog(LOG_INFO, "Seek to %d", Seconds);
+  bd_seek_time(bd, tick);
+}
+
+bool cBDCore::SeekChapter(int Chapter)
+{
+  if (!title_info || current_chapter <= 0)
+    return false;
+
+  if (Chapter < 1) Chapter = 1;
+  if (Chapter > (int)title_info->chapter_count) Chapter = title_info->chapter_count;
+
+  cBDStatTimer timer(bhSeek);
+  BD_TRACE_SPAN(btSeek);
+  cBDStats::Count(bcSeeks);
+
+  Empty();
+
+  syslog(LOG_INFO, "Seek to chapter %d", Chapter);
+  bd_seek_chapter(bd, Chapter - 1);
+  return true;
+}
+
+int cBDCore::TellTime(void)
+{
+  return bd_tell_time(bd) / 90000;
+}
+
+bool cBDCore::SelectAngle(int Angle)
+{
+  if (Angle < 0 || Angle >= Angles())
+    return false;
+  if (Angle == cBDCore::Angle())
+    return true;
+
+  cBDStats::Count(bcAngleChanges);
+  syslog(LOG_INFO, "BluRay: angle %d requested", Angle + 1);
+
+  // libbluray switches clips at the next angle change point
+  // (interleaved unit boundary) without seeking
+  requested_angle = Angle;
+  angleRequestTime = cBDStats::Now();
+  bd_seamless_angle_change(bd, Angle);
+  return true;
+}
+
+bool cBDCore::UserInput(uint32_t Key, int64_t Pts)
+{
+  if (!navigation)
+    return false;
+
+  if (overlay)
+    overlay->InputSent();
+  return bd_user_input(bd, Pts, Key) >= 0;
+}
+
+bool cBDCore::MenuCall(int64_t Pts)
+{
+  if (!navigation)
+    return false;
+
+  if (popup_available)
+    return UserInput(BD_VK_POPUP, Pts);
+
+  syslog(LOG_INFO, "BluRay: top menu");
+  if (overlay)
+    overlay->InputSent();
+  return bd_menu_call(bd, Pts) > 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * bdcore.h: BluRay playback core (disc, titles, events, read loop)
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDCORE_H
+#define _BDCORE_H
+
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+#include "bdrecovery.h"
+#include "m2ts.h"
+
+class cBDAnglePrefetch;
+class cBDOverlay;
+class cBDReadAhead;
+class cBDStage;
+
+// The core does not depend on VDR. It is not thread safe,
+// callers must serialize access.
+
+// --- cBDCoreListener --------------------------------------------------
+
+class cBDCoreListener {
+public:
+  virtual ~cBDCoreListener() {}
+
+  virtual void PlaylistChanged(int Playlist) {}  // new title info available
+  virtual void ClipChanged(int Clip) {}
+  virtual void ChapterChanged(int Chapter) {}
+  virtual void AngleChanged(int Angle) {}      // angle switch took effect
+  virtual void MenuChanged(bool Active) {}     // HDMV menu shown / removed
+  virtual void Discontinuity(void) {}          // navigation jumped, drop buffered data
+  virtual void EndOfTitle(void) {}
+};
+
+// --- cBDOpenListener --------------------------------------------------
+
+// Stages of starting playback, in order
+enum eBDOpenStage {
+  boMount,             // mounting the disc (by the caller)
+  boOpen,              // bd_open(): disc structure, AACS
+  boTitles,            // title scan / first play
+  boFirstData,         // first read of the title (by the caller)
+  boCount
+};
+
+class cBDOpenListener {
+public:
+  virtual ~cBDOpenListener() {}
+
+  virtual void OpenStage(eBDOpenStage Stage) {}  // Stage starts
+  // Give up at the next stage. bd_open() and the title scan can't be
+  // interrupted.
+  virtual bool OpenCancelled(void) { return false; }
+};
+
+// --- cBDCore ----------------------------------------------------------
+
+class cBDCore {
+private:
+  BLURAY *bd;
+  BLURAY_TITLE_INFO *title_info;
+  cBDCoreListener *listener;
+  cBDRecovery *recovery;
+  cBDAnglePrefetch *prefetch;
+  cBDOverlay *overlay;
+  cBDReadAhead *readAhead;
+
+  cM2tsFramer framer;
+  int     readSize;
+  int64_t rateStart;         // title time of the bitrate sample, -1: none
+  uint64_t rateBytes;
+
+  int     current_playlist;
+  int     current_clip;
+  int     current_chapter;
+  int     current_angle;
+  int     requested_angle;   // -1: no switch pending
+  uint64_t angleRequestTime;
+  bool    end_of_title;
+  bool    read_error;
+  uint64_t resumeTime;       // playback resumed, waiting for data
+
+  // HDMV navigation
+  bool    navigation;
+  bool    menu_active;
+  bool    popup_available;
+  bool    still;             // still frame, waiting for timeout or input
+  uint64_t stillUntil;       // 0: until input
+  bool    idle;
+
+  void HandleEvents(BD_EVENT *ev);
+  void UpdateBitrate(int Bytes);
+
+public:
+  // ReadAhead: file layer Bd was opened with (takes ownership)
+  cBDCore(BLURAY *Bd, cBDReadAhead *ReadAhead = NULL);
+  ~cBDCore();
+
+  // Open disc and select Title (< 0: guess main title). Listener gets
+  // the stages and can cancel (NULL: none). Menus: start in HDMV
+  // navigation mode (first play, disc menus) if Title < 0 and the disc
+  // has no BD-J titles, on the same handle.
+  static cBDCore *Open(const char *Path, int MinTitleLength, int Title = -1, cBDOpenListener *Listener = NULL, bool Menus = false);
+  // Open disc and select Playlist (mpls number)
+  static cBDCore *OpenPlaylist(const char *Path, int Playlist);
+  // Index of the longest title, -1 if none
+  static int MainTitle(BLURAY *Bd, int MinTitleLength);
+  // Frame rate of the primary video stream of the first clip, 0 if unknown
+  static double FramesPerSecond(const BLURAY_TITLE_INFO *Info);
+
+  void SetListener(cBDCoreListener *Listener) { listener = Listener; }
+  // Skip damaged regions instead of ending playback (takes ownership, NULL: off)
+  void SetRecovery(cBDRecovery *Recovery);
+  // Read ahead alternate angles (takes ownership, NULL: off)
+  void SetAnglePrefetch(cBDAnglePrefetch *Prefetch);
+  // Menu graphics output (takes ownership, NULL: off)
+  void SetOverlay(cBDOverlay *Overlay);
+  // Apply changed BDReadAheadConfig, BDStageConfig, BDRecoveryConfig and
+  // BDPlayerSched (the settings that can change during playback)
+  void Reconfigure(void);
+  // Stage the playing title on local storage (takes ownership, NULL:
+  // off). Needs the read-ahead file layer, see BDStageConfig.
+  void SetStage(cBDStage *Stage);
+
+  BLURAY *Handle(void)                   { return bd; }
+  const BLURAY_TITLE_INFO *TitleInfo(void) { return title_info; }
+  const char *DiscName(void);
+  cBDReadAhead *ReadAhead(void) { return readAhead; }
+  cBDRecovery *Recovery(void) { return recovery; }
+
+  int  Playlist(void)   { return current_playlist; }
+  int  Clip(void)       { return current_clip; }
+  int  Chapter(void)    { return current_chapter; }
+  bool EndOfTitle(void) { return end_of_title; }
+  int  Angles(void)     { return title_info && title_info->angle_count > 0 ? title_info->angle_count : 1; }
+  int  Angle(void)      { return requested_angle >= 0 ? requested_angle : current_angle; }
+
+  // Read into Buffer and handle events. Returns bytes read, < 0 on error.
+  int  ReadUnit(uint8_t *Buffer, int Size);
+
+  // Playback paused / resumed: the read-ahead buffers deeper while
+  // paused; the time from resume to the next data is measured
+  void Pause(bool On);
+
+  // Bytes requested from libbluray per read, rounded to aligned units
+  void SetReadSize(int Bytes);
+  int  ReadSize(void)   { return readSize; }
+
+  // Read more data when all complete packets have been consumed
+  bool Read(void);
+  bool Pending(void)    { return framer.Pending(); }
+  // Feed buffered packets
+  bool Feed(cBDSink &Sink) { return framer.Feed(Sink); }
+  // Drop buffered data
+  void Empty(void)      { framer.Clear(); rateStart = -1; }
+  // Pass PG stream Pid to Sink (-1: off), see cM2tsFramer
+  void SetPgSink(int Pid, cBDSink *Sink) { framer.SetPgSink(Pid, Sink); }
+  const cM2tsFramer &Framer(void) { return framer; }
+
+  bool SelectPlaylist(int Playlist);
+  void Seek(int Seconds);
+  bool SeekChapter(int Chapter);
+  int  TellTime(void);  // seconds
+
+  // HDMV navigation mode
+  bool Navigation(void)     { return navigation; }
+  bool MenuActive(void)     { return menu_active; }
+  bool PopupAvailable(void) { return popup_available; }
+  // Send remote key (BD_VK_*) to the disc. Pts: current video PTS, -1 if unknown
+  bool UserInput(uint32_t Key, int64_t Pts = -1);
+  // Toggle the popup menu if the title has one, else open the top menu
+  bool MenuCall(int64_t Pts = -1);
+
+  // Switch to Angle (0...Angles()-1) at the next angle change point.
+  // Buffered data of the old angle is played out, nothing is flushed.
+  bool SelectAngle(int Angle);
+};
+
+#endif //_BDCORE_H
@@ -0,0 +1,516 @@
+/*
+ * bdcover.c: Disc cover art thumbnails
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <dirent.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <jpeglib.h>
+
+#include "bddiscid.h"
+
+#include "bdcover.h"
+
+#define THUMB_MAGIC     "BDTHUMB1"
+#define MEMORY_ENTRIES  64          // decoded thumbnails kept in memory
+
+// --- cover file -------------------------------------------------------
+
+// Largest <di:thumbnail href="..." size="WxH"/> of a bdmt_*.xml file
+static bool ThumbnailFromMeta(const char *Dir, const char *Xml, char *Path, int Size)
+{
+  char file[1024];
+  snprintf(file, sizeof(file), "%s/%s", Dir, Xml);
+  FILE *fp = fopen(file, "r");
+  if (!fp)
+    return false;
+
+  char buf[16384];
+  size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  buf[len] = 0;
+
+  long best = 0;
+  for (char *p = strstr(buf, "<di:thumbnail"); p; p = strstr(p + 1, "<di:thumbnail")) {
+    char *end = strchr(p, '>');
+    char *href = strstr(p, "href=\"");
+    if (!end || !href || href > end)
+      continue;
+    href += 6;
+    char *q = strchr(href, '"');
+    if (!q || q > end)
+      continue;
+
+    int w = 0, h = 0;
+    char *size = strstr(p, "size=\"");
+    if (size && size < end)
+      sscanf(size + 6, "%dx%d", &w, &h);
+    long area = w > 0 && h > 0 ? (long)w * h : 1;
+    if (area > best) {
+      best = area;
+      snprintf(Path, Size, "%s/%.*s", Dir, (int)(q - href), href);
+    }
+  }
+  return best > 0;
+}
+
+bool BDCoverFile(const char *Root, const char *Language, char *Path, int Size)
+{
+  char dir[1024];
+  snprintf(dir, sizeof(dir), "%s/BDMV/META/DL", Root);
+
+  char xml[32];
+  if (Language && *Language) {
+    snprintf(xml, sizeof(xml), "bdmt_%.3s.xml", Language);
+    if (ThumbnailFromMeta(dir, xml, Path, Size))
+      return true;
+  }
+  if (ThumbnailFromMeta(dir, "bdmt_eng.xml", Path, Size))
+    return true;
+
+  DIR *d = opendir(dir);
+  if (!d)
+    return false;
+
+  bool found = false;
+  off_t largest = 0;
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL && !found) {
+    if (!strncmp(e->d_name, "bdmt_", 5) && strstr(e->d_name, ".xml"))
+      found = ThumbnailFromMeta(dir, e->d_name, Path, Size);
+  }
+  if (!found) {
+    // no meta file: the largest JPEG
+    rewinddir(d);
+    while ((e = readdir(d)) != NULL) {
+      const char *ext = strrchr(e->d_name, '.');
+      if (!ext || strcasecmp(ext, ".jpg"))
+        continue;
+      char file[1024];
+      struct stat st;
+      if (snprintf(file, sizeof(file), "%s/%s", dir, e->d_name) < (int)sizeof(file) && stat(file, &st) == 0 && st.st_size > largest) {
+        largest = st.st_size;
+        snprintf(Path, Size, "%s", file);
+        found = true;
+      }
+    }
+  }
+  closedir(d);
+  return found;
+}
+
+// --- JPEG decoding ----------------------------------------------------
+
+struct sJpegError {
+  struct jpeg_error_mgr pub;
+  jmp_buf jump;
+};
+
+static void JpegError(j_common_ptr Info)
+{
+  char msg[JMSG_LENGTH_MAX];
+  (*Info->err->format_message)(Info, msg);
+  syslog(LOG_ERR, "BluRay: JPEG: %s", msg);
+  longjmp(((sJpegError *)Info->err)->jump, 1);
+}
+
+uint32_t *BDDecodeJpeg(const char *File, int MaxWidth, int MaxHeight, int &Width, int &Height)
+{
+  FILE *fp = fopen(File, "rb");
+  if (!fp)
+    return NULL;
+
+  struct jpeg_decompress_struct cinfo;
+  sJpegError err;
+  // changed after setjmp()
+  uint8_t * volatile line = NULL;
+  uint32_t * volatile sums = NULL;
+  uint32_t * volatile argb = NULL;
+
+  cinfo.err = jpeg_std_error(&err.pub);
+  err.pub.error_exit = JpegError;
+  if (setjmp(err.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    free(line);
+    free(sums);
+    free(argb);
+    return NULL;
+  }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, fp);
+  jpeg_read_header(&cinfo, TRUE);
+
+  // let libjpeg do most of the scaling (DCT domain, 1/2 ... 1/8)
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = 1;
+  while (cinfo.scale_denom < 8 &&
+         cinfo.image_width / (cinfo.scale_denom * 2) >= (unsigned)MaxWidth &&
+         cinfo.image_height / (cinfo.scale_denom * 2) >= (unsigned)MaxHeight)
+    cinfo.scale_denom *= 2;
+  cinfo.dct_method = JDCT_IFAST;
+  jpeg_start_decompress(&cinfo);
+
+  int sw = cinfo.output_width, sh = cinfo.output_height;
+  if (sw * MaxHeight > sh * MaxWidth) {
+    Width = sw < MaxWidth ? sw : MaxWidth;
+    Height = sh * Width / sw;
+  } else {
+    Height = sh < MaxHeight ? sh : MaxHeight;
+    Width = sw * Height / sh;
+  }
+  if (Width < 1)  Width = 1;
+  if (Height < 1) Height = 1;
+
+  // box filter the rest: sum source lines into destination rows
+  line = (uint8_t *)malloc(sw * 3);
+  sums = (uint32_t *)malloc(Width * 4 * sizeof(uint32_t));
+  argb = (uint32_t *)malloc(Width * Height * sizeof(uint32_t));
+  if (!line || !sums || !argb)
+    longjmp(err.jump, 1);
+
+  uint32_t *d = argb;
+  int dy = 0;
+  memset(sums, 0, Width * 4 * sizeof(uint32_t));
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = line;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+    int sy = cinfo.output_scanline - 1;
+
+    for (int dx = 0, sx = 0; dx < Width; dx++) {
+      int sx1 = (dx + 1) * sw / Width;
+      uint32_t *s = sums + dx * 4;
+      for (; sx < sx1; sx++) {
+        s[0] += line[sx * 3];
+        s[1] += line[sx * 3 + 1];
+        s[2] += line[sx * 3 + 2];
+        s[3]++;
+      }
+    }
+
+    if (sy + 1 == (dy + 1) * sh / Height || sy + 1 == sh) {
+      for (int dx = 0; dx < Width; dx++) {
+        uint32_t *s = sums + dx * 4;
+        uint32_t n = s[3] ? s[3] : 1;
+        *d++ = 0xff000000 | ((s[0] / n) << 16) | ((s[1] / n) << 8) | (s[2] / n);
+      }
+      memset(sums, 0, Width * 4 * sizeof(uint32_t));
+      if (++dy >= Height)
+        break;
+    }
+  }
+  for (; dy < Height; dy++, d += Width)
+    memcpy(d, d - Width, Width * sizeof(uint32_t));
+
+  jpeg_abort_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  fclose(fp);
+  free(line);
+  free(sums);
+  return argb;
+}
+
+// --- thumbnail files --------------------------------------------------
+
+// header: magic, width, height (16 bit little endian), then RGB
+
+static uint32_t *ReadThumbnail(const char *File, int &Width, int &Height)
+{
+  FILE *fp = fopen(File, "rb");
+  if (!fp)
+    return NULL;
+
+  uint32_t *argb = NULL;
+  uint8_t hdr[12];
+  if (fread(hdr, 1, sizeof(hdr), fp) == sizeof(hdr) && !memcmp(hdr, THUMB_MAGIC, 8)) {
+    Width = hdr[8] | (hdr[9] << 8);
+    Height = hdr[10] | (hdr[11] << 8);
+    int n = Width * Height;
+    uint8_t *rgb = (uint8_t *)malloc(n * 3);
+    argb = (uint32_t *)malloc(n * sizeof(uint32_t));
+    if (n > 0 && rgb && argb && fread(rgb, 3, n, fp) == (size_t)n) {
+      for (int i = 0; i < n; i++)
+        argb[i] = 0xff000000 | (rgb[i * 3] << 16) | (rgb[i * 3 + 1] << 8) | rgb[i * 3 + 2];
+    } else {
+      free(argb);
+      argb = NULL;
+    }
+    free(rgb);
+  }
+  fclose(fp);
+  return argb;
+}
+
+static bool WriteThumbnail(const char *File, const uint32_t *Argb, int Width, int Height)
+{
+  char tmp[1040];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", File);
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp)
+    return false;
+
+  int n = Width * Height;
+  uint8_t hdr[12];
+  memcpy(hdr, THUMB_MAGIC, 8);
+  hdr[8]  = Width & 0xff;
+  hdr[9]  = Width >> 8;
+  hdr[10] = Height & 0xff;
+  hdr[11] = Height >> 8;
+  uint8_t *rgb = (uint8_t *)malloc(n * 3);
+  bool ok = rgb != NULL;
+  if (ok) {
+    for (int i = 0; i < n; i++) {
+      rgb[i * 3]     = Argb[i] >> 16;
+      rgb[i * 3 + 1] = Argb[i] >> 8;
+      rgb[i * 3 + 2] = Argb[i];
+    }
+    ok = fwrite(hdr, 1, sizeof(hdr), fp) == sizeof(hdr) && fwrite(rgb, 3, n, fp) == (size_t)n;
+    free(rgb);
+  }
+  ok = !fclose(fp) && ok;
+  if (ok && rename(tmp, File) == 0)
+    return true;
+  unlink(tmp);
+  return false;
+}
+
+// Remove thumbnails of older images of the same disc
+static void RemoveStale(const char *Dir, const char *Id, const char *Keep)
+{
+  DIR *d = opendir(Dir);
+  if (!d)
+    return;
+  int len = strlen(Id);
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    if (!strncmp(e->d_name, Id, len) && e->d_name[len] == '-' && strcmp(e->d_name, Keep)) {
+      char file[1024];
+      snprintf(file, sizeof(file), "%s/%s", Dir, e->d_name);
+      unlink(file);
+    }
+  }
+  closedir(d);
+}
+
+uint32_t *cBDCoverCache::Thumbnail(const char *Dir, const char *Root, const char *Language,
+                                   int MaxWidth, int MaxHeight, int &Width, int &Height, bool &Hit)
+{
+  Hit = false;
+
+  char image[1024];
+  struct stat st;
+  if (!BDCoverFile(Root, Language, image, sizeof(image)) || stat(image, &st))
+    return NULL;
+
+  char id[41];
+  char name[128];
+  char file[1024];
+  bool cache = Dir && BDDiscId(Root, id);
+  if (cache) {
+    snprintf(name, sizeof(name), "%s-%lx-%dx%d.thumb", id, (unsigned long)st.st_mtime, MaxWidth, MaxHeight);
+    snprintf(file, sizeof(file), "%s/%s", Dir, name);
+    uint32_t *argb = ReadThumbnail(file, Width, Height);
+    if (argb) {
+      Hit = true;
+      return argb;
+    }
+  }
+
+  uint32_t *argb = BDDecodeJpeg(image, MaxWidth, MaxHeight, Width, Height);
+  if (argb && cache) {
+    if (WriteThumbnail(file, argb, Width, Height))
+      RemoveStale(Dir, id, name);
+    else
+      syslog(LOG_ERR, "BluRay: can't write %s: %m", file);
+  }
+  return argb;
+}
+
+// --- cBDCoverCache ----------------------------------------------------
+
+cBDCoverCache::cBDCoverCache(const char *Dir, const char *Language, int MaxWidth, int MaxHeight)
+:cBDThread("BluRay covers")
+{
+  dir = Dir ? strdup(Dir) : NULL;
+  language = strdup(Language ? Language : "");
+  maxWidth = MaxWidth;
+  maxHeight = MaxHeight;
+  entries = NULL;
+  count = allocated = 0;
+  clock = 0;
+  generation = observed = 0;
+  hits = decodes = 0;
+}
+
+cBDCoverCache::~cBDCoverCache()
+{
+  Cancel();
+  for (int i = 0; i < count; i++) {
+    free(entries[i].root);
+    free(entries[i].argb);
+  }
+  free(entries);
+  free(dir);
+  free(language);
+}
+
+cBDCoverCache::sEntry *cBDCoverCache::Find(const char *Root)
+{
+  for (int i = 0; i < count; i++) {
+    if (!strcmp(entries[i].root, Root))
+      return &entries[i];
+  }
+  return NULL;
+}
+
+cBDCoverCache::sEntry *cBDCoverCache::Add(const char *Root)
+{
+  if (count == allocated) {
+    int n = allocated ? allocated * 2 : 64;
+    sEntry *e = (sEntry *)realloc(entries, n * sizeof(sEntry));
+    if (!e)
+      return NULL;
+    entries = e;
+    allocated = n;
+  }
+  sEntry *e = &entries[count++];
+  e->root = strdup(Root);
+  e->state = csQueued;
+  e->argb = NULL;
+  e->width = e->height = 0;
+  e->lastUse = ++clock;
+  e->completed = 0;
+  return e;
+}
+
+cBDCoverCache::sEntry *cBDCoverCache::Next(void)
+{
+  sEntry *next = NULL;
+  for (int i = 0; i < count; i++) {
+    if (entries[i].state == csQueued && (!next || entries[i].lastUse > next->lastUse))
+      next = &entries[i];
+  }
+  return next;
+}
+
+void cBDCoverCache::Evict(void)
+{
+  // drop pixels of the least recently used thumbnails, they are reloaded
+  // from disk when requested again; those not drawn yet stay
+  for (;;) {
+    int loaded = 0;
+    sEntry *oldest = NULL;
+    for (int i = 0; i < count; i++) {
+      if (entries[i].argb) {
+        loaded++;
+        if (entries[i].completed < observed && (!oldest || entries[i].lastUse < oldest->lastUse))
+          oldest = &entries[i];
+      }
+    }
+    if (loaded <= MEMORY_ENTRIES || !oldest)
+      break;
+    free(oldest->argb);
+    oldest->argb = NULL;
+    oldest->state = csUnknown;
+  }
+}
+
+int cBDCoverCache::Generation(void)
+{
+  cBDMutexLock lock(mutex);
+  observed = generation;
+  return generation;
+}
+
+void cBDCoverCache::Prefetch(const char *Root)
+{
+  cBDMutexLock lock(mutex);
+
+  sEntry *e = Find(Root);
+  if (!e)
+    e = Add(Root);
+  if (e) {
+    e->lastUse = ++clock;
+    if (e->state == csUnknown)
+      e->state = csQueued;
+    if (e->state == csQueued) {
+      if (!Active())
+        Start();
+      wake.Signal();
+    }
+  }
+}
+
+bool cBDCoverCache::Pending(const char *Root)
+{
+  cBDMutexLock lock(mutex);
+  sEntry *e = Find(Root);
+  return e && (e->state == csQueued || e->state == csBusy);
+}
+
+uint32_t *cBDCoverCache::Get(const char *Root, int &Width, int &Height)
+{
+  Prefetch(Root);
+
+  cBDMutexLock lock(mutex);
+  sEntry *e = Find(Root);
+  if (!e || e->state != csReady || !e->argb)
+    return NULL;
+
+  uint32_t *argb = (uint32_t *)malloc(e->width * e->height * sizeof(uint32_t));
+  if (argb) {
+    memcpy(argb, e->argb, e->width * e->height * sizeof(uint32_t));
+    Width = e->width;
+    Height = e->height;
+  }
+  return argb;
+}
+
+void cBDCoverCache::Action(void)
+{
+  mutex.Lock();
+  while (Running()) {
+    sEntry *e = Next();
+    if (!e) {
+      wake.TimedWait(mutex, 100);
+      continue;
+    }
+    e->state = csBusy;
+    char *root = strdup(e->root);
+    mutex.Unlock();
+
+    int w = 0, h = 0;
+    bool hit;
+    uint32_t *argb = Thumbnail(dir, root, language, maxWidth, maxHeight, w, h, hit);
+
+    mutex.Lock();
+    e = Find(root);
+    free(root);
+    if (hit)
+      hits++;
+    else if (argb)
+      decodes++;
+    if (e) {
+      e->state = argb ? csReady : csNone;
+      e->argb = argb;
+      e->width = w;
+      e->height = h;
+      e->completed = generation;
+      Evict();
+    } else
+      free(argb);
+    generation++;
+  }
+  mutex.Unlock();
+}
@@ -0,0 +1,95 @@
+/*
+ * bdcover.h: Disc cover art thumbnails
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDCOVER_H
+#define _BDCOVER_H
+
+#include <stdint.h>
+
+#include "bdthread.h"
+
+// Cover image of the disc (or BDMV folder) at Root: the largest thumbnail
+// listed in BDMV/META/DL/bdmt_<Language>.xml (then bdmt_eng.xml, then any
+// bdmt_*.xml), else the largest JPEG in BDMV/META/DL.
+bool BDCoverFile(const char *Root, const char *Language, char *Path, int Size);
+
+// Decode JPEG File, scaled down to fit MaxWidth x MaxHeight (aspect kept).
+// Returns ARGB pixels (free() them), NULL on error.
+uint32_t *BDDecodeJpeg(const char *File, int MaxWidth, int MaxHeight, int &Width, int &Height);
+
+// --- cBDCoverCache ----------------------------------------------------
+
+// Thumbnails of disc covers for the library menu. JPEGs are decoded and
+// scaled once, on a background thread, and stored in Dir as small RGB
+// files named after the disc fingerprint (BDDiscId) and the mtime of
+// the image; later requests only read the thumbnail file. Recently used
+// thumbnails are also kept in memory.
+//
+// Get() never blocks on decoding: a missing thumbnail is queued and
+// returned by a later call. The most recent requests are served first,
+// so the items on screen are done before those scrolled past.
+
+#define BD_COVER_WIDTH    320
+#define BD_COVER_HEIGHT   180
+
+class cBDCoverCache : public cBDThread {
+private:
+  enum eState { csUnknown, csQueued, csBusy, csReady, csNone };
+
+  struct sEntry {
+    char     *root;
+    eState    state;            // csUnknown: not loaded or evicted
+    uint32_t *argb;
+    int       width, height;
+    uint64_t  lastUse;
+    int       completed;        // generation of the thumbnail
+  };
+
+  char     *dir;
+  char     *language;
+  int       maxWidth, maxHeight;
+
+  cBDMutex   mutex;
+  cBDCondVar wake;
+  sEntry    *entries;
+  int        count, allocated;
+  uint64_t   clock;
+  int        generation;
+  int        observed;          // generation a reader has seen, newer thumbnails stay
+
+  sEntry *Find(const char *Root);
+  sEntry *Add(const char *Root);
+  sEntry *Next(void);
+  void    Evict(void);
+
+protected:
+  virtual void Action(void);
+
+public:
+  uint64_t hits, decodes;
+
+  cBDCoverCache(const char *Dir, const char *Language,
+                int MaxWidth = BD_COVER_WIDTH, int MaxHeight = BD_COVER_HEIGHT);
+  virtual ~cBDCoverCache();
+
+  // Copy of the thumbnail of the disc at Root (free() it), NULL if the
+  // disc has no cover or it is not ready yet (Pending() tells).
+  uint32_t *Get(const char *Root, int &Width, int &Height);
+  // Queue Root without waiting for the result
+  void Prefetch(const char *Root);
+  bool Pending(const char *Root);
+  // Changes whenever a thumbnail has been completed. Thumbnails completed
+  // after the last call are not evicted before they could be drawn.
+  int  Generation(void);
+
+  // Thumbnail of the disc at Root from the cache file in Dir, decoded
+  // (and stored) if there is none. Synchronous. Hit: read from the cache.
+  static uint32_t *Thumbnail(const char *Dir, const char *Root, const char *Language,
+                             int MaxWidth, int MaxHeight, int &Width, int &Height, bool &Hit);
+};
+
+#endif //_BDCOVER_H
@@ -0,0 +1,138 @@
+/*
+ * bddiscid.c: BluRay disc fingerprint
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bddiscid.h"
+
+// --- cSha1 ------------------------------------------------------------
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+cSha1::cSha1(void)
+{
+  state[0] = 0x67452301;
+  state[1] = 0xefcdab89;
+  state[2] = 0x98badcfe;
+  state[3] = 0x10325476;
+  state[4] = 0xc3d2e1f0;
+  length = 0;
+  fill = 0;
+}
+
+void cSha1::Transform(const uint8_t *Block)
+{
+  uint32_t w[80];
+
+  for (int i = 0; i < 16; i++)
+    w[i] = (Block[4*i] << 24) | (Block[4*i+1] << 16) | (Block[4*i+2] << 8) | Block[4*i+3];
+  for (int i = 16; i < 80; i++)
+    w[i] = ROL(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+  for (int i = 0; i < 80; i++) {
+    uint32_t f, k;
+    if (i < 20)      { f = (b & c) | (~b & d);           k = 0x5a827999; }
+    else if (i < 40) { f = b ^ c ^ d;                    k = 0x6ed9eba1; }
+    else if (i < 60) { f = (b & c) | (b & d) | (c & d);  k = 0x8f1bbcdc; }
+    else             { f = b ^ c ^ d;                    k = 0xca62c1d6; }
+    uint32_t t = ROL(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = ROL(b, 30);
+    b = a;
+    a = t;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+void cSha1::Update(const void *Data, size_t Length)
+{
+  const uint8_t *p = (const uint8_t *)Data;
+
+  length += Length;
+  while (Length > 0) {
+    size_t n = 64 - fill;
+    if (n > Length)
+      n = Length;
+    memcpy(block + fill, p, n);
+    fill += n;
+    p += n;
+    Length -= n;
+    if (fill == 64) {
+      Transform(block);
+      fill = 0;
+    }
+  }
+}
+
+void cSha1::Final(uint8_t Digest[20])
+{
+  uint64_t bits = length * 8;
+  uint8_t pad = 0x80;
+
+  Update(&pad, 1);
+  pad = 0;
+  while (fill != 56)
+    Update(&pad, 1);
+
+  uint8_t len[8];
+  for (int i = 0; i < 8; i++)
+    len[i] = bits >> (56 - 8 * i);
+  Update(len, 8);
+
+  for (int i = 0; i < 20; i++)
+    Digest[i] = state[i / 4] >> (24 - 8 * (i % 4));
+}
+
+// --- disc id ----------------------------------------------------------
+
+bool BDFileHash(const char *Root, const char * const *Files, char Hex[41])
+{
+  cSha1 sha;
+  bool found = false;
+
+  for (int i = 0; Files[i]; i++) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", Root, Files[i]);
+    FILE *f = fopen(path, "rb");
+    if (!f)
+      continue;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      sha.Update(buf, n);
+    fclose(f);
+    found = true;
+  }
+
+  if (!found)
+    return false;
+
+  uint8_t digest[20];
+  sha.Final(digest);
+  for (int i = 0; i < 20; i++)
+    sprintf(Hex + 2 * i, "%02x", digest[i]);
+  return true;
+}
+
+bool BDDiscId(const char *Root, char Id[41])
+{
+  static const char * const files[] = {
+    "BDMV/index.bdmv",
+    "BDMV/MovieObject.bdmv",
+    NULL
+  };
+  return BDFileHash(Root, files, Id);
+}
@@ -0,0 +1,39 @@
+/*
+ * bddiscid.h: BluRay disc fingerprint
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDDISCID_H
+#define _BDDISCID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// --- cSha1 ------------------------------------------------------------
+
+class cSha1 {
+private:
+  uint32_t state[5];
+  uint64_t length;
+  uint8_t  block[64];
+  int      fill;
+
+  void Transform(const uint8_t *Block);
+
+public:
+  cSha1(void);
+  void Update(const void *Data, size_t Length);
+  void Final(uint8_t Digest[20]);
+};
+
+// Hex string of SHA1 over the contents of Files (NULL terminated, relative to Root).
+// Returns false if none of the files can be read.
+bool BDFileHash(const char *Root, const char * const *Files, char Hex[41]);
+
+// Fingerprint of a disc (or BDMV folder) at Root, based on its navigation files.
+// The same disc gives the same id in any drive or mount point.
+bool BDDiscId(const char *Root, char Id[41]);
+
+#endif //_BDDISCID_H
@@ -0,0 +1,375 @@
+/*
+ * bdexport.c: Copy a BluRay title to a VDR recording
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <libbluray/bluray.h>
+
+#include <vdr/recording.h>
+#include <vdr/skins.h>
+#include <vdr/videodir.h>
+
+#include "bdcore.h"
+#include "bdindex.h"
+#include "bdplayer.h"
+#include "bdstats.h"
+#include "m2ts.h"
+
+#include "bdexport.h"
+
+#define EXPORT_BUFFER_SIZE  (160 * ALIGNED_UNIT_SIZE)  // ~1 MB per buffer
+#define EXPORT_WAIT_MS      10000                      // for playback to end
+
+/*
+ * cBDExportWriter
+ *
+ * Writes TS data to the recording. The reader fills one buffer while
+ * the other one is written; buffers are handed over, not copied.
+ * The recording is a single file (TS recordings may have up to 1 TB per
+ * file), so that the index can be built from the EP map.
+ */
+
+class cBDExportWriter : public cThread
+{
+ private:
+  struct sBuffer {
+    uint8_t *data;
+    int      length;
+    bool     full;
+  };
+
+  cString dir;
+
+  sBuffer buffers[2];
+  int     next;             // buffer the reader gets next
+  bool    eof, error;
+  cMutex  mutex;
+  cCondVar changed;
+
+ protected:
+  virtual void Action(void);
+
+ public:
+  cBDExportWriter(const char *Dir);
+  virtual ~cBDExportWriter();
+
+  // Reader side: get an empty buffer (NULL on write error / abort), pass it back filled
+  uint8_t *Get(void);
+  void Put(int Length);
+  // Wait until all data is written. Returns false on write error.
+  bool Finish(void);
+};
+
+cBDExportWriter::cBDExportWriter(const char *Dir) :
+    cThread("BluRay export writer")
+{
+  dir = Dir;
+  next = 0;
+  eof = error = false;
+  for (int i = 0; i < 2; i++) {
+    buffers[i].data = MALLOC(uint8_t, EXPORT_BUFFER_SIZE);
+    buffers[i].length = 0;
+    buffers[i].full = false;
+  }
+}
+
+cBDExportWriter::~cBDExportWriter()
+{
+  {
+    cMutexLock lock(&mutex);
+    eof = true;
+    changed.Broadcast();
+  }
+  Cancel(3);
+
+  for (int i = 0; i < 2; i++)
+    free(buffers[i].data);
+}
+
+uint8_t *cBDExportWriter::Get(void)
+{
+  cMutexLock lock(&mutex);
+  while (buffers[next].full && !error && Running())
+    changed.TimedWait(mutex, 100);
+  return error ? NULL : buffers[next].data;
+}
+
+void cBDExportWriter::Put(int Length)
+{
+  cMutexLock lock(&mutex);
+  buffers[next].length = Length;
+  buffers[next].full = true;
+  next ^= 1;
+  changed.Broadcast();
+}
+
+bool cBDExportWriter::Finish(void)
+{
+  {
+    cMutexLock lock(&mutex);
+    eof = true;
+    changed.Broadcast();
+  }
+  while (Active())
+    cCondWait::SleepMs(10);
+  return !error;
+}
+
+void cBDExportWriter::Action(void)
+{
+  cBDStats::Attach("export writer");
+
+  cFileName fileName(dir, true);
+  cUnbufferedFile *file = fileName.Open();
+  int current = 0;
+
+  if (!file) {
+    esyslog("BluRay export: can't create recording %s", *dir);
+    cMutexLock lock(&mutex);
+    error = true;
+    changed.Broadcast();
+    return;
+  }
+
+  while (Running()) {
+
+    sBuffer *b = &buffers[current];
+    {
+      cMutexLock lock(&mutex);
+      while (!b->full && !eof)
+        changed.TimedWait(mutex, 100);
+      if (!b->full)
+        break;
+    }
+
+    bool ok = file->Write(b->data, b->length) == b->length;
+    if (!ok)
+      LOG_ERROR_STR(fileName.Name());
+
+    cMutexLock lock(&mutex);
+    b->full = false;
+    if (!ok) {
+      error = true;
+      changed.Broadcast();
+      break;
+    }
+    current ^= 1;
+    changed.Broadcast();
+  }
+
+  fileName.Close();
+}
+
+/*
+ * cBDExport
+ */
+
+cMutex cBDExport::mutex;
+cBDExport *cBDExport::job = NULL;
+cList<cBDExport> cBDExport::cancelled;
+
+cBDExport::cBDExport(const char *Path, int Playlist, const char *Name) :
+    cThread("BluRay export")
+{
+  path = Path;
+  playlist = Playlist;
+  name = Name;
+  progress = 0;
+
+  char *n = ExchangeChars(strdup(Name), true);
+  time_t now = time(NULL);
+  struct tm tm_r;
+  struct tm *t = localtime_r(&now, &tm_r);
+  dir = cString::sprintf("%s/%s/%4d-%02d-%02d.%02d.%02d.0-0.rec", VideoDirectory, n,
+                         t->tm_year + 1900, t->tm_mon + 1, t->tm_mday, t->tm_hour, t->tm_min);
+  free(n);
+}
+
+cBDExport::~cBDExport()
+{
+  Cancel(10);
+}
+
+bool cBDExport::WriteInfo(const char *Title, double Fps)
+{
+  cString fileName = AddDirectory(dir, "info");
+  FILE *f = fopen(fileName, "w");
+  if (!f) {
+    LOG_ERROR_STR(*fileName);
+    return false;
+  }
+  fprintf(f, "T %s\n", Title);
+  fprintf(f, "D BluRay playlist %05d.mpls\n", playlist);
+  if (Fps > 0)
+    fprintf(f, "F %.6g\n", Fps);
+  fprintf(f, "P %d\n", Setup.DefaultPriority);
+  fprintf(f, "L %d\n", Setup.DefaultLifetime);
+  return fclose(f) == 0;
+}
+
+void cBDExport::WriteMarks(const BLURAY_TITLE_INFO *Info, cBDIndex &Index)
+{
+  cMarks marks;
+  marks.Load(dir, Index.FramesPerSecond(), false);
+  for (unsigned i = 0; i < Info->chapter_count; i++) {
+    if (Info->chapters[i].start > 0)
+      marks.Add(Index.FrameOf(Info->chapters[i].start));
+  }
+  marks.Save();
+}
+
+bool cBDExport::Copy(cBDCore *Core, cBDExportWriter *Writer)
+{
+  BLURAY *bd = Core->Handle();
+  uint64_t size = bd_get_title_size(bd);
+  uint8_t carry[M2TS_SIZE];
+  int carried = 0;
+  int reported = 0;
+
+  while (Running()) {
+
+    uint8_t *buf = Writer->Get();
+    if (!buf)
+      return false;
+
+    // partial packet from the previous read
+    memcpy(buf, carry, carried);
+    int length = carried;
+
+    while (length + ALIGNED_UNIT_SIZE <= EXPORT_BUFFER_SIZE && !Core->EndOfTitle() && Running()) {
+      int free = EXPORT_BUFFER_SIZE - length;
+      int r = Core->ReadUnit(buf + length, free - free % ALIGNED_UNIT_SIZE);
+      if (r < 0)
+        return false;
+      length += r;
+    }
+
+    int count = length / M2TS_SIZE;
+    carried = length % M2TS_SIZE;
+    memcpy(carry, buf + count * M2TS_SIZE, carried);
+
+    Writer->Put(M2tsToTs(buf, count, false));
+
+    if (size > 0) {
+      progress = bd_tell(bd) * 1000 / size;
+      if (progress / 100 > reported) {
+        reported = progress / 100;
+        Skins.QueueMessage(mtInfo, cString::sprintf(tr("BluRay copy: %d%%"), reported * 10));
+      }
+    }
+
+    if (Core->EndOfTitle())
+      return true;
+  }
+
+  return false;
+}
+
+void cBDExport::Action(void)
+{
+  cBDStats::Attach("export");
+
+  // a second handle on the playing disc would make the drive seek between both
+  for (int waited = 0; cBDControl::Active(); waited += 100) {
+    if (!Running())
+      return;
+    if (waited >= EXPORT_WAIT_MS) {
+      esyslog("BluRay export: disc still playing");
+      Skins.QueueMessage(mtError, tr("BluRay copy failed"));
+      return;
+    }
+    cCondWait::SleepMs(100);
+  }
+
+  cBDCore *core = cBDCore::OpenPlaylist(path, playlist);
+  BLURAY_TITLE_INFO *info = core ? bd_get_playlist_info(core->Handle(), playlist, 0) : NULL;
+  cBDIndex index;
+  if (!info || !index.Build(core->Handle(), info)) {
+    esyslog("BluRay export: can't open playlist %05d", playlist);
+    Skins.QueueMessage(mtError, tr("BluRay copy failed"));
+    if (info)
+      bd_free_title_info(info);
+    delete core;
+    return;
+  }
+
+  bool ok = MakeDirs(dir, true) && WriteInfo(name, index.FramesPerSecond());
+  if (ok) {
+    isyslog("BluRay export: %05d.mpls -> %s", playlist, *dir);
+    Skins.QueueMessage(mtInfo, tr("BluRay copy started"));
+
+    cBDExportWriter writer(dir);
+    writer.Start();
+    ok = Copy(core, &writer);
+    ok = writer.Finish() && ok;
+  }
+
+  if (ok)
+    ok = index.WriteVdrIndex(AddDirectory(dir, "index"));
+
+  if (ok) {
+    WriteMarks(info, index);
+    Recordings.AddByName(dir);
+    isyslog("BluRay export: %s done", *dir);
+    Skins.QueueMessage(mtInfo, tr("BluRay copy finished"));
+  } else {
+    RemoveFileOrDir(dir);
+    esyslog("BluRay export: %s failed", *dir);
+    Skins.QueueMessage(mtError, tr("BluRay copy failed"));
+  }
+
+  bd_free_title_info(info);
+  delete core;
+}
+
+bool cBDExport::Start(const char *Path, int Playlist, const char *DiscName)
+{
+  cMutexLock lock(&mutex);
+  Collect();
+
+  if (job && job->Active())
+    return false;
+  delete job;
+
+  job = new cBDExport(Path, Playlist, cString::sprintf("%s - %05d", DiscName, Playlist));
+  return job->cThread::Start();
+}
+
+void cBDExport::Collect(void)
+{
+  cBDExport *e = cancelled.First();
+  while (e) {
+    cBDExport *next = cancelled.Next(e);
+    if (!e->Active())
+      cancelled.Del(e);
+    e = next;
+  }
+}
+
+void cBDExport::Abort(void)
+{
+  cMutexLock lock(&mutex);
+  Collect();
+  if (job && job->Active()) {
+    // ends at the next buffer and removes the recording
+    job->Cancel(-1);
+    cancelled.Add(job);
+    job = NULL;
+  }
+}
+
+void cBDExport::Stop(void)
+{
+  cMutexLock lock(&mutex);
+  // the destructors wait
+  DELETENULL(job);
+  cancelled.Clear();
+}
+
+int cBDExport::Progress(void)
+{
+  cMutexLock lock(&mutex);
+  return job && job->Active() ? job->progress : -1;
+}
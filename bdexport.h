@@ -0,0 +1,55 @@
+/*
+ * bdexport.h: Copy a BluRay title to a VDR recording
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDEXPORT_H
+#define _BDEXPORT_H
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+class cBDCore;
+class cBDExportWriter;
+class cBDIndex;
+
+class cBDExport : public cThread, public cListObject {
+private:
+  static cMutex mutex;
+  static cBDExport *job;
+  static cList<cBDExport> cancelled;  // still running
+
+  static void Collect(void);
+
+  cString path;
+  int playlist;
+  cString name;
+  cString dir;
+  volatile int progress;   // 1/1000
+
+  cBDExport(const char *Path, int Playlist, const char *Name);
+
+  bool Copy(cBDCore *Core, cBDExportWriter *Writer);
+  bool WriteInfo(const char *Title, double Fps);
+  void WriteMarks(const struct bd_title_info *Info, cBDIndex &Index);
+
+protected:
+  virtual void Action(void);
+
+public:
+  virtual ~cBDExport();
+
+  // Start copying Playlist of disc at Path into a new recording, once
+  // playback has ended. Only one copy can run at a time.
+  static bool Start(const char *Path, int Playlist, const char *DiscName);
+  // Abort running copy, don't wait (the partial recording is removed)
+  static void Abort(void);
+  // Wait for the running and aborted copies (plugin shutdown)
+  static void Stop(void);
+  // Progress in 1/1000, -1 if no copy is running
+  static int Progress(void);
+};
+
+#endif //_BDEXPORT_H
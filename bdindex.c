@@ -0,0 +1,180 @@
+/*
+ * bdindex.c: Frame index of a playlist from the clip EP maps
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+
+#include "bdcore.h"
+#include "m2ts.h"
+
+#include "bdindex.h"
+
+cBDIndex::cBDIndex(void)
+{
+  entries = NULL;
+  count = allocated = 0;
+  fps = 25;
+  frames = 0;
+}
+
+cBDIndex::~cBDIndex()
+{
+  free(entries);
+}
+
+void cBDIndex::Clear(void)
+{
+  count = 0;
+  frames = 0;
+}
+
+void cBDIndex::Add(uint64_t Time, uint64_t Offset)
+{
+  if (count == allocated) {
+    allocated = allocated ? 2 * allocated : 1024;
+    entries = (sBDIndexEntry *)realloc(entries, allocated * sizeof(sBDIndexEntry));
+  }
+  entries[count].time = Time;
+  entries[count].offset = Offset;
+  count++;
+}
+
+const CLPI_EP_MAP_ENTRY *BDVideoEpMap(const CLPI_CL *Cl, uint16_t Pid)
+{
+  if (Cl->cpi.num_stream_pid < 1)
+    return NULL;
+  for (int i = 0; i < Cl->cpi.num_stream_pid; i++) {
+    if (Cl->cpi.entry[i].pid == Pid)
+      return &Cl->cpi.entry[i];
+  }
+  return &Cl->cpi.entry[0];
+}
+
+void BDEpEntry(const CLPI_EP_MAP_ENTRY *Ep, int Coarse, int Fine, uint64_t &Pts, uint32_t &Spn)
+{
+  // EP map time stamps are 45kHz
+  uint64_t pts = ((uint64_t)(Ep->coarse[Coarse].pts_ep & ~0x01) << 18) + ((uint64_t)Ep->fine[Fine].pts_ep << 8);
+  Pts = pts * 2;
+  Spn = (Ep->coarse[Coarse].spn_ep & ~0x1ffff) + Ep->fine[Fine].spn_ep;
+}
+
+bool cBDIndex::Build(BLURAY *Bd, const BLURAY_TITLE_INFO *Info)
+{
+  Clear();
+  if (!Info)
+    return false;
+
+  fps = cBDCore::FramesPerSecond(Info);
+  if (fps <= 0)
+    fps = 25;
+  frames = FrameOf(Info->duration);
+
+  uint64_t base = 0;
+
+  for (unsigned i = 0; i < Info->clip_count; i++) {
+    const BLURAY_CLIP_INFO &clip = Info->clips[i];
+    uint16_t pid = clip.video_stream_count ? clip.video_streams[0].pid : 0x1011;
+
+    CLPI_CL *cl = bd_get_clpi(Bd, i);
+    const CLPI_EP_MAP_ENTRY *ep = cl ? BDVideoEpMap(cl, pid) : NULL;
+
+    if (ep) {
+      // the clip is read from the last entry point at or before in_time
+      uint32_t startSpn = 0;
+      int c = 0;
+      for (int pass = 0; pass < 2; pass++) {
+        c = 0;
+        for (int f = 0; f < ep->num_ep_fine; f++) {
+          while (c + 1 < ep->num_ep_coarse && ep->coarse[c + 1].ref_ep_fine_id <= f)
+            c++;
+          uint64_t pts;
+          uint32_t spn;
+          BDEpEntry(ep, c, f, pts, spn);
+          if (pass == 0) {
+            if (pts > clip.in_time)
+              break;
+            startSpn = spn;
+          } else if (pts >= clip.in_time && pts < clip.out_time && spn >= startSpn) {
+            Add(clip.start_time + pts - clip.in_time, base + (uint64_t)(spn - startSpn) * M2TS_SIZE);
+          }
+        }
+      }
+    } else {
+      syslog(LOG_INFO, "BluRay: no EP map for clip %s", clip.clip_id);
+    }
+
+    if (cl)
+      bd_free_clpi(cl);
+
+    base += (uint64_t)clip.pkt_count * M2TS_SIZE;
+  }
+
+  syslog(LOG_INFO, "BluRay: index %05d.mpls: %d entry points, %d frames at %.3f fps",
+         Info->playlist, count, frames, fps);
+  return count > 0;
+}
+
+int cBDIndex::EntryAt(uint64_t Time)
+{
+  int lo = 0, hi = count - 1, found = -1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (entries[mid].time <= Time) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+// VDR's tIndexTs
+struct tIndexTs {
+  uint64_t offset:40;
+  int reserved:7;
+  int independent:1;
+  uint16_t number:16;
+};
+
+bool cBDIndex::WriteVdrIndex(const char *FileName)
+{
+  if (!count)
+    return false;
+
+  FILE *f = fopen(FileName, "wb");
+  if (!f) {
+    syslog(LOG_ERR, "ERROR: can't write %s: %m", FileName);
+    return false;
+  }
+
+  int e = 0;
+  for (int frame = 0; frame < frames; frame++) {
+    uint64_t t = TimeOf(frame);
+    while (e + 1 < count && entries[e + 1].time <= t)
+      e++;
+
+    // TS offset of m2ts packet. Only entry points have known offsets:
+    // frames up to the next one repeat the offset of their I-frame, so
+    // replay from any frame starts where it can be decoded
+    uint64_t packet = entries[e].offset / M2TS_SIZE;
+    bool independent = FrameOf(entries[e].time) == frame;
+
+    tIndexTs i;
+    i.offset = packet * TS_SIZE;
+    i.reserved = 0;
+    i.independent = independent;
+    i.number = 1;
+    if (fwrite(&i, sizeof(i), 1, f) != 1) {
+      fclose(f);
+      return false;
+    }
+  }
+
+  return fclose(f) == 0;
+}
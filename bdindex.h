@@ -0,0 +1,62 @@
+/*
+ * bdindex.h: Frame index of a playlist from the clip EP maps
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDINDEX_H
+#define _BDINDEX_H
+
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+#include <libbluray/clpi_data.h>
+
+// EP map of the video stream with Pid (the first map if not found), NULL if none
+const CLPI_EP_MAP_ENTRY *BDVideoEpMap(const CLPI_CL *Cl, uint16_t Pid);
+// Time (90kHz) and source packet number of fine entry Fine in coarse entry Coarse
+void BDEpEntry(const CLPI_EP_MAP_ENTRY *Ep, int Coarse, int Fine, uint64_t &Pts, uint32_t &Spn);
+
+// Entry points (I-frames) of a playlist, read from the CLPI files.
+// Building the index does not touch the stream files.
+
+struct sBDIndexEntry {
+  uint64_t time;      // 90kHz ticks from title start
+  uint64_t offset;    // byte offset in the title stream (m2ts packets)
+};
+
+class cBDIndex {
+private:
+  sBDIndexEntry *entries;
+  int    count, allocated;
+  double fps;
+  int    frames;
+
+  void Add(uint64_t Time, uint64_t Offset);
+
+public:
+  cBDIndex(void);
+  ~cBDIndex();
+
+  void Clear(void);
+  // Build index for the playlist described by Info (from bd_get_playlist_info())
+  bool Build(BLURAY *Bd, const BLURAY_TITLE_INFO *Info);
+
+  double FramesPerSecond(void) { return fps; }
+  int    Frames(void)          { return frames; }
+  int    Count(void)           { return count; }
+  const sBDIndexEntry &Entry(int Index) { return entries[Index]; }
+
+  int      FrameOf(uint64_t Time) { return int(Time * fps / 90000 + 0.5); }
+  uint64_t TimeOf(int Frame)      { return uint64_t(Frame * 90000 / fps); }
+  // Last entry at or before Time, -1 if none
+  int  EntryAt(uint64_t Time);
+
+  // Write a VDR TS index (one entry per frame) for a TS copy of the
+  // complete title stream in a single file. Frames between entry points
+  // get the offset of the preceding entry point (their I-frame).
+  bool WriteVdrIndex(const char *FileName);
+};
+
+#endif //_BDINDEX_H
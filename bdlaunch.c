@@ -0,0 +1,233 @@
+/*
+ * bdlaunch.c: Starting playback in the background
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <vdr/i18n.h>
+#include <vdr/player.h>
+#include <vdr/skins.h>
+#include <vdr/thread.h>
+
+#include "bdplayer.h"
+#include "bdstats.h"
+#include "discmgr.h"
+
+#include "bdlaunch.h"
+
+#define CANCEL_WAIT_S  5   // bd_open() of a slow drive at shutdown
+
+/*
+ * cBDLaunch
+ *
+ * The worker. Stage times are kept in microseconds; a stage entered
+ * again (disc menus not available, main title instead) adds up.
+ */
+
+class cBDLaunch : public cThread, public cListObject, public cBDOpenListener
+{
+ private:
+  cString path, device;
+  cDiscMgr *drive;
+
+  cMutex mutex;
+  eBDOpenStage stage;        // boCount: finished
+  uint64_t since;            // start of the current stage
+  uint64_t spent[boCount];
+  cBDPlayer *player;
+
+  void Enter(eBDOpenStage Stage);
+
+ protected:
+  virtual void Action(void);
+
+ public:
+  cBDLaunch(const char *Path, const char *Device, cDiscMgr *Drive);
+  virtual ~cBDLaunch();
+
+  // cBDOpenListener
+  virtual void OpenStage(eBDOpenStage Stage) { Enter(Stage); }
+  virtual bool OpenCancelled(void) { return !Running(); }
+
+  // Current stage (boCount: finished) and the times spent so far
+  eBDOpenStage Progress(uint64_t *Spent);
+  // The opened player once finished, NULL on failure (takes ownership)
+  cBDPlayer *Player(void);
+  // Give up at the next stage, don't wait
+  void Abort(void) { Cancel(-1); }
+};
+
+cBDLaunch::cBDLaunch(const char *Path, const char *Device, cDiscMgr *Drive) :
+    cThread("BluRay launch")
+{
+  path = Path;
+  device = Device;
+  drive = Drive;
+  stage = boMount;
+  since = cBDStats::Now();
+  for (int i = 0; i < boCount; i++)
+    spent[i] = 0;
+  player = NULL;
+}
+
+cBDLaunch::~cBDLaunch()
+{
+  Cancel(CANCEL_WAIT_S);
+  if (player)
+    cBDControl::Close(player);
+}
+
+void cBDLaunch::Enter(eBDOpenStage Stage)
+{
+  cMutexLock lock(&mutex);
+  uint64_t now = cBDStats::Now();
+  if (stage < boCount)
+    spent[stage] += now - since;
+  stage = Stage;
+  since = now;
+}
+
+eBDOpenStage cBDLaunch::Progress(uint64_t *Spent)
+{
+  cMutexLock lock(&mutex);
+  for (int i = 0; i < boCount; i++)
+    Spent[i] = spent[i];
+  if (stage < boCount)
+    Spent[stage] += cBDStats::Now() - since;
+  return stage;
+}
+
+cBDPlayer *cBDLaunch::Player(void)
+{
+  cMutexLock lock(&mutex);
+  cBDPlayer *p = stage == boCount ? player : NULL;
+  if (p)
+    player = NULL;
+  return p;
+}
+
+void cBDLaunch::Action(void)
+{
+  cBDPlayer *p = NULL;
+
+  if (!drive || drive->CheckDisc())
+    p = cBDControl::Open(path, device, this);
+
+  if (p && !Running()) {
+    cBDControl::Close(p);
+    p = NULL;
+  }
+
+  Enter(boCount);
+
+  cMutexLock lock(&mutex);
+  player = p;
+  isyslog("BluRay: %s %s after %.1f s (mount %.1f s, open %.1f s, titles %.1f s, first data %.1f s)",
+          *path, p ? "opened" : Running() ? "failed" : "cancelled",
+          (spent[boMount] + spent[boOpen] + spent[boTitles] + spent[boFirstData]) / 1e6,
+          spent[boMount] / 1e6, spent[boOpen] / 1e6, spent[boTitles] / 1e6, spent[boFirstData] / 1e6);
+}
+
+/*
+ * cBDLaunchMenu
+ */
+
+static const char *stageNames[boCount] = {
+  trNOOP("Mounting disc"),
+  trNOOP("Opening disc"),
+  trNOOP("Reading titles"),
+  trNOOP("Reading first data"),
+};
+
+cList<cBDLaunch> cBDLaunchMenu::cancelled;
+
+cBDLaunchMenu::cBDLaunchMenu(const char *Path, const char *Device, cDiscMgr *Drive) :
+    cOsdMenu(tr("Starting BluRay playback"), 24)
+{
+  SetNeedsFastResponse(true);
+  Collect();
+
+  // two players would read the same drive
+  if (cBDControl::Active())
+    cControl::Shutdown();
+
+  path = Path;
+  for (int i = 0; i < boCount; i++) {
+    items[i] = NULL;
+    if (i != boMount || Drive)
+      Add(items[i] = new cOsdItem("", osUnknown, false));
+  }
+
+  launch = new cBDLaunch(Path, Device, Drive);
+  launch->Start();
+  Update(false);
+}
+
+cBDLaunchMenu::~cBDLaunchMenu()
+{
+  if (launch) {
+    if (launch->Active()) {
+      launch->Abort();
+      cancelled.Add(launch);
+    } else
+      delete launch;
+  }
+}
+
+void cBDLaunchMenu::Collect(void)
+{
+  cBDLaunch *l = cancelled.First();
+  while (l) {
+    cBDLaunch *next = cancelled.Next(l);
+    if (!l->Active())
+      cancelled.Del(l);
+    l = next;
+  }
+}
+
+void cBDLaunchMenu::Stop(void)
+{
+  // the destructors wait
+  cancelled.Clear();
+}
+
+bool cBDLaunchMenu::Update(bool Redraw)
+{
+  uint64_t spent[boCount];
+  eBDOpenStage stage = launch->Progress(spent);
+
+  for (int i = 0; i < boCount; i++) {
+    if (!items[i])
+      continue;
+    cString time = "";
+    if (i == stage)
+      time = cString::sprintf("%.1f s ...", spent[i] / 1e6);
+    else if (i < stage)
+      time = spent[i] ? *cString::sprintf("%.1f s", spent[i] / 1e6) : "-";
+    items[i]->SetText(cString::sprintf("%s\t%s", tr(stageNames[i]), *time));
+    if (Redraw)
+      DisplayItem(items[i]);
+  }
+  return stage == boCount;
+}
+
+eOSState cBDLaunchMenu::ProcessKey(eKeys Key)
+{
+  eOSState state = cOsdMenu::ProcessKey(Key);
+  if (state != osUnknown)
+    return state;
+
+  if (!Update(true))
+    return osContinue;
+
+  cBDPlayer *player = launch->Player();
+  if (!player) {
+    Skins.Message(mtError, tr("Can't open BluRay disc!"));
+    return osBack;
+  }
+
+  cControl::Shutdown();
+  cControl::Launch(cBDControl::Create(player, path));
+  return osEnd;
+}
@@ -0,0 +1,51 @@
+/*
+ * bdlaunch.h: Starting playback in the background
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDLAUNCH_H
+#define _BDLAUNCH_H
+
+#include <vdr/osdbase.h>
+#include <vdr/tools.h>
+
+#include "bdcore.h"
+
+class cBDLaunch;
+class cDiscMgr;
+
+/*
+ * cBDLaunchMenu
+ *
+ * Opens a disc on a worker thread (mounting, bd_open(), the title scan
+ * and the first read) and shows each stage with the time spent in it.
+ * The replay control is launched once the first data is buffered. Back
+ * cancels, the worker then finishes its stage and closes the disc.
+ */
+
+class cBDLaunchMenu : public cOsdMenu {
+ private:
+  static cList<cBDLaunch> cancelled;   // still running
+
+  cBDLaunch *launch;
+  cString path;
+  cOsdItem *items[boCount];
+
+  static void Collect(void);
+  bool Update(bool Redraw);  // true: finished
+
+ public:
+  // Device: the drive Path is on (NULL for discs in the library).
+  // Drive: mount it first (NULL: Path is mounted).
+  cBDLaunchMenu(const char *Path, const char *Device = NULL, cDiscMgr *Drive = NULL);
+  virtual ~cBDLaunchMenu();
+
+  virtual eOSState ProcessKey(eKeys Key);
+
+  // Wait for cancelled launches (plugin shutdown)
+  static void Stop(void);
+};
+
+#endif //_BDLAUNCH_H
@@ -0,0 +1,515 @@
+/*
+ * bdlibrary.c: Disc library index
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+
+#include "bdlibrary.h"
+
+// --- T9 keys ----------------------------------------------------------
+
+static char KeyOf(char c)
+{
+  static const char digits[] = "22233344455566677778889999";  // a ... z
+  if (c >= 'a' && c <= 'z')
+    return digits[c - 'a'];
+  if (c >= 'A' && c <= 'Z')
+    return digits[c - 'A'];
+  if (c >= '0' && c <= '9')
+    return c;
+  return 0;
+}
+
+void cBDLibrary::Keys(const char *Text, char *Key, int Size)
+{
+  // U+00C0 ... U+00FF as base letters, '.' if none
+  static const char latin1[] = "AAAAAAACEEEEIIIIDNOOOOO.OUUUUYTsaaaaaaaceeeeiiiidnooooo.ouuuuyty";
+
+  int n = 0;
+  for (const unsigned char *p = (const unsigned char *)Text; *p && n < Size - 1; p++) {
+    char c = *p;
+    if (p[0] == 0xc3 && p[1] >= 0x80 && p[1] <= 0xbf)
+      c = latin1[*++p - 0x80];
+    else if (*p >= 0x80)
+      continue;  // other UTF-8 bytes
+    if ((c = KeyOf(c)) != 0)
+      Key[n++] = c;
+  }
+  Key[n] = 0;
+}
+
+// --- sorting ----------------------------------------------------------
+
+struct sSortItem {
+  const char *group;
+  const char *text;
+  int64_t     value;
+  int         entry;
+};
+
+static int CompareItems(const void *A, const void *B)
+{
+  const sSortItem *a = (const sSortItem *)A, *b = (const sSortItem *)B;
+  int r;
+  if (a->group && (r = strcmp(a->group, b->group)) != 0)
+    return r;
+  if (a->value != b->value)
+    return a->value < b->value ? -1 : 1;
+  if ((r = strcasecmp(a->text, b->text)) != 0)
+    return r;
+  return a->entry - b->entry;
+}
+
+static uint32_t HashRoot(const char *Root)
+{
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)Root; *p; p++)
+    h = (h ^ *p) * 16777619u;
+  return h;
+}
+
+static int CompareRanked(const void *A, const void *B)
+{
+  uint64_t a = *(const uint64_t *)A, b = *(const uint64_t *)B;
+  return a < b ? -1 : a > b;
+}
+
+// --- cBDLibrary -------------------------------------------------------
+
+cBDLibrary::cBDLibrary(void)
+{
+  arena = NULL;
+  arenaUsed = arenaSize = 0;
+  entries = NULL;
+  count = allocated = 0;
+  memset(order, 0, sizeof(order));
+  memset(rank, 0, sizeof(rank));
+  byKey = NULL;
+  byRoot = NULL;
+  byRootSize = 0;
+  sort = lsTitle;
+  group = false;
+  search[0] = 0;
+  keyFirst = keyLast = 0;
+  rows = rowBuffer = NULL;
+  rowCount = 0;
+  rowsValid = false;
+}
+
+cBDLibrary::~cBDLibrary()
+{
+  Clear();
+}
+
+void cBDLibrary::Clear(void)
+{
+  for (int s = 0; s < BD_LIBRARY_SORTS; s++)
+    Invalidate(s);
+  free(arena);
+  free(entries);
+  free(rowBuffer);
+  free(byKey);
+  free(byRoot);
+  arena = NULL;
+  arenaUsed = arenaSize = 0;
+  entries = NULL;
+  byKey = byRoot = NULL;
+  byRootSize = 0;
+  count = allocated = 0;
+  rows = rowBuffer = NULL;
+  rowCount = 0;
+  search[0] = 0;
+}
+
+void cBDLibrary::Invalidate(int Sort)
+{
+  for (int g = 0; g < 2; g++) {
+    free(order[Sort][g]);
+    free(rank[Sort][g]);
+    order[Sort][g] = rank[Sort][g] = NULL;
+  }
+  rowsValid = false;
+}
+
+size_t cBDLibrary::Memory(void) const
+{
+  size_t size = arenaSize + allocated * sizeof(sEntry);
+  for (int s = 0; s < BD_LIBRARY_SORTS; s++) {
+    for (int g = 0; g < 2; g++) {
+      if (order[s][g])
+        size += 2 * count * sizeof(int);
+    }
+  }
+  if (byKey)
+    size += count * sizeof(int);
+  if (byRoot)
+    size += byRootSize * sizeof(int);
+  if (rowBuffer)
+    size += 2 * count * sizeof(int);
+  return size;
+}
+
+uint32_t cBDLibrary::Store(const char *String)
+{
+  size_t len = strlen(String) + 1;
+  if (arenaUsed + len > arenaSize) {
+    size_t size = arenaSize ? arenaSize : 65536;
+    while (arenaUsed + len > size)
+      size *= 2;
+    char *a = (char *)realloc(arena, size);
+    if (!a)
+      return UINT32_MAX;
+    arena = a;
+    arenaSize = size;
+  }
+  uint32_t offset = arenaUsed;
+  memcpy(arena + arenaUsed, String, len);
+  arenaUsed += len;
+  return offset;
+}
+
+int cBDLibrary::Add(const char *Root, const char *Folder, const char *Title, time_t Added, int Runtime)
+{
+  if (count == allocated) {
+    int n = allocated ? allocated * 2 : 1024;
+    sEntry *e = (sEntry *)realloc(entries, n * sizeof(sEntry));
+    if (!e)
+      return -1;
+    entries = e;
+    allocated = n;
+    free(rowBuffer);  // sized for allocated
+    rowBuffer = NULL;
+  }
+
+  char key[256];
+  Keys(Title, key, sizeof(key));
+
+  sEntry &e = entries[count];
+  // discs of a folder are added one after the other: share the folder name
+  if (count > 0 && !strcmp(Text(entries[count - 1].folder), Folder))
+    e.folder = entries[count - 1].folder;
+  else
+    e.folder = Store(Folder);
+  e.root = Store(Root);
+  e.title = Store(Title);
+  e.key = Store(key);
+  if (e.folder == UINT32_MAX || e.root == UINT32_MAX || e.title == UINT32_MAX || e.key == UINT32_MAX) {
+    syslog(LOG_ERR, "BluRay: no memory for the library index");
+    return -1;
+  }
+  e.added = Added;
+  e.runtime = Runtime;
+
+  for (int s = 0; s < BD_LIBRARY_SORTS; s++)
+    Invalidate(s);
+  free(byKey);
+  byKey = NULL;
+  free(byRoot);
+  byRoot = NULL;
+  return count++;
+}
+
+bool cBDLibrary::SetTitle(int Entry, const char *Title)
+{
+  if (!strcmp(Text(entries[Entry].title), Title))
+    return false;
+
+  // the old strings stay in the arena until Clear()
+  char key[256];
+  Keys(Title, key, sizeof(key));
+  uint32_t title = Store(Title), k = Store(key);
+  if (title == UINT32_MAX || k == UINT32_MAX)
+    return false;
+  entries[Entry].title = title;
+  entries[Entry].key = k;
+
+  // titles break ties in all orders
+  for (int s = 0; s < BD_LIBRARY_SORTS; s++)
+    Invalidate(s);
+  free(byKey);
+  byKey = NULL;
+  return true;
+}
+
+bool cBDLibrary::SetRuntime(int Entry, int Runtime)
+{
+  if (entries[Entry].runtime == Runtime)
+    return false;
+  entries[Entry].runtime = Runtime;
+  Invalidate(lsRuntime);
+  return true;
+}
+
+void cBDLibrary::MakeOrder(int Sort, bool Group)
+{
+  int g = Group;
+  if (order[Sort][g])
+    return;
+
+  sSortItem *items = (sSortItem *)malloc(count * sizeof(sSortItem));
+  int *o = (int *)malloc(count * sizeof(int));
+  int *r = (int *)malloc(count * sizeof(int));
+  if (!items || !o || !r) {
+    free(items);
+    free(o);
+    free(r);
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    const sEntry &e = entries[i];
+    sSortItem &it = items[i];
+    it.group = Group ? Text(e.folder) : NULL;
+    it.text = Text(e.title);
+    it.entry = i;
+    switch (Sort) {
+      case lsAdded:   it.value = -(int64_t)e.added; break;                      // newest first
+      case lsRuntime: it.value = e.runtime >= 0 ? e.runtime : INT64_MAX; break;  // unknown last
+      default:        it.value = 0; break;
+    }
+  }
+  qsort(items, count, sizeof(sSortItem), CompareItems);
+
+  for (int i = 0; i < count; i++) {
+    o[i] = items[i].entry;
+    r[items[i].entry] = i;
+  }
+  free(items);
+  order[Sort][g] = o;
+  rank[Sort][g] = r;
+}
+
+void cBDLibrary::MakeKeys(void)
+{
+  if (byKey)
+    return;
+
+  sSortItem *items = (sSortItem *)malloc(count * sizeof(sSortItem));
+  byKey = (int *)malloc(count * sizeof(int));
+  if (!items || !byKey) {
+    free(items);
+    free(byKey);
+    byKey = NULL;
+    return;
+  }
+  for (int i = 0; i < count; i++) {
+    items[i].group = NULL;
+    items[i].text = Text(entries[i].key);
+    items[i].value = 0;
+    items[i].entry = i;
+  }
+  qsort(items, count, sizeof(sSortItem), CompareItems);
+  for (int i = 0; i < count; i++)
+    byKey[i] = items[i].entry;
+  free(items);
+
+  // the range of the current search is recomputed
+  char digits[sizeof(search)];
+  strcpy(digits, search);
+  search[0] = 0;
+  keyFirst = 0;
+  keyLast = count;
+  if (*digits && !Search(digits))
+    search[0] = 0;
+}
+
+void cBDLibrary::MakeRoots(void)
+{
+  if (byRoot)
+    return;
+
+  // at most half full
+  int size = 16;
+  while (size < 2 * count)
+    size *= 2;
+  byRoot = (int *)malloc(size * sizeof(int));
+  if (!byRoot)
+    return;
+  memset(byRoot, 0xff, size * sizeof(int));
+  byRootSize = size;
+  for (int n = 0; n < count; n++) {
+    uint32_t i = HashRoot(Root(n)) & (size - 1);
+    while (byRoot[i] >= 0)
+      i = (i + 1) & (size - 1);
+    byRoot[i] = n;
+  }
+}
+
+int cBDLibrary::FindRoot(const char *Root)
+{
+  MakeRoots();
+  if (!byRoot)
+    return -1;
+  for (uint32_t i = HashRoot(Root) & (byRootSize - 1); byRoot[i] >= 0; i = (i + 1) & (byRootSize - 1)) {
+    if (!strcmp(Text(entries[byRoot[i]].root), Root))
+      return byRoot[i];
+  }
+  return -1;
+}
+
+bool cBDLibrary::Search(const char *Digits)
+{
+  int len = strlen(Digits);
+  if (len >= (int)sizeof(search))
+    return false;
+
+  if (!len) {
+    search[0] = 0;
+    keyFirst = 0;
+    keyLast = count;
+    rowsValid = false;
+    return true;
+  }
+
+  MakeKeys();
+  if (!byKey)
+    return false;
+
+  // typing one more digit only narrows the current range
+  int lo = 0, hi = count;
+  int searchLen = strlen(search);
+  if (searchLen && searchLen < len && !strncmp(Digits, search, searchLen)) {
+    lo = keyFirst;
+    hi = keyLast;
+  }
+
+  // first key >= Digits, first key with a prefix > Digits
+  int a = lo, b = hi;
+  while (a < b) {
+    int m = (a + b) / 2;
+    if (strncmp(Text(entries[byKey[m]].key), Digits, len) < 0)
+      a = m + 1;
+    else
+      b = m;
+  }
+  int first = a;
+  b = hi;
+  while (a < b) {
+    int m = (a + b) / 2;
+    if (strncmp(Text(entries[byKey[m]].key), Digits, len) <= 0)
+      a = m + 1;
+    else
+      b = m;
+  }
+  if (a == first)
+    return false;
+
+  strcpy(search, Digits);
+  keyFirst = first;
+  keyLast = a;
+  rowsValid = false;
+  return true;
+}
+
+void cBDLibrary::SetOrder(eBDLibrarySort Sort, bool Group)
+{
+  if (Sort != sort || Group != group)
+    rowsValid = false;
+  sort = Sort;
+  group = Group;
+}
+
+void cBDLibrary::MakeRows(void)
+{
+  if (rowsValid)
+    return;
+  rowsValid = true;
+  rows = NULL;
+  rowCount = 0;
+
+  MakeOrder(sort, group);
+  int *o = order[sort][group];
+  int *r = rank[sort][group];
+  if (!o)
+    return;
+  if (*search)
+    MakeKeys();
+  bool all = !*search || !byKey;
+
+  if (all && !group) {
+    rows = o;
+    rowCount = count;
+    return;
+  }
+
+  if (!rowBuffer) {
+    rowBuffer = (int *)malloc(2 * allocated * sizeof(int));
+    if (!rowBuffer)
+      return;
+  }
+
+  // matching entries in view order: a few are sorted by their rank,
+  // many are marked and picked up in one pass over the order
+  int *matches = o;
+  int n = count;
+  uint64_t *ranked = NULL;
+  if (!all) {
+    n = keyLast - keyFirst;
+    if (n > count / 16) {
+      uint8_t *mark = (uint8_t *)calloc(count, 1);
+      if (!mark)
+        return;
+      for (int i = keyFirst; i < keyLast; i++)
+        mark[byKey[i]] = 1;
+      matches = rowBuffer + count;  // upper half, rows are written from the start
+      n = 0;
+      for (int i = 0; i < count; i++) {
+        if (mark[o[i]])
+          matches[n++] = o[i];
+      }
+      free(mark);
+    } else {
+      ranked = (uint64_t *)malloc(n * sizeof(uint64_t));
+      if (!ranked)
+        return;
+      for (int i = 0; i < n; i++) {
+        int e = byKey[keyFirst + i];
+        ranked[i] = (uint64_t)r[e] << 32 | e;
+      }
+      qsort(ranked, n, sizeof(uint64_t), CompareRanked);
+    }
+  }
+
+  const char *folder = NULL;
+  for (int i = 0; i < n; i++) {
+    int e = ranked ? (int)(ranked[i] & 0xffffffff) : matches[i];
+    if (group && (!folder || strcmp(folder, Text(entries[e].folder)))) {
+      folder = Text(entries[e].folder);
+      rowBuffer[rowCount++] = -1 - e;
+    }
+    rowBuffer[rowCount++] = e;
+  }
+  free(ranked);
+  rows = rowBuffer;
+}
+
+int cBDLibrary::Rows(void)
+{
+  MakeRows();
+  return rowCount;
+}
+
+int cBDLibrary::Row(int Row)
+{
+  MakeRows();
+  return rows[Row];
+}
+
+int cBDLibrary::Find(int Entry)
+{
+  MakeRows();
+  if (rows == order[sort][group] && rows)
+    return rank[sort][group][Entry];
+  for (int i = 0; i < rowCount; i++) {
+    if (rows[i] == Entry)
+      return i;
+  }
+  return -1;
+}
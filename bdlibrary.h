@@ -0,0 +1,111 @@
+/*
+ * bdlibrary.h: Disc library index
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDLIBRARY_H
+#define _BDLIBRARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+enum eBDLibrarySort { lsTitle, lsAdded, lsRuntime };
+#define BD_LIBRARY_SORTS  3
+
+// --- cBDLibrary -------------------------------------------------------
+
+// In-memory index of the discs of a library. All strings live in one
+// arena and entries are small fixed size records of arena offsets, so
+// 100000 discs take a few MB and no per-disc allocations. Sort orders
+// (title, date added, runtime; optionally grouped by folder) are arrays
+// of entry numbers built on first use and kept until a title or runtime
+// changes.
+//
+// Titles can be searched by the prefix of their phone keypad digits
+// ("T9": 2 = abc ... 9 = wxyz, other characters ignored) with a binary
+// search in the entries sorted by digits; each further digit narrows
+// the previous range.
+//
+// The view is a list of rows: the matching entries in the current
+// order, with a folder header row before each folder if grouped.
+
+class cBDLibrary {
+private:
+  struct sEntry {
+    uint32_t root, folder, title, key;   // arena offsets (key: T9 digits of the title)
+    uint32_t added;                      // time_t
+    int32_t  runtime;                    // seconds, -1 unknown
+  };
+
+  char    *arena;
+  size_t   arenaUsed, arenaSize;
+  sEntry  *entries;
+  int      count, allocated;
+
+  int     *order[BD_LIBRARY_SORTS][2];   // entries by sort, [1] grouped by folder
+  int     *rank[BD_LIBRARY_SORTS][2];    // position of each entry in order
+  int     *byKey;                        // entries by T9 key
+  int     *byRoot;                       // hash of root -> entry, -1 empty
+  int      byRootSize;
+
+  eBDLibrarySort sort;
+  bool     group;
+  char     search[32];
+  int      keyFirst, keyLast;            // range of byKey matching search
+  int     *rows;                         // view: entry, or -1 - entry for a folder header
+  int     *rowBuffer;
+  int      rowCount;
+  bool     rowsValid;
+
+  uint32_t Store(const char *String);
+  const char *Text(uint32_t Offset) const { return arena + Offset; }
+  void Invalidate(int Sort);
+  void MakeOrder(int Sort, bool Group);
+  void MakeKeys(void);
+  void MakeRoots(void);
+  void MakeRows(void);
+
+public:
+  cBDLibrary(void);
+  ~cBDLibrary();
+
+  void Clear(void);
+  // Returns the entry number, -1 out of memory
+  int  Add(const char *Root, const char *Folder, const char *Title, time_t Added, int Runtime = -1);
+  // true if changed
+  bool SetTitle(int Entry, const char *Title);
+  bool SetRuntime(int Entry, int Runtime);
+
+  int    Count(void) const                { return count; }
+  const char *Root(int Entry) const       { return Text(entries[Entry].root); }
+  const char *Folder(int Entry) const     { return Text(entries[Entry].folder); }
+  const char *Title(int Entry) const      { return Text(entries[Entry].title); }
+  time_t Added(int Entry) const           { return entries[Entry].added; }
+  int    Runtime(int Entry) const         { return entries[Entry].runtime; }
+  size_t Memory(void) const;
+  // Entry of the disc at Root, -1 if none
+  int    FindRoot(const char *Root);
+
+  // View
+  void SetOrder(eBDLibrarySort Sort, bool Group);
+  eBDLibrarySort Sort(void) const         { return sort; }
+  bool Grouped(void) const                { return group; }
+  // Show titles starting with Digits (T9), "" for all. Returns false
+  // (and keeps the current search) if no title matches.
+  bool Search(const char *Digits);
+  const char *Searching(void) const       { return search; }
+
+  int  Rows(void);
+  // Entry shown in Row (< Rows()), or -1 - entry for the folder header above it
+  int  Row(int Row);
+  // Row of Entry, -1 if not in the view
+  int  Find(int Entry);
+
+  // T9 digits of Text (UTF-8; accented Latin-1 letters as their base letter)
+  static void Keys(const char *Text, char *Key, int Size);
+};
+
+#endif //_BDLIBRARY_H
@@ -0,0 +1,436 @@
+/*
+ * bdmeta.c: Disc titles from the BDMV meta files
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <libbluray/bluray.h>
+
+#include "bdmeta.h"
+
+#define CACHE_MAGIC     "# BDMETA2"
+#define MAX_META_SIZE   65536
+
+// --- meta files -------------------------------------------------------
+
+// Copy XML text to Name: entities decoded, white space collapsed
+static void XmlText(const char *Text, int Length, char *Name, int Size)
+{
+  static const struct { const char *entity; char c; } entities[] = {
+    { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' },
+  };
+
+  int n = 0;
+  bool space = false;
+  for (const char *p = Text, *end = Text + Length; p < end && n < Size - 1; p++) {
+    char c = *p;
+    if ((unsigned char)c <= ' ') {
+      space = n > 0;
+      continue;
+    }
+    if (c == '&') {
+      for (unsigned i = 0; i < sizeof(entities) / sizeof(entities[0]); i++) {
+        int len = strlen(entities[i].entity);
+        if (end - p >= len && !strncmp(p, entities[i].entity, len)) {
+          c = entities[i].c;
+          p += len - 1;
+          break;
+        }
+      }
+    }
+    if (space && n < Size - 2)
+      Name[n++] = ' ';
+    space = false;
+    Name[n++] = c;
+  }
+  Name[n] = 0;
+}
+
+static bool NameFromMeta(const char *Dir, const char *Xml, char *Name, int Size)
+{
+  char file[1024];
+  snprintf(file, sizeof(file), "%s/%s", Dir, Xml);
+  FILE *fp = fopen(file, "r");
+  if (!fp)
+    return false;
+
+  // <di:name> is near the start, no need for the whole file
+  char *buf = (char *)malloc(MAX_META_SIZE);
+  bool found = false;
+  if (buf) {
+    size_t len = fread(buf, 1, MAX_META_SIZE - 1, fp);
+    buf[len] = 0;
+    char *p = strstr(buf, "<di:name>");
+    char *end = p ? strstr(p, "</di:name>") : NULL;
+    if (end) {
+      p += 9;
+      XmlText(p, end - p, Name, Size);
+      found = *Name != 0;
+    }
+    free(buf);
+  }
+  fclose(fp);
+  return found;
+}
+
+bool BDMetaName(const char *Root, const char *Language, char *Name, int Size)
+{
+  char dir[1024];
+  snprintf(dir, sizeof(dir), "%s/BDMV/META/DL", Root);
+
+  // VDR language codes may list alternatives ("deu,ger")
+  char xml[32];
+  for (const char *l = Language; l && *l; ) {
+    int len = strcspn(l, ",");
+    if (len == 3) {
+      snprintf(xml, sizeof(xml), "bdmt_%.3s.xml", l);
+      if (NameFromMeta(dir, xml, Name, Size))
+        return true;
+    }
+    l += len;
+    if (*l)
+      l++;
+  }
+  if (NameFromMeta(dir, "bdmt_eng.xml", Name, Size))
+    return true;
+
+  DIR *d = opendir(dir);
+  if (!d)
+    return false;
+  bool found = false;
+  struct dirent *e;
+  while (!found && (e = readdir(d)) != NULL) {
+    if (!strncmp(e->d_name, "bdmt_", 5) && strstr(e->d_name, ".xml"))
+      found = NameFromMeta(dir, e->d_name, Name, Size);
+  }
+  closedir(d);
+  return found;
+}
+
+time_t BDMetaStamp(const char *Root)
+{
+  // adding or replacing a meta file changes the directory
+  char dir[1024];
+  struct stat st;
+  snprintf(dir, sizeof(dir), "%s/BDMV/META/DL", Root);
+  return stat(dir, &st) == 0 ? st.st_mtime : 0;
+}
+
+int BDMetaRuntime(const char *Root)
+{
+  BLURAY *bd = bd_open(Root, NULL);
+  if (!bd)
+    return 0;
+
+  // the longest title, as the player's main title guess
+  uint64_t duration = 0;
+  unsigned titles = bd_get_titles(bd, TITLES_RELEVANT, 0);
+  for (unsigned i = 0; i < titles; i++) {
+    BLURAY_TITLE_INFO *info = bd_get_title_info(bd, i, 0);
+    if (info) {
+      if (info->duration > duration)
+        duration = info->duration;
+      bd_free_title_info(info);
+    }
+  }
+  bd_close(bd);
+  return duration / 90000;
+}
+
+// --- cBDMetaCache -----------------------------------------------------
+
+cBDMetaCache::cBDMetaCache(const char *File, const char *Language)
+:cBDThread("BluRay titles")
+{
+  file = File ? strdup(File) : NULL;
+  language = strdup(Language ? Language : "");
+  entries = NULL;
+  count = allocated = 0;
+  table = NULL;
+  tableSize = 0;
+  clock = 0;
+  generation = 0;
+  changes = NULL;
+  changesAllocated = 0;
+  dirty = false;
+  checks = reads = 0;
+
+  Load();
+}
+
+cBDMetaCache::~cBDMetaCache()
+{
+  Cancel();
+  Save();
+  for (int i = 0; i < count; i++) {
+    free(entries[i].root);
+    free(entries[i].name);
+  }
+  free(entries);
+  free(table);
+  free(changes);
+  free(file);
+  free(language);
+}
+
+uint32_t cBDMetaCache::Hash(const char *Root)
+{
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)Root; *p; p++)
+    h = (h ^ *p) * 16777619u;
+  return h;
+}
+
+cBDMetaCache::sEntry *cBDMetaCache::Find(const char *Root)
+{
+  if (!tableSize)
+    return NULL;
+  for (uint32_t i = Hash(Root) & (tableSize - 1); table[i] >= 0; i = (i + 1) & (tableSize - 1)) {
+    if (!strcmp(entries[table[i]].root, Root))
+      return &entries[table[i]];
+  }
+  return NULL;
+}
+
+bool cBDMetaCache::Rehash(int Size)
+{
+  int *t = (int *)malloc(Size * sizeof(int));
+  if (!t)
+    return false;
+  memset(t, 0xff, Size * sizeof(int));
+  for (int n = 0; n < count; n++) {
+    uint32_t i = Hash(entries[n].root) & (Size - 1);
+    while (t[i] >= 0)
+      i = (i + 1) & (Size - 1);
+    t[i] = n;
+  }
+  free(table);
+  table = t;
+  tableSize = Size;
+  return true;
+}
+
+cBDMetaCache::sEntry *cBDMetaCache::Add(const char *Root, const char *Name, time_t Stamp, int Runtime)
+{
+  if (count == allocated) {
+    int n = allocated ? allocated * 2 : 256;
+    sEntry *e = (sEntry *)realloc(entries, n * sizeof(sEntry));
+    if (!e)
+      return NULL;
+    entries = e;
+    allocated = n;
+  }
+  // table at most half full
+  if (2 * (count + 1) > tableSize && !Rehash(tableSize ? tableSize * 2 : 512))
+    return NULL;
+
+  sEntry *e = &entries[count];
+  e->root = strdup(Root);
+  e->name = Name ? strdup(Name) : NULL;
+  e->stamp = Stamp;
+  e->runtime = Runtime;
+  e->state = msUnknown;
+  e->lastUse = 0;
+
+  uint32_t i = Hash(Root) & (tableSize - 1);
+  while (table[i] >= 0)
+    i = (i + 1) & (tableSize - 1);
+  table[i] = count++;
+  return e;
+}
+
+cBDMetaCache::sEntry *cBDMetaCache::Next(void)
+{
+  sEntry *next = NULL;
+  for (int i = 0; i < count; i++) {
+    if (entries[i].state == msQueued && (!next || entries[i].lastUse > next->lastUse))
+      next = &entries[i];
+  }
+  return next;
+}
+
+void cBDMetaCache::Updated(sEntry *Entry)
+{
+  if (generation == changesAllocated) {
+    int n = changesAllocated ? changesAllocated * 2 : 256;
+    int *c = (int *)realloc(changes, n * sizeof(int));
+    if (!c)
+      return;
+    changes = c;
+    changesAllocated = n;
+  }
+  changes[generation] = Entry - entries;
+  generation++;
+}
+
+bool cBDMetaCache::Changed(int &Cursor, char *Root, int Size)
+{
+  cBDMutexLock lock(mutex);
+  if (Cursor < 0 || Cursor >= generation)
+    return false;
+  snprintf(Root, Size, "%s", entries[changes[Cursor++]].root);
+  return true;
+}
+
+void cBDMetaCache::Load(void)
+{
+  if (!file)
+    return;
+  FILE *fp = fopen(file, "r");
+  if (!fp)
+    return;
+
+  // "# BDMETA2 <language>", then "<stamp>\t<runtime>\t<root>\t<name>" per disc
+  char line[2048];
+  if (fgets(line, sizeof(line), fp) && !strncmp(line, CACHE_MAGIC " ", 10)) {
+    line[strcspn(line, "\n")] = 0;
+    if (!strcmp(line + 10, language)) {
+      while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = 0;
+        char *runtime = strchr(line, '\t');
+        char *root = runtime ? strchr(runtime + 1, '\t') : NULL;
+        char *name = root ? strchr(root + 1, '\t') : NULL;
+        if (!name)
+          continue;
+        *root++ = 0;
+        *name++ = 0;
+        if (!Find(root))
+          Add(root, *name ? name : NULL, (time_t)strtoll(line, NULL, 16), atoi(runtime + 1));
+      }
+    }
+  }
+  fclose(fp);
+  syslog(LOG_INFO, "BluRay: %d cached disc titles", count);
+}
+
+void cBDMetaCache::Save(void)
+{
+  cBDMutexLock lock(mutex);
+  if (!file || !dirty)
+    return;
+  dirty = false;  // not again on errors
+
+  char tmp[1040];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+  FILE *fp = fopen(tmp, "w");
+  if (!fp) {
+    syslog(LOG_ERR, "BluRay: can't write %s: %m", tmp);
+    return;
+  }
+
+  bool ok = fprintf(fp, CACHE_MAGIC " %s\n", language) > 0;
+  for (int i = 0; ok && i < count; i++)
+    ok = fprintf(fp, "%llx\t%d\t%s\t%s\n", (long long)entries[i].stamp, entries[i].runtime,
+                 entries[i].root, entries[i].name ? entries[i].name : "") > 0;
+  ok = !fclose(fp) && ok;
+  if (!ok || rename(tmp, file)) {
+    syslog(LOG_ERR, "BluRay: can't write %s", file);
+    unlink(tmp);
+  }
+}
+
+bool cBDMetaCache::Name(const char *Root, char *Name, int Size)
+{
+  cBDMutexLock lock(mutex);
+  sEntry *e = Find(Root);
+  if (!e || !e->name)
+    return false;
+  snprintf(Name, Size, "%s", e->name);
+  return true;
+}
+
+int cBDMetaCache::Runtime(const char *Root)
+{
+  cBDMutexLock lock(mutex);
+  sEntry *e = Find(Root);
+  return e ? e->runtime : -1;
+}
+
+void cBDMetaCache::Resolve(const char *Root)
+{
+  cBDMutexLock lock(mutex);
+
+  sEntry *e = Find(Root);
+  if (!e)
+    e = Add(Root, NULL, 0, -1);
+  if (!e)
+    return;
+  e->lastUse = ++clock;
+  if (e->state == msUnknown) {
+    e->state = msQueued;
+    if (!Active())
+      Start();
+    wake.Signal();
+  }
+}
+
+void cBDMetaCache::Action(void)
+{
+  mutex.Lock();
+  while (Running()) {
+    sEntry *e = Next();
+    if (!e) {
+      if (dirty) {
+        // queue drained: keep the titles
+        mutex.Unlock();
+        Save();
+        mutex.Lock();
+        continue;
+      }
+      wake.TimedWait(mutex, 100);
+      continue;
+    }
+    e->state = msBusy;
+    char *root = strdup(e->root);
+    time_t stamp = e->stamp;
+    bool runtime = e->runtime < 0;
+    mutex.Unlock();
+
+    // usually the title is cached and one stat() tells it is current
+    time_t now = BDMetaStamp(root);
+    char name[256];
+    bool changed = now != stamp;
+    bool found = false;
+    if (changed)
+      found = BDMetaName(root, language, name, sizeof(name));
+    // once per disc, the playlists are not expected to change
+    int seconds = runtime ? BDMetaRuntime(root) : 0;
+
+    mutex.Lock();
+    checks++;
+    e = Find(root);
+    free(root);
+    if (!e)
+      continue;
+    e->state = msDone;
+    bool updated = false;
+    if (runtime) {
+      e->runtime = seconds;
+      updated = true;
+      dirty = true;
+    }
+    if (changed) {
+      reads++;
+      if (found ? !e->name || strcmp(e->name, name) : e->name != NULL) {
+        free(e->name);
+        e->name = found ? strdup(name) : NULL;
+        updated = true;
+      }
+      e->stamp = now;
+      dirty = true;
+    }
+    if (updated)
+      Updated(e);
+  }
+  mutex.Unlock();
+}
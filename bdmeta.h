@@ -0,0 +1,97 @@
+/*
+ * bdmeta.h: Disc titles from the BDMV meta files
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDMETA_H
+#define _BDMETA_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "bdthread.h"
+
+// Title of the disc (or BDMV folder) at Root: <di:name> of
+// BDMV/META/DL/bdmt_<lang>.xml for the codes in Language ("deu,ger"),
+// then bdmt_eng.xml, then any bdmt_*.xml.
+bool BDMetaName(const char *Root, const char *Language, char *Name, int Size);
+
+// Modification time of the meta files of Root (0 if there are none)
+time_t BDMetaStamp(const char *Root);
+
+// Length of the longest title in seconds (0 if it can't be opened)
+int BDMetaRuntime(const char *Root);
+
+// --- cBDMetaCache -----------------------------------------------------
+
+// Disc titles and runtimes for the library menu. Name() only looks at
+// memory, so a menu can be filled with thousands of discs without
+// touching them; Resolve() queues a disc for the background thread,
+// which checks the meta files and reads them only if they changed since
+// the title was cached (the runtime, which needs the playlists, is read
+// once). The most recent requests are served first (the items on
+// screen). Titles are kept in File between sessions.
+
+class cBDMetaCache : public cBDThread {
+private:
+  enum eState { msUnknown, msQueued, msBusy, msDone };
+
+  struct sEntry {
+    char    *root;
+    char    *name;              // NULL: no title
+    time_t   stamp;
+    int      runtime;           // seconds, -1 not known yet
+    eState   state;             // msDone: checked in this session
+    uint64_t lastUse;
+  };
+
+  char     *file;
+  char     *language;
+
+  cBDMutex   mutex;
+  cBDCondVar wake;
+  sEntry    *entries;
+  int        count, allocated;
+  int       *table;             // hash of root -> entry index, -1 empty
+  int        tableSize;
+  uint64_t   clock;
+  int        generation;
+  int       *changes;           // entry of each update, by generation
+  int        changesAllocated;
+  bool       dirty;
+
+  static uint32_t Hash(const char *Root);
+  sEntry *Find(const char *Root);
+  sEntry *Add(const char *Root, const char *Name, time_t Stamp, int Runtime);
+  bool    Rehash(int Size);
+  sEntry *Next(void);
+  void    Updated(sEntry *Entry);
+  void    Load(void);
+  void    Save(void);
+
+protected:
+  virtual void Action(void);
+
+public:
+  uint64_t checks, reads;
+
+  cBDMetaCache(const char *File, const char *Language);
+  virtual ~cBDMetaCache();
+
+  // Cached title of Root, false if unknown (not resolved yet or none)
+  bool Name(const char *Root, char *Name, int Size);
+  // Cached runtime of Root in seconds, -1 if unknown
+  int  Runtime(const char *Root);
+  // Check Root (once per session) without waiting for the result
+  void Resolve(const char *Root);
+  // Number of title or runtime updates so far
+  int  Generation(void) { return generation; }
+  // Root of update Cursor (a Generation() value) into Root, and Cursor
+  // to the next update; false if there is none yet. A menu applies the
+  // updates since it last looked, not the whole library.
+  bool Changed(int &Cursor, char *Root, int Size);
+};
+
+#endif //_BDMETA_H
@@ -0,0 +1,275 @@
+/*
+ * bdoverlay.c: HDMV menu graphics (libbluray overlay plane)
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include <libbluray/overlay.h>
+
+#include "bdstats.h"
+#include "bdtrace.h"
+
+#include "bdoverlay.h"
+
+#define DEFAULT_WIDTH   1920
+#define DEFAULT_HEIGHT  1080
+
+cBDOverlay::cBDOverlay(cBDOverlayPresenter *Presenter)
+{
+  presenter = Presenter;
+  index = NULL;
+  plane = NULL;
+  width = height = 0;
+  memset(palette, 0, sizeof(palette));
+  hd = true;
+  memset(&dirty, 0, sizeof(dirty));
+  open = false;
+  inputTime = 0;
+}
+
+cBDOverlay::~cBDOverlay()
+{
+  Free();
+}
+
+void cBDOverlay::Attach(BLURAY *Bd)
+{
+  bd_register_overlay_proc(Bd, this, Callback);
+}
+
+void cBDOverlay::Detach(BLURAY *Bd)
+{
+  // libbluray closes the graphics (through the callback) when unregistering
+  bd_register_overlay_proc(Bd, NULL, NULL);
+  Free();
+}
+
+void cBDOverlay::Callback(void *Handle, const struct bd_overlay_s * const Overlay)
+{
+  cBDOverlay *overlay = (cBDOverlay *)Handle;
+  if (overlay) {
+    if (Overlay)
+      overlay->Process(Overlay);
+    else
+      overlay->Free();  // libbluray: plane closed
+  }
+}
+
+void cBDOverlay::InputSent(void)
+{
+  cBDStats::Count(bcMenuKeys);
+  inputTime = cBDStats::Now();
+}
+
+bool cBDOverlay::Init(int Width, int Height)
+{
+  if (Width <= 0 || Height <= 0) {
+    // drawing without INIT: size of the last plane
+    Width = width > 0 ? width : DEFAULT_WIDTH;
+    Height = height > 0 ? height : DEFAULT_HEIGHT;
+  }
+  if (plane && Width == width && Height == height)
+    return true;
+
+  Free();
+  index = (uint8_t *)malloc(Width * Height);
+  plane = (uint32_t *)calloc(Width * Height, sizeof(uint32_t));
+  if (!index || !plane) {
+    syslog(LOG_ERR, "BluRay: no memory for %dx%d menu plane", Width, Height);
+    Free();
+    return false;
+  }
+  memset(index, 0xff, Width * Height);
+  width = Width;
+  height = Height;
+  hd = Height > 576;
+  return true;
+}
+
+void cBDOverlay::Free(void)
+{
+  bool wasOpen = open;
+  free(index);
+  free(plane);
+  index = NULL;
+  plane = NULL;
+  memset(&dirty, 0, sizeof(dirty));
+  open = false;
+  if (wasOpen)
+    presenter->Close();
+}
+
+void cBDOverlay::Hide(void)
+{
+  if (plane)
+    Wipe(0, 0, width, height);
+  memset(&dirty, 0, sizeof(dirty));
+  if (open)
+    presenter->Close();
+  open = false;
+}
+
+void cBDOverlay::Invalidate(int X, int Y, int Width, int Height)
+{
+  if (!plane)
+    return;
+  if (X < 0) { Width += X; X = 0; }
+  if (Y < 0) { Height += Y; Y = 0; }
+  if (X + Width > width)   Width = width - X;
+  if (Y + Height > height) Height = height - Y;
+  if (Width <= 0 || Height <= 0)
+    return;
+
+  if (!dirty.width) {
+    dirty.x = X;
+    dirty.y = Y;
+    dirty.width = Width;
+    dirty.height = Height;
+    return;
+  }
+
+  int x2 = dirty.x + dirty.width  > X + Width  ? dirty.x + dirty.width  : X + Width;
+  int y2 = dirty.y + dirty.height > Y + Height ? dirty.y + dirty.height : Y + Height;
+  dirty.x = dirty.x < X ? dirty.x : X;
+  dirty.y = dirty.y < Y ? dirty.y : Y;
+  dirty.width  = x2 - dirty.x;
+  dirty.height = y2 - dirty.y;
+}
+
+void cBDOverlay::SetPalette(const struct bd_overlay_s *Overlay)
+{
+  if (!Overlay->palette)
+    return;
+  for (int i = 0; i < 256; i++) {
+    const BD_PG_PALETTE_ENTRY &e = Overlay->palette[i];
+    palette[i] = BDPgColor(e.Y, e.Cr, e.Cb, e.T, hd);
+  }
+}
+
+void cBDOverlay::Draw(const struct bd_overlay_s *Overlay)
+{
+  int x0 = Overlay->x, y0 = Overlay->y;
+  int w = Overlay->w, h = Overlay->h;
+  if (x0 >= width || y0 >= height)
+    return;
+  if (w > width - x0)  w = width - x0;
+  if (h > height - y0) h = height - y0;
+
+  // RLE runs, each line ends with a zero length element
+  const BD_PG_RLE_ELEM *rle = Overlay->img;
+  for (int y = 0; y < h; y++) {
+    uint8_t  *il = index + (y0 + y) * width + x0;
+    uint32_t *pl = plane + (y0 + y) * width + x0;
+    int x = 0;
+    for (; rle->len; rle++) {
+      int len = rle->len < w - x ? rle->len : w - x;
+      if (len > 0) {
+        memset(il + x, rle->color, len);
+        BDPgFill(pl + x, palette[rle->color & 0xff], len);
+        x += len;
+      }
+    }
+    rle++;
+  }
+
+  Invalidate(x0, y0, w, h);
+}
+
+void cBDOverlay::Recolor(int X, int Y, int Width, int Height)
+{
+  if (X + Width > width)   Width = width - X;
+  if (Y + Height > height) Height = height - Y;
+
+  for (int y = Y; y < Y + Height; y++) {
+    const uint8_t *il = index + y * width + X;
+    uint32_t *pl = plane + y * width + X;
+    for (int x = 0; x < Width; x++)
+      pl[x] = palette[il[x]];
+  }
+  Invalidate(X, Y, Width, Height);
+}
+
+void cBDOverlay::Wipe(int X, int Y, int Width, int Height)
+{
+  if (X + Width > width)   Width = width - X;
+  if (Y + Height > height) Height = height - Y;
+
+  // entry 0xff is reserved for transparency in BluRay graphics palettes
+  for (int y = Y; y < Y + Height; y++) {
+    memset(index + y * width + X, 0xff, Width);
+    BDPgFill(plane + y * width + X, 0, Width);
+  }
+  Invalidate(X, Y, Width, Height);
+}
+
+void cBDOverlay::Flush(void)
+{
+  if (!dirty.width)
+    return;
+
+  {
+    BD_TRACE_SPAN(btOsdFlush);
+    presenter->Update(plane, width, height, dirty);
+  }
+  memset(&dirty, 0, sizeof(dirty));
+  open = true;
+
+  cBDStats::Count(bcOverlayFlushes);
+  if (inputTime) {
+    cBDStats::Time(bhMenuResponse, cBDStats::Now() - inputTime);
+    inputTime = 0;
+  }
+}
+
+void cBDOverlay::Process(const struct bd_overlay_s *Overlay)
+{
+  if (Overlay->plane != BD_OVERLAY_IG)
+    return;
+
+  switch (Overlay->cmd) {
+    case BD_OVERLAY_INIT:
+      Init(Overlay->w, Overlay->h);
+      break;
+
+    case BD_OVERLAY_CLOSE:
+      Free();
+      break;
+
+    case BD_OVERLAY_HIDE:
+      Hide();
+      break;
+
+    case BD_OVERLAY_CLEAR:
+      if (plane)
+        Wipe(0, 0, width, height);
+      break;
+
+    case BD_OVERLAY_WIPE:
+      if (plane && Overlay->x < width && Overlay->y < height)
+        Wipe(Overlay->x, Overlay->y, Overlay->w, Overlay->h);
+      break;
+
+    case BD_OVERLAY_DRAW:
+      if (!plane && !Init(0, 0))
+        break;
+      SetPalette(Overlay);
+      if (Overlay->img)
+        Draw(Overlay);
+      else if (Overlay->palette_update_flag && Overlay->x < width && Overlay->y < height)
+        Recolor(Overlay->x, Overlay->y, Overlay->w, Overlay->h);
+      break;
+
+    case BD_OVERLAY_FLUSH:
+      if (plane)
+        Flush();
+      break;
+
+    default:
+      break;
+  }
+}
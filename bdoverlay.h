@@ -0,0 +1,79 @@
+/*
+ * bdoverlay.h: HDMV menu graphics (libbluray overlay plane)
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDOVERLAY_H
+#define _BDOVERLAY_H
+
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+#include "bdpg.h"
+
+struct bd_overlay_s;
+
+// --- cBDOverlayPresenter ----------------------------------------------
+
+class cBDOverlayPresenter {
+public:
+  virtual ~cBDOverlayPresenter() {}
+  // Dirty changed in Plane (Width x Height ARGB pixels). Called once per
+  // display update, after all drawing commands of the update.
+  virtual void Update(const uint32_t *Plane, int Width, int Height, const sBDPgRect &Dirty) = 0;
+  // Menu graphics closed or hidden
+  virtual void Close(void) = 0;
+};
+
+// --- cBDOverlay -------------------------------------------------------
+
+// Composites the interactive graphics (IG) plane of libbluray's HDMV
+// navigation into an ARGB plane. Drawing commands only extend a dirty
+// rectangle; the presenter is called when libbluray flushes the plane,
+// so a button highlight costs one OSD update of the button area.
+//
+// libbluray calls the overlay procedure from bd_read_ext() and
+// bd_user_input(), i.e. under the lock of the caller of cBDCore.
+// PG subtitles are decoded by cBDPgDecoder and are ignored here.
+
+class cBDOverlay {
+private:
+  cBDOverlayPresenter *presenter;
+  uint8_t  *index;              // palette indices, for palette updates
+  uint32_t *plane;
+  int       width, height;
+  uint32_t  palette[256];
+  bool      hd;
+  sBDPgRect dirty;              // empty if width == 0
+  bool      open;               // presenter shows the plane
+  uint64_t  inputTime;          // key pending a response, 0 if none
+
+  static void Callback(void *Handle, const struct bd_overlay_s * const Overlay);
+  void Process(const struct bd_overlay_s *Overlay);
+  bool Init(int Width, int Height);
+  void Free(void);
+  void Hide(void);
+  void Invalidate(int X, int Y, int Width, int Height);
+  void SetPalette(const struct bd_overlay_s *Overlay);
+  void Draw(const struct bd_overlay_s *Overlay);
+  void Recolor(int X, int Y, int Width, int Height);
+  void Wipe(int X, int Y, int Width, int Height);
+  void Flush(void);
+
+public:
+  cBDOverlay(cBDOverlayPresenter *Presenter);
+  ~cBDOverlay();
+
+  // Register with / unregister from libbluray
+  void Attach(BLURAY *Bd);
+  void Detach(BLURAY *Bd);
+
+  // A key was sent to the menu (for response time statistics)
+  void InputSent(void);
+  bool Open(void) { return open; }
+};
+
+#endif //_BDOVERLAY_H
@@ -0,0 +1,760 @@
+/*
+ * bdpg.c: BluRay presentation graphics (PG subtitle) decoder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "bdstats.h"
+
+#include "bdpg.h"
+
+#define PG_QUEUE_PACKETS  2048          // ~370 kB of TS packets
+#define PG_MAX_VIDEO_SIZE 4096          // PCS video width / height
+#define PG_MAX_PIXELS     (1920 * 1080) // ODS: the graphics plane at most
+
+// segment types
+#define SEG_PDS   0x14
+#define SEG_ODS   0x15
+#define SEG_PCS   0x16
+#define SEG_WDS   0x17
+#define SEG_END   0x80
+
+static uint64_t Hash(const uint8_t *Data, int Length, uint64_t h = 0xcbf29ce484222325ULL)
+{
+  while (Length >= 8) {
+    uint64_t v;
+    memcpy(&v, Data, 8);
+    h = (h ^ v) * 0x100000001b3ULL;
+    h ^= h >> 29;
+    Data += 8;
+    Length -= 8;
+  }
+  while (Length-- > 0)
+    h = (h ^ *Data++) * 0x100000001b3ULL;
+  return h;
+}
+
+// --- RLE expansion ----------------------------------------------------
+
+// Runs are expanded straight to ARGB: one palette lookup per run, the
+// fill uses 128 bit stores where available.
+
+static inline void Fill(uint32_t *Dst, uint32_t Color, int Count)
+{
+#if defined(__SSE2__)
+  if (Count >= 8) {
+    __m128i v = _mm_set1_epi32(Color);
+    do {
+      _mm_storeu_si128((__m128i *)Dst, v);
+      _mm_storeu_si128((__m128i *)(Dst + 4), v);
+      Dst += 8;
+      Count -= 8;
+    } while (Count >= 8);
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  if (Count >= 8) {
+    uint32x4_t v = vdupq_n_u32(Color);
+    do {
+      vst1q_u32(Dst, v);
+      vst1q_u32(Dst + 4, v);
+      Dst += 8;
+      Count -= 8;
+    } while (Count >= 8);
+  }
+#endif
+  while (Count-- > 0)
+    *Dst++ = Color;
+}
+
+void BDPgFill(uint32_t *Dst, uint32_t Color, int Count)
+{
+  Fill(Dst, Color, Count);
+}
+
+uint32_t BDPgColor(int Y, int Cr, int Cb, int T, bool Hd)
+{
+  // BT.709 for HD, BT.601 for SD; limited range, 16.16 fixed point
+  const int cy  = 76284;
+  const int crr = Hd ? 117504 : 104595;
+  const int cgb = Hd ?  13954 :  25690;
+  const int cgr = Hd ?  34903 :  53280;
+  const int cbb = Hd ? 138453 : 132186;
+
+  int y  = (Y - 16) * cy;
+  int cr = Cr - 128;
+  int cb = Cb - 128;
+  int r = (y + crr * cr) >> 16;
+  int g = (y - cgb * cb - cgr * cr) >> 16;
+  int b = (y + cbb * cb) >> 16;
+  r = r < 0 ? 0 : r > 255 ? 255 : r;
+  g = g < 0 ? 0 : g > 255 ? 255 : g;
+  b = b < 0 ? 0 : b > 255 ? 255 : b;
+  return ((uint32_t)T << 24) | (r << 16) | (g << 8) | b;
+}
+
+bool BDPgDecodeRle(const uint8_t *Rle, int Length, const uint32_t *Palette,
+                   uint32_t *Argb, int Width, int Height)
+{
+  const uint8_t *p = Rle, *end = Rle + Length;
+  uint32_t *line = Argb;
+  int x = 0, y = 0;
+
+  while (y < Height && p < end) {
+    uint8_t b = *p++;
+    if (b) {
+      // single pixel
+      if (x < Width)
+        line[x++] = Palette[b];
+      continue;
+    }
+    if (p >= end)
+      break;
+    uint8_t f = *p++;
+    if (!f) {
+      // end of line
+      Fill(line + x, 0, Width - x);
+      line += Width;
+      x = 0;
+      y++;
+      continue;
+    }
+    int len = f & 0x3f;
+    if (f & 0x40) {
+      if (p >= end)
+        break;
+      len = (len << 8) | *p++;
+    }
+    int color = 0;
+    if (f & 0x80) {
+      if (p >= end)
+        break;
+      color = *p++;
+    }
+    if (len > Width - x)
+      len = Width - x;
+    Fill(line + x, Palette[color], len);
+    x += len;
+  }
+
+  if (y < Height) {
+    // damaged or truncated: rest is transparent
+    Fill(line + x, 0, Width - x);
+    for (line += Width, y++; y < Height; y++, line += Width)
+      Fill(line, 0, Width);
+    return false;
+  }
+  return true;
+}
+
+// --- cBDPgCache -------------------------------------------------------
+
+cBDPgCache::cBDPgCache(uint64_t MaxBytes)
+{
+  entries = NULL;
+  count = allocated = 0;
+  bytes = 0;
+  maxBytes = MaxBytes;
+  clock = 0;
+}
+
+cBDPgCache::~cBDPgCache()
+{
+  Clear();
+  free(entries);
+}
+
+void cBDPgCache::Clear(void)
+{
+  // pinned entries stay valid until unpinned
+  for (int i = 0; i < count; i++) {
+    if (entries[i].argb && !entries[i].pins) {
+      free(entries[i].argb);
+      entries[i].argb = NULL;
+      bytes -= (uint64_t)entries[i].width * entries[i].height * 4;
+    }
+  }
+}
+
+void cBDPgCache::Evict(void)
+{
+  int lru = -1;
+  for (int i = 0; i < count; i++) {
+    if (entries[i].argb && !entries[i].pins && (lru < 0 || entries[i].lastUse < entries[lru].lastUse))
+      lru = i;
+  }
+  if (lru >= 0) {
+    free(entries[lru].argb);
+    entries[lru].argb = NULL;
+    bytes -= (uint64_t)entries[lru].width * entries[lru].height * 4;
+  }
+}
+
+int cBDPgCache::Find(uint64_t Key)
+{
+  for (int i = 0; i < count; i++) {
+    if (entries[i].argb && entries[i].key == Key) {
+      Pin(i);
+      return i;
+    }
+  }
+  return -1;
+}
+
+int cBDPgCache::Add(uint64_t Key, int Width, int Height)
+{
+  uint64_t size = (uint64_t)Width * Height * 4;
+  for (int n = count; n > 0 && bytes + size > maxBytes; n--)
+    Evict();
+
+  // entry indexes are kept by compositions: slots are reused, never moved
+  int i = 0;
+  while (i < count && entries[i].argb)
+    i++;
+  if (i == count) {
+    if (count == allocated) {
+      allocated = allocated ? 2 * allocated : 16;
+      entries = (sEntry *)realloc(entries, allocated * sizeof(sEntry));
+    }
+    count++;
+  }
+
+  sEntry &e = entries[i];
+  e.argb = (uint32_t *)malloc(size ? size : 4);
+  if (!e.argb)
+    return -1;
+  e.key = Key;
+  e.width = Width;
+  e.height = Height;
+  e.pins = 0;
+  bytes += size;
+  Pin(i);
+  return i;
+}
+
+void cBDPgCache::Pin(int Entry)
+{
+  entries[Entry].pins++;
+  entries[Entry].lastUse = ++clock;
+}
+
+void cBDPgCache::Unpin(int Entry)
+{
+  if (Entry >= 0 && Entry < count && entries[Entry].pins > 0)
+    entries[Entry].pins--;
+}
+
+// --- cBDPgParser ------------------------------------------------------
+
+cBDPgParser::cBDPgParser(uint64_t CacheBytes)
+:cache(CacheBytes)
+{
+  pes = NULL;
+  pesLength = pesSize = 0;
+  pesStarted = false;
+  pesPts = -1;
+  objects = NULL;
+  objectCount = objectsAllocated = 0;
+  displaySets = cacheHits = cacheMisses = 0;
+  haveReady = false;
+  Reset();
+}
+
+cBDPgParser::~cBDPgParser()
+{
+  ClearObjects();
+  free(objects);
+  free(pes);
+}
+
+void cBDPgParser::ClearObjects(void)
+{
+  for (int i = 0; i < objectCount; i++)
+    free(objects[i].rle);
+  objectCount = 0;
+}
+
+void cBDPgParser::Reset(void)
+{
+  if (haveReady)
+    Release(ready);
+  haveReady = false;
+  pesLength = 0;
+  pesStarted = false;
+  havePcs = false;
+  pcsObjectCount = windowCount = 0;
+  videoWidth = 1920;
+  videoHeight = 1080;
+  memset(palettes, 0, sizeof(palettes));
+  ClearObjects();
+  cache.Clear();
+}
+
+cBDPgParser::sObject *cBDPgParser::Object(int Id, bool Create)
+{
+  for (int i = 0; i < objectCount; i++) {
+    if (objects[i].id == Id)
+      return &objects[i];
+  }
+  if (!Create)
+    return NULL;
+
+  if (objectCount == objectsAllocated) {
+    objectsAllocated = objectsAllocated ? 2 * objectsAllocated : 8;
+    objects = (sObject *)realloc(objects, objectsAllocated * sizeof(sObject));
+  }
+  sObject *o = &objects[objectCount++];
+  memset(o, 0, sizeof(*o));
+  o->id = Id;
+  return o;
+}
+
+bool cBDPgParser::Packet(const uint8_t *Data)
+{
+  if (Data[0] != 0x47)
+    return haveReady;
+
+  bool pusi = Data[1] & 0x40;
+  int afc = (Data[3] >> 4) & 3;
+  int offset = 4;
+  if (afc & 2)
+    offset += 1 + Data[4];
+  if (!(afc & 1) || offset >= TS_SIZE)
+    return haveReady;
+
+  if (pusi) {
+    // PES without length ends at the next one
+    if (pesStarted && pesLength >= 6 && !(pes[4] | pes[5]))
+      ParsePes();
+    pesLength = 0;
+    pesStarted = true;
+  }
+  if (!pesStarted)
+    return haveReady;
+
+  int len = TS_SIZE - offset;
+  if (pesLength + len > pesSize) {
+    pesSize = (pesLength + len) * 2;
+    pes = (uint8_t *)realloc(pes, pesSize);
+  }
+  memcpy(pes + pesLength, Data + offset, len);
+  pesLength += len;
+
+  if (pesLength >= 6) {
+    int total = 6 + ((pes[4] << 8) | pes[5]);
+    if (total > 6 && pesLength >= total) {
+      pesLength = total;
+      ParsePes();
+      pesStarted = false;
+      pesLength = 0;
+    }
+  }
+
+  return haveReady;
+}
+
+void cBDPgParser::ParsePes(void)
+{
+  if (pesLength < 9 || pes[0] || pes[1] || pes[2] != 1 || pes[3] != 0xbd)
+    return;
+
+  int payload = 9 + pes[8];
+  if (payload > pesLength)
+    return;
+
+  if ((pes[7] & 0x80) && pesLength >= 14) {
+    const uint8_t *p = pes + 9;
+    pesPts = ((int64_t)(p[0] & 0x0e) << 29) | (p[1] << 22) | ((p[2] & 0xfe) << 14) | (p[3] << 7) | (p[4] >> 1);
+  }
+
+  const uint8_t *p = pes + payload;
+  int left = pesLength - payload;
+  while (left >= 3) {
+    int type = p[0];
+    int len = (p[1] << 8) | p[2];
+    if (len > left - 3)
+      break;
+    ParseSegment(type, p + 3, len);
+    p += 3 + len;
+    left -= 3 + len;
+  }
+}
+
+void cBDPgParser::ParseSegment(int Type, const uint8_t *Data, int Length)
+{
+  switch (Type) {
+    case SEG_PCS: ParsePcs(Data, Length); break;
+    case SEG_WDS: ParseWds(Data, Length); break;
+    case SEG_PDS: ParsePds(Data, Length); break;
+    case SEG_ODS: ParseOds(Data, Length); break;
+    case SEG_END: EndOfDisplaySet();      break;
+    default:      break;
+  }
+}
+
+void cBDPgParser::ParsePcs(const uint8_t *Data, int Length)
+{
+  if (Length < 11)
+    return;
+
+  int width  = (Data[0] << 8) | Data[1];
+  int height = (Data[2] << 8) | Data[3];
+  if (!width || !height || width > PG_MAX_VIDEO_SIZE || height > PG_MAX_VIDEO_SIZE) {
+    // the presenter scales by these: drop the display set
+    syslog(LOG_ERR, "BluRay PG: bad video size %dx%d, display set dropped", width, height);
+    havePcs = false;
+    return;
+  }
+
+  videoWidth        = width;
+  videoHeight       = height;
+  compositionNumber = (Data[5] << 8) | Data[6];
+  int state         = Data[7];
+  paletteId         = Data[9] & 7;
+  int n             = Data[10];
+
+  if (state & 0x80) {
+    // epoch start: object buffer and palettes are reset
+    ClearObjects();
+    memset(palettes, 0, sizeof(palettes));
+  }
+
+  pts = pesPts;
+  pcsObjectCount = 0;
+  windowCount = 0;
+  const uint8_t *p = Data + 11;
+  const uint8_t *end = Data + Length;
+  for (int i = 0; i < n && p + 8 <= end; i++) {
+    sPcsObject o;
+    o.objectId = (p[0] << 8) | p[1];
+    o.windowId = p[2];
+    o.cropped  = p[3] & 0x80;
+    o.x        = (p[4] << 8) | p[5];
+    o.y        = (p[6] << 8) | p[7];
+    p += 8;
+    if (o.cropped) {
+      if (p + 8 > end)
+        break;
+      o.cropX      = (p[0] << 8) | p[1];
+      o.cropY      = (p[2] << 8) | p[3];
+      o.cropWidth  = (p[4] << 8) | p[5];
+      o.cropHeight = (p[6] << 8) | p[7];
+      p += 8;
+    }
+    if (pcsObjectCount < BD_PG_MAX_OBJECTS)
+      pcsObjects[pcsObjectCount++] = o;
+  }
+
+  havePcs = true;
+}
+
+void cBDPgParser::ParseWds(const uint8_t *Data, int Length)
+{
+  if (Length < 1)
+    return;
+
+  int n = Data[0];
+  const uint8_t *p = Data + 1;
+  windowCount = 0;
+  for (int i = 0; i < n && p + 9 <= Data + Length && windowCount < BD_PG_MAX_WINDOWS; i++, p += 9) {
+    sBDPgRect &w = windows[windowCount++];
+    w.x      = (p[1] << 8) | p[2];
+    w.y      = (p[3] << 8) | p[4];
+    w.width  = (p[5] << 8) | p[6];
+    w.height = (p[7] << 8) | p[8];
+  }
+}
+
+void cBDPgParser::ParsePds(const uint8_t *Data, int Length)
+{
+  if (Length < 2)
+    return;
+
+  sPalette &pal = palettes[Data[0] & 7];
+  pal.version = Data[1];
+  pal.valid = true;
+
+  bool hd = videoHeight > 576;
+  for (const uint8_t *p = Data + 2; p + 5 <= Data + Length; p += 5)
+    pal.argb[p[0]] = BDPgColor(p[1], p[2], p[3], p[4], hd);
+
+  pal.hash = Hash((const uint8_t *)pal.argb, sizeof(pal.argb));
+}
+
+void cBDPgParser::ParseOds(const uint8_t *Data, int Length)
+{
+  if (Length < 4)
+    return;
+
+  sObject *o = Object((Data[0] << 8) | Data[1], true);
+  int flags = Data[3];
+  const uint8_t *p = Data + 4;
+
+  if (flags & 0x80) {
+    // first in sequence
+    if (Length < 11)
+      return;
+    o->version  = Data[2];
+    o->expected = ((Data[4] << 16) | (Data[5] << 8) | Data[6]) - 4;
+    o->width    = (Data[7] << 8) | Data[8];
+    o->height   = (Data[9] << 8) | Data[10];
+    o->length   = 0;
+    o->complete = false;
+    if ((int64_t)o->width * o->height > PG_MAX_PIXELS) {
+      // not decoded: the continuations are dropped as well
+      syslog(LOG_ERR, "BluRay PG: object %d: bad size %dx%d", o->id, o->width, o->height);
+      free(o->rle);
+      o->rle = NULL;
+      o->size = 0;
+      return;
+    }
+    p = Data + 11;
+  } else if (o->complete || !o->rle) {
+    return;  // continuation without start
+  }
+
+  int len = Length - (p - Data);
+  if (o->length + len > o->size) {
+    o->size = o->expected > o->length + len ? o->expected : o->length + len;
+    o->rle = (uint8_t *)realloc(o->rle, o->size);
+  }
+  memcpy(o->rle + o->length, p, len);
+  o->length += len;
+
+  if ((flags & 0x40) || o->length >= o->expected) {
+    o->complete = true;
+    uint8_t size[4] = { uint8_t(o->width >> 8), uint8_t(o->width), uint8_t(o->height >> 8), uint8_t(o->height) };
+    o->hash = Hash(o->rle, o->length, Hash(size, 4));
+  }
+}
+
+void cBDPgParser::EndOfDisplaySet(void)
+{
+  if (!havePcs)
+    return;
+  havePcs = false;
+
+  cBDStatTimer timer(bhPgDecode);
+  cBDStats::Count(bcPgDisplaySets);
+  displaySets++;
+
+  if (haveReady) {
+    // not taken: replaced by the newer one
+    Release(ready);
+    haveReady = false;
+  }
+
+  sBDPgComposition &c = ready;
+  c.pts = pts;
+  c.videoWidth = videoWidth;
+  c.videoHeight = videoHeight;
+  c.number = compositionNumber;
+  c.windowCount = windowCount;
+  memcpy(c.windows, windows, sizeof(windows));
+  c.objectCount = 0;
+
+  const sPalette &pal = palettes[paletteId];
+
+  for (int i = 0; i < pcsObjectCount; i++) {
+    const sPcsObject &po = pcsObjects[i];
+    sObject *o = Object(po.objectId, false);
+    if (!o || !o->complete || o->width <= 0 || o->height <= 0)
+      continue;
+
+    uint64_t key = o->hash ^ (pal.hash * 0x9e3779b97f4a7c15ULL);
+    int entry = cache.Find(key);
+    if (entry >= 0) {
+      cacheHits++;
+      cBDStats::Count(bcPgCacheHits);
+    } else {
+      entry = cache.Add(key, o->width, o->height);
+      if (entry < 0)
+        continue;
+      cacheMisses++;
+      if (!BDPgDecodeRle(o->rle, o->length, pal.argb, cache.Pixels(entry), o->width, o->height))
+        syslog(LOG_ERR, "BluRay PG: object %d: damaged RLE data", o->id);
+    }
+
+    sBDPgObject &co = c.objects[c.objectCount++];
+    co.cacheEntry = entry;
+    co.key = key;
+    co.stride = o->width;
+    co.x = po.x;
+    co.y = po.y;
+    co.width = o->width;
+    co.height = o->height;
+    co.argb = cache.Pixels(entry);
+    if (po.cropped) {
+      int cx = po.cropX < o->width ? po.cropX : o->width;
+      int cy = po.cropY < o->height ? po.cropY : o->height;
+      co.width = po.cropWidth < o->width - cx ? po.cropWidth : o->width - cx;
+      co.height = po.cropHeight < o->height - cy ? po.cropHeight : o->height - cy;
+      co.argb += cy * o->width + cx;
+    }
+  }
+
+  haveReady = true;
+}
+
+bool cBDPgParser::Get(sBDPgComposition &Composition)
+{
+  if (!haveReady)
+    return false;
+  Composition = ready;
+  haveReady = false;
+  return true;
+}
+
+void cBDPgParser::Release(const sBDPgComposition &Composition)
+{
+  for (int i = 0; i < Composition.objectCount; i++)
+    cache.Unpin(Composition.objects[i].cacheEntry);
+}
+
+// --- cBDPgDecoder -----------------------------------------------------
+
+cBDPgDecoder::cBDPgDecoder(cBDPgPresenter *Presenter)
+:cBDThread("BluRay PG decoder")
+{
+  presenter = Presenter;
+  queueSize = PG_QUEUE_PACKETS * TS_SIZE;
+  queue = (uint8_t *)malloc(queueSize);
+  queueHead = queueTail = 0;
+  pid = -1;
+  flush = false;
+  pendingCount = 0;
+}
+
+cBDPgDecoder::~cBDPgDecoder()
+{
+  Cancel();
+  DropPending();
+  free(queue);
+}
+
+void cBDPgDecoder::SetPid(int Pid)
+{
+  cBDMutexLock lock(mutex);
+  if (pid != Pid) {
+    syslog(LOG_INFO, "BluRay PG: PID 0x%04x", Pid < 0 ? 0 : Pid);
+    pid = Pid;
+    flush = true;
+    queueHead = queueTail = 0;
+    changed.Broadcast();
+  }
+}
+
+void cBDPgDecoder::Flush(void)
+{
+  cBDMutexLock lock(mutex);
+  flush = true;
+  queueHead = queueTail = 0;
+  changed.Broadcast();
+}
+
+int cBDPgDecoder::Feed(const uint8_t *Data, int Length)
+{
+  cBDMutexLock lock(mutex);
+
+  if (pid < 0 || Length != TS_SIZE)
+    return Length;
+
+  int next = (queueTail + TS_SIZE) % queueSize;
+  if (next == queueHead) {
+    cBDStats::Count(bcPgDroppedPackets);
+    return Length;
+  }
+  memcpy(queue + queueTail, Data, TS_SIZE);
+  cBDStats::Count(bcCopiedBytes, TS_SIZE);
+  queueTail = next;
+  changed.Broadcast();
+  return Length;
+}
+
+void cBDPgDecoder::DropPending(void)
+{
+  for (int i = 0; i < pendingCount; i++)
+    parser.Release(pending[i]);
+  pendingCount = 0;
+}
+
+void cBDPgDecoder::Present(void)
+{
+  int64_t stc = pendingCount ? presenter->Stc() : -1;
+
+  while (pendingCount > 0) {
+    const sBDPgComposition &c = pending[0];
+    if (stc >= 0 && c.pts >= 0) {
+      // 33 bit time stamps; more than 10 s ahead: discontinuity, show now
+      int64_t d = (c.pts - stc) & 0x1ffffffffLL;
+      if (d >= 0x100000000LL)
+        d -= 0x200000000LL;
+      if (d > 0 && d < 10 * 90000)
+        break;
+    }
+    presenter->Show(c);
+    parser.Release(c);
+    memmove(pending, pending + 1, --pendingCount * sizeof(pending[0]));
+  }
+}
+
+void cBDPgDecoder::Action(void)
+{
+  cBDStats::Attach("PG decoder");
+
+  const int batch = 32;
+  uint8_t packets[batch * TS_SIZE];
+
+  while (Running()) {
+
+    bool doFlush;
+    int n = 0;
+    {
+      cBDMutexLock lock(mutex);
+      if (!flush && (queueHead == queueTail || pendingCount == BD_PG_MAX_PENDING))
+        changed.TimedWait(mutex, pendingCount ? 10 : 100);
+      doFlush = flush;
+      flush = false;
+      // stop decoding ahead when enough compositions are waiting
+      while (pendingCount < BD_PG_MAX_PENDING && n < batch && queueHead != queueTail) {
+        memcpy(packets + n * TS_SIZE, queue + queueHead, TS_SIZE);
+        queueHead = (queueHead + TS_SIZE) % queueSize;
+        n++;
+      }
+    }
+
+    if (doFlush) {
+      DropPending();
+      parser.Reset();
+      presenter->Clear();
+    }
+
+    for (int i = 0; i < n; i++) {
+      sBDPgComposition c;
+      if (parser.Packet(packets + i * TS_SIZE) && parser.Get(c)) {
+        if (pendingCount == BD_PG_MAX_PENDING) {
+          // late: show the oldest one now
+          presenter->Show(pending[0]);
+          parser.Release(pending[0]);
+          memmove(pending, pending + 1, --pendingCount * sizeof(pending[0]));
+        }
+        pending[pendingCount++] = c;
+      }
+    }
+
+    Present();
+  }
+
+  DropPending();
+  presenter->Clear();
+}
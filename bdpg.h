@@ -0,0 +1,229 @@
+/*
+ * bdpg.h: BluRay presentation graphics (PG subtitle) decoder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDPG_H
+#define _BDPG_H
+
+#include <stdint.h>
+
+#include "bdthread.h"
+#include "m2ts.h"
+
+#define BD_PG_MAX_OBJECTS   2    // composition objects per display set
+#define BD_PG_MAX_WINDOWS   2
+
+// --- sBDPgComposition -------------------------------------------------
+
+// A decoded display set, ready for the OSD. Pixels are ARGB (VDR tColor),
+// owned by the bitmap cache and valid until the composition is released.
+
+struct sBDPgObject {
+  int x, y, width, height;
+  int stride;                    // pixels per line
+  const uint32_t *argb;
+  uint64_t key;                  // identifies the bitmap contents
+  int cacheEntry;
+};
+
+struct sBDPgRect {
+  int x, y, width, height;
+};
+
+struct sBDPgComposition {
+  int64_t pts;                   // 90kHz
+  int     videoWidth, videoHeight;
+  int     number;                // composition_number
+  int     objectCount;           // 0: clear the screen
+  sBDPgObject objects[BD_PG_MAX_OBJECTS];
+  int     windowCount;
+  sBDPgRect windows[BD_PG_MAX_WINDOWS];
+};
+
+// --- cBDPgCache -------------------------------------------------------
+
+// Decoded bitmaps keyed by a hash of the object (RLE data and size) and
+// of its palette. Display sets repeated at acquisition points or in a new
+// epoch are not decoded again. Entries used by queued compositions are
+// pinned.
+
+class cBDPgCache {
+private:
+  struct sEntry {
+    uint64_t  key;
+    uint32_t *argb;
+    int       width, height;
+    int       pins;
+    uint64_t  lastUse;
+  };
+  sEntry  *entries;
+  int      count, allocated;
+  uint64_t bytes, maxBytes;
+  uint64_t clock;
+
+  void Evict(void);
+
+public:
+  cBDPgCache(uint64_t MaxBytes);
+  ~cBDPgCache();
+
+  // Pinned entry for Key, -1 if not cached
+  int  Find(uint64_t Key);
+  // New pinned entry with room for Width x Height pixels, -1 if out of memory
+  int  Add(uint64_t Key, int Width, int Height);
+  uint32_t *Pixels(int Entry) { return entries[Entry].argb; }
+  void Pin(int Entry);
+  void Unpin(int Entry);
+  void Clear(void);
+};
+
+// --- cBDPgParser ------------------------------------------------------
+
+// Assembles PES packets of one PG stream from TS packets and decodes the
+// segments (PCS, WDS, PDS, ODS, END). Synchronous; used by cBDPgDecoder
+// and bdbench.
+
+class cBDPgParser {
+private:
+  // PES assembly
+  uint8_t *pes;
+  int      pesLength, pesSize;
+  bool     pesStarted;
+
+  // palettes (ARGB) and object buffer of the current epoch
+  struct sPalette {
+    int      version;
+    bool     valid;
+    uint64_t hash;
+    uint32_t argb[256];
+  } palettes[8];
+
+  struct sObject {
+    int      id, version;
+    int      width, height;
+    uint8_t *rle;
+    int      length, size;
+    int      expected;           // object_data_length - 4
+    bool     complete;
+    uint64_t hash;
+  };
+  sObject *objects;
+  int      objectCount, objectsAllocated;
+
+  int64_t  pesPts;
+
+  // state of the display set being received
+  struct sPcsObject {
+    int  objectId, windowId;
+    int  x, y;
+    bool cropped;
+    int  cropX, cropY, cropWidth, cropHeight;
+  };
+  int64_t    pts;
+  int        videoWidth, videoHeight;
+  int        compositionNumber;
+  int        paletteId;
+  bool       havePcs;
+  int        pcsObjectCount;
+  sPcsObject pcsObjects[BD_PG_MAX_OBJECTS];
+  int        windowCount;
+  sBDPgRect  windows[BD_PG_MAX_WINDOWS];
+
+  cBDPgCache cache;
+  sBDPgComposition ready;
+  bool       haveReady;
+
+  void ParsePes(void);
+  void ParseSegment(int Type, const uint8_t *Data, int Length);
+  void ParsePcs(const uint8_t *Data, int Length);
+  void ParseWds(const uint8_t *Data, int Length);
+  void ParsePds(const uint8_t *Data, int Length);
+  void ParseOds(const uint8_t *Data, int Length);
+  void EndOfDisplaySet(void);
+  sObject *Object(int Id, bool Create);
+  void ClearObjects(void);
+
+public:
+  uint64_t displaySets, cacheHits, cacheMisses;
+
+  cBDPgParser(uint64_t CacheBytes = 32 * 1024 * 1024);
+  ~cBDPgParser();
+
+  // Feed one TS packet of the PG PID. Returns true when a composition is ready.
+  bool Packet(const uint8_t *Data);
+  // Take the ready composition. Release it after display.
+  bool Get(sBDPgComposition &Composition);
+  void Release(const sBDPgComposition &Composition);
+  // Forget everything (new stream or seek)
+  void Reset(void);
+};
+
+// Expand a PG RLE bitmap to ARGB with palette Palette.
+// Returns false if the data is damaged (the rest of the bitmap is transparent).
+bool BDPgDecodeRle(const uint8_t *Rle, int Length, const uint32_t *Palette,
+                   uint32_t *Argb, int Width, int Height);
+// ARGB of a palette entry (limited range YCbCr, T: alpha), BT.709 if Hd else BT.601
+uint32_t BDPgColor(int Y, int Cr, int Cb, int T, bool Hd);
+// Fill Count pixels with Color
+void BDPgFill(uint32_t *Dst, uint32_t Color, int Count);
+
+// --- cBDPgPresenter ---------------------------------------------------
+
+class cBDPgPresenter {
+public:
+  virtual ~cBDPgPresenter() {}
+  // Current presentation time of the video (90kHz), < 0 if unknown
+  virtual int64_t Stc(void) = 0;
+  virtual void Show(const sBDPgComposition &Composition) = 0;
+  virtual void Clear(void) = 0;
+};
+
+// --- cBDPgDecoder -----------------------------------------------------
+
+// Decodes one PG stream on its own thread and presents the compositions
+// when the video reaches their PTS. TS packets are queued by Feed()
+// (from the packet loop, never blocks: packets are dropped when the
+// queue is full).
+
+#define BD_PG_MAX_PENDING  8
+
+class cBDPgDecoder : public cBDThread, public cBDSink {
+private:
+  cBDPgPresenter *presenter;
+  cBDPgParser     parser;
+
+  cBDMutex   mutex;
+  cBDCondVar changed;
+  uint8_t   *queue;
+  int        queueSize, queueHead, queueTail;
+  int        pid;
+  bool       flush;
+
+  sBDPgComposition pending[BD_PG_MAX_PENDING];
+  int        pendingCount;
+
+  void Present(void);
+  void DropPending(void);
+
+protected:
+  virtual void Action(void);
+
+public:
+  cBDPgDecoder(cBDPgPresenter *Presenter);
+  virtual ~cBDPgDecoder();
+
+  // Select PG stream (-1: off)
+  void SetPid(int Pid);
+  int  Pid(void) { return pid; }
+  // Drop queued data and clear the screen (seek)
+  void Flush(void);
+
+  // cBDSink, one TS packet per call
+  virtual int  Feed(const uint8_t *Data, int Length);
+  virtual bool Poll(int TimeoutMs) { return true; }
+};
+
+#endif //_BDPG_H
@@ -10,49 +10,67 @@
 #include <vdr/remote.h>
 #include <vdr/tools.h>
 #include <vdr/status.h>
+#include <vdr/plugin.h>     // cPlugin::CacheDirectory()
 #include <vdr/recording.h>  // cMarks
-
-#include <libbluray/bluray.h>
-#include <libbluray/meta_data.h>
-
-#define MIN_TITLE_LENGTH   (180)               // seconds
-#define M2TS_SIZE          (188 + 4)           // size of m2ts packet
-#define ALIGNED_UNIT_SIZE  (32 * M2TS_SIZE)    // size of aligned unit (32 packets)
+#include <vdr/skins.h>
+
+#include <libbluray/keys.h>
+
+#include "bdangle.h"
+#include "bdcore.h"
+#include "bdindex.h"
+#include "bdoverlay.h"
+#include "bdpg.h"
+#include "bdreadahead.h"
+#include "bdsched.h"
+#include "bdstage.h"
+#include "bdstats.h"
+#include "bdsubtitle.h"
+#include "bdtrace.h"
+#include "setupmenu.h"
 
 // --- cBDPlayer --------------------------------------------------------
 
-class cBDPlayer : public cPlayer, cThread {
+class cBDPlayer : public cPlayer, cThread, cBDSink, cBDCoreListener {
 private:
-  BLURAY *bd;
-  BLURAY_TITLE_INFO *title_info;
+  cBDCore *core;
+  cString path, device;
+  cBDIndex index;
+  cBDSubtitleOsd subtitleOsd;
+  cBDPgDecoder subtitles;
+  cBDMenuOsd menuOsd;
 
   cMarks marks;
-  int current_chapter;
 
   enum ePlayModes { pmPlay, pmPause };
   ePlayModes playMode;
+  volatile bool schedChanged;
 
-  uchar buffer[ALIGNED_UNIT_SIZE];
-  int   pos, packs;
+  virtual void Activate(bool On);
 
-  int   current_playlist;
-  int   current_clip;
+  // cBDSink
+  virtual int  Feed(const uint8_t *Data, int Length) { BD_TRACE_SPAN(btPlayTs); return PlayTs(Data, Length, false); }
+  virtual bool Poll(int TimeoutMs) { BD_TRACE_SPAN(btPoll); cPoller Poller; return DevicePoll(Poller, TimeoutMs); }
 
-  bool DoRead(void);
-  bool DoPlay(void);
+  // cBDCoreListener
+  virtual void PlaylistChanged(int Playlist);
+  virtual void ClipChanged(int Clip) { UpdateTracks(Clip); }
+  virtual void EndOfTitle(void) { Cancel(-1); }
+  virtual void AngleChanged(int Angle);
+  virtual void Discontinuity(void) { DeviceClear(); ClearSubtitles(); }
 
-  virtual void Activate(bool On);
+  bool DoPlay(void);
+  void ClearSubtitles(void) { subtitles.Flush(); }
 
   void UpdateTracks(unsigned int current_clip);
   void UpdateMarks();
-  void HandleEvents(BD_EVENT *ev);
   void Empty();
 
 protected:
   void Action(void);
 
 public:
-  cBDPlayer(BLURAY *bd);
+  cBDPlayer(cBDCore *Core, const char *Path, const char *Device);
   ~cBDPlayer();
 
   void Goto(int Seconds);
@@ -60,41 +78,49 @@ public:
   void SkipSeconds(int seconds);
   void Play();
   void Pause();
+  // Recovery and staging as configured (turned on / off)
+  void SetupRecovery(void);
+  void Reconfigure(void);
   bool SelectPlaylist(int pl);
-  BLURAY *BDHandle() { return bd; }
+  bool NextAngle(void);
+  bool MenuActive(void) { return core->MenuActive(); }
+  bool MenuKey(uint32_t Key);
+  bool MenuCall(void);
+  BLURAY *BDHandle() { return core->Handle(); }
+  const char *DiscName(void) { return core->DiscName(); }
   cMarks *Marks() { return &marks; }
   cString PosStr();
+  void Position(cBDRedraw &Redraw) { Redraw.SetPosition(core->Playlist(), core->Clip(), core->Chapter(), core->Angle(), core->Angles()); }
 
+  virtual double FramesPerSecond(void) { return index.FramesPerSecond(); }
   virtual bool GetIndex(int &Current, int &Total, bool SnapToIFrame = false);
   virtual bool GetReplayMode(bool &Play, bool &Forward, int &Speed);
+  virtual void SetSubtitleTrack(eTrackType Type, const tTrackId *TrackId);
 };
 
-cBDPlayer::cBDPlayer(BLURAY *Bd)
+cBDPlayer::cBDPlayer(cBDCore *Core, const char *Path, const char *Device)
+:subtitles(&subtitleOsd)
 {
-  bd = Bd;
-  title_info = NULL;
+  core = Core;
+  path = Path;
+  device = Device;
+  core->SetListener(this);
+  if (core->Navigation())
+    core->SetOverlay(new cBDOverlay(&menuOsd));
   playMode = pmPlay;
-  pos = packs = 0;
-  current_clip = 0;
-  current_playlist = -1;
-  current_chapter = -1;
+  schedChanged = false;
 }
 
 cBDPlayer::~cBDPlayer()
 {
-  if (title_info) {
-    bd_free_title_info(title_info);
-    title_info = NULL;
-  }
-
-  if (bd) {
-    bd_close(bd);
-    bd = NULL;
-  }
+  Detach();
+  delete core;
 }
 
 void cBDPlayer::UpdateTracks(unsigned int current_clip)
 {
+  const BLURAY_TITLE_INFO *title_info = core->TitleInfo();
+
   if (title_info && current_clip < title_info->clip_count) {
     BLURAY_CLIP_INFO *clip = &title_info->clips[current_clip];
     int i;
@@ -114,147 +140,87 @@ void cBDPlayer::UpdateTracks(unsigned int current_clip)
   }
 }
 
-void cBDPlayer::UpdateMarks()
+void cBDPlayer::PlaylistChanged(int Playlist)
 {
-  ((cList<cMark> *)&marks)->Clear();
-
-  if (title_info && title_info->chapter_count > 1) {
-    marks.Add(0);
-    for (unsigned i = 1; i < title_info->chapter_count; i++) {
-      marks.Add(title_info->chapters[i].start / 90000 * 25 - 1);/// 90000 * 25;//DEFAULTFRAMESPERSECOND; // assume 25fps ...
-      marks.Add(title_info->chapters[i].start / 90000 * 25);/// 90000 * 25;//DEFAULTFRAMESPERSECOND; // assume 25fps ...
-    }
-  }
+  index.Build(core->Handle(), core->TitleInfo());
+  UpdateMarks();
 }
 
-void cBDPlayer::HandleEvents(BD_EVENT *ev)
+void cBDPlayer::AngleChanged(int Angle)
 {
-  while (ev->event != BD_EVENT_NONE) {
-
-    switch (ev->event) {
-
-    //case BD_EVENT_ANGLE:
-    //case BD_EVENT_TITLE:
-
-    case BD_EVENT_PLAYLIST:
-      if (title_info) {
-        bd_free_title_info(title_info);
-        title_info = NULL;
-      }
-      title_info = bd_get_playlist_info(bd, ev->param, 0);
-      current_playlist = ev->param;
-      current_chapter = -1;
-      current_clip = -1;
-      UpdateMarks();
-      break;
-
-    case BD_EVENT_PLAYITEM:
-      current_clip = ev->param;
-      UpdateTracks(ev->param);
-      break;
-
-    case BD_EVENT_CHAPTER:
-      current_chapter = ev->param;
-      break;
-
-    case BD_EVENT_END_OF_TITLE:
-      isyslog("END_OF_TITLE");
-      Cancel(-1);
-      break;
-
-    default:
-      break;
-    }
-
-    /* get next event */
-    if (!bd_get_event(bd, ev))
-      break;
-  }
+  Skins.QueueMessage(mtInfo, cString::sprintf(tr("Angle %d/%d"), Angle + 1, core->Angles()), 2);
 }
 
-bool cBDPlayer::DoRead()
+void cBDPlayer::UpdateMarks()
 {
-  BD_EVENT ev = {0, 0};
+  const BLURAY_TITLE_INFO *title_info = core->TitleInfo();
 
-  LOCK_THREAD;
-
-  pos = 0;
-  packs = bd_read_ext(bd, buffer, ALIGNED_UNIT_SIZE, &ev);
+  ((cList<cMark> *)&marks)->Clear();
 
-  if (packs == 0) {
-    if (ev.event == BD_EVENT_NONE) {
-      // title without video
-      cCondWait::SleepMs(3);
+  if (title_info && title_info->chapter_count > 1) {
+    marks.Add(0);
+    for (unsigned i = 1; i < title_info->chapter_count; i++) {
+      int frame = index.FrameOf(title_info->chapters[i].start);
+      marks.Add(frame - 1);
+      marks.Add(frame);
     }
-  } else if (packs < 0) {
-    // ERROR
-    esyslog("bd_read() error");
-    return false;
   }
-  packs /= 192;
-
-  HandleEvents(&ev);
-  return true;
 }
 
 bool cBDPlayer::DoPlay()
 {
-  cPoller Poller;
-
-  if (DevicePoll(Poller, 10)) {
+  if (Poll(10)) {
 
     LOCK_THREAD;
 
-    for (;pos < packs; pos++) {
-
-      uint16_t pid = (((buffer)[1+4+pos*192] << 8) | (buffer)[2+4+pos*192]) & 0x1fff;
-      if (pid >= 1200 && pid < 1300) {
-	// skip PG streams
-	continue;
-      }
-      if (pid >= 1400 && pid < 1500) {
-	// skip IG streams
-	continue;
-      }
-
-      int w = PlayTs(buffer + pos*192 + 4, 188, false);
-
-      if (w == 188) {
-	continue;
-      } else if (w > 0) {
-	esyslog("PlayTs() error: partial ts packet accepted");
-	continue;
-      } else if (w == 0) {
-	//esyslog("PlayTs() error: data not accepted");
-	break;
-      } else {
-	esyslog("PlayTs() error");
-	return false;
-      }
-    }
+    return core->Feed(*this);
   }
 
+  cBDStats::Count(bcPollTimeouts);
   return true;
 }
 
 void cBDPlayer::Activate(bool On)
 {
-  if (On && bd) {
+  if (On) {
+    // the first read may have changed the clip before there was a device
+    UpdateTracks(core->Clip());
+    subtitles.Start();
     Start();
   } else {
     Cancel(6);
+    subtitles.Cancel();
   }
 }
 
+void cBDPlayer::SetSubtitleTrack(eTrackType Type, const tTrackId *TrackId)
+{
+  LOCK_THREAD;
+
+  int pid = (IS_SUBTITLE_TRACK(Type) && TrackId) ? TrackId->id : -1;
+  subtitles.SetPid(pid);
+  core->SetPgSink(pid, pid >= 0 ? &subtitles : NULL);
+}
+
 void cBDPlayer::Action()
 {
-  DoRead();
+  cBDStats::Attach("player");
+  cBDStats::Reset();
+
+  BDApplySched(BDPlayerSched, "BluRay player");
 
   while (Running()) {
 
-    if (pos >= packs) {
-      if (!DoRead()) {
-	break;
+    if (schedChanged) {
+      // applies to the calling thread only
+      schedChanged = false;
+      BDApplySched(BDPlayerSched, "BluRay player");
+    }
+
+    {
+      LOCK_THREAD;
+      if (!core->Read()) {
+        break;
       }
     }
 
@@ -264,17 +230,17 @@ void cBDPlayer::Action()
   }
 
   isyslog("End BluRay playback");
+
+  const char *statsFile = cBDStats::DumpFile();
+  if (statsFile && !cBDStats::Dump(statsFile))
+    LOG_ERROR_STR(statsFile);
 }
 
 void cBDPlayer::SkipSeconds(int seconds)
 {
-  uint64_t tick = bd_tell_time(bd);
-  if (tick < 0) {
-    isyslog("bd_tell_time() failed");
-    return;
-  }
+  LOCK_THREAD;
 
-  seconds += tick / 90000;
+  seconds += core->TellTime();
   if (seconds < 0) {
     seconds = 0;
   }
@@ -286,27 +252,19 @@ void cBDPlayer::Goto(int seconds)
 {
   LOCK_THREAD;
 
-  Empty();
-  uint64_t tick = seconds;
-  tick *= 90000;
-
-  isyslog("Seek to %d", seconds);
-  bd_seek_time(bd, tick);
+  DeviceClear();
+  ClearSubtitles();
+  core->Seek(seconds);
 }
 
 void cBDPlayer::SkipChapters(int Chapters)
 {
   LOCK_THREAD;
 
-  if (title_info && current_chapter > 0) {
-    int chapter = current_chapter + Chapters;
-    if (chapter < 1) chapter = 1;
-    if (chapter > (int)title_info->chapter_count) chapter = title_info->chapter_count;
-
-    Empty();
-
-    isyslog("Seek to chapter %d", chapter);
-    bd_seek_chapter(bd, chapter - 1);
+  if (core->Chapter() > 0) {
+    DeviceClear();
+    ClearSubtitles();
+    core->SeekChapter(core->Chapter() + Chapters);
   }
 }
 
@@ -314,22 +272,43 @@ void cBDPlayer::Empty(void)
 {
   LOCK_THREAD;
 
-  pos = packs = 0;
+  core->Empty();
 
   DeviceClear();
+  ClearSubtitles();
 }
 
 bool cBDPlayer::SelectPlaylist(int pl)
 {
-  bool end_of_title;
-
   LOCK_THREAD;
 
   Empty();
 
-  end_of_title = !bd_select_playlist(bd, pl);
-  isyslog("bd_select_playlist -> %s", end_of_title ? "FAIL" : "OK");
-  return !end_of_title;
+  return core->SelectPlaylist(pl);
+}
+
+bool cBDPlayer::NextAngle(void)
+{
+  LOCK_THREAD;
+
+  if (core->Angles() < 2)
+    return false;
+
+  return core->SelectAngle((core->Angle() + 1) % core->Angles());
+}
+
+bool cBDPlayer::MenuKey(uint32_t Key)
+{
+  LOCK_THREAD;
+
+  return core->UserInput(Key, (int64_t)DeviceGetSTC());
+}
+
+bool cBDPlayer::MenuCall(void)
+{
+  LOCK_THREAD;
+
+  return core->MenuCall((int64_t)DeviceGetSTC());
 }
 
 void cBDPlayer::Pause(void)
@@ -341,6 +320,7 @@ void cBDPlayer::Pause(void)
     LOCK_THREAD;
 
     DeviceFreeze();
+    core->Pause(true);
     playMode = pmPause;
   }
 }
@@ -351,26 +331,69 @@ void cBDPlayer::Play(void)
   if (playMode != pmPlay) {
     LOCK_THREAD;
 
+    core->Pause(false);
     DevicePlay();
     playMode = pmPlay;
   }
 }
 
+void cBDPlayer::SetupRecovery(void)
+{
+  // both keep state in the plugin's cache directory
+  bool recover = BDRecoveryConfig.mode != rmOff;
+  if (recover && !core->Recovery()) {
+    core->SetRecovery(new cBDRecovery(BDRecoveryConfig, path, device,
+                                      cPlugin::CacheDirectory(PLUGIN_NAME_I18N)));
+  } else if (!recover && core->Recovery())
+    core->SetRecovery(NULL);
+
+  // staging needs the read-ahead file layer the disc was opened with
+  cBDReadAhead *readAhead = core->ReadAhead();
+  if (BDStageConfig.maxMB > 0 && readAhead && !readAhead->Stage()) {
+    cString dir = cString::sprintf("%s/stage", cPlugin::CacheDirectory(PLUGIN_NAME_I18N));
+    if (MakeDirs(dir, true))
+      core->SetStage(new cBDStage(BDStageConfig, path, dir));
+  } else if (BDStageConfig.maxMB <= 0 && readAhead && readAhead->Stage())
+    core->SetStage(NULL);
+}
+
+void cBDPlayer::Reconfigure(void)
+{
+  LOCK_THREAD;
+
+  core->Reconfigure();
+  core->SetReadSize(BDSetup.readUnits * ALIGNED_UNIT_SIZE);
+  SetupRecovery();
+  schedChanged = true;
+}
+
 cString cBDPlayer::PosStr()
 {
+  int current_playlist = core->Playlist();
+  int current_clip     = core->Clip();
+  int current_chapter  = core->Chapter();
+  int angles           = core->Angles();
+
   cString pl = current_playlist >= 0 ? cString::sprintf("PL %d",  current_playlist) : cString("");
   cString cl = current_clip     >= 0 ? cString::sprintf(" CL %d", current_clip)     : cString("");
   cString ch = current_chapter  >= 1 ? cString::sprintf(" C %d",  current_chapter)  : cString("");
-  return cString::sprintf("%s%s%s", *pl, *cl, *ch);
+  cString an = angles           >  1 ? cString::sprintf(" A %d/%d", core->Angle() + 1, angles) : cString("");
+  return cString::sprintf("%s%s%s%s", *pl, *cl, *ch, *an);
 }
 
 bool cBDPlayer::GetIndex(int &Current, int &Total, bool SnapToIFrame)
 {
   LOCK_THREAD;
 
-  if (title_info) {
-    Total = title_info->duration / 90000 * 25;
-    Current = bd_tell_time(bd) / 90000 * 25;
+  if (core->TitleInfo()) {
+    uint64_t time = bd_tell_time(core->Handle());
+    if (SnapToIFrame) {
+      int e = index.EntryAt(time);
+      if (e >= 0)
+        time = index.Entry(e).time;
+    }
+    Total = index.Frames();
+    Current = index.FrameOf(time);
     return true;
   }
 
@@ -393,9 +416,11 @@ bool cBDPlayer::GetReplayMode(bool &Play, bool &Forward, int &Speed)
 #define MODETIMEOUT       3 // seconds
 
 int cBDControl::active = 0;
+bool cBDControl::menus = true;
 
 cBDControl::cBDControl(cBDPlayer *Player)
-:cControl(Player)
+:cControl(Player),
+ redraw(BDRedrawConfig.maxRate)
 {
   player = Player;
   active++;
@@ -412,6 +437,8 @@ cBDControl::cBDControl(cBDPlayer *Player)
   disc_name = tr("BluRay");
   menu = NULL;
 
+  cBDStats::Attach("ui");
+
   cStatus::MsgReplaying(this, "BluRay", NULL, true);
 }
 
@@ -424,65 +451,68 @@ cBDControl::~cBDControl()
   cStatus::MsgReplaying(this, NULL, NULL, false);
 }
 
-cControl *cBDControl::Create(const char *Path)
+cBDPlayer *cBDControl::Open(const char *Path, const char *Device, cBDOpenListener *Listener)
 {
-  const struct meta_dl *meta_data = NULL;
-  BLURAY *bd;
-
-  /* open disc */
-  bd = bd_open(Path, NULL);
-  if (!bd) {
-    isyslog("opening BluRay disc %s failed", Path);
+  // disc menus if possible, else the main title
+  cBDCore *core = cBDCore::Open(Path, BDSetup.minTitleLength, -1, Listener, menus);
+  if (!core) {
     return NULL;
   }
 
-  /* load title list */
-  unsigned num_title_idx = bd_get_titles(bd, TITLES_RELEVANT, MIN_TITLE_LENGTH);
-  if (num_title_idx < 1) {
-    esyslog("BluRay: no titles found");
-    return NULL;
-  }
-  isyslog("BluRay: %d titles", num_title_idx);
+  core->SetAnglePrefetch(new cBDAnglePrefetch(Path));
+  core->SetReadSize(BDSetup.readUnits * ALIGNED_UNIT_SIZE);
 
-  /* guess the main title */
+  cBDPlayer *player = new cBDPlayer(core, Path, Device);
+  player->SetupRecovery();
 
-  unsigned title_idx = 0;
-  uint64_t duration = 0;
-  int playlist = 99999;
-
-  for (unsigned i = 0; i < num_title_idx; i++) {
-    BLURAY_TITLE_INFO *info = bd_get_title_info(bd, i, 0);
-    if (info) {
-      if (info->duration > duration) {
-        title_idx = i;
-        duration  = info->duration;
-        playlist  = info->playlist;
+  // menus draw on the OSD, they start when the player is attached
+  if (!core->Navigation()) {
+    if (Listener) {
+      if (Listener->OpenCancelled()) {
+        delete player;
+        return NULL;
       }
-      bd_free_title_info(info);
+      Listener->OpenStage(boFirstData);
+    }
+    if (!core->Read()) {
+      esyslog("BluRay: reading %s failed", Path);
+      delete player;
+      return NULL;
     }
   }
-  isyslog("BluRay main title: #%d (%05d.mpls)\n", title_idx, playlist);
 
-  /* init event queue */
-  bd_get_event(bd, NULL);
-
-  /* select playlist */
-  if (bd_select_title(bd, title_idx) <= 0) {
-    esyslog("bd_select_title(%d) failed", title_idx);
-    return NULL;
-  }
+  return player;
+}
 
-  cBDControl *control = new cBDControl(new cBDPlayer(bd));
+cControl *cBDControl::Create(cBDPlayer *Player, const char *Path)
+{
+  cBDControl *control = new cBDControl(Player);
+  control->path = Path;
 
   /* get disc name */
-  meta_data = bd_get_meta(bd);
-  if (meta_data && meta_data->di_name && strlen(meta_data->di_name) > 1) {
-    control->disc_name = meta_data->di_name;
+  const char *name = Player->DiscName();
+  if (name) {
+    control->disc_name = name;
   }
 
   return control;
 }
 
+void cBDControl::Close(cBDPlayer *Player)
+{
+  delete Player;
+}
+
+void cBDControl::Reconfigure(void)
+{
+  cBDControl *control = dynamic_cast<cBDControl *>(cControl::Control(true));
+  if (control) {
+    control->redraw.SetRate(BDRedrawConfig.maxRate);
+    if (control->player)
+      control->player->Reconfigure();
+  }
+}
+
 void cBDControl::Pause(void)
 {
   if (player)
@@ -502,6 +532,36 @@ BLURAY *cBDControl::BDHandle()
   return NULL;
 }
 
+void cBDControl::NextAngle(void)
+{
+  if (player && !player->NextAngle())
+    Skins.Message(mtInfo, tr("No other angles"));
+}
+
+void cBDControl::MenuCall(void)
+{
+  if (player && !player->MenuCall())
+    Skins.Message(mtInfo, tr("No disc menu"));
+}
+
+bool cBDControl::MenuKey(eKeys Key)
+{
+  uint32_t vk;
+  switch (int(NORMALKEY(Key))) {
+    case kUp:      vk = BD_VK_UP;    break;
+    case kDown:    vk = BD_VK_DOWN;  break;
+    case kLeft:    vk = BD_VK_LEFT;  break;
+    case kRight:   vk = BD_VK_RIGHT; break;
+    case kOk:      vk = BD_VK_ENTER; break;
+    case k1 ... k9: vk = BD_VK_1 + (NORMALKEY(Key) - k1); break;
+    default:       return false;
+  }
+  // consume releases and repeated activations, repeat moves the selection
+  if (player && !(Key & k_Release) && !((Key & k_Repeat) && vk == BD_VK_ENTER))
+    player->MenuKey(vk);
+  return true;
+}
+
 bool cBDControl::SelectPlaylist(int pl)
 {
   if (player)
@@ -586,6 +646,7 @@ void cBDControl::ShowMode(void)
         if (modeOnly && !timeoutShow && NormalPlay)
            timeoutShow = time(NULL) + MODETIMEOUT;
         displayReplay->SetMode(Play, Forward, Speed);
+        redraw.Mark(rfMode);
         lastPlay = Play;
         lastForward = Forward;
         lastSpeed = Speed;
@@ -595,7 +656,7 @@ void cBDControl::ShowMode(void)
 
 bool cBDControl::ShowProgress(bool Initial)
 {
-  // from vdr-1.7.34
+  // from vdr-1.7.34, changes drawn by cBDRedraw with one flush
   int Current, Total;
 
   if (GetIndex(Current, Total) && Total > 0) {
@@ -605,35 +666,35 @@ bool cBDControl::ShowProgress(bool Initial)
         SetNeedsFastResponse(true);
         visible = true;
         }
-     if (Initial) {
-        lastCurrent = lastTotal = -1;
-        }
-     if (Current != lastCurrent || Total != lastTotal) {
-        if (Total != lastTotal) {
-           int Index = Total;
-           displayReplay->SetTotal(IndexToHMSF(Index, false, FramesPerSecond()));
-           if (!Initial)
-              displayReplay->Flush();
-           }
+     if (Initial)
+        redraw.Reset();
+     redraw.SetIndex(Current, Total, FramesPerSecond());
+     if (player)
+        player->Position(redraw);
+     ShowMode();
+
+     uint64_t now = cBDStats::Now();
+     int fields = redraw.Due(now);
+     if (fields & rfTotal)
+        displayReplay->SetTotal(IndexToHMSF(Total, false, FramesPerSecond()));
+     if (fields & rfProgress)
         displayReplay->SetProgress(Current, Total);
-        if (!Initial)
-           displayReplay->Flush();
+     if (fields & rfCurrent)
         displayReplay->SetCurrent(IndexToHMSF(Current, false, FramesPerSecond()));
-
-        cString Title;
+     if (fields & rfTitle) {
         cString Pos = player ? player->PosStr() : cString(NULL);
-        if (*Pos && strlen(Pos) > 1) {
-          Title = cString::sprintf("%s (%s)", *disc_name, *Pos);
-        } else {
-          Title = disc_name;
+        if (*Pos && strlen(Pos) > 1)
+           displayReplay->SetTitle(cString::sprintf("%s (%s)", *disc_name, *Pos));
+        else
+           displayReplay->SetTitle(disc_name);
         }
-        displayReplay->SetTitle(Title);
-
+     if (fields) {
+        BD_TRACE_SPAN(btOsdFlush);
         displayReplay->Flush();
-        lastCurrent = Current;
+        redraw.Drawn(now);
         }
+     lastCurrent = Current;
      lastTotal = Total;
-     ShowMode();
      return true;
      }
   return false;
@@ -769,6 +830,9 @@ eOSState cBDControl::ProcessKey(eKeys Key)
      TimeSearchProcess(Key);
      return osContinue;
      }
+  // disc menu shown: navigation keys go to the disc
+  if (player && player->MenuActive() && MenuKey(Key))
+     return osContinue;
   bool DoShowMode = true;
 
   switch ((int)Key) {
@@ -796,6 +860,10 @@ eOSState cBDControl::ProcessKey(eKeys Key)
                   break;
     case k6:      SkipChapters(1);
                   break;
+    case k5:      NextAngle();
+                  break;
+    case k0:      MenuCall();
+                  break;
     default: {
       DoShowMode = false;
       switch (int(Key)) {
@@ -11,14 +11,19 @@
 #include <vdr/player.h>
 #include <vdr/tools.h>
 
+#include "bdredraw.h"
+
+class cBDOpenListener;
 class cBDPlayer;
 struct bluray;
 
 class cBDControl : public cControl {
 private:
   static int active;
+  static bool menus;
   cBDPlayer *player;
   cString disc_name;
+  cString path;
   cOsdMenu *menu;
 
   cBDControl();
@@ -29,6 +34,9 @@ private:
   void SkipSeconds(int seconds);
   void SkipChapters(int chapters);
   void Goto(int seconds);
+  void NextAngle(void);
+  void MenuCall(void);
+  bool MenuKey(eKeys Key);
 
   cSkinDisplayReplay *displayReplay;
   bool visible, modeOnly, shown;
@@ -39,6 +47,7 @@ private:
   bool timeSearchActive, timeSearchHide;
   int timeSearchTime, timeSearchPos;
   int chapterSeekTime;
+  cBDRedraw redraw;
 
   void TimeSearchDisplay(void);
   void TimeSearchProcess(eKeys Key);
@@ -48,8 +57,19 @@ private:
   bool ShowProgress(bool Initial);
 
 public:
-  static cControl *Create(const char *Path);
+  // Open the disc at Path and read the first data (any thread). Device
+  // is the drive Path is on (NULL for discs in the library). Listener
+  // gets the stages and can cancel (NULL: none).
+  static cBDPlayer *Open(const char *Path, const char *Device = NULL, cBDOpenListener *Listener = NULL);
+  // Control of an opened player (VDR main thread, takes ownership)
+  static cControl *Create(cBDPlayer *Player, const char *Path);
+  // Close a player that was not launched
+  static void Close(cBDPlayer *Player);
   static bool Active(void) { return active > 0; }
+  // Start with the disc menus (HDMV discs) instead of the main title
+  static void SetMenus(bool On) { menus = On; }
+  // Apply changed settings to the running playback, if any
+  static void Reconfigure(void);
 
   virtual ~cBDControl();
 
@@ -61,6 +81,9 @@ public:
   virtual cString GetHeader(void);
   virtual eOSState ProcessKey(eKeys Key);
 
+  const char *Path(void)     { return path; }
+  const char *DiscName(void) { return disc_name; }
+
   struct bluray *BDHandle();
   bool SelectPlaylist(int pl);
 };
@@ -0,0 +1,629 @@
+/*
+ * bdreadahead.c: Adaptive read-ahead for disc folders on slow storage
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <libbluray/bluray-version.h>
+
+#include "bdaacs.h"
+#include "bdsched.h"
+#include "bdstage.h"
+#include "bdstats.h"
+#include "m2ts.h"
+
+#include "bdreadahead.h"
+
+#define DEFAULT_BITRATE  (6 * 1024 * 1024)       // bytes/s until measured (48 Mbit/s, BD maximum)
+#define MAX_BITRATE      (8 * 1024 * 1024)       // bytes/s the ring is sized for
+#define MIN_REQUEST      (16 * ALIGNED_UNIT_SIZE)  // 96 KB
+#define MAX_REQUEST      (704 * ALIGNED_UNIT_SIZE) // 4.1 MB
+#define MODEL_DECAY      0.9                     // weight of older requests per request
+#define TAKEOVER_US      1000000                 // idle time before another stream gets the buffer
+
+sBDReadAheadConfig BDReadAheadConfig = {
+  0,       // seconds
+  64,      // maxMB
+  0,       // aacsThreads
+  0,       // pauseSeconds
+};
+
+struct cBDReadAhead::sStream {
+  cBDReadAhead *owner;
+  int      fd;
+  uint64_t size;
+  uint64_t pos;
+  bool     buffered;            // stream file, read through the ring buffer
+  uint64_t lastRead;
+  char     clip[8];             // stream file name without extension
+};
+
+// --- cBDReadModel -----------------------------------------------------
+
+void cBDReadModel::Reset(void)
+{
+  n = sx = sy = sxx = sxy = 0;
+  latency = 0;
+  throughput = 0;
+}
+
+void cBDReadModel::Add(int Bytes, uint64_t Us)
+{
+  double x = Bytes, y = Us / 1e6;
+  n   = n   * MODEL_DECAY + 1;
+  sx  = sx  * MODEL_DECAY + x;
+  sy  = sy  * MODEL_DECAY + y;
+  sxx = sxx * MODEL_DECAY + x * x;
+  sxy = sxy * MODEL_DECAY + x * y;
+
+  // y = latency + x / throughput
+  double var = n * sxx - sx * sx;
+  if (var > 1e-6 * n * sxx) {
+    double slope = (n * sxy - sx * sy) / var;
+    if (slope > 0) {
+      throughput = 1 / slope;
+      latency = (sy - slope * sx) / n;
+      if (latency < 0)
+        latency = 0;
+    } else if (sy > 0) {
+      // larger requests are not slower: all latency
+      throughput = sx / sy;
+      latency = sy / n;
+    }
+  } else if (throughput <= 0 && sy > 0) {
+    // one request size so far
+    throughput = sx / sy;
+  }
+}
+
+int cBDReadModel::RequestSize(int Min, int Max) const
+{
+  if (throughput <= 0)
+    return Min;
+  double size = 8 * latency * throughput;
+  if (size <= Min)
+    return Min;
+  if (size >= Max)
+    return Max;
+  int s = (int)size;
+  return s - s % ALIGNED_UNIT_SIZE;
+}
+
+// --- file layer -------------------------------------------------------
+
+static void DirClose(BD_DIR_H *Dir)
+{
+  closedir((DIR *)Dir->internal);
+  free(Dir);
+}
+
+static int DirRead(BD_DIR_H *Dir, BD_DIRENT *Entry)
+{
+  errno = 0;
+  struct dirent *e = readdir((DIR *)Dir->internal);
+  if (!e)
+    return errno ? -1 : 1;
+  snprintf(Entry->d_name, sizeof(Entry->d_name), "%s", e->d_name);
+  return 0;
+}
+
+BD_DIR_H *cBDReadAhead::DirOpen(void *Handle, const char *RelPath)
+{
+  cBDReadAhead *ra = (cBDReadAhead *)Handle;
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", ra->root, RelPath);
+  DIR *d = opendir(path);
+  if (!d)
+    return NULL;
+  BD_DIR_H *dir = (BD_DIR_H *)calloc(1, sizeof(BD_DIR_H));
+  if (!dir) {
+    closedir(d);
+    return NULL;
+  }
+  dir->internal = d;
+  dir->close = DirClose;
+  dir->read = DirRead;
+  return dir;
+}
+
+BD_FILE_H *cBDReadAhead::FileOpen(void *Handle, const char *RelPath)
+{
+  return ((cBDReadAhead *)Handle)->OpenFile(RelPath);
+}
+
+void cBDReadAhead::StreamClose(BD_FILE_H *File)
+{
+  sStream *s = (sStream *)File->internal;
+  s->owner->Close(s);
+  free(File);
+}
+
+int64_t cBDReadAhead::StreamSeek(BD_FILE_H *File, int64_t Offset, int32_t Origin)
+{
+  // the buffer follows at the next read
+  sStream *s = (sStream *)File->internal;
+  int64_t pos;
+  switch (Origin) {
+    case SEEK_SET: pos = Offset; break;
+    case SEEK_CUR: pos = s->pos + Offset; break;
+    case SEEK_END: pos = s->size + Offset; break;
+    default:       return -1;
+  }
+  if (pos < 0)
+    return -1;
+  s->pos = pos;
+  return pos;
+}
+
+int64_t cBDReadAhead::StreamTell(BD_FILE_H *File)
+{
+  return ((sStream *)File->internal)->pos;
+}
+
+int cBDReadAhead::StreamEof(BD_FILE_H *File)
+{
+  sStream *s = (sStream *)File->internal;
+  return s->pos >= s->size;
+}
+
+int64_t cBDReadAhead::StreamRead(BD_FILE_H *File, uint8_t *Buffer, int64_t Size)
+{
+  sStream *s = (sStream *)File->internal;
+  if (Size <= 0 || Size > 0x7fffffff)
+    return Size ? -1 : 0;
+  return s->owner->Read(s, Buffer, (int)Size);
+}
+
+int64_t cBDReadAhead::NoWrite(BD_FILE_H *File, const uint8_t *Buffer, int64_t Size)
+{
+  return -1;
+}
+
+// --- cBDReadAhead -----------------------------------------------------
+
+cBDReadAhead::cBDReadAhead(const char *Root, const sBDReadAheadConfig &Config)
+:cBDThread("BluRay read-ahead")
+{
+  root = strdup(Root);
+  config = Config;
+  // decryption and pause buffering happen in the buffer: keep a little
+  if ((config.aacsThreads > 0 || config.pauseSeconds > 0) && config.seconds <= 0)
+    config.seconds = 1;
+  aacs = NULL;
+  stage = NULL;
+  ring = NULL;
+  // room for the buffered time at any BD bitrate and a request in flight
+  int seconds = config.pauseSeconds > config.seconds ? config.pauseSeconds : config.seconds;
+  int64_t size = (int64_t)seconds * MAX_BITRATE + 2 * MAX_REQUEST;
+  if (size > (int64_t)config.maxMB * 1024 * 1024)
+    size = (int64_t)config.maxMB * 1024 * 1024;
+  if (size < 4 * MIN_REQUEST)
+    size = 4 * MIN_REQUEST;
+  ringSize = size - size % ALIGNED_UNIT_SIZE;
+  active = NULL;
+  winStart = 0;
+  winLen = ringStart = 0;
+  generation = 0;
+  busy = NULL;
+  failed = false;
+  bitrate = DEFAULT_BITRATE;
+  requests = 0;
+  paused = false;
+  lent = false;
+  lentGeneration = 0;
+  lentStart = 0;
+  schedChanged = false;
+  deepUntil = 0;
+  waits = waitUs = bytes = 0;
+}
+
+cBDReadAhead::~cBDReadAhead()
+{
+  Cancel();
+  if (requests) {
+    syslog(LOG_INFO, "BluRay: read-ahead: %d requests, latency %.1f ms, %.1f MB/s, %llu waits (%llu ms)",
+           requests, model.Latency() * 1000, model.Throughput() / 1e6,
+           (unsigned long long)waits, (unsigned long long)(waitUs / 1000));
+  }
+  delete aacs;
+  delete stage;
+  free(ring);
+  free(root);
+}
+
+BLURAY *cBDReadAhead::Open(void)
+{
+#if BLURAY_VERSION >= BLURAY_VERSION_CODE(1, 0, 0)
+  struct stat st;
+  if (stat(root, &st) || !S_ISDIR(st.st_mode))
+    return NULL;
+
+  BLURAY *bd = bd_init();
+  if (bd && !bd_open_files(bd, this, DirOpen, FileOpen)) {
+    bd_close(bd);
+    bd = NULL;
+  }
+  // after bd_open_files(): libaacs has the media key then; stream data
+  // is read only later
+  if (bd && config.aacsThreads > 0 && !aacs)
+    aacs = cBDAacs::Open(root, config.aacsThreads - 1, bd);
+  if (bd)
+    syslog(LOG_INFO, "BluRay: read-ahead of %d s (up to %d MB) for %s", config.seconds, ringSize >> 20, root);
+  return bd;
+#else
+  return NULL;
+#endif
+}
+
+BD_FILE_H *cBDReadAhead::OpenFile(const char *RelPath)
+{
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", root, RelPath);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return NULL;
+  }
+
+  BD_FILE_H *file = (BD_FILE_H *)calloc(1, sizeof(BD_FILE_H) + sizeof(sStream));
+  if (!file) {
+    close(fd);
+    return NULL;
+  }
+  sStream *s = (sStream *)(file + 1);
+  s->owner = this;
+  s->fd = fd;
+  s->size = st.st_size;
+  s->pos = 0;
+  s->lastRead = 0;
+  s->buffered = false;
+  s->clip[0] = 0;
+
+  if (!strncmp(RelPath, "BDMV/STREAM/", 12))
+    snprintf(s->clip, sizeof(s->clip), "%.5s", RelPath + 12);
+
+  if (config.seconds > 0 && !strncmp(RelPath, "BDMV/STREAM/", 12)) {
+    cBDMutexLock lock(mutex);
+    if (!ring)
+      ring = (uint8_t *)malloc(ringSize);
+    s->buffered = ring != NULL;
+    if (s->buffered && !Active())
+      Start();
+  }
+
+  file->internal = s;
+  file->close = StreamClose;
+  file->seek = StreamSeek;
+  file->tell = StreamTell;
+  file->eof = StreamEof;
+  file->read = StreamRead;
+  file->write = NoWrite;
+  return file;
+}
+
+ssize_t cBDReadAhead::ReadAt(int Fd, uint8_t *Buffer, int Size, uint64_t Offset)
+{
+  ssize_t r;
+  do {
+    r = pread(Fd, Buffer, Size, Offset);
+  } while (r < 0 && errno == EINTR);
+  return r;
+}
+
+void cBDReadAhead::SetBitrate(double BytesPerSecond)
+{
+  cBDMutexLock lock(mutex);
+  if (BytesPerSecond > 0) {
+    bitrate = BytesPerSecond;
+    wake.Signal();
+  }
+}
+
+void cBDReadAhead::SetConfig(const sBDReadAheadConfig &Config)
+{
+  cBDMutexLock lock(mutex);
+  // the file layer stays, with a little buffer at least
+  config.seconds = Config.seconds > 0 ? Config.seconds : 1;
+  config.pauseSeconds = Config.pauseSeconds;
+  wake.Signal();
+}
+
+void cBDReadAhead::Reschedule(void)
+{
+  cBDMutexLock lock(mutex);
+  if (aacs)
+    aacs->Reschedule();
+  schedChanged = true;
+  wake.Signal();
+}
+
+void cBDReadAhead::SetPaused(bool On)
+{
+  cBDMutexLock lock(mutex);
+  if (On == paused)
+    return;
+  paused = On;
+  // the buffer drains at the playback rate: refill it meanwhile
+  deepUntil = On || config.pauseSeconds <= 0 ? 0 : cBDStats::Now() + (uint64_t)config.pauseSeconds * 1000000;
+  if (On && config.pauseSeconds > 0)
+    syslog(LOG_INFO, "BluRay: read-ahead: paused, buffering %d s", config.pauseSeconds);
+  wake.Signal();
+}
+
+bool cBDReadAhead::LendDrive(void)
+{
+  cBDMutexLock lock(mutex);
+  if (!paused || lent || busy || !active)
+    return false;
+  int request, depth;
+  Sizing(request, depth);
+  if (!failed && winLen < depth && winStart + winLen < active->size)
+    return false;
+  lent = true;
+  lentGeneration = generation;
+  lentStart = winStart;
+  return true;
+}
+
+bool cBDReadAhead::DriveWanted(void)
+{
+  cBDMutexLock lock(mutex);
+  return !paused || generation != lentGeneration || winStart != lentStart;
+}
+
+void cBDReadAhead::ReturnDrive(void)
+{
+  cBDMutexLock lock(mutex);
+  lent = false;
+  wake.Signal();
+}
+
+void cBDReadAhead::Sizing(int &Request, int &Depth)
+{
+  // the buffered time, at least two requests, and room for one more
+  bool deep = paused || (deepUntil && cBDStats::Now() < deepUntil);
+  double depth = bitrate * (deep && config.pauseSeconds > config.seconds ? config.pauseSeconds : config.seconds);
+  Request = model.RequestSize(MIN_REQUEST, MAX_REQUEST);
+  if (Request > depth / 2) {
+    Request = (int)(depth / 2);
+    Request -= Request % ALIGNED_UNIT_SIZE;
+    if (Request < MIN_REQUEST)
+      Request = MIN_REQUEST;
+  }
+  if (depth < 2 * Request)
+    depth = 2 * Request;
+  if (depth > ringSize - Request)
+    depth = ringSize - Request;
+  Depth = (int)depth;
+}
+
+int cBDReadAhead::RequestSize(void)
+{
+  cBDMutexLock lock(mutex);
+  int request, depth;
+  Sizing(request, depth);
+  return request;
+}
+
+int cBDReadAhead::Depth(void)
+{
+  cBDMutexLock lock(mutex);
+  int request, depth;
+  Sizing(request, depth);
+  return depth;
+}
+
+void cBDReadAhead::Restart(sStream *Stream, uint64_t Pos)
+{
+  active = Stream;
+  winStart = Pos;
+  winLen = ringStart = 0;
+  failed = false;
+  generation++;
+  wake.Signal();
+}
+
+void cBDReadAhead::Consume(sStream *Stream)
+{
+  // data before the read position is not needed again
+  if (active == Stream && Stream->pos > winStart && Stream->pos <= winStart + winLen) {
+    int drop = Stream->pos - winStart;
+    ringStart = (ringStart + drop) % ringSize;
+    winStart = Stream->pos;
+    winLen -= drop;
+    wake.Signal();
+  }
+}
+
+int cBDReadAhead::Read(sStream *Stream, uint8_t *Buffer, int Size)
+{
+  if (Stream->pos >= Stream->size)
+    return 0;
+  if (Stream->buffered) {
+    cBDMutexLock lock(mutex);
+    // a second stream read at the same time (sub paths) is read
+    // directly, it gets the buffer when the playing one is idle
+    uint64_t now = cBDStats::Now();
+    if (!active || active == Stream || now - active->lastRead >= TAKEOVER_US) {
+      Stream->lastRead = now;
+      return ReadBuffered(Stream, Buffer, Size);
+    }
+  }
+  ssize_t r = ReadStream(Stream, Buffer, Size, Stream->pos);
+  if (r > 0)
+    Stream->pos += r;
+  return r;
+}
+
+int cBDReadAhead::ReadBuffered(sStream *Stream, uint8_t *Buffer, int Size)
+{
+  int n = 0;
+  uint64_t waitStart = 0;
+  while (n < Size && Stream->pos < Stream->size) {
+    if (active != Stream || Stream->pos < winStart || Stream->pos > winStart + winLen)
+      Restart(Stream, Stream->pos);
+    else
+      Consume(Stream);
+    if (winLen > 0) {
+      int c = Size - n;
+      if (c > winLen)
+        c = winLen;
+      if (c > ringSize - ringStart)
+        c = ringSize - ringStart;
+      memcpy(Buffer + n, ring + ringStart, c);
+      cBDStats::Count(bcCopiedBytes, c);
+      n += c;
+      Stream->pos += c;
+      continue;
+    }
+    if (failed)
+      break;
+    if (!waitStart) {
+      waitStart = cBDStats::Now();
+      waits++;
+      cBDStats::Count(bcReadAheadWaits);
+    }
+    filled.TimedWait(mutex, 100);
+  }
+  Consume(Stream);
+  if (waitStart)
+    waitUs += cBDStats::Now() - waitStart;
+  bytes += n;
+  return n > 0 || !failed ? n : -1;
+}
+
+void cBDReadAhead::Close(sStream *Stream)
+{
+  if (Stream->buffered) {
+    cBDMutexLock lock(mutex);
+    // the thread may be reading into the buffer from this file
+    while (busy == Stream)
+      filled.TimedWait(mutex, 100);
+    if (active == Stream) {
+      active = NULL;
+      generation++;
+    }
+  }
+  close(Stream->fd);
+}
+
+void cBDReadAhead::SetStage(cBDStage *Stage)
+{
+  // may change during playback (setup)
+  cBDMutexLock lock(stageMutex);
+  if (stage != Stage) {
+    delete stage;
+    stage = Stage;
+  }
+}
+
+ssize_t cBDReadAhead::ReadStream(sStream *Stream, uint8_t *Buffer, int Size, uint64_t Offset)
+{
+  // staged ranges from the cache, the rest from the disc
+  int n = 0;
+  if (Stream->clip[0]) {
+    cBDMutexLock lock(stageMutex);
+    n = stage ? stage->Read(Stream->clip, Buffer, Size, Offset) : 0;
+  }
+  if (n >= Size)
+    return n;
+  ssize_t r = ReadAt(Stream->fd, Buffer + n, Size - n, Offset + n);
+  {
+    cBDMutexLock lock(stageMutex);
+    if (stage)
+      stage->Missed(r > 0 ? r : 0);
+  }
+  if (r < 0)
+    return n > 0 ? n : r;
+  return n + r;
+}
+
+void cBDReadAhead::Decrypt(uint8_t *Data, int Length, uint64_t Offset)
+{
+  // whole aligned units only; units split between requests stay
+  // encrypted and libaacs decrypts them
+  int skip = (ALIGNED_UNIT_SIZE - Offset % ALIGNED_UNIT_SIZE) % ALIGNED_UNIT_SIZE;
+  int units = Length > skip ? (Length - skip) / ALIGNED_UNIT_SIZE : 0;
+  if (units > 0) {
+    cBDStatTimer timer(bhDecrypt);
+    aacs->Decrypt(Data + skip, units);
+  }
+}
+
+void cBDReadAhead::Action(void)
+{
+  cBDStats::Attach("read-ahead");
+  BDApplyPlayerSched("BluRay read-ahead");
+
+  mutex.Lock();
+  while (Running()) {
+    if (schedChanged) {
+      schedChanged = false;
+      BDApplyPlayerSched("BluRay read-ahead");
+    }
+    sStream *s = active;
+    int request, depth;
+    Sizing(request, depth);
+    // twice the size now and then, for the latency estimate
+    if ((requests & 3) == 3 && winLen + 2 * request <= ringSize && 2 * request <= MAX_REQUEST)
+      request *= 2;
+
+    uint64_t end = winStart + winLen;
+    int index = (ringStart + winLen) % ringSize;
+    int size = 0;
+    if (s && !failed && !lent && end < s->size && winLen < depth) {
+      size = request;
+      if (size > ringSize - index)
+        size = ringSize - index;  // up to the end of the ring, the rest with the next request
+      if ((uint64_t)size > s->size - end)
+        size = s->size - end;
+    }
+    if (size <= 0) {
+      wake.TimedWait(mutex, 100);
+      continue;
+    }
+
+    busy = s;
+    int gen = generation;
+    mutex.Unlock();
+
+    uint64_t t = cBDStats::Now();
+    ssize_t r = ReadStream(s, ring + index, size, end);
+    t = cBDStats::Now() - t;
+    cBDStats::Time(bhStorageRead, t);
+    if (aacs && r > 0)
+      Decrypt(ring + index, r, end);
+
+    mutex.Lock();
+    busy = NULL;
+    requests++;
+    if (r > 0)
+      model.Add(r, t);
+    // dropped if the reader went elsewhere meanwhile
+    if (gen == generation) {
+      if (r > 0) {
+        winLen += r;
+        cBDStats::Count(bcReadAheadBytes, r);
+      } else {
+        syslog(LOG_ERR, "BluRay: read-ahead: read error at %llu", (unsigned long long)end);
+        failed = true;
+      }
+    }
+    filled.Broadcast();
+  }
+  mutex.Unlock();
+}
@@ -0,0 +1,171 @@
+/*
+ * bdreadahead.h: Adaptive read-ahead for disc folders on slow storage
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDREADAHEAD_H
+#define _BDREADAHEAD_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libbluray/bluray.h>
+#include <libbluray/filesystem.h>
+
+#include "bdthread.h"
+
+class cBDAacs;
+class cBDStage;
+
+struct sBDReadAheadConfig {
+  int seconds;         // playback time to keep buffered, 0: off
+  int maxMB;           // buffer memory limit
+  int aacsThreads;     // AACS decryption workers, 0: libaacs decrypts
+  int pauseSeconds;    // playback time to buffer while paused, 0: off
+};
+
+extern sBDReadAheadConfig BDReadAheadConfig;
+
+// --- cBDReadModel -----------------------------------------------------
+
+// Time of a storage request as latency + bytes / throughput, a least
+// squares fit of the recent requests (older ones fade out). Requests of
+// a single size don't tell latency from throughput, so the read-ahead
+// makes every fourth request twice as large.
+
+class cBDReadModel {
+private:
+  double n, sx, sy, sxx, sxy;   // decayed sums of bytes (x) and seconds (y)
+  double latency;               // seconds
+  double throughput;            // bytes/s, 0: unknown
+
+public:
+  cBDReadModel(void) { Reset(); }
+
+  void Reset(void);
+  void Add(int Bytes, uint64_t Us);
+
+  double Latency(void) const    { return latency; }
+  double Throughput(void) const { return throughput; }
+  // Request size (bytes, whole aligned units) at which the latency
+  // costs at most 1/8 of the transfer time, within Min and Max
+  int RequestSize(int Min, int Max) const;
+};
+
+// --- cBDReadAhead -----------------------------------------------------
+
+// File layer for libbluray (bd_open_files(), libbluray 1.0 or later):
+// the stream files of a disc folder are read in large requests by a
+// background thread, ahead of playback, into a ring buffer; libbluray's
+// 6 KB reads are served from memory. The request size follows the
+// measured latency and throughput of the storage, the amount buffered
+// follows the bitrate of the title (SetBitrate()), so an NFS or SMB
+// library pays the network latency once per request instead of once per
+// aligned unit. A read outside the buffered range (seek) restarts the
+// read-ahead there. Other files (playlists, clip info) are read directly.
+// With AACS workers, protected stream data is decrypted in the buffer
+// (see cBDAacs), in parallel, before libbluray reads it.
+// While paused the buffer is filled up to pauseSeconds, then the drive
+// idles (and spins down). After resuming playback is fed from memory
+// while the thread keeps the buffer that deep for pauseSeconds more:
+// the drive spins up in the background.
+// Stream data staged on local storage (see cBDStage) is read from there.
+// While paused with the buffer full the drive can be lent to a background
+// task (see cBDRecovery): no requests are made until it is returned.
+
+class cBDReadAhead : public cBDThread {
+private:
+  struct sStream;
+
+  char    *root;
+  sBDReadAheadConfig config;
+  cBDReadModel model;
+  cBDAacs *aacs;
+  cBDStage *stage;
+  cBDMutex  stageMutex;         // stage of the reads in flight
+
+  cBDMutex   mutex;
+  cBDCondVar filled;            // data or end of file for the reader
+  cBDCondVar wake;              // space or a new position for the thread
+  uint8_t   *ring;
+  int        ringSize;
+  sStream   *active;            // stream the buffer holds data of
+  uint64_t   winStart;          // file offset of the first buffered byte
+  int        winLen;            // bytes buffered
+  int        ringStart;         // ring index of winStart
+  int        generation;        // changes when the buffer is restarted
+  sStream   *busy;              // stream of the request in flight
+  bool       failed;            // storage read error at the end of the buffer
+  double     bitrate;           // bytes/s of the title
+  int        requests;
+  bool       paused;
+  uint64_t   deepUntil;         // keep the pause depth until then
+  bool       lent;              // drive lent out, no requests
+  int        lentGeneration;    // buffer state when it was lent
+  uint64_t   lentStart;
+  volatile bool schedChanged;   // BDPlayerSched changed
+
+  static BD_DIR_H  *DirOpen(void *Handle, const char *RelPath);
+  static BD_FILE_H *FileOpen(void *Handle, const char *RelPath);
+  static void    StreamClose(BD_FILE_H *File);
+  static int64_t StreamSeek(BD_FILE_H *File, int64_t Offset, int32_t Origin);
+  static int64_t StreamTell(BD_FILE_H *File);
+  static int     StreamEof(BD_FILE_H *File);
+  static int64_t StreamRead(BD_FILE_H *File, uint8_t *Buffer, int64_t Size);
+  static int64_t NoWrite(BD_FILE_H *File, const uint8_t *Buffer, int64_t Size);
+
+  void Sizing(int &Request, int &Depth);
+  void Restart(sStream *Stream, uint64_t Pos);
+  void Consume(sStream *Stream);
+  int  Read(sStream *Stream, uint8_t *Buffer, int Size);
+  int  ReadBuffered(sStream *Stream, uint8_t *Buffer, int Size);
+  void Close(sStream *Stream);
+  void Decrypt(uint8_t *Data, int Length, uint64_t Offset);
+  ssize_t ReadStream(sStream *Stream, uint8_t *Buffer, int Size, uint64_t Offset);
+
+protected:
+  virtual void Action(void);
+  // Storage read (the benchmark adds latency here)
+  virtual ssize_t ReadAt(int Fd, uint8_t *Buffer, int Size, uint64_t Offset);
+
+public:
+  // stall statistics of the reader
+  uint64_t waits, waitUs, bytes;
+
+  cBDReadAhead(const char *Root, const sBDReadAheadConfig &Config);
+  virtual ~cBDReadAhead();
+
+  // Open the disc through the read-ahead, NULL if not possible (image
+  // files, libbluray too old). The disc must be closed before the
+  // read-ahead is deleted.
+  BLURAY *Open(void);
+  // Open a file of the disc (path relative to Root), as libbluray does
+  BD_FILE_H *OpenFile(const char *RelPath);
+
+  // Bytes/s of the playing title
+  void SetBitrate(double BytesPerSecond);
+  // Playback paused / resumed: buffer pauseSeconds
+  void SetPaused(bool On);
+  // New seconds and pauseSeconds (memory and AACS workers stay)
+  void SetConfig(const sBDReadAheadConfig &Config);
+  // BDPlayerSched changed: this thread and the AACS workers apply it again
+  void Reschedule(void);
+  // Lend the drive while paused with the buffer full, false if not possible.
+  // The borrower checks DriveWanted() between its reads and returns the
+  // drive with ReturnDrive() as soon as it is wanted again.
+  bool LendDrive(void);
+  // Playback resumed or the reader moved on
+  bool DriveWanted(void);
+  void ReturnDrive(void);
+  // Read staged stream data from Stage (takes ownership, NULL: off)
+  void SetStage(cBDStage *Stage);
+  cBDStage *Stage(void) { return stage; }
+  // Current sizing: bytes per storage request, bytes to keep buffered
+  int  RequestSize(void);
+  int  Depth(void);
+  const cBDReadModel &Model(void) { return model; }
+};
+
+#endif //_BDREADAHEAD_H
@@ -0,0 +1,411 @@
+/*
+ * bdrecovery.c: Read error recovery for damaged discs
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/cdrom.h>
+
+#include "bddiscid.h"
+#include "bdreadahead.h"
+#include "bdsched.h"
+#include "bdstats.h"
+#include "m2ts.h"
+
+#include "bdrecovery.h"
+
+#define RETRY_DELAY_MS   (30 * 1000)   // pause between background retry passes
+#define RETRY_POLL_MS    1000          // checks whether the drive can be borrowed
+#define SLOW_READS_SKIP  2             // slow reads in a row before skipping ahead
+
+sBDRecoveryConfig BDRecoveryConfig = {
+  rmOff,   // mode
+  3000,    // readTimeoutMs
+  16,      // skipUnits
+  1000,    // skipMs
+  200,     // maxErrors
+  2,       // retrySpeed
+};
+
+// --- cBDBadMap --------------------------------------------------------
+
+cBDBadMap::cBDBadMap(void)
+{
+  regions = NULL;
+  count = allocated = 0;
+  modified = false;
+}
+
+cBDBadMap::~cBDBadMap()
+{
+  free(regions);
+}
+
+bool cBDBadMap::Load(const char *FileName)
+{
+  FILE *f = fopen(FileName, "r");
+  if (!f)
+    return false;
+
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    int playlist;
+    unsigned long long start, end;
+    if (line[0] != '#' && sscanf(line, "%d %llu %llu", &playlist, &start, &end) == 3)
+      Add(playlist, start, end);
+  }
+  fclose(f);
+
+  modified = false;
+  return true;
+}
+
+bool cBDBadMap::Save(const char *FileName)
+{
+  cBDMutexLock lock(mutex);
+
+  if (!count) {
+    unlink(FileName);
+    modified = false;
+    return true;
+  }
+
+  FILE *f = fopen(FileName, "w");
+  if (!f) {
+    syslog(LOG_ERR, "ERROR: can't write %s: %m", FileName);
+    return false;
+  }
+  fprintf(f, "# playlist start end\n");
+  for (int i = 0; i < count; i++)
+    fprintf(f, "%d %llu %llu\n", regions[i].playlist,
+            (unsigned long long)regions[i].start, (unsigned long long)regions[i].end);
+  modified = false;
+  return fclose(f) == 0;
+}
+
+void cBDBadMap::Add(int Playlist, uint64_t Start, uint64_t End)
+{
+  cBDMutexLock lock(mutex);
+
+  // merge with overlapping or adjacent regions
+  for (int i = 0; i < count; i++) {
+    sBDBadRegion &r = regions[i];
+    if (r.playlist == Playlist && Start <= r.end && End >= r.start) {
+      if (Start < r.start) r.start = Start;
+      if (End > r.end)     r.end = End;
+      modified = true;
+      return;
+    }
+  }
+
+  if (count == allocated) {
+    allocated = allocated ? 2 * allocated : 16;
+    regions = (sBDBadRegion *)realloc(regions, allocated * sizeof(sBDBadRegion));
+  }
+  regions[count].playlist = Playlist;
+  regions[count].start = Start;
+  regions[count].end = End;
+  count++;
+  modified = true;
+}
+
+void cBDBadMap::Remove(int Playlist, uint64_t Start, uint64_t End)
+{
+  cBDMutexLock lock(mutex);
+
+  for (int i = 0; i < count; i++) {
+    if (regions[i].playlist == Playlist && regions[i].start == Start && regions[i].end == End) {
+      regions[i] = regions[--count];
+      modified = true;
+      return;
+    }
+  }
+}
+
+uint64_t cBDBadMap::Find(int Playlist, uint64_t Pos)
+{
+  cBDMutexLock lock(mutex);
+
+  for (int i = 0; i < count; i++) {
+    if (regions[i].playlist == Playlist && Pos >= regions[i].start && Pos < regions[i].end)
+      return regions[i].end;
+  }
+  return 0;
+}
+
+bool cBDBadMap::Get(int Index, sBDBadRegion &Region)
+{
+  cBDMutexLock lock(mutex);
+
+  if (Index < 0 || Index >= count)
+    return false;
+  Region = regions[Index];
+  return true;
+}
+
+int cBDBadMap::Count(void)
+{
+  cBDMutexLock lock(mutex);
+  return count;
+}
+
+// --- cBDRetrier -------------------------------------------------------
+
+// Retries bad regions with a separate libbluray handle at reduced drive speed,
+// only while the read-ahead lends the drive (playback paused, buffer full).
+// The pass ends and the drive speed is restored as soon as the player wants
+// the drive back. Regions that can be read again are removed from the map.
+
+class cBDRetrier : public cBDThread {
+private:
+  char *path;
+  char *device;
+  int speed;
+  int timeoutMs;
+  cBDBadMap &map;
+  cBDReadAhead *readAhead;
+
+  bool Wanted(void) { return !Running() || readAhead->DriveWanted(); }
+  bool Retry(BLURAY *Bd, const sBDBadRegion &Region);
+  void Pass(void);
+
+protected:
+  virtual void Action(void);
+
+public:
+  cBDRetrier(const char *Path, const char *Device, int Speed, int TimeoutMs, cBDBadMap &Map, cBDReadAhead *ReadAhead);
+  virtual ~cBDRetrier();
+};
+
+cBDRetrier::cBDRetrier(const char *Path, const char *Device, int Speed, int TimeoutMs, cBDBadMap &Map, cBDReadAhead *ReadAhead)
+:cBDThread("BluRay retry"),
+ map(Map)
+{
+  timeoutMs = TimeoutMs;
+  readAhead = ReadAhead;
+  path = strdup(Path);
+  device = Device ? strdup(Device) : NULL;
+  speed = Speed;
+}
+
+cBDRetrier::~cBDRetrier()
+{
+  Cancel();
+  free(path);
+  free(device);
+}
+
+bool cBDRetrier::Retry(BLURAY *Bd, const sBDBadRegion &Region)
+{
+  uint8_t buf[ALIGNED_UNIT_SIZE];
+
+  if (!bd_select_playlist(Bd, Region.playlist))
+    return false;
+
+  uint64_t pos = Region.start - Region.start % ALIGNED_UNIT_SIZE;
+  if (bd_seek(Bd, pos) < 0)
+    return false;
+
+  while (pos < Region.end && !Wanted()) {
+    uint64_t start = cBDStats::Now();
+    int r = bd_read(Bd, buf, sizeof(buf));
+    if (r <= 0)
+      return false;
+    // still too slow for playback
+    if (timeoutMs > 0 && cBDStats::Now() - start > (uint64_t)timeoutMs * 1000)
+      return false;
+    pos += r;
+  }
+
+  return pos >= Region.end;
+}
+
+void cBDRetrier::Pass(void)
+{
+  BLURAY *bd = bd_open(path, NULL);
+  if (!bd)
+    return;
+
+  if (device && !Wanted())
+    cBDRecovery::SetDriveSpeed(device, speed);
+
+  sBDBadRegion region;
+  for (int i = map.Count() - 1; !Wanted() && map.Get(i, region); i--) {
+    if (Retry(bd, region)) {
+      syslog(LOG_INFO, "BluRay: bad region %d:%llu-%llu is readable again", region.playlist,
+             (unsigned long long)region.start, (unsigned long long)region.end);
+      map.Remove(region.playlist, region.start, region.end);
+    }
+  }
+
+  // before the player reads again
+  if (device)
+    cBDRecovery::SetDriveSpeed(device, 0);
+
+  bd_close(bd);
+}
+
+void cBDRetrier::Action(void)
+{
+  static const sBDSchedParams idle = { spNice, 10, 0, icIdle, 0 };
+  BDApplySched(idle, "BluRay retry");
+
+  uint64_t next = cBDStats::Now() + (uint64_t)RETRY_DELAY_MS * 1000;
+  while (Running()) {
+
+    Sleep(RETRY_POLL_MS);
+
+    if (!Running() || !map.Count() || cBDStats::Now() < next || !readAhead->LendDrive())
+      continue;
+
+    Pass();
+    readAhead->ReturnDrive();
+    next = cBDStats::Now() + (uint64_t)RETRY_DELAY_MS * 1000;
+  }
+}
+
+// --- cBDRecovery ------------------------------------------------------
+
+cBDRecovery::cBDRecovery(const sBDRecoveryConfig &Config, const char *Path, const char *Device, const char *MapDir)
+{
+  config = Config;
+  path = strdup(Path);
+  device = Device ? strdup(Device) : NULL;
+  mapFile = NULL;
+  errors = slowReads = 0;
+  retrier = NULL;
+
+  char id[41];
+  if (MapDir && BDDiscId(Path, id)) {
+    if (asprintf(&mapFile, "%s/%s.bad", MapDir, id) < 0)
+      mapFile = NULL;
+    else if (map.Load(mapFile))
+      syslog(LOG_INFO, "BluRay: %d known bad regions", map.Count());
+  }
+}
+
+cBDRecovery::~cBDRecovery()
+{
+  delete retrier;
+
+  if (mapFile && map.Modified())
+    map.Save(mapFile);
+
+  free(mapFile);
+  free(path);
+  free(device);
+}
+
+void cBDRecovery::SetReadAhead(cBDReadAhead *ReadAhead)
+{
+  delete retrier;
+  retrier = NULL;
+  if (ReadAhead && config.retrySpeed > 0) {
+    retrier = new cBDRetrier(path, device, config.retrySpeed, config.readTimeoutMs, map, ReadAhead);
+    retrier->Start();
+  }
+}
+
+void cBDRecovery::SetConfig(const sBDRecoveryConfig &Config)
+{
+  int retrySpeed = config.retrySpeed;
+  config = Config;
+  config.retrySpeed = retrySpeed;
+}
+
+bool cBDRecovery::SetDriveSpeed(const char *Device, int Speed)
+{
+  int fd = open(Device, O_RDONLY | O_NONBLOCK);
+  if (fd < 0)
+    return false;
+  bool ok = ioctl(fd, CDROM_SELECT_SPEED, Speed) == 0;
+  if (!ok)
+    syslog(LOG_ERR, "BluRay: can't set speed of %s: %m", Device);
+  close(fd);
+  return ok;
+}
+
+bool cBDRecovery::SkipKnown(BLURAY *Bd, int Playlist)
+{
+  uint64_t pos = bd_tell(Bd);
+  uint64_t end = map.Find(Playlist, pos);
+  if (!end)
+    return false;
+
+  end += ALIGNED_UNIT_SIZE - 1;
+  end -= end % ALIGNED_UNIT_SIZE;
+  syslog(LOG_INFO, "BluRay: skipping known bad region %llu-%llu",
+         (unsigned long long)pos, (unsigned long long)end);
+  bd_seek(Bd, end);
+  cBDStats::Count(bcSkips);
+  cBDStats::Count(bcSkippedBytes, end - pos);
+  return true;
+}
+
+void cBDRecovery::Skip(BLURAY *Bd, int Playlist, uint64_t Pos)
+{
+  uint64_t start = Pos - Pos % ALIGNED_UNIT_SIZE;
+  uint64_t next = 0;
+
+  if (config.mode == rmEntryPoint) {
+    // libbluray seeks to the entry point (I-frame) at or before the time
+    uint64_t tick = bd_tell_time(Bd) + (uint64_t)config.skipMs * 90;
+    int64_t r = bd_seek_time(Bd, tick);
+    if (r > (int64_t)Pos)
+      next = r;
+  }
+
+  if (!next) {
+    next = start + (uint64_t)config.skipUnits * ALIGNED_UNIT_SIZE;
+    if (next <= Pos)
+      next = start + ALIGNED_UNIT_SIZE;
+    bd_seek(Bd, next);
+  }
+
+  syslog(LOG_INFO, "BluRay: read error at %llu, skipping to %llu",
+         (unsigned long long)Pos, (unsigned long long)next);
+  map.Add(Playlist, start, next);
+  cBDStats::Count(bcSkips);
+  cBDStats::Count(bcSkippedBytes, next - Pos);
+}
+
+bool cBDRecovery::Slow(BLURAY *Bd, int Playlist, uint64_t Start, uint64_t End)
+{
+  uint64_t start = Start - Start % ALIGNED_UNIT_SIZE;
+  uint64_t end = End + ALIGNED_UNIT_SIZE - 1;
+  end -= end % ALIGNED_UNIT_SIZE;
+  syslog(LOG_INFO, "BluRay: slow read of %llu-%llu, remembered as bad",
+         (unsigned long long)start, (unsigned long long)end);
+  map.Add(Playlist, start, end);
+
+  // the data was read: one slow spot (a scratch) is played through
+  if (++slowReads < SLOW_READS_SKIP)
+    return false;
+  slowReads = 0;
+  return Failed(Bd, Playlist, End);
+}
+
+bool cBDRecovery::Failed(BLURAY *Bd, int Playlist, uint64_t Pos)
+{
+  if (config.mode == rmOff)
+    return false;
+
+  if (++errors > config.maxErrors) {
+    syslog(LOG_ERR, "BluRay: %d consecutive read errors, giving up", errors - 1);
+    return false;
+  }
+
+  if (Pos >= bd_get_title_size(Bd))
+    return false;
+
+  Skip(Bd, Playlist, Pos);
+  return true;
+}
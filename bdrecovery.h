@@ -0,0 +1,114 @@
+/*
+ * bdrecovery.h: Read error recovery for damaged discs
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDRECOVERY_H
+#define _BDRECOVERY_H
+
+#include <stdint.h>
+
+#include <libbluray/bluray.h>
+
+#include "bdthread.h"
+
+enum eBDRecoveryMode {
+  rmOff,               // read errors end playback
+  rmSkip,              // skip ahead by aligned units
+  rmEntryPoint,        // skip to the next entry point (I-frame)
+};
+
+struct sBDRecoveryConfig {
+  int mode;            // eBDRecoveryMode
+  int readTimeoutMs;   // reads taking longer count as failed (0: no limit)
+  int skipUnits;       // aligned units to skip per failed read (rmSkip)
+  int skipMs;          // time to skip per failed read (rmEntryPoint)
+  int maxErrors;       // consecutive failed reads before giving up
+  int retrySpeed;      // drive speed (x) for background retries of bad regions, 0: no retries
+};
+
+extern sBDRecoveryConfig BDRecoveryConfig;
+
+// --- cBDBadMap --------------------------------------------------------
+
+// Bad regions of a disc (byte ranges in playlist streams)
+
+struct sBDBadRegion {
+  int      playlist;
+  uint64_t start;
+  uint64_t end;
+};
+
+class cBDBadMap {
+private:
+  cBDMutex mutex;
+  sBDBadRegion *regions;
+  int count, allocated;
+  bool modified;
+
+public:
+  cBDBadMap(void);
+  ~cBDBadMap();
+
+  bool Load(const char *FileName);
+  bool Save(const char *FileName);
+
+  void Add(int Playlist, uint64_t Start, uint64_t End);
+  void Remove(int Playlist, uint64_t Start, uint64_t End);
+  // End of the bad region containing Pos, 0 if none
+  uint64_t Find(int Playlist, uint64_t Pos);
+  // Copy of region Index, false if out of range
+  bool Get(int Index, sBDBadRegion &Region);
+  int  Count(void);
+  bool Modified(void) { return modified; }
+};
+
+// --- cBDRecovery ------------------------------------------------------
+
+class cBDReadAhead;
+class cBDRetrier;
+
+class cBDRecovery {
+private:
+  sBDRecoveryConfig config;
+  cBDBadMap map;
+  char *mapFile;
+  char *path;
+  char *device;
+  int errors;
+  int slowReads;       // in a row
+  cBDRetrier *retrier;
+
+  void Skip(BLURAY *Bd, int Playlist, uint64_t Pos);
+
+public:
+  // Path is the disc root, Device the drive (may be NULL for disc images / folders),
+  // bad regions are remembered in MapDir (may be NULL).
+  cBDRecovery(const sBDRecoveryConfig &Config, const char *Path, const char *Device, const char *MapDir);
+  ~cBDRecovery();
+
+  int ReadTimeoutMs(void) { return config.readTimeoutMs; }
+  // New settings, except the retry speed
+  void SetConfig(const sBDRecoveryConfig &Config);
+  // Bad regions are retried while ReadAhead lends the drive (paused
+  // playback), never while the player reads from it. NULL: no retries.
+  void SetReadAhead(cBDReadAhead *ReadAhead);
+
+  // Skip a known bad region at the current read position.
+  // Returns true if the position was changed.
+  bool SkipKnown(BLURAY *Bd, int Playlist);
+  // Read at Pos failed (or was too slow). Skips the region and returns true,
+  // or returns false if playback should end.
+  bool Failed(BLURAY *Bd, int Playlist, uint64_t Pos);
+  // Read of [Start, End) took too long but returned the data. The region
+  // is remembered (and skipped the next time). Returns true if reading
+  // skipped ahead, after several slow reads in a row.
+  bool Slow(BLURAY *Bd, int Playlist, uint64_t Start, uint64_t End);
+  void Succeeded(void) { errors = slowReads = 0; }
+
+  static bool SetDriveSpeed(const char *Device, int Speed);
+};
+
+#endif //_BDRECOVERY_H
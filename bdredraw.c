@@ -0,0 +1,84 @@
+/*
+ * bdredraw.c: Rate limited redraws of the replay progress display
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <string.h>
+
+#include "bdstats.h"
+
+#include "bdredraw.h"
+
+#define URGENT_FIELDS (rfTotal | rfMode)
+
+sBDRedrawConfig BDRedrawConfig = {
+  5,       // maxRate
+};
+
+// --- cBDRedraw --------------------------------------------------------
+
+cBDRedraw::cBDRedraw(int MaxRate)
+{
+  SetRate(MaxRate);
+  ticks = draws = 0;
+  Reset();
+}
+
+void cBDRedraw::SetRate(int MaxRate)
+{
+  intervalUs = MaxRate > 0 ? 1000000 / MaxRate : 0;
+}
+
+void cBDRedraw::Reset(void)
+{
+  lastDraw = 0;
+  dirty = rfAll;
+  current = total = second = -1;
+  memset(position, -1, sizeof(position));
+}
+
+void cBDRedraw::SetIndex(int Current, int Total, double FramesPerSecond)
+{
+  ticks++;
+  if (Total != total) {
+    total = Total;
+    dirty |= rfTotal | rfProgress;
+  }
+  if (Current != current) {
+    current = Current;
+    dirty |= rfProgress;
+    int s = FramesPerSecond > 0 ? (int)(Current / FramesPerSecond) : Current;
+    if (s != second) {
+      second = s;
+      dirty |= rfCurrent;
+    }
+  }
+}
+
+void cBDRedraw::SetPosition(int Playlist, int Clip, int Chapter, int Angle, int Angles)
+{
+  int p[5] = { Playlist, Clip, Chapter, Angle, Angles };
+  if (memcmp(p, position, sizeof(p))) {
+    memcpy(position, p, sizeof(p));
+    dirty |= rfTitle;
+  }
+}
+
+int cBDRedraw::Due(uint64_t Now)
+{
+  if (!dirty)
+    return 0;
+  if (!(dirty & URGENT_FIELDS) && lastDraw && Now - lastDraw < (uint64_t)intervalUs)
+    return 0;
+  return dirty;
+}
+
+void cBDRedraw::Drawn(uint64_t Now)
+{
+  dirty = 0;
+  lastDraw = Now;
+  draws++;
+  cBDStats::Count(bcProgressDraws);
+}
@@ -0,0 +1,62 @@
+/*
+ * bdredraw.h: Rate limited redraws of the replay progress display
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDREDRAW_H
+#define _BDREDRAW_H
+
+#include <stdint.h>
+
+struct sBDRedrawConfig {
+  int maxRate;         // progress redraws per second, 0: on every change
+};
+
+extern sBDRedrawConfig BDRedrawConfig;
+
+enum eBDRedrawField {
+  rfTotal    = 0x01,   // length of the title
+  rfProgress = 0x02,   // progress bar
+  rfCurrent  = 0x04,   // current time (changes once per second)
+  rfTitle    = 0x08,   // disc name and playlist / clip / chapter / angle
+  rfMode     = 0x10,   // play mode symbol
+  rfAll      = 0x1f
+};
+
+// --- cBDRedraw --------------------------------------------------------
+
+// Collects the changes of the replay display between redraws. The
+// control reports the values on every tick; Due() returns the fields
+// that changed, at most MaxRate times per second, so all of them are
+// drawn with a single flush. Length and mode changes (a new title, a key
+// press) are drawn at once.
+
+class cBDRedraw {
+private:
+  int      intervalUs;
+  uint64_t lastDraw;
+  int      dirty;
+  int      current, total, second;
+  int      position[5];
+
+public:
+  uint64_t ticks, draws;
+
+  cBDRedraw(int MaxRate);
+
+  void SetRate(int MaxRate);
+  // Everything changed (display opened)
+  void Reset(void);
+
+  void SetIndex(int Current, int Total, double FramesPerSecond);
+  void SetPosition(int Playlist, int Clip, int Chapter, int Angle, int Angles);
+  void Mark(int Fields) { dirty |= Fields; }
+
+  // Fields to draw now (0: nothing, or too early); Drawn() after the flush
+  int  Due(uint64_t Now);
+  void Drawn(uint64_t Now);
+};
+
+#endif //_BDREDRAW_H
@@ -0,0 +1,243 @@
+/*
+ * bdsched.c: CPU and I/O scheduling of playback threads
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "bdsched.h"
+
+// not exported by glibc
+#define IOPRIO_WHO_PROCESS   1
+#define IOPRIO_CLASS_SHIFT   13
+
+sBDSchedParams BDPlayerSched = { spDefault, 0, 0, icDefault, 0 };
+
+// --- parsing ----------------------------------------------------------
+
+static bool IsWord(const char *Spec, int Length, const char *Word)
+{
+  return Length == (int)strlen(Word) && !strncmp(Spec, Word, Length);
+}
+
+// Priority range of Policy
+static void SchedLimits(int Policy, int &Min, int &Max)
+{
+  switch (Policy) {
+    case spFifo:
+    case spRR:   Min = 1;   Max = 99; break;
+    case spNice: Min = -20; Max = 19; break;
+    default:     Min = 0;   Max = 0;  break;
+  }
+}
+
+void BDClampSched(sBDSchedParams &Params)
+{
+  if (Params.policy < spDefault || Params.policy > spRR)
+    Params.policy = spDefault;
+  int min, max;
+  SchedLimits(Params.policy, min, max);
+  Params.priority = Params.priority < min ? min : Params.priority > max ? max : Params.priority;
+  if (Params.ioClass < icDefault || Params.ioClass > icIdle)
+    Params.ioClass = icDefault;
+  Params.ioLevel = Params.ioLevel < 0 ? 0 : Params.ioLevel > 7 ? 7 : Params.ioLevel;
+}
+
+bool BDParseSched(const char *Spec, sBDSchedParams &Params)
+{
+  if (!strcmp(Spec, "default")) {
+    Params.policy = spDefault;
+    return true;
+  }
+
+  const char *arg = strchr(Spec, ':');
+  if (!arg)
+    return false;
+  int len = arg - Spec;
+  int value = atoi(arg + 1);
+
+  int policy;
+  if (IsWord(Spec, len, "fifo") || IsWord(Spec, len, "rr"))
+    policy = Spec[0] == 'f' ? spFifo : spRR;
+  else if (IsWord(Spec, len, "nice"))
+    policy = spNice;
+  else
+    return false;
+
+  int min, max;
+  SchedLimits(policy, min, max);
+  if (value < min || value > max)
+    return false;
+  Params.policy = policy;
+  Params.priority = value;
+  return true;
+}
+
+bool BDParseCpus(const char *Spec, sBDSchedParams &Params)
+{
+  uint64_t mask = 0;
+  const char *p = Spec;
+
+  while (*p) {
+    char *end;
+    long first = strtol(p, &end, 10);
+    long last = first;
+    if (end == p)
+      return false;
+    if (*end == '-') {
+      p = end + 1;
+      last = strtol(p, &end, 10);
+      if (end == p)
+        return false;
+    }
+    if (first < 0 || last < first || last > 63)
+      return false;
+    for (long i = first; i <= last; i++)
+      mask |= 1ULL << i;
+    p = end;
+    if (*p == ',')
+      p++;
+    else if (*p)
+      return false;
+  }
+
+  Params.cpus = mask;
+  return mask != 0;
+}
+
+bool BDParseIoPrio(const char *Spec, sBDSchedParams &Params)
+{
+  const char *arg = strchr(Spec, ':');
+  int len = arg ? arg - Spec : strlen(Spec);
+  int level = arg ? atoi(arg + 1) : 4;
+
+  if (level < 0 || level > 7)
+    return false;
+
+  if (IsWord(Spec, len, "rt"))
+    Params.ioClass = icRealtime;
+  else if (IsWord(Spec, len, "be"))
+    Params.ioClass = icBestEffort;
+  else if (!strcmp(Spec, "idle"))
+    Params.ioClass = icIdle;
+  else if (!strcmp(Spec, "default"))
+    Params.ioClass = icDefault;
+  else
+    return false;
+
+  Params.ioLevel = level;
+  return true;
+}
+
+// --- applying ---------------------------------------------------------
+
+// Lowest nice value the process may set (RLIMIT_NICE)
+static int NiceFloor(void)
+{
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NICE, &rl) || rl.rlim_cur == RLIM_INFINITY)
+    return 0;
+  return 20 - (int)rl.rlim_cur;
+}
+
+static bool SetNice(pid_t Tid, int Nice, const char *Name)
+{
+  if (!setpriority(PRIO_PROCESS, Tid, Nice))
+    return true;
+
+  int floor = NiceFloor();
+  if (errno == EACCES || errno == EPERM) {
+    syslog(LOG_WARNING, "%s: no permission for nice %d, using %d", Name, Nice, floor > Nice ? floor : 0);
+    if (floor > Nice && floor < 0)
+      setpriority(PRIO_PROCESS, Tid, floor);
+  } else {
+    syslog(LOG_ERR, "%s: setpriority(%d) failed: %m", Name, Nice);
+  }
+  return false;
+}
+
+static bool SetIoPrio(pid_t Tid, int Class, int Level, const char *Name)
+{
+  // eBDIoClass values are the kernel's IOPRIO_CLASS_*
+  if (!syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, Tid, (Class << IOPRIO_CLASS_SHIFT) | Level))
+    return true;
+
+  if (errno == EPERM && Class == icRealtime) {
+    syslog(LOG_WARNING, "%s: no permission for real-time I/O priority, using best-effort", Name);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, Tid, icBestEffort << IOPRIO_CLASS_SHIFT);
+  } else {
+    syslog(LOG_ERR, "%s: ioprio_set failed: %m", Name);
+  }
+  return false;
+}
+
+bool BDApplySched(const sBDSchedParams &Params, const char *Name)
+{
+  pid_t tid = syscall(SYS_gettid);
+  bool ok = true;
+
+  if (Params.policy == spFifo || Params.policy == spRR) {
+    struct sched_param sp;
+    sp.sched_priority = Params.priority;
+    int policy = Params.policy == spFifo ? SCHED_FIFO : SCHED_RR;
+    int err = pthread_setschedparam(pthread_self(), policy, &sp);
+    if (err) {
+      syslog(LOG_WARNING, "%s: can't set real-time scheduling: %s", Name, strerror(err));
+      // nearest permitted setting is the lowest allowed nice value
+      int floor = NiceFloor();
+      if (floor < 0)
+        setpriority(PRIO_PROCESS, tid, floor);
+      ok = false;
+    } else {
+      syslog(LOG_INFO, "%s: %s priority %d", Name, policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR", Params.priority);
+    }
+  } else {
+    // also undoes earlier settings of this thread (setup changed during playback)
+    struct sched_param sp;
+    sp.sched_priority = 0;
+    int err = pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+    if (err) {
+      syslog(LOG_WARNING, "%s: can't set SCHED_OTHER: %s", Name, strerror(err));
+      ok = false;
+    }
+    errno = 0;
+    int nice = Params.policy == spNice ? Params.priority : getpriority(PRIO_PROCESS, getpid());
+    if (errno || !SetNice(tid, nice, Name))
+      ok = false;
+  }
+
+  if (Params.cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < 64 && i < CPU_SETSIZE; i++)
+      if (Params.cpus & (1ULL << i))
+        CPU_SET(i, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err) {
+      syslog(LOG_WARNING, "%s: can't set CPU affinity: %s", Name, strerror(err));
+      ok = false;
+    }
+  }
+
+  // icDefault is IOPRIO_CLASS_NONE: I/O priority follows the nice value
+  ok = SetIoPrio(tid, Params.ioClass, Params.ioClass == icIdle || Params.ioClass == icDefault ? 0 : Params.ioLevel, Name) && ok;
+
+  return ok;
+}
+
+bool BDApplyPlayerSched(const char *Name)
+{
+  sBDSchedParams params = BDPlayerSched;
+  params.cpus = 0;
+  return BDApplySched(params, Name);
+}
@@ -0,0 +1,54 @@
+/*
+ * bdsched.h: CPU and I/O scheduling of playback threads
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDSCHED_H
+#define _BDSCHED_H
+
+#include <stdint.h>
+
+enum eBDSchedPolicy {
+  spDefault,           // SCHED_OTHER with the nice value of the process
+  spNice,              // SCHED_OTHER with nice value
+  spFifo,              // SCHED_FIFO
+  spRR,                // SCHED_RR
+};
+
+enum eBDIoClass {
+  icDefault,           // none: derived from the nice value
+  icRealtime,
+  icBestEffort,
+  icIdle,
+};
+
+struct sBDSchedParams {
+  int      policy;     // eBDSchedPolicy
+  int      priority;   // real-time priority (1...99) or nice value (-20...19)
+  uint64_t cpus;       // CPU affinity mask, 0: all CPUs
+  int      ioClass;    // eBDIoClass
+  int      ioLevel;    // 0 (highest) ... 7
+};
+
+extern sBDSchedParams BDPlayerSched;
+
+// Parse "fifo:PRIO", "rr:PRIO", "nice:N" or "default"
+bool BDParseSched(const char *Spec, sBDSchedParams &Params);
+// Bring policy, priority and I/O settings into their valid ranges
+void BDClampSched(sBDSchedParams &Params);
+// Parse a CPU list like "1" or "0,2-3"
+bool BDParseCpus(const char *Spec, sBDSchedParams &Params);
+// Parse "rt:LEVEL", "be:LEVEL", "idle" or "default"
+bool BDParseIoPrio(const char *Spec, sBDSchedParams &Params);
+
+// Apply Params to the calling thread. Settings the process lacks permission
+// for are logged and replaced by the nearest permitted setting.
+// Returns false if any setting could not be applied as requested.
+bool BDApplySched(const sBDSchedParams &Params, const char *Name);
+// BDPlayerSched for the threads reading and decrypting for the player
+// (read-ahead, AACS workers), without the CPU affinity: they run beside it
+bool BDApplyPlayerSched(const char *Name);
+
+#endif //_BDSCHED_H
@@ -0,0 +1,632 @@
+/*
+ * bdserver.c: HTTP transport stream server for a BluRay title
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "bdcore.h"
+#include "bdstats.h"
+#include "bdunit.h"
+
+#include "bdserver.h"
+
+#define CLIENT_IOV     64               // TS packets per send
+#define COPY_UNIT      (64 * 1024)      // ring buffers for Feed()
+
+// --- cBDStreamRing ----------------------------------------------------
+
+cBDStreamRing::cBDStreamRing(int Size, int MaxLagMs)
+{
+  size = Size - Size % TS_SIZE;
+  head = 0;
+  eof = false;
+  maxLagMs = MaxLagMs;
+  blockedSince = 0;
+  slices = new sSlice[BD_RING_SLICES];
+  first = count = 0;
+  copyPool = new cBDUnitPool(COPY_UNIT);
+  fill = NULL;
+  fillLen = 0;
+  memset(cursors, 0, sizeof(cursors));
+}
+
+cBDStreamRing::~cBDStreamRing()
+{
+  for (; count > 0; count--) {
+    slices[first].unit->Unref();
+    first = (first + 1) % BD_RING_SLICES;
+  }
+  if (fill)
+    fill->Unref();
+  copyPool->Release();
+  delete[] slices;
+}
+
+uint64_t cBDStreamRing::Tail(void)
+{
+  uint64_t tail = head;
+  for (int i = 0; i < BD_SERVER_MAX_CLIENTS; i++) {
+    if (cursors[i].active && cursors[i].pos < tail)
+      tail = cursors[i].pos;
+  }
+  return tail;
+}
+
+void cBDStreamRing::Trim(void)
+{
+  uint64_t tail = Tail();
+  while (count > 0) {
+    sSlice &s = slices[first];
+    if (s.start + s.length > tail)
+      break;
+    s.unit->Unref();
+    first = (first + 1) % BD_RING_SLICES;
+    count--;
+  }
+}
+
+int cBDStreamRing::Free(void)
+{
+  if (count >= BD_RING_SLICES)
+    return 0;
+  return size - (int)(head - Tail());
+}
+
+cBDStreamRing::sSlice *cBDStreamRing::Find(uint64_t Pos)
+{
+  if (!count || Pos >= head || Pos < slices[first].start)
+    return NULL;
+
+  // last slice starting at or before Pos
+  int lo = 0, hi = count - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (slices[(first + mid) % BD_RING_SLICES].start <= Pos)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return &slices[(first + lo) % BD_RING_SLICES];
+}
+
+void cBDStreamRing::Add(cBDUnit *Unit, const uint8_t *Data, int Length, bool M2ts)
+{
+  if (count > 0) {
+    // extend the last slice if the data follows it in the same buffer
+    sSlice &s = slices[(first + count - 1) % BD_RING_SLICES];
+    if (s.unit == Unit && s.m2ts == M2ts) {
+      const uint8_t *end = M2ts ? s.data + s.length / TS_SIZE * M2TS_SIZE : s.data + s.length;
+      if (end == Data && (!M2ts || s.length % TS_SIZE == 0)) {
+        s.length += Length;
+        head += Length;
+        return;
+      }
+    }
+  }
+
+  sSlice &s = slices[(first + count) % BD_RING_SLICES];
+  count++;
+  Unit->Ref();
+  s.unit = Unit;
+  s.data = Data;
+  s.start = head;
+  s.length = Length;
+  s.m2ts = M2ts;
+  head += Length;
+}
+
+// Contiguous stream data at Offset of a slice
+static inline int Piece(const uint8_t *Data, int Length, bool M2ts, int Offset, const uint8_t *&Ptr)
+{
+  if (!M2ts) {
+    Ptr = Data + Offset;
+    return Length - Offset;
+  }
+  int in = Offset % TS_SIZE;
+  Ptr = Data + Offset / TS_SIZE * M2TS_SIZE + 4 + in;
+  return TS_SIZE - in < Length - Offset ? TS_SIZE - in : Length - Offset;
+}
+
+void cBDStreamRing::SkipSlowClients(void)
+{
+  // move clients in the older half of the buffer to the newer half
+  uint64_t limit = head > (uint64_t)size / 2 ? head - size / 2 : 0;
+  limit -= limit % TS_SIZE;
+
+  for (int i = 0; i < BD_SERVER_MAX_CLIENTS; i++) {
+    sCursor &c = cursors[i];
+    if (c.active && c.pos < limit) {
+      syslog(LOG_INFO, "BluRay server: client %d too slow, %llu bytes dropped", i,
+             (unsigned long long)(limit - c.pos));
+      cBDStats::Count(bcClientDroppedBytes, limit - c.pos);
+      c.dropped += limit - c.pos;
+      c.pos = limit;
+    }
+  }
+  Trim();
+}
+
+int cBDStreamRing::Attach(void)
+{
+  cBDMutexLock lock(mutex);
+  for (int i = 0; i < BD_SERVER_MAX_CLIENTS; i++) {
+    if (!cursors[i].active) {
+      cursors[i].active = true;
+      cursors[i].pos = cursors[i].peek = head;
+      cursors[i].dropped = 0;
+      return i;
+    }
+  }
+  return -1;
+}
+
+void cBDStreamRing::Detach(int Id)
+{
+  cBDMutexLock lock(mutex);
+  cursors[Id].active = false;
+  Trim();
+  spaceAvailable.Broadcast();
+}
+
+int cBDStreamRing::Clients(void)
+{
+  cBDMutexLock lock(mutex);
+  int n = 0;
+  for (int i = 0; i < BD_SERVER_MAX_CLIENTS; i++)
+    n += cursors[i].active;
+  return n;
+}
+
+uint64_t cBDStreamRing::Dropped(int Id)
+{
+  cBDMutexLock lock(mutex);
+  return cursors[Id].dropped;
+}
+
+int cBDStreamRing::WaitData(sCursor &c, int TimeoutMs)
+{
+  if (c.pos == head) {
+    if (eof)
+      return -1;
+    dataAvailable.TimedWait(mutex, TimeoutMs);
+    if (c.pos == head)
+      return eof ? -1 : 0;
+  }
+  return 1;
+}
+
+int cBDStreamRing::Read(int Id, uint8_t *Data, int Size, int TimeoutMs)
+{
+  cBDMutexLock lock(mutex);
+  sCursor &c = cursors[Id];
+
+  int r = WaitData(c, TimeoutMs);
+  if (r <= 0)
+    return r;
+
+  // copy out under the lock: the producer may skip this client meanwhile
+  int n = 0;
+  sSlice *s;
+  while (n < Size && (s = Find(c.pos)) != NULL) {
+    const uint8_t *p;
+    int len = Piece(s->data, s->length, s->m2ts, c.pos - s->start, p);
+    if (len > Size - n)
+      len = Size - n;
+    memcpy(Data + n, p, len);
+    n += len;
+    c.pos += len;
+  }
+  cBDStats::Count(bcCopiedBytes, n);
+
+  Trim();
+  spaceAvailable.Broadcast();
+  return n;
+}
+
+int cBDStreamRing::Peek(int Id, struct iovec *Iov, int &IovCount, cBDUnit *&Unit, int TimeoutMs)
+{
+  cBDMutexLock lock(mutex);
+  sCursor &c = cursors[Id];
+
+  int max = IovCount;
+  IovCount = 0;
+  int r = WaitData(c, TimeoutMs);
+  if (r <= 0)
+    return r;
+
+  sSlice *s = Find(c.pos);
+  if (!s)
+    return 0;
+
+  // the reference keeps the buffer while the client sends, even if
+  // the client is skipped meanwhile
+  int n = 0;
+  int offset = c.pos - s->start;
+  while (IovCount < max && offset < s->length) {
+    const uint8_t *p;
+    int len = Piece(s->data, s->length, s->m2ts, offset, p);
+    Iov[IovCount].iov_base = (void *)p;
+    Iov[IovCount].iov_len = len;
+    IovCount++;
+    offset += len;
+    n += len;
+  }
+  Unit = s->unit;
+  Unit->Ref();
+  c.peek = c.pos;
+  return n;
+}
+
+void cBDStreamRing::Release(int Id, cBDUnit *Unit, int Bytes)
+{
+  mutex.Lock();
+  sCursor &c = cursors[Id];
+  if (c.pos == c.peek)
+    c.pos += Bytes;
+  Trim();
+  spaceAvailable.Broadcast();
+  mutex.Unlock();
+  Unit->Unref();
+}
+
+int cBDStreamRing::Feed(const uint8_t *Data, int Length)
+{
+  cBDMutexLock lock(mutex);
+
+  int free = Free();
+  if (free < Length || count + Length / COPY_UNIT + 2 > BD_RING_SLICES) {
+    if (!blockedSince)
+      blockedSince = cBDStats::Now();
+    return 0;
+  }
+  blockedSince = 0;
+
+  for (int n = 0; n < Length; ) {
+    if (!fill || fillLen == fill->Size()) {
+      if (fill)
+        fill->Unref();
+      fillLen = 0;
+      if ((fill = copyPool->Get()) == NULL)
+        return n > 0 ? n : -1;
+    }
+    int len = fill->Size() - fillLen < Length - n ? fill->Size() - fillLen : Length - n;
+    memcpy(fill->Data() + fillLen, Data + n, len);
+    Add(fill, fill->Data() + fillLen, len, false);
+    fillLen += len;
+    n += len;
+  }
+  cBDStats::Count(bcCopiedBytes, Length);
+
+  dataAvailable.Broadcast();
+  return Length;
+}
+
+int cBDStreamRing::FeedUnit(cBDUnit *Unit, const uint8_t *Packets, int Count)
+{
+  cBDMutexLock lock(mutex);
+
+  int n = Free() / TS_SIZE;
+  if (n > Count)
+    n = Count;
+  if (n <= 0) {
+    if (!blockedSince)
+      blockedSince = cBDStats::Now();
+    return 0;
+  }
+  blockedSince = 0;
+
+  Add(Unit, Packets, n * TS_SIZE, true);
+
+  dataAvailable.Broadcast();
+  return n;
+}
+
+bool cBDStreamRing::Poll(int TimeoutMs)
+{
+  cBDMutexLock lock(mutex);
+
+  if (Free() >= TS_SIZE)
+    return true;
+
+  if (blockedSince && cBDStats::Now() - blockedSince > (uint64_t)maxLagMs * 1000) {
+    SkipSlowClients();
+    blockedSince = 0;
+    return true;
+  }
+
+  spaceAvailable.TimedWait(mutex, TimeoutMs);
+  return Free() >= TS_SIZE;
+}
+
+void cBDStreamRing::SetEof(void)
+{
+  cBDMutexLock lock(mutex);
+  eof = true;
+  dataAvailable.Broadcast();
+}
+
+// --- cBDServerClient --------------------------------------------------
+
+class cBDServerClient : public cBDThread {
+private:
+  int fd;
+  cBDStreamRing &ring;
+  int id;
+  volatile bool finished;
+
+  bool SendAll(const void *Data, int Length);
+  bool SendAll(struct iovec *Iov, int Count);
+  bool ReadRequest(void);
+
+protected:
+  virtual void Action(void);
+
+public:
+  cBDServerClient(int Fd, cBDStreamRing &Ring, int Id);
+  virtual ~cBDServerClient();
+  bool Finished(void) { return finished; }
+};
+
+cBDServerClient::cBDServerClient(int Fd, cBDStreamRing &Ring, int Id)
+:cBDThread("BluRay client"),
+ ring(Ring)
+{
+  fd = Fd;
+  id = Id;
+  finished = false;
+}
+
+cBDServerClient::~cBDServerClient()
+{
+  Cancel();
+  close(fd);
+}
+
+bool cBDServerClient::SendAll(const void *Data, int Length)
+{
+  const uint8_t *p = (const uint8_t *)Data;
+  while (Length > 0 && Running()) {
+    struct pollfd pfd = { fd, POLLOUT, 0 };
+    if (poll(&pfd, 1, 100) <= 0)
+      continue;
+    ssize_t w = send(fd, p, Length, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return false;
+    }
+    p += w;
+    Length -= w;
+  }
+  return Length == 0;
+}
+
+bool cBDServerClient::SendAll(struct iovec *Iov, int Count)
+{
+  while (Count > 0 && Running()) {
+    struct pollfd pfd = { fd, POLLOUT, 0 };
+    if (poll(&pfd, 1, 100) <= 0)
+      continue;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = Iov;
+    msg.msg_iovlen = Count;
+    ssize_t w = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return false;
+    }
+    // skip what was sent
+    while (Count > 0 && (size_t)w >= Iov->iov_len) {
+      w -= Iov->iov_len;
+      Iov++;
+      Count--;
+    }
+    if (Count > 0) {
+      Iov->iov_base = (uint8_t *)Iov->iov_base + w;
+      Iov->iov_len -= w;
+    }
+  }
+  return Count == 0;
+}
+
+bool cBDServerClient::ReadRequest(void)
+{
+  char request[1024];
+  int len = 0;
+
+  // read header up to the empty line
+  while (len < (int)sizeof(request) - 1 && Running()) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int r = poll(&pfd, 1, 5000);
+    if (r <= 0)
+      return false;
+    ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+    if (n <= 0)
+      return false;
+    len += n;
+    request[len] = 0;
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+      break;
+  }
+
+  if (strncmp(request, "GET ", 4) && strncmp(request, "HEAD ", 5)) {
+    static const char response[] = "HTTP/1.0 405 Method Not Allowed\r\nConnection: close\r\n\r\n";
+    SendAll(response, sizeof(response) - 1);
+    return false;
+  }
+
+  static const char response[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: video/mp2t\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+  if (!SendAll(response, sizeof(response) - 1))
+    return false;
+
+  return strncmp(request, "HEAD ", 5) != 0;
+}
+
+void cBDServerClient::Action(void)
+{
+  if (ReadRequest()) {
+    struct iovec iov[CLIENT_IOV];
+    uint64_t sent = 0;
+    while (Running()) {
+      // send straight from the read buffers
+      int count = CLIENT_IOV;
+      cBDUnit *unit;
+      int n = ring.Peek(id, iov, count, unit, 100);
+      if (n < 0)
+        break;
+      if (n == 0)
+        continue;
+      bool ok = SendAll(iov, count);
+      ring.Release(id, unit, ok ? n : 0);
+      if (!ok)
+        break;
+      sent += n;
+    }
+    syslog(LOG_INFO, "BluRay server: client %d: %llu bytes sent, %llu dropped", id,
+           (unsigned long long)sent, (unsigned long long)ring.Dropped(id));
+  }
+
+  shutdown(fd, SHUT_RDWR);
+  ring.Detach(id);
+  finished = true;
+}
+
+// --- cBDServer --------------------------------------------------------
+
+cBDServer::cBDServer(cBDCore *Core, int RingSize, int MaxLagMs)
+:cBDThread("BluRay server"),
+ ring(RingSize, MaxLagMs)
+{
+  core = Core;
+  listenFd = -1;
+  done = false;
+  memset(clients, 0, sizeof(clients));
+}
+
+cBDServer::~cBDServer()
+{
+  Cancel();
+  for (int i = 0; i < BD_SERVER_MAX_CLIENTS; i++)
+    delete clients[i];
+  if (listenFd >= 0)
+    close(listenFd);
+  delete core;
+}
+
+bool cBDServer::Listen(const char *Address, int Port)
+{
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(Port);
+  sa.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (Address && !inet_aton(Address, &sa.sin_addr)) {
+    syslog(LOG_ERR, "BluRay server: invalid address %s", Address);
+    return false;
+  }
+
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&sa, sizeof(sa)) || listen(listenFd, 4)) {
+    syslog(LOG_ERR, "BluRay server: can't listen on %s:%d: %m", Address ? Address : "*", Port);
+    return false;
+  }
+
+  syslog(LOG_INFO, "BluRay server: listening on %s:%d", Address ? Address : "*", Port);
+  return Start();
+}
+
+void cBDServer::Accept(void)
+{
+  int fd = accept(listenFd, NULL, NULL);
+  if (fd < 0)
+    return;
+
+  int id = ring.Attach();
+  if (id < 0) {
+    static const char response[] = "HTTP/1.0 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+    send(fd, response, sizeof(response) - 1, MSG_NOSIGNAL);
+    close(fd);
+    return;
+  }
+
+  syslog(LOG_INFO, "BluRay server: client %d connected", id);
+  delete clients[id];
+  clients[id] = new cBDServerClient(fd, ring, id);
+  clients[id]->Start();
+}
+
+int cBDServer::Reap(void)
+{
+  int active = 0;
+  for (int i = 0; i < BD_SERVER_MAX_CLIENTS; i++) {
+    if (clients[i] && clients[i]->Finished()) {
+      delete clients[i];
+      clients[i] = NULL;
+    }
+    active += clients[i] != NULL;
+  }
+  return active;
+}
+
+void cBDServer::Action(void)
+{
+  cBDStats::Attach("server");
+
+  bool eof = false;
+
+  while (Running()) {
+
+    int active = Reap();
+    if (eof && !active)
+      break;
+
+    // wait for clients; don't spin the drive for nobody
+    struct pollfd pfd = { listenFd, POLLIN, 0 };
+    if (poll(&pfd, 1, active && !eof ? 0 : 100) > 0)
+      Accept();
+
+    if (!active || eof)
+      continue;
+
+    if (core->EndOfTitle() && !core->Pending()) {
+      ring.SetEof();
+      eof = true;
+      continue;
+    }
+
+    if (!core->Read()) {
+      ring.SetEof();
+      eof = true;
+      continue;
+    }
+    if (core->Pending()) {
+      if (ring.Poll(10))
+        core->Feed(ring);
+      else
+        cBDStats::Count(bcPollTimeouts);
+    }
+  }
+
+  done = true;
+}
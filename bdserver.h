@@ -0,0 +1,137 @@
+/*
+ * bdserver.h: HTTP transport stream server for a BluRay title
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDSERVER_H
+#define _BDSERVER_H
+
+#include <stdint.h>
+
+#include "bdthread.h"
+#include "m2ts.h"
+
+#define BD_SERVER_MAX_CLIENTS  8
+
+class cBDCore;
+class cBDServerClient;
+
+// --- cBDStreamRing ----------------------------------------------------
+
+// Filtered TS data is read from the disc once and kept in a ring buffer.
+// Every client has its own read position. The producer waits for the
+// slowest client; a client that stays behind for longer than MaxLagMs
+// skips ahead and loses data.
+// The ring holds references to the read buffers of the framer (see
+// FeedUnit()), not copies; clients send straight from them with Peek()
+// and Release(). Data fed with Feed() is copied into buffers of the ring.
+// Size limits the stream bytes held, buffers may be larger.
+
+#define BD_RING_SLICES 4096
+
+struct iovec;
+class cBDUnit;
+class cBDUnitPool;
+
+class cBDStreamRing : public cBDSink {
+private:
+  int        size;
+  uint64_t   head;                      // bytes written in total
+  bool       eof;
+  int        maxLagMs;
+  uint64_t   blockedSince;              // 0: producer not blocked
+
+  // stream bytes [start, start + length) in a buffer, either m2ts packets
+  // (TS data at offset 4) or plain TS data
+  struct sSlice {
+    cBDUnit       *unit;
+    const uint8_t *data;
+    uint64_t       start;
+    int            length;
+    bool           m2ts;
+  } *slices;
+  int        first, count;              // circular array of BD_RING_SLICES
+
+  cBDUnitPool *copyPool;                // buffers for Feed()
+  cBDUnit   *fill;
+  int        fillLen;
+
+  struct sCursor {
+    bool     active;
+    uint64_t pos;
+    uint64_t peek;                      // position of the last Peek()
+    uint64_t dropped;
+  } cursors[BD_SERVER_MAX_CLIENTS];
+
+  cBDMutex   mutex;
+  cBDCondVar dataAvailable, spaceAvailable;
+
+  uint64_t Tail(void);                  // read position of the slowest client
+  void     Trim(void);                  // release slices below Tail()
+  int      Free(void);
+  sSlice  *Find(uint64_t Pos);
+  void     Add(cBDUnit *Unit, const uint8_t *Data, int Length, bool M2ts);
+  int      WaitData(sCursor &c, int TimeoutMs);
+  void     SkipSlowClients(void);
+
+public:
+  cBDStreamRing(int Size, int MaxLagMs);
+  virtual ~cBDStreamRing();
+
+  // Client side. Attach() returns a client id (-1 if too many clients).
+  int  Attach(void);
+  void Detach(int Id);
+  int  Clients(void);
+  // Copy up to Size bytes at the position of client Id.
+  // Returns 0 on timeout, -1 at end of stream.
+  int  Read(int Id, uint8_t *Data, int Size, int TimeoutMs);
+  // Data at the position of client Id without copying: up to IovCount
+  // pieces in Iov (IovCount returns the number used), in a buffer
+  // referenced by Unit. Returns the bytes, 0 on timeout, -1 at end of
+  // stream. Release() must follow with the bytes consumed.
+  int  Peek(int Id, struct iovec *Iov, int &IovCount, cBDUnit *&Unit, int TimeoutMs);
+  void Release(int Id, cBDUnit *Unit, int Bytes);
+  uint64_t Dropped(int Id);
+
+  // Producer side
+  virtual int  Feed(const uint8_t *Data, int Length);
+  virtual bool TakesUnits(void) { return true; }
+  virtual int  FeedUnit(cBDUnit *Unit, const uint8_t *Packets, int Count);
+  virtual bool Poll(int TimeoutMs);
+  void SetEof(void);
+};
+
+// --- cBDServer --------------------------------------------------------
+
+// Streams a title over HTTP ("GET /" returns video/mp2t) to up to
+// BD_SERVER_MAX_CLIENTS clients. The disc is read only while clients
+// are connected; new clients join at the current position.
+
+class cBDServer : public cBDThread {
+private:
+  cBDCore *core;
+  cBDStreamRing ring;
+  int listenFd;
+  cBDServerClient *clients[BD_SERVER_MAX_CLIENTS];
+  volatile bool done;
+
+  void Accept(void);
+  int  Reap(void);
+
+protected:
+  virtual void Action(void);
+
+public:
+  // Takes ownership of Core
+  cBDServer(cBDCore *Core, int RingSize = 16 * 1024 * 1024, int MaxLagMs = 2000);
+  virtual ~cBDServer();
+
+  // Bind to Address (NULL: all interfaces) and start serving
+  bool Listen(const char *Address, int Port);
+  // True when the title has been sent and all clients have disconnected
+  bool Done(void) { return done; }
+};
+
+#endif //_BDSERVER_H
@@ -0,0 +1,491 @@
+/*
+ * bdstage.c: Staging of the playing title on local storage
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "bddiscid.h"
+#include "bdsched.h"
+#include "bdstats.h"
+
+#include "bdstage.h"
+
+#define CHUNK_SIZE       (4 * 1024 * 1024)
+#define COPY_REQUEST     (1024 * 1024)    // the copier checks for playback reads in between
+#define DRIVE_IDLE_US    300000           // playback didn't use the drive for that long
+
+sBDStageConfig BDStageConfig = {
+  0,       // maxMB
+};
+
+enum { csMissing, csStaged, csFailed };
+
+struct cBDStage::sClip {
+  char     name[8];
+  int      discFd;
+  int      fd;                // staged copy
+  uint64_t size;
+  int      chunks;
+  uint8_t *map;               // state of each chunk
+  int      staged;
+};
+
+// --- helpers ----------------------------------------------------------
+
+static uint64_t DirBytes(const char *Dir)
+{
+  uint64_t bytes = 0;
+  DIR *d = opendir(Dir);
+  if (!d)
+    return 0;
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    char path[1024];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", Dir, e->d_name);
+    if (e->d_name[0] != '.' && !stat(path, &st) && S_ISREG(st.st_mode))
+      bytes += (uint64_t)st.st_blocks * 512;
+  }
+  closedir(d);
+  return bytes;
+}
+
+static void RemoveDir(const char *Dir)
+{
+  DIR *d = opendir(Dir);
+  if (!d)
+    return;
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    if (e->d_name[0] != '.') {
+      char path[1024];
+      snprintf(path, sizeof(path), "%s/%s", Dir, e->d_name);
+      unlink(path);
+    }
+  }
+  closedir(d);
+  rmdir(Dir);
+}
+
+static bool ReadAll(int Fd, uint8_t *Buffer, int Size, uint64_t Offset)
+{
+  while (Size > 0) {
+    ssize_t r = pread(Fd, Buffer, Size, Offset);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    Buffer += r;
+    Size -= r;
+    Offset += r;
+  }
+  return true;
+}
+
+static bool WriteAll(int Fd, const uint8_t *Buffer, int Size, uint64_t Offset)
+{
+  while (Size > 0) {
+    ssize_t r = pwrite(Fd, Buffer, Size, Offset);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    Buffer += r;
+    Size -= r;
+    Offset += r;
+  }
+  return true;
+}
+
+// --- cBDStage ---------------------------------------------------------
+
+cBDStage::cBDStage(const sBDStageConfig &Config, const char *Root, const char *Dir)
+:cBDThread("BluRay stage")
+{
+  config = Config;
+  root = strdup(Root);
+  cacheDir = strdup(Dir);
+  dir = NULL;
+  clips = NULL;
+  clipCount = 0;
+  lastDiscRead = 0;
+  cacheBytes = 0;
+  full = false;
+  hitBytes = missBytes = 0;
+
+  char id[41];
+  if (BDDiscId(Root, id) && asprintf(&dir, "%s/%s", Dir, id) >= 0) {
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+      syslog(LOG_ERR, "BluRay: stage: can't create %s: %m", dir);
+      free(dir);
+      dir = NULL;
+    } else {
+      // most recently played disc
+      utimes(dir, NULL);
+    }
+  } else
+    dir = NULL;
+}
+
+cBDStage::~cBDStage()
+{
+  Cancel();
+
+  uint64_t staged, total;
+  Progress(staged, total);
+  if (hitBytes + missBytes)
+    syslog(LOG_INFO, "BluRay: stage: %llu of %llu MB staged, %.0f%% of reads from the cache",
+           (unsigned long long)(staged >> 20), (unsigned long long)(total >> 20), HitRatio() * 100);
+
+  for (int i = 0; i < clipCount; i++) {
+    close(clips[i]->discFd);
+    if (clips[i]->fd >= 0)
+      close(clips[i]->fd);
+    free(clips[i]->map);
+    delete clips[i];
+  }
+  free(clips);
+  free(dir);
+  free(cacheDir);
+  free(root);
+}
+
+cBDStage::sClip *cBDStage::Find(const char *Clip)
+{
+  for (int i = 0; i < clipCount; i++)
+    if (!strcmp(clips[i]->name, Clip))
+      return clips[i];
+  return NULL;
+}
+
+bool cBDStage::LoadMap(sClip *Clip)
+{
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s.map", dir, Clip->name);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  bool ok = !fstat(fd, &st) && st.st_size == Clip->chunks && ReadAll(fd, Clip->map, Clip->chunks, 0);
+  close(fd);
+  Clip->staged = 0;
+  for (int i = 0; i < Clip->chunks; i++) {
+    // unreadable chunks are tried again
+    if (!ok || Clip->map[i] != csStaged)
+      Clip->map[i] = csMissing;
+    Clip->staged += Clip->map[i] == csStaged;
+  }
+  return ok;
+}
+
+bool cBDStage::SaveMap(sClip *Clip)
+{
+  char path[1024], tmp[1024];
+  snprintf(path, sizeof(path), "%s/%s.map", dir, Clip->name);
+  snprintf(tmp, sizeof(tmp), "%s/%s.map.tmp", dir, Clip->name);
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+  bool ok = WriteAll(fd, Clip->map, Clip->chunks, 0);
+  ok = !close(fd) && ok;
+  if (ok && rename(tmp, path) == 0)
+    return true;
+  unlink(tmp);
+  return false;
+}
+
+void cBDStage::SetClips(const BLURAY_TITLE_INFO *Info)
+{
+  if (Info) {
+    for (unsigned i = 0; i < Info->clip_count; i++)
+      AddClip(Info->clips[i].clip_id);
+  }
+}
+
+void cBDStage::AddClip(const char *Clip)
+{
+  if (!dir)
+    return;
+
+  cBDMutexLock lock(mutex);
+
+  char name[8];
+  snprintf(name, sizeof(name), "%.5s", Clip);
+  if (Find(name))
+    return;
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/BDMV/STREAM/%s.m2ts", root, name);
+  int discFd = open(path, O_RDONLY);
+  struct stat st;
+  if (discFd < 0 || fstat(discFd, &st) || !S_ISREG(st.st_mode)) {
+    if (discFd >= 0)
+      close(discFd);
+    return;
+  }
+
+  sClip *c = new sClip;
+  strcpy(c->name, name);
+  c->discFd = discFd;
+  c->size = st.st_size;
+  c->chunks = (st.st_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  c->map = (uint8_t *)calloc(c->chunks + 1, 1);
+  c->staged = 0;
+  snprintf(path, sizeof(path), "%s/%s.m2ts", dir, name);
+  c->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (c->fd < 0)
+    syslog(LOG_ERR, "BluRay: stage: can't open %s: %m", path);
+  else if (!LoadMap(c))
+    SaveMap(c);
+
+  sClip **p = (sClip **)realloc(clips, (clipCount + 1) * sizeof(sClip *));
+  if (!p) {
+    close(c->discFd);
+    if (c->fd >= 0)
+      close(c->fd);
+    free(c->map);
+    delete c;
+    return;
+  }
+  clips = p;
+  clips[clipCount++] = c;
+
+  if (!Active())
+    Start();
+  wake.Signal();
+}
+
+void cBDStage::SetMaxMB(int MB)
+{
+  cBDMutexLock lock(mutex);
+  config.maxMB = MB;
+  full = false;
+  wake.Signal();
+}
+
+int cBDStage::Read(const char *Clip, uint8_t *Buffer, int Size, uint64_t Offset)
+{
+  cBDMutexLock lock(mutex);
+
+  sClip *c = Find(Clip);
+  if (!c || c->fd < 0)
+    return 0;
+
+  // the staged chunks from Offset on
+  int n = 0;
+  while (n < Size && Offset + n < c->size) {
+    uint64_t pos = Offset + n;
+    int chunk = pos / CHUNK_SIZE;
+    if (c->map[chunk] != csStaged)
+      break;
+    uint64_t end = (uint64_t)(chunk + 1) * CHUNK_SIZE;
+    if (end > c->size)
+      end = c->size;
+    n += end - pos < (uint64_t)(Size - n) ? (int)(end - pos) : Size - n;
+  }
+  if (n <= 0 || !ReadAll(c->fd, Buffer, n, Offset))
+    return 0;
+
+  hitBytes += n;
+  cBDStats::Count(bcStageHitBytes, n);
+  return n;
+}
+
+void cBDStage::Missed(int Bytes)
+{
+  cBDMutexLock lock(mutex);
+  lastDiscRead = cBDStats::Now();
+  if (Bytes > 0) {
+    missBytes += Bytes;
+    cBDStats::Count(bcStageMissBytes, Bytes);
+  }
+}
+
+void cBDStage::Progress(uint64_t &Staged, uint64_t &Total)
+{
+  cBDMutexLock lock(mutex);
+  Staged = Total = 0;
+  for (int i = 0; i < clipCount; i++) {
+    sClip *c = clips[i];
+    Total += c->size;
+    Staged += (uint64_t)c->staged * CHUNK_SIZE;
+    // the last chunk is shorter
+    if (c->chunks && c->map[c->chunks - 1] == csStaged)
+      Staged -= (uint64_t)c->chunks * CHUNK_SIZE - c->size;
+  }
+}
+
+double cBDStage::HitRatio(void)
+{
+  cBDMutexLock lock(mutex);
+  return hitBytes + missBytes ? (double)hitBytes / (hitBytes + missBytes) : 0;
+}
+
+bool cBDStage::NextChunk(sClip *&Clip, int &Chunk)
+{
+  for (int i = 0; i < clipCount; i++) {
+    sClip *c = clips[i];
+    if (c->fd < 0 || c->staged == c->chunks)
+      continue;
+    for (int k = 0; k < c->chunks; k++) {
+      if (c->map[k] == csMissing) {
+        Clip = c;
+        Chunk = k;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+ssize_t cBDStage::ReadDisc(int Fd, uint8_t *Buffer, int Size, uint64_t Offset)
+{
+  ssize_t r;
+  do {
+    r = pread(Fd, Buffer, Size, Offset);
+  } while (r < 0 && errno == EINTR);
+  return r;
+}
+
+bool cBDStage::CopyChunk(sClip *Clip, int Chunk)
+{
+  uint8_t *buf = (uint8_t *)malloc(COPY_REQUEST);
+  if (!buf)
+    return false;
+
+  uint64_t pos = (uint64_t)Chunk * CHUNK_SIZE;
+  uint64_t end = pos + CHUNK_SIZE < Clip->size ? pos + CHUNK_SIZE : Clip->size;
+  bool ok = true;
+  while (ok && pos < end && Running()) {
+    // playback has the drive
+    mutex.Lock();
+    uint64_t idle = cBDStats::Now() - lastDiscRead;
+    mutex.Unlock();
+    if (idle < DRIVE_IDLE_US) {
+      Sleep((DRIVE_IDLE_US - idle) / 1000 + 1);
+      continue;
+    }
+
+    int size = end - pos < COPY_REQUEST ? (int)(end - pos) : COPY_REQUEST;
+    ssize_t r = ReadDisc(Clip->discFd, buf, size, pos);
+    if (r <= 0 || !WriteAll(Clip->fd, buf, r, pos)) {
+      ok = false;
+      break;
+    }
+    pos += r;
+    cBDStats::Count(bcStagedBytes, r);
+  }
+  free(buf);
+
+  // the map must not get ahead of the data
+  return ok && pos >= end && !fdatasync(Clip->fd);
+}
+
+bool cBDStage::MakeRoom(uint64_t Bytes)
+{
+  uint64_t limit = (uint64_t)config.maxMB << 20;
+  if (cacheBytes + Bytes <= limit)
+    return true;
+
+  // least recently played discs first, never this one
+  for (;;) {
+    DIR *d = opendir(cacheDir);
+    if (!d)
+      return false;
+    char oldest[1024] = "";
+    time_t oldestTime = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+      char path[1024];
+      struct stat st;
+      snprintf(path, sizeof(path), "%s/%s", cacheDir, e->d_name);
+      if (e->d_name[0] == '.' || !strcmp(path, dir) || stat(path, &st) || !S_ISDIR(st.st_mode))
+        continue;
+      if (!oldest[0] || st.st_mtime < oldestTime) {
+        strcpy(oldest, path);
+        oldestTime = st.st_mtime;
+      }
+    }
+    closedir(d);
+    if (!oldest[0])
+      return false;
+
+    uint64_t bytes = DirBytes(oldest);
+    RemoveDir(oldest);
+    syslog(LOG_INFO, "BluRay: stage: evicted %s (%llu MB)", oldest, (unsigned long long)(bytes >> 20));
+    cacheBytes = cacheBytes > bytes ? cacheBytes - bytes : 0;
+    if (cacheBytes + Bytes <= limit)
+      return true;
+  }
+}
+
+void cBDStage::Action(void)
+{
+  cBDStats::Attach("stage");
+
+  sBDSchedParams sched = { spNice, 19, 0, icIdle, 0 };
+  BDApplySched(sched, "BluRay stage");
+
+  // what all discs use
+  uint64_t bytes = 0;
+  DIR *d = opendir(cacheDir);
+  if (d) {
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+      char path[1024];
+      snprintf(path, sizeof(path), "%s/%s", cacheDir, e->d_name);
+      if (e->d_name[0] != '.')
+        bytes += DirBytes(path);
+    }
+    closedir(d);
+  }
+
+  mutex.Lock();
+  cacheBytes = bytes;
+  while (Running()) {
+    sClip *c;
+    int chunk;
+    if (full || !NextChunk(c, chunk)) {
+      wake.TimedWait(mutex, 200);
+      continue;
+    }
+    uint64_t idle = cBDStats::Now() - lastDiscRead;
+    if (idle < DRIVE_IDLE_US) {
+      wake.TimedWait(mutex, (DRIVE_IDLE_US - idle) / 1000 + 1);
+      continue;
+    }
+    mutex.Unlock();
+
+    bool room = MakeRoom(CHUNK_SIZE);
+    bool ok = room && CopyChunk(c, chunk);
+
+    mutex.Lock();
+    if (!room) {
+      syslog(LOG_INFO, "BluRay: stage: cache full (%d MB)", config.maxMB);
+      full = true;
+    } else if (ok) {
+      c->map[chunk] = csStaged;
+      c->staged++;
+      cacheBytes += CHUNK_SIZE;
+      SaveMap(c);
+      if (c->staged == c->chunks)
+        syslog(LOG_INFO, "BluRay: stage: %s.m2ts staged (%llu MB)", c->name, (unsigned long long)(c->size >> 20));
+    } else if (Running()) {
+      syslog(LOG_ERR, "BluRay: stage: can't copy %s.m2ts at %llu", c->name, (unsigned long long)chunk * CHUNK_SIZE);
+      c->map[chunk] = csFailed;
+    }
+  }
+  mutex.Unlock();
+}
@@ -0,0 +1,90 @@
+/*
+ * bdstage.h: Staging of the playing title on local storage
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDSTAGE_H
+#define _BDSTAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libbluray/bluray.h>
+
+#include "bdthread.h"
+
+struct sBDStageConfig {
+  int maxMB;           // cache size of all discs, 0: off
+};
+
+extern sBDStageConfig BDStageConfig;
+
+// --- cBDStage ---------------------------------------------------------
+
+// While a title plays, a background thread (idle I/O priority) copies
+// the stream files of its clips in 4 MB chunks from the disc into a
+// cache directory (Dir/<disc id>/<clip>.m2ts, a chunk map next to it).
+// The read-ahead file layer reads staged chunks from there, so seeks,
+// chapter skips and rewatches don't touch the drive. The copier only
+// reads while playback hasn't used the drive for a while. Discs are
+// evicted least recently played first when the cache is full.
+
+class cBDStage : public cBDThread {
+private:
+  struct sClip;
+
+  char    *root;
+  char    *dir;                 // staged files of this disc
+  char    *cacheDir;            // all discs
+  sBDStageConfig config;
+
+  cBDMutex   mutex;
+  cBDCondVar wake;
+  sClip    **clips;             // in playlist order
+  int        clipCount;
+  uint64_t   lastDiscRead;      // playback read from the disc
+  uint64_t   cacheBytes;        // used by all discs
+  bool       full;
+
+  sClip *Find(const char *Clip);
+  bool   LoadMap(sClip *Clip);
+  bool   SaveMap(sClip *Clip);
+  bool   NextChunk(sClip *&Clip, int &Chunk);
+  bool   CopyChunk(sClip *Clip, int Chunk);
+  bool   MakeRoom(uint64_t Bytes);
+
+protected:
+  virtual void Action(void);
+  // Disc read (the benchmark adds latency here)
+  virtual ssize_t ReadDisc(int Fd, uint8_t *Buffer, int Size, uint64_t Offset);
+
+public:
+  // bytes of playback reads served from the cache / from the disc
+  uint64_t hitBytes, missBytes;
+
+  // Root: disc folder, Dir: cache directory of all discs
+  cBDStage(const sBDStageConfig &Config, const char *Root, const char *Dir);
+  virtual ~cBDStage();
+
+  // Stage the clips of Info (in addition to the ones given before)
+  void SetClips(const BLURAY_TITLE_INFO *Info);
+  // Stage stream file BDMV/STREAM/<Clip>.m2ts
+  void AddClip(const char *Clip);
+  // New cache size
+  void SetMaxMB(int MB);
+
+  // Read Size bytes at Offset of stream file Clip from the cache. Returns
+  // the bytes read, up to the first chunk that is not staged (0: none).
+  int  Read(const char *Clip, uint8_t *Buffer, int Size, uint64_t Offset);
+  // Playback read Bytes from the disc: the copier keeps off the drive
+  void Missed(int Bytes);
+
+  // Bytes of the clips staged / in total
+  void Progress(uint64_t &Staged, uint64_t &Total);
+  // Share of playback reads served from the cache (0...1)
+  double HitRatio(void);
+};
+
+#endif //_BDSTAGE_H
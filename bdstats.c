@@ -0,0 +1,285 @@
+/*
+ * bdstats.c: Playback pipeline statistics
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bdstats.h"
+
+static const char *CounterNames[bcCount] = {
+  "read calls",
+  "read bytes",
+  "read errors",
+  "packets video",
+  "packets audio",
+  "packets PG",
+  "packets IG",
+  "packets other",
+  "PlayTs accepted",
+  "PlayTs partial",
+  "PlayTs rejected",
+  "PlayTs errors",
+  "poll timeouts",
+  "seeks",
+  "events",
+  "resyncs",
+  "dropped bytes",
+  "carry-overs",
+  "skips",
+  "skipped bytes",
+  "client dropped",
+  "angle changes",
+  "prefetch bytes",
+  "PG display sets",
+  "PG cache hits",
+  "PG dropped",
+  "menu keys",
+  "overlay flushes",
+  "read-ahead bytes",
+  "read-ahead waits",
+  "copied bytes",
+  "progress draws",
+  "AACS units",
+  "staged bytes",
+  "stage hit bytes",
+  "stage miss bytes",
+};
+
+static const char *HistogramNames[bhCount] = {
+  "bd_read_ext",
+  "seek",
+  "events",
+  "angle switch",
+  "PG decode",
+  "menu response",
+  "storage read",
+  "AACS decrypt",
+  "resume",
+};
+
+static pthread_mutex_t blocksMutex = PTHREAD_MUTEX_INITIALIZER;
+static sBDStatBlock *blocks = NULL;
+static int epoch = 0;              // written under blocksMutex
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t blockKey;
+static __thread sBDStatBlock *threadBlock = NULL;
+static char *dumpFile = NULL;
+
+// --- cBDStats ---------------------------------------------------------
+
+sBDStatBlock *cBDStats::Find(const char *Name)
+{
+  pthread_mutex_lock(&blocksMutex);
+
+  sBDStatBlock *b;
+  for (b = blocks; b; b = b->next) {
+    if (!b->used && !strcmp(b->name, Name))
+      break;
+  }
+  if (!b) {
+    b = (sBDStatBlock *)calloc(1, sizeof(sBDStatBlock));
+    strncpy(b->name, Name, sizeof(b->name) - 1);
+    b->epoch = epoch;
+    b->next = blocks;
+    blocks = b;
+  }
+  b->used = true;
+
+  pthread_mutex_unlock(&blocksMutex);
+  return b;
+}
+
+void cBDStats::CreateKey(void)
+{
+  // releases the block of an ending thread
+  pthread_key_create(&blockKey, Release);
+}
+
+void cBDStats::Release(void *Block)
+{
+  pthread_mutex_lock(&blocksMutex);
+  ((sBDStatBlock *)Block)->used = false;
+  pthread_mutex_unlock(&blocksMutex);
+}
+
+void cBDStats::Clear(sBDStatBlock *b)
+{
+  memset(b->counter, 0, sizeof(b->counter));
+  memset(b->hist,    0, sizeof(b->hist));
+  memset(b->histSum, 0, sizeof(b->histSum));
+  memset(b->histMax, 0, sizeof(b->histMax));
+  __atomic_store_n(&b->epoch, __atomic_load_n(&epoch, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+}
+
+void cBDStats::Attach(const char *ThreadName)
+{
+  if (threadBlock) {
+    if (!strncmp(threadBlock->name, ThreadName, sizeof(threadBlock->name) - 1))
+      return;
+    Release(threadBlock);
+  }
+  // a block of an ended thread of the same name is continued, the block
+  // is released again when this thread ends
+  threadBlock = Find(ThreadName);
+  pthread_once(&keyOnce, CreateKey);
+  pthread_setspecific(blockKey, threadBlock);
+}
+
+sBDStatBlock *cBDStats::Block(void)
+{
+  if (!threadBlock)
+    Attach("other");
+  if (threadBlock->epoch != __atomic_load_n(&epoch, __ATOMIC_RELAXED))
+    Clear(threadBlock);
+  return threadBlock;
+}
+
+uint64_t cBDStats::Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void cBDStats::Time(eBDHistogram Histogram, uint64_t Us)
+{
+  sBDStatBlock *b = Block();
+  int bucket = 0;
+  while (bucket < BD_HIST_BUCKETS - 1 && (Us >> bucket))
+    bucket++;
+  b->hist[Histogram][bucket]++;
+  b->histSum[Histogram] += Us;
+  if (Us > b->histMax[Histogram])
+    b->histMax[Histogram] = Us;
+}
+
+uint64_t cBDStats::Total(eBDCounter Counter)
+{
+  uint64_t n = 0;
+  pthread_mutex_lock(&blocksMutex);
+  for (sBDStatBlock *b = blocks; b; b = b->next) {
+    if (__atomic_load_n(&b->epoch, __ATOMIC_ACQUIRE) == epoch)
+      n += b->counter[Counter];
+  }
+  pthread_mutex_unlock(&blocksMutex);
+  return n;
+}
+
+uint64_t cBDStats::Average(eBDHistogram Histogram)
+{
+  uint64_t n = 0, sum = 0;
+  pthread_mutex_lock(&blocksMutex);
+  for (sBDStatBlock *b = blocks; b; b = b->next) {
+    if (__atomic_load_n(&b->epoch, __ATOMIC_ACQUIRE) != epoch)
+      continue;
+    for (int i = 0; i < BD_HIST_BUCKETS; i++)
+      n += b->hist[Histogram][i];
+    sum += b->histSum[Histogram];
+  }
+  pthread_mutex_unlock(&blocksMutex);
+  return n ? sum / n : 0;
+}
+
+void cBDStats::Reset(void)
+{
+  // the blocks are written by their threads only, see Block()
+  pthread_mutex_lock(&blocksMutex);
+  __atomic_store_n(&epoch, epoch + 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&blocksMutex);
+}
+
+void cBDStats::Print(FILE *f, sBDStatBlock *b)
+{
+  fprintf(f, "[%s]\n", b->name);
+
+  for (int i = 0; i < bcCount; i++) {
+    if (b->counter[i])
+      fprintf(f, "  %-18s %llu\n", CounterNames[i], (unsigned long long)b->counter[i]);
+  }
+
+  for (int h = 0; h < bhCount; h++) {
+    uint64_t n = 0;
+    for (int i = 0; i < BD_HIST_BUCKETS; i++)
+      n += b->hist[h][i];
+    if (!n)
+      continue;
+
+    fprintf(f, "  %-18s n=%llu avg=%lluus max=%lluus\n", HistogramNames[h],
+            (unsigned long long)n,
+            (unsigned long long)(b->histSum[h] / n),
+            (unsigned long long)b->histMax[h]);
+    for (int i = 0; i < BD_HIST_BUCKETS; i++) {
+      if (b->hist[h][i])
+        fprintf(f, "    <%-10llu %llu\n", 1ULL << i, (unsigned long long)b->hist[h][i]);
+    }
+  }
+}
+
+void cBDStats::Report(FILE *f)
+{
+  pthread_mutex_lock(&blocksMutex);
+  for (sBDStatBlock *b = blocks; b; b = b->next) {
+    // the sum of all threads of this name, at its first block
+    sBDStatBlock *p;
+    for (p = blocks; p != b && strcmp(p->name, b->name); p = p->next)
+      ;
+    if (p != b)
+      continue;
+    sBDStatBlock sum;
+    memset(&sum, 0, sizeof(sum));
+    strcpy(sum.name, b->name);
+    for (p = b; p; p = p->next) {
+      if (__atomic_load_n(&p->epoch, __ATOMIC_ACQUIRE) != epoch || strcmp(p->name, b->name))
+        continue;
+      for (int i = 0; i < bcCount; i++)
+        sum.counter[i] += p->counter[i];
+      for (int h = 0; h < bhCount; h++) {
+        for (int i = 0; i < BD_HIST_BUCKETS; i++)
+          sum.hist[h][i] += p->hist[h][i];
+        sum.histSum[h] += p->histSum[h];
+        if (p->histMax[h] > sum.histMax[h])
+          sum.histMax[h] = p->histMax[h];
+      }
+    }
+    Print(f, &sum);
+  }
+  pthread_mutex_unlock(&blocksMutex);
+}
+
+char *cBDStats::Report(void)
+{
+  char *buf = NULL;
+  size_t size = 0;
+  FILE *f = open_memstream(&buf, &size);
+  if (!f)
+    return NULL;
+  Report(f);
+  fclose(f);
+  return buf;
+}
+
+bool cBDStats::Dump(const char *FileName)
+{
+  FILE *f = fopen(FileName, "w");
+  if (!f)
+    return false;
+  Report(f);
+  return fclose(f) == 0;
+}
+
+void cBDStats::SetDumpFile(const char *FileName)
+{
+  free(dumpFile);
+  dumpFile = FileName ? strdup(FileName) : NULL;
+}
+
+const char *cBDStats::DumpFile(void)
+{
+  return dumpFile;
+}
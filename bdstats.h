@@ -0,0 +1,122 @@
+/*
+ * bdstats.h: Playback pipeline statistics
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDSTATS_H
+#define _BDSTATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum eBDCounter {
+  bcReadCalls,
+  bcReadBytes,
+  bcReadErrors,
+  bcPidVideo,          // packets per PID class, same order as ePidClass
+  bcPidAudio,
+  bcPidPG,
+  bcPidIG,
+  bcPidOther,
+  bcPlayTsAccepted,
+  bcPlayTsPartial,
+  bcPlayTsRejected,
+  bcPlayTsErrors,
+  bcPollTimeouts,
+  bcSeeks,
+  bcEvents,
+  bcResyncs,
+  bcDroppedBytes,
+  bcCarryOvers,
+  bcSkips,             // read errors skipped by recovery
+  bcSkippedBytes,
+  bcClientDroppedBytes, // streaming server: data lost by slow clients
+  bcAngleChanges,
+  bcPrefetchBytes,     // alternate angle data read ahead
+  bcPgDisplaySets,
+  bcPgCacheHits,       // PG objects not decoded again
+  bcPgDroppedPackets,  // PG decoder queue full
+  bcMenuKeys,          // keys sent to HDMV menus
+  bcOverlayFlushes,    // menu OSD updates
+  bcReadAheadBytes,    // stream data read ahead from disc folders
+  bcReadAheadWaits,    // reads that waited for the read-ahead
+  bcCopiedBytes,       // stream data copied between pipeline stages
+  bcProgressDraws,     // replay progress display flushes
+  bcAacsUnits,         // aligned units decrypted by the plugin
+  bcStagedBytes,       // stream data copied to the staging cache
+  bcStageHitBytes,     // stream data read from the staging cache
+  bcStageMissBytes,    // stream data read from the disc while staging
+  bcCount
+};
+
+enum eBDHistogram {
+  bhRead,              // bd_read_ext() latency
+  bhSeek,              // seek latency
+  bhEvents,            // event handling time
+  bhAngle,             // angle switch latency (request to change point)
+  bhPgDecode,          // PG display set decoding (RLE expansion)
+  bhMenuResponse,      // menu key to OSD update
+  bhStorageRead,       // read-ahead storage request
+  bhDecrypt,           // AACS decryption of a read-ahead request
+  bhResume,            // resume after pause to the next data from the disc
+  bhCount
+};
+
+#define BD_HIST_BUCKETS 24 // log2 of microseconds: <1us ... >4s
+
+struct sBDStatBlock {
+  char     name[16];
+  uint64_t counter[bcCount];
+  uint64_t hist[bhCount][BD_HIST_BUCKETS];
+  uint64_t histSum[bhCount];
+  uint64_t histMax[bhCount];
+  int      epoch;      // Reset() count the values belong to
+  bool     used;       // owned by a running thread
+  sBDStatBlock *next;
+};
+
+// Counters are kept in per-thread blocks and updated without locking, each
+// block by its thread only. Threads of the same name have a block each,
+// reports show their sum. Reset() starts a new epoch: readers skip blocks
+// of an earlier one, their threads clear them on their next update.
+// Readers (SVDRP, dump) may see slightly stale values.
+
+class cBDStats {
+private:
+  static sBDStatBlock *Find(const char *Name);
+  static void CreateKey(void);
+  static void Release(void *Block);
+  static void Clear(sBDStatBlock *Block);
+  static void Print(FILE *f, sBDStatBlock *Block);
+
+public:
+  static void Attach(const char *ThreadName);
+  static sBDStatBlock *Block(void);
+
+  static void Count(eBDCounter Counter, uint64_t n = 1) { Block()->counter[Counter] += n; }
+  static void Time(eBDHistogram Histogram, uint64_t Us);
+  static uint64_t Total(eBDCounter Counter); // sum of all threads
+  static uint64_t Average(eBDHistogram Histogram); // of all threads, microseconds
+  static uint64_t Now(void); // monotonic, microseconds
+
+  static void Reset(void);
+  static void Report(FILE *f);
+  static char *Report(void); // malloc()ed, free() after use
+  static bool Dump(const char *FileName);
+
+  static void SetDumpFile(const char *FileName);
+  static const char *DumpFile(void);
+};
+
+class cBDStatTimer {
+private:
+  eBDHistogram histogram;
+  uint64_t start;
+public:
+  cBDStatTimer(eBDHistogram Histogram) : histogram(Histogram), start(cBDStats::Now()) {}
+  ~cBDStatTimer() { cBDStats::Time(histogram, cBDStats::Now() - start); }
+};
+
+#endif //_BDSTATS_H
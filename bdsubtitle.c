@@ -0,0 +1,242 @@
+/*
+ * bdsubtitle.c: OSD output of BluRay graphics (PG subtitles, HDMV menus)
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <vdr/device.h>
+#include <vdr/tools.h>
+
+#include "bdsubtitle.h"
+
+// Full screen true color OSD, NULL if not supported
+static cOsd *NewTrueColorOsd(int Level, int &Width, int &Height)
+{
+  double aspect;
+  cDevice::PrimaryDevice()->GetOsdSize(Width, Height, aspect);
+
+  if (cOsdProvider::SupportsTrueColor() && Width > 0 && Height > 0) {
+    cOsd *osd = cOsdProvider::NewOsd(0, 0, Level);
+    tArea area = { 0, 0, Width - 1, Height - 1, 32 };
+    if (osd && osd->SetAreas(&area, 1) == oeOk)
+      return osd;
+    delete osd;
+  }
+  return NULL;
+}
+
+/*
+ * cBDSubtitleOsd
+ *
+ * Subtitles are drawn into a true color OSD at subtitle level (hidden
+ * while a menu is open). Only the areas of the objects that changed are
+ * redrawn or cleared; unchanged objects (repeated display sets) are left
+ * alone, so a flush transfers just the dirty regions.
+ */
+
+cBDSubtitleOsd::cBDSubtitleOsd(void)
+{
+  osd = NULL;
+  width = height = 0;
+  failed = false;
+  shownCount = 0;
+}
+
+cBDSubtitleOsd::~cBDSubtitleOsd()
+{
+  delete osd;
+}
+
+bool cBDSubtitleOsd::Open(void)
+{
+  if (osd)
+    return true;
+  if (failed)
+    return false;
+
+  osd = NewTrueColorOsd(OSD_LEVEL_SUBTITLES, width, height);
+  if (osd)
+    return true;
+
+  esyslog("BluRay: OSD has no true color support, subtitles disabled");
+  failed = true;
+  return false;
+}
+
+int64_t cBDSubtitleOsd::Stc(void)
+{
+  return cDevice::PrimaryDevice()->GetSTC();
+}
+
+void cBDSubtitleOsd::Draw(const sBDPgObject &Object, const sShown &Rect)
+{
+  if (Rect.width <= 0 || Rect.height <= 0)
+    return;
+
+  if (Rect.width == Object.width && Rect.height == Object.height && Object.stride == Object.width) {
+    osd->DrawImage(cPoint(Rect.x, Rect.y), cImage(cSize(Rect.width, Rect.height), Object.argb));
+    return;
+  }
+
+  // crop and scale to the OSD size (nearest neighbour)
+  tColor *pixels = MALLOC(tColor, Rect.width * Rect.height);
+  if (!pixels)
+    return;
+  tColor *d = pixels;
+  for (int y = 0; y < Rect.height; y++) {
+    const uint32_t *line = Object.argb + (y * Object.height / Rect.height) * Object.stride;
+    for (int x = 0; x < Rect.width; x++)
+      *d++ = line[x * Object.width / Rect.width];
+  }
+  osd->DrawImage(cPoint(Rect.x, Rect.y), cImage(cSize(Rect.width, Rect.height), pixels));
+  free(pixels);
+}
+
+void cBDSubtitleOsd::Show(const sBDPgComposition &Composition)
+{
+  if (!Composition.objectCount) {
+    Clear();
+    return;
+  }
+  if (!Open())
+    return;
+
+  sShown next[BD_PG_MAX_OBJECTS];
+  int nextCount = 0;
+  for (int i = 0; i < Composition.objectCount; i++) {
+    const sBDPgObject &o = Composition.objects[i];
+    sShown &r = next[nextCount++];
+    r.x      = o.x * width / Composition.videoWidth;
+    r.y      = o.y * height / Composition.videoHeight;
+    r.width  = o.width * width / Composition.videoWidth;
+    r.height = o.height * height / Composition.videoHeight;
+    r.key    = o.key;
+    if (r.x + r.width > width)
+      r.width = width - r.x;
+    if (r.y + r.height > height)
+      r.height = height - r.y;
+  }
+
+  bool dirty = false;
+
+  // clear old objects that are not shown again at the same place
+  for (int i = 0; i < shownCount; i++) {
+    const sShown &s = shown[i];
+    bool kept = false;
+    for (int j = 0; j < nextCount && !kept; j++)
+      kept = !memcmp(&s, &next[j], sizeof(s));
+    if (!kept && s.width > 0 && s.height > 0) {
+      osd->DrawRectangle(s.x, s.y, s.x + s.width - 1, s.y + s.height - 1, clrTransparent);
+      dirty = true;
+    }
+  }
+
+  // draw new objects
+  for (int j = 0; j < nextCount; j++) {
+    bool same = false;
+    for (int i = 0; i < shownCount && !same; i++)
+      same = !memcmp(&shown[i], &next[j], sizeof(next[j]));
+    if (!same) {
+      Draw(Composition.objects[j], next[j]);
+      dirty = true;
+    }
+  }
+
+  memcpy(shown, next, sizeof(next));
+  shownCount = nextCount;
+
+  if (dirty)
+    osd->Flush();
+}
+
+void cBDSubtitleOsd::Clear(void)
+{
+  if (!osd || !shownCount)
+    return;
+
+  for (int i = 0; i < shownCount; i++) {
+    const sShown &s = shown[i];
+    if (s.width > 0 && s.height > 0)
+      osd->DrawRectangle(s.x, s.y, s.x + s.width - 1, s.y + s.height - 1, clrTransparent);
+  }
+  shownCount = 0;
+  osd->Flush();
+}
+
+/*
+ * cBDMenuOsd
+ *
+ * The menu plane goes to its own OSD above the subtitles, so subtitles
+ * are hidden while a menu is shown. Each update redraws only the dirty
+ * rectangle of the plane (scaled to the OSD size) and flushes once.
+ */
+
+cBDMenuOsd::cBDMenuOsd(void)
+{
+  osd = NULL;
+  width = height = 0;
+  failed = false;
+}
+
+cBDMenuOsd::~cBDMenuOsd()
+{
+  delete osd;
+}
+
+bool cBDMenuOsd::Open(void)
+{
+  if (osd)
+    return true;
+  if (failed)
+    return false;
+
+  osd = NewTrueColorOsd(OSD_LEVEL_SUBTITLES + 1, width, height);
+  if (osd)
+    return true;
+
+  esyslog("BluRay: OSD has no true color support, disc menus not shown");
+  failed = true;
+  return false;
+}
+
+void cBDMenuOsd::Update(const uint32_t *Plane, int Width, int Height, const sBDPgRect &Dirty)
+{
+  if (!Open())
+    return;
+
+  // dirty area in OSD coordinates, rounded outwards
+  int x0 = Dirty.x * width / Width;
+  int y0 = Dirty.y * height / Height;
+  int x1 = ((Dirty.x + Dirty.width) * width + Width - 1) / Width;
+  int y1 = ((Dirty.y + Dirty.height) * height + Height - 1) / Height;
+  if (x1 > width)  x1 = width;
+  if (y1 > height) y1 = height;
+  int w = x1 - x0, h = y1 - y0;
+  if (w <= 0 || h <= 0)
+    return;
+
+  tColor *pixels = MALLOC(tColor, w * h);
+  if (!pixels)
+    return;
+  tColor *d = pixels;
+  if (Width == width && Height == height) {
+    for (int y = y0; y < y1; y++, d += w)
+      memcpy(d, Plane + y * Width + x0, w * sizeof(tColor));
+  } else {
+    for (int y = y0; y < y1; y++) {
+      const uint32_t *line = Plane + (y * Height / height) * Width;
+      for (int x = x0; x < x1; x++)
+        *d++ = line[x * Width / width];
+    }
+  }
+  osd->DrawImage(cPoint(x0, y0), cImage(cSize(w, h), pixels));
+  free(pixels);
+
+  osd->Flush();
+}
+
+void cBDMenuOsd::Close(void)
+{
+  DELETENULL(osd);
+}
@@ -0,0 +1,61 @@
+/*
+ * bdsubtitle.h: OSD output of BluRay graphics (PG subtitles, HDMV menus)
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDSUBTITLE_H
+#define _BDSUBTITLE_H
+
+#include <vdr/osd.h>
+
+#include "bdoverlay.h"
+#include "bdpg.h"
+
+class cBDSubtitleOsd : public cBDPgPresenter
+{
+ private:
+  cOsd *osd;
+  int   width, height;
+  bool  failed;
+
+  // what is on the OSD now
+  struct sShown {
+    int x, y, width, height;
+    uint64_t key;
+  } shown[BD_PG_MAX_OBJECTS];
+  int   shownCount;
+
+  bool Open(void);
+  void Draw(const sBDPgObject &Object, const sShown &Rect);
+
+ public:
+  cBDSubtitleOsd(void);
+  virtual ~cBDSubtitleOsd();
+
+  // cBDPgPresenter (called from the decoder thread)
+  virtual int64_t Stc(void);
+  virtual void Show(const sBDPgComposition &Composition);
+  virtual void Clear(void);
+};
+
+class cBDMenuOsd : public cBDOverlayPresenter
+{
+ private:
+  cOsd *osd;
+  int   width, height;
+  bool  failed;
+
+  bool Open(void);
+
+ public:
+  cBDMenuOsd(void);
+  virtual ~cBDMenuOsd();
+
+  // cBDOverlayPresenter (called with the player locked)
+  virtual void Update(const uint32_t *Plane, int Width, int Height, const sBDPgRect &Dirty);
+  virtual void Close(void);
+};
+
+#endif //_BDSUBTITLE_H
@@ -0,0 +1,121 @@
+/*
+ * bdthread.c: Threads and locks for the playback core
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "bdthread.h"
+
+// --- cBDMutex ---------------------------------------------------------
+
+cBDMutex::cBDMutex(void)
+{
+  pthread_mutex_init(&mutex, NULL);
+}
+
+cBDMutex::~cBDMutex()
+{
+  pthread_mutex_destroy(&mutex);
+}
+
+// --- cBDCondVar -------------------------------------------------------
+
+cBDCondVar::cBDCondVar(void)
+{
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+cBDCondVar::~cBDCondVar()
+{
+  pthread_cond_destroy(&cond);
+}
+
+void cBDCondVar::Wait(cBDMutex &Mutex)
+{
+  pthread_cond_wait(&cond, &Mutex.mutex);
+}
+
+bool cBDCondVar::TimedWait(cBDMutex &Mutex, int TimeoutMs)
+{
+  struct timespec abstime;
+  clock_gettime(CLOCK_MONOTONIC, &abstime);
+  abstime.tv_sec  += TimeoutMs / 1000;
+  abstime.tv_nsec += (TimeoutMs % 1000) * 1000000;
+  if (abstime.tv_nsec >= 1000000000) {
+    abstime.tv_sec++;
+    abstime.tv_nsec -= 1000000000;
+  }
+  return pthread_cond_timedwait(&cond, &Mutex.mutex, &abstime) != ETIMEDOUT;
+}
+
+// --- cBDThread --------------------------------------------------------
+
+cBDThread::cBDThread(const char *Name)
+{
+  name = strdup(Name);
+  active = running = false;
+}
+
+cBDThread::~cBDThread()
+{
+  Cancel();
+  free(name);
+}
+
+void *cBDThread::StartThread(void *Thread)
+{
+  cBDThread *t = (cBDThread *)Thread;
+  pthread_setname_np(pthread_self(), t->name);
+  syslog(LOG_DEBUG, "%s thread started", t->name);
+  t->Action();
+  syslog(LOG_DEBUG, "%s thread ended", t->name);
+  t->running = false;
+  return NULL;
+}
+
+bool cBDThread::Start(void)
+{
+  if (active)
+    return true;
+
+  running = true;
+  if (pthread_create(&thread, NULL, StartThread, this)) {
+    syslog(LOG_ERR, "ERROR: can't start %s thread", name);
+    running = false;
+    return false;
+  }
+  active = true;
+  return true;
+}
+
+void cBDThread::Cancel(void)
+{
+  if (!active)
+    return;
+
+  mutex.Lock();
+  running = false;
+  wakeup.Broadcast();
+  mutex.Unlock();
+
+  pthread_join(thread, NULL);
+  active = false;
+}
+
+void cBDThread::Sleep(int TimeoutMs)
+{
+  cBDMutexLock lock(mutex);
+  if (running)
+    wakeup.TimedWait(mutex, TimeoutMs);
+}
@@ -0,0 +1,74 @@
+/*
+ * bdthread.h: Threads and locks for the playback core
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDTHREAD_H
+#define _BDTHREAD_H
+
+#include <pthread.h>
+
+// Minimal counterparts of VDR's cMutex / cCondVar / cThread,
+// the core can't use VDR classes.
+
+class cBDMutex {
+  friend class cBDCondVar;
+private:
+  pthread_mutex_t mutex;
+public:
+  cBDMutex(void);
+  ~cBDMutex();
+  void Lock(void)   { pthread_mutex_lock(&mutex); }
+  void Unlock(void) { pthread_mutex_unlock(&mutex); }
+};
+
+class cBDMutexLock {
+private:
+  cBDMutex &mutex;
+public:
+  cBDMutexLock(cBDMutex &Mutex) : mutex(Mutex) { mutex.Lock(); }
+  ~cBDMutexLock() { mutex.Unlock(); }
+};
+
+class cBDCondVar {
+private:
+  pthread_cond_t cond;
+public:
+  cBDCondVar(void);
+  ~cBDCondVar();
+  void Wait(cBDMutex &Mutex);
+  bool TimedWait(cBDMutex &Mutex, int TimeoutMs);
+  void Signal(void)    { pthread_cond_signal(&cond); }
+  void Broadcast(void) { pthread_cond_broadcast(&cond); }
+};
+
+class cBDThread {
+private:
+  pthread_t thread;
+  char *name;
+  bool active;
+  volatile bool running;
+  cBDMutex mutex;
+  cBDCondVar wakeup;
+
+  static void *StartThread(void *Thread);
+
+protected:
+  virtual void Action(void) = 0;
+  bool Running(void) { return running; }
+  // Sleep, returns early when the thread is cancelled
+  void Sleep(int TimeoutMs);
+
+public:
+  cBDThread(const char *Name);
+  virtual ~cBDThread();
+
+  bool Start(void);
+  // Stop the thread and wait for it to end
+  void Cancel(void);
+  bool Active(void) { return active; }
+};
+
+#endif //_BDTHREAD_H
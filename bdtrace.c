@@ -0,0 +1,258 @@
+/*
+ * bdtrace.c: Pipeline latency tracing
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include "bdtrace.h"
+
+#ifdef BD_TRACE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "bdsched.h"
+#include "bdthread.h"
+
+#define TRACE_EVENTS   32768               // per thread
+#define MIN_SPAN_US    10
+#define MAX_TIDS       64                  // threads named per ring in a dump
+#define STALL_DUMP_US  (10 * 1000000ULL)   // between stall dumps
+
+static const char *SpanNames[btCount] = {
+  "bd_read_ext",
+  "events",
+  "PID filter",
+  "DevicePoll",
+  "PlayTs",
+  "seek",
+  "OSD flush",
+};
+
+// seq is 0 while the event is written, then its index + 1
+struct sBDTraceEvent {
+  volatile uint64_t seq;
+  uint64_t start;
+  uint32_t duration;
+  int32_t  tid;
+  uint32_t span;
+};
+
+// Rings are looked up by the thread's statistics name like the
+// statistics blocks, so restarted threads continue the old ring. Threads
+// sharing a name reserve events with an atomic add.
+struct sBDTraceRing {
+  char name[16];
+  volatile uint64_t head;                  // events written
+  sBDTraceEvent events[TRACE_EVENTS];
+  sBDTraceRing *next;
+};
+
+static pthread_mutex_t ringsMutex = PTHREAD_MUTEX_INITIALIZER;
+static sBDTraceRing *rings = NULL;
+static __thread sBDTraceRing *threadRing = NULL;
+static __thread int threadId = 0;
+static char *dumpFile = NULL;
+static uint64_t stallUs = 0;
+static volatile uint64_t lastStallDump = 0;
+
+bool cBDTrace::enabled = false;
+
+// --- cBDTraceWriter ---------------------------------------------------
+
+// Writes the stall dumps, so the stalled thread only signals it
+
+class cBDTraceWriter : public cBDThread {
+private:
+  cBDMutex mutex;
+  cBDCondVar request;
+  bool pending;
+  eBDTraceSpan span;
+  uint64_t us;
+
+protected:
+  virtual void Action(void);
+
+public:
+  cBDTraceWriter(void) : cBDThread("BluRay trace") { pending = false; span = btRead; us = 0; }
+  virtual ~cBDTraceWriter() { Cancel(); }
+  void Request(eBDTraceSpan Span, uint64_t Us);
+};
+
+void cBDTraceWriter::Request(eBDTraceSpan Span, uint64_t Us)
+{
+  cBDMutexLock lock(mutex);
+  span = Span;
+  us = Us;
+  pending = true;
+  request.Signal();
+}
+
+void cBDTraceWriter::Action(void)
+{
+  static const sBDSchedParams idle = { spNice, 19, 0, icIdle, 0 };
+  BDApplySched(idle, "BluRay trace");
+
+  while (Running()) {
+    mutex.Lock();
+    if (!pending)
+      request.TimedWait(mutex, 1000);
+    bool dump = pending;
+    eBDTraceSpan s = span;
+    uint64_t u = us;
+    pending = false;
+    mutex.Unlock();
+
+    if (!dump)
+      continue;
+    const char *file = cBDTrace::DumpFile();
+    syslog(LOG_INFO, "BluRay trace: %s took %llu ms", SpanNames[s], (unsigned long long)(u / 1000));
+    if (file && !cBDTrace::Dump(file))
+      syslog(LOG_ERR, "BluRay trace: can't write %s", file);
+  }
+}
+
+static cBDTraceWriter writer;
+
+static sBDTraceRing *Ring(void)
+{
+  const char *name = cBDStats::Block()->name;
+  if (threadRing && !strcmp(threadRing->name, name))
+    return threadRing;
+
+  pthread_mutex_lock(&ringsMutex);
+  sBDTraceRing *r;
+  for (r = rings; r; r = r->next) {
+    if (!strcmp(r->name, name))
+      break;
+  }
+  if (!r) {
+    r = (sBDTraceRing *)calloc(1, sizeof(sBDTraceRing));
+    if (r) {
+      strcpy(r->name, name);   // same size as the statistics block name
+      r->next = rings;
+      rings = r;
+    }
+  }
+  pthread_mutex_unlock(&ringsMutex);
+
+  threadRing = r;
+  threadId = syscall(SYS_gettid);
+  return r;
+}
+
+// --- cBDTrace ---------------------------------------------------------
+
+void cBDTrace::Span(eBDTraceSpan Span, uint64_t Start, uint64_t End)
+{
+  uint64_t us = End - Start;
+  if (!enabled || us < MIN_SPAN_US)
+    return;
+
+  sBDTraceRing *r = Ring();
+  if (!r)
+    return;
+
+  uint64_t i = __sync_fetch_and_add(&r->head, 1);
+  sBDTraceEvent *e = &r->events[i % TRACE_EVENTS];
+  e->seq = 0;
+  __sync_synchronize();
+  e->start    = Start;
+  e->duration = us > UINT32_MAX ? UINT32_MAX : us;
+  e->tid      = threadId;
+  e->span     = Span;
+  __sync_synchronize();
+  e->seq = i + 1;
+
+  if (stallUs && us >= stallUs && (Span == btRead || Span == btPoll || Span == btPlayTs))
+    Stall(Span, us);
+}
+
+void cBDTrace::Stall(eBDTraceSpan Span, uint64_t Us)
+{
+  uint64_t now = cBDStats::Now();
+  uint64_t last = lastStallDump;
+  if ((last && now - last < STALL_DUMP_US) || !__sync_bool_compare_and_swap(&lastStallDump, last, now))
+    return;
+
+  // started here, not before VDR has become a daemon
+  if (!writer.Active())
+    writer.Start();
+  writer.Request(Span, Us);
+}
+
+static void DumpRing(FILE *f, sBDTraceRing *r, int Pid, bool &First)
+{
+  int tids[MAX_TIDS];
+  int tidCount = 0;
+
+  uint64_t head = r->head;
+  uint64_t first = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+  for (uint64_t i = first; i < head; i++) {
+    const sBDTraceEvent *e = &r->events[i % TRACE_EVENTS];
+    uint64_t seq = e->seq;
+    __sync_synchronize();
+    sBDTraceEvent copy = *e;
+    __sync_synchronize();
+    // overwritten or being written meanwhile
+    if (seq != i + 1 || e->seq != seq)
+      continue;
+
+    int t = 0;
+    while (t < tidCount && tids[t] != copy.tid)
+      t++;
+    if (t == tidCount && tidCount < MAX_TIDS) {
+      tids[tidCount++] = copy.tid;
+      fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              First ? "" : ",", Pid, copy.tid, r->name);
+      First = false;
+    }
+
+    fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"bluray\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%u,\"pid\":%d,\"tid\":%d}",
+            First ? "" : ",", SpanNames[copy.span < btCount ? copy.span : 0],
+            (unsigned long long)copy.start, copy.duration, Pid, copy.tid);
+    First = false;
+  }
+}
+
+bool cBDTrace::Dump(const char *FileName)
+{
+  FILE *f = fopen(FileName, "w");
+  if (!f)
+    return false;
+
+  int pid = getpid();
+  bool first = true;
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  pthread_mutex_lock(&ringsMutex);
+  for (sBDTraceRing *r = rings; r; r = r->next)
+    DumpRing(f, r, pid, first);
+  pthread_mutex_unlock(&ringsMutex);
+  fprintf(f, "\n]}\n");
+
+  return fclose(f) == 0;
+}
+
+void cBDTrace::SetDumpFile(const char *FileName)
+{
+  free(dumpFile);
+  dumpFile = FileName ? strdup(FileName) : NULL;
+}
+
+const char *cBDTrace::DumpFile(void)
+{
+  return dumpFile;
+}
+
+void cBDTrace::SetStallMs(int Ms)
+{
+  stallUs = Ms > 0 ? Ms * 1000ULL : 0;
+}
+
+#endif //BD_TRACE
@@ -0,0 +1,80 @@
+/*
+ * bdtrace.h: Pipeline latency tracing
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDTRACE_H
+#define _BDTRACE_H
+
+#include <stdint.h>
+
+#include "bdstats.h"
+
+enum eBDTraceSpan {
+  btRead,              // bd_read_ext()
+  btEvents,            // event handling
+  btPidFilter,         // PID filtering of buffered packets (includes btPlayTs)
+  btPoll,              // DevicePoll() wait
+  btPlayTs,            // PlayTs() call
+  btSeek,              // seek / chapter skip
+  btOsdFlush,          // progress display and menu OSD flushes
+  btCount
+};
+
+#ifdef BD_TRACE
+
+// --- cBDTrace ---------------------------------------------------------
+
+// Built with BD_TRACE only (make BDTRACE=1), else the span macros below
+// compile to nothing. Spans are kept in a ring per thread (the latest
+// 32768) and written without locking; spans shorter than 10 us are not
+// kept (most PlayTs() calls). Dump() writes Chrome trace-event JSON
+// (chrome://tracing, ui.perfetto.dev). A read, poll or PlayTs() span
+// longer than the stall time has the trace dumped to the dump file, by
+// a low priority thread of its own.
+
+class cBDTrace {
+private:
+  static bool enabled;
+  static void Stall(eBDTraceSpan Span, uint64_t Us);
+
+public:
+  static void Enable(bool On) { enabled = On; }
+  static bool Enabled(void) { return enabled; }
+
+  static void Span(eBDTraceSpan Span, uint64_t Start, uint64_t End);
+
+  static bool Dump(const char *FileName);
+  static void SetDumpFile(const char *FileName);
+  static const char *DumpFile(void);
+  // Dump when playback stalls for Ms (0: never), at most every 10 s
+  static void SetStallMs(int Ms);
+};
+
+class cBDTraceTimer {
+private:
+  eBDTraceSpan span;
+  uint64_t start;
+public:
+  cBDTraceTimer(eBDTraceSpan Span) : span(Span), start(cBDTrace::Enabled() ? cBDStats::Now() : 0) {}
+  ~cBDTraceTimer() { if (start) cBDTrace::Span(span, start, cBDStats::Now()); }
+};
+
+#define BD_TRACE_JOIN2(a, b) a##b
+#define BD_TRACE_JOIN(a, b)  BD_TRACE_JOIN2(a, b)
+
+// Span from here to the end of the scope
+#define BD_TRACE_SPAN(Type)              cBDTraceTimer BD_TRACE_JOIN(traceTimer, __LINE__)(Type)
+// Span measured by the caller (cBDStats::Now() times)
+#define BD_TRACE_EVENT(Type, Start, End) do { if (cBDTrace::Enabled()) cBDTrace::Span(Type, Start, End); } while (0)
+
+#else
+
+#define BD_TRACE_SPAN(Type)
+#define BD_TRACE_EVENT(Type, Start, End)
+
+#endif //BD_TRACE
+
+#endif //_BDTRACE_H
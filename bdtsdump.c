@@ -0,0 +1,229 @@
+/*
+ * bdtsdump.c: Dump BluRay title as MPEG-TS using the playback core
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "bdcore.h"
+#include "bdserver.h"
+#include "bdstats.h"
+
+// --- cFileSink --------------------------------------------------------
+
+class cFileSink : public cBDSink {
+private:
+  int fd;
+  uint8_t buffer[256 * TS_SIZE];
+  int fill;
+
+public:
+  uint64_t written;
+
+  cFileSink(int Fd) : fd(Fd), fill(0), written(0) {}
+
+  bool Flush(void) {
+    int done = 0;
+    while (done < fill) {
+      ssize_t w = write(fd, buffer + done, fill - done);
+      if (w < 0) {
+        if (errno == EINTR)
+          continue;
+        perror("write");
+        return false;
+      }
+      done += w;
+    }
+    written += fill;
+    fill = 0;
+    return true;
+  }
+
+  virtual int Feed(const uint8_t *Data, int Length) {
+    if (fill + Length > (int)sizeof(buffer) && !Flush())
+      return -1;
+    memcpy(buffer + fill, Data, Length);
+    fill += Length;
+    return Length;
+  }
+
+  virtual bool Poll(int TimeoutMs) { return true; }
+};
+
+// --- main -------------------------------------------------------------
+
+static volatile bool interrupted = false;
+
+static void SignalHandler(int)
+{
+  interrupted = true;
+}
+
+static void ListTitles(const char *Path, int MinTitleLength)
+{
+  BLURAY *bd = bd_open(Path, NULL);
+  if (!bd) {
+    fprintf(stderr, "opening %s failed\n", Path);
+    return;
+  }
+  unsigned num_title_idx = bd_get_titles(bd, TITLES_RELEVANT, MinTitleLength);
+  int main_title = cBDCore::MainTitle(bd, MinTitleLength);
+  for (unsigned i = 0; i < num_title_idx; i++) {
+    BLURAY_TITLE_INFO *info = bd_get_title_info(bd, i, 0);
+    if (info) {
+      unsigned s = info->duration / 90000;
+      printf("%c%3u: %05u.mpls %02u:%02u:%02u, %u chapters, %u clips\n",
+             (int)i == main_title ? '*' : ' ', i, info->playlist,
+             s / 3600, (s / 60) % 60, s % 60, info->chapter_count, info->clip_count);
+      bd_free_title_info(info);
+    }
+  }
+  bd_close(bd);
+}
+
+static int Serve(const char *Path, int MinTitleLength, int Title, int Units,
+                 const char *Address, int Port, bool Stats)
+{
+  cBDCore *core = cBDCore::Open(Path, MinTitleLength, Title);
+  if (!core)
+    return 1;
+  core->SetReadSize(Units * ALIGNED_UNIT_SIZE);
+
+  signal(SIGINT, SignalHandler);
+  signal(SIGTERM, SignalHandler);
+
+  cBDServer server(core);
+  if (!server.Listen(strcmp(Address, "0.0.0.0") ? Address : NULL, Port))
+    return 1;
+
+  fprintf(stderr, "serving on http://%s:%d/\n", Address, Port);
+  while (!interrupted && !server.Done())
+    usleep(100 * 1000);
+
+  server.Cancel();
+  if (Stats)
+    cBDStats::Report(stderr);
+  return 0;
+}
+
+static void Usage(void)
+{
+  fprintf(stderr,
+    "usage: bdtsdump [options] <BluRay path>\n"
+    "  -l,        --list         list titles\n"
+    "  -t N,      --title=N      title to dump (default: main title)\n"
+    "  -m SEC,    --min=SEC      minimum title length (default 180)\n"
+    "  -o FILE,   --output=FILE  output file (default: stdout)\n"
+    "  -u N,      --units=N      aligned units (6 KB) per read (default 32)\n"
+    "  -S,        --stats        print pipeline statistics to stderr\n"
+    "  -H PORT,   --http=PORT    serve the title over HTTP instead of dumping it\n"
+    "  -b ADDR,   --bind=ADDR    address to serve on (default 127.0.0.1, 0.0.0.0: all)\n");
+}
+
+int main(int argc, char *argv[])
+{
+  static const struct option long_options[] = {
+    { "list",    no_argument,       NULL, 'l' },
+    { "title",   required_argument, NULL, 't' },
+    { "min",     required_argument, NULL, 'm' },
+    { "output",  required_argument, NULL, 'o' },
+    { "units",   required_argument, NULL, 'u' },
+    { "stats",   no_argument,       NULL, 'S' },
+    { "http",    required_argument, NULL, 'H' },
+    { "bind",    required_argument, NULL, 'b' },
+    { NULL,      no_argument,       NULL,  0  }
+  };
+
+  int title = -1, min_length = 180, units = 32, port = 0;
+  const char *output = NULL, *bind = "127.0.0.1";
+  bool list = false, stats = false;
+
+  int c;
+  while ((c = getopt_long(argc, argv, "lt:m:o:u:SH:b:", long_options, NULL)) != -1) {
+    switch (c) {
+      case 'l': list       = true;         break;
+      case 't': title      = atoi(optarg); break;
+      case 'm': min_length = atoi(optarg); break;
+      case 'o': output     = optarg;       break;
+      case 'u': units      = atoi(optarg); break;
+      case 'S': stats      = true;         break;
+      case 'H': port       = atoi(optarg); break;
+      case 'b': bind       = optarg;       break;
+      default:  Usage(); return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    Usage();
+    return 2;
+  }
+  const char *path = argv[optind];
+
+  openlog("bdtsdump", LOG_PERROR, LOG_USER);
+
+  if (list) {
+    ListTitles(path, min_length);
+    return 0;
+  }
+
+  if (port > 0)
+    return Serve(path, min_length, title, units, bind, port, stats);
+
+  int fd = STDOUT_FILENO;
+  if (output && strcmp(output, "-")) {
+    fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      perror(output);
+      return 1;
+    }
+  }
+
+  cBDCore *core = cBDCore::Open(path, min_length, title);
+  if (!core)
+    return 1;
+
+  core->SetReadSize(units * ALIGNED_UNIT_SIZE);
+
+  signal(SIGINT, SignalHandler);
+  signal(SIGPIPE, SignalHandler);
+
+  cBDStats::Attach("bdtsdump");
+  cFileSink sink(fd);
+  uint64_t t0 = cBDStats::Now();
+  bool ok = true;
+
+  while (!interrupted && !core->EndOfTitle()) {
+    if (!core->Read() || !core->Feed(sink)) {
+      ok = false;
+      break;
+    }
+  }
+  if (!sink.Flush())
+    ok = false;
+
+  double secs = (cBDStats::Now() - t0) / 1e6;
+  fprintf(stderr, "%llu bytes in %.1f s (%.1f Mbit/s)\n", (unsigned long long)sink.written,
+          secs, secs > 0 ? sink.written * 8 / 1e6 / secs : 0);
+  const cM2tsFramer &framer = core->Framer();
+  if (framer.resyncs || framer.carryOvers)
+    fprintf(stderr, "%llu resyncs (%llu bytes dropped), %llu carry-overs\n",
+            (unsigned long long)framer.resyncs, (unsigned long long)framer.droppedBytes,
+            (unsigned long long)framer.carryOvers);
+  if (stats)
+    cBDStats::Report(stderr);
+
+  delete core;
+  if (fd != STDOUT_FILENO)
+    close(fd);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * bdunit.c: Reference counted buffers for the playback pipeline
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdlib.h>
+#include <syslog.h>
+#include <sys/mman.h>
+
+#include "bdunit.h"
+
+#define SLAB_SIZE   (2 * 1024 * 1024)   // one huge page on x86 and ARM
+#define ALIGNMENT   64                  // cache line
+
+// --- cBDUnit ----------------------------------------------------------
+
+int cBDUnit::Size(void)
+{
+  return pool->unitSize;
+}
+
+void cBDUnit::Unref(void)
+{
+  if (__sync_sub_and_fetch(&refs, 1) == 0)
+    pool->Put(this);
+}
+
+// --- cBDUnitPool ------------------------------------------------------
+
+cBDUnitPool::cBDUnitPool(int UnitSize, bool HugePages)
+{
+  unitSize = (UnitSize + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  hugePages = HugePages;
+  owners = 1;
+  free = NULL;
+  slabs = NULL;
+  slabPos = NULL;
+  slabLeft = 0;
+  allocated = gets = 0;
+  out = peak = 0;
+}
+
+cBDUnitPool::~cBDUnitPool()
+{
+  while (free) {
+    cBDUnit *u = free;
+    free = u->next;
+    delete u;
+  }
+  while (slabs) {
+    sSlab *s = slabs;
+    slabs = s->next;
+    munmap(s->mem, s->size);
+    delete s;
+  }
+}
+
+bool cBDUnitPool::NewSlab(void)
+{
+  size_t size = (size_t)unitSize > SLAB_SIZE ? ((size_t)unitSize + SLAB_SIZE - 1) & ~(size_t)(SLAB_SIZE - 1) : SLAB_SIZE;
+  void *mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (hugePages) {
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem == MAP_FAILED) {
+      syslog(LOG_INFO, "BluRay: no reserved huge pages for buffers, using normal pages");
+      hugePages = false;
+    }
+  }
+#endif
+  if (mem == MAP_FAILED) {
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+      return false;
+#ifdef MADV_HUGEPAGE
+    madvise(mem, size, MADV_HUGEPAGE);
+#endif
+  }
+
+  sSlab *s = new sSlab;
+  s->mem = mem;
+  s->size = size;
+  s->next = slabs;
+  slabs = s;
+  slabPos = (uint8_t *)mem;
+  slabLeft = size;
+  return true;
+}
+
+cBDUnit *cBDUnitPool::Get(void)
+{
+  cBDMutexLock lock(mutex);
+
+  cBDUnit *u = free;
+  if (u)
+    free = u->next;
+  else {
+    if (slabLeft < (size_t)unitSize && !NewSlab())
+      return NULL;
+    u = new cBDUnit(this, slabPos);
+    slabPos += unitSize;
+    slabLeft -= unitSize;
+    allocated++;
+  }
+
+  u->next = NULL;
+  u->refs = 1;
+  gets++;
+  owners++;
+  if (++out > peak)
+    peak = out;
+  return u;
+}
+
+void cBDUnitPool::Put(cBDUnit *Unit)
+{
+  mutex.Lock();
+  Unit->next = free;
+  free = Unit;
+  out--;
+  mutex.Unlock();
+  Drop();
+}
+
+void cBDUnitPool::Drop(void)
+{
+  mutex.Lock();
+  bool last = --owners == 0;
+  mutex.Unlock();
+  if (last)
+    delete this;
+}
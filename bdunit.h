@@ -0,0 +1,82 @@
+/*
+ * bdunit.h: Reference counted buffers for the playback pipeline
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _BDUNIT_H
+#define _BDUNIT_H
+
+#include <stdint.h>
+
+#include "bdthread.h"
+
+class cBDUnitPool;
+
+// --- cBDUnit ----------------------------------------------------------
+
+// A buffer the reader fills once. Every stage that keeps the data
+// (stream server clients, ...) holds a reference instead of a copy;
+// the last Unref() returns the buffer to its pool.
+
+class cBDUnit {
+  friend class cBDUnitPool;
+private:
+  cBDUnitPool *pool;
+  cBDUnit *next;                // free list
+  uint8_t *data;
+  volatile int refs;
+
+  cBDUnit(cBDUnitPool *Pool, uint8_t *Data) : pool(Pool), next(NULL), data(Data), refs(0) {}
+
+public:
+  uint8_t *Data(void)  { return data; }
+  int  Size(void);
+  void Ref(void)       { __sync_fetch_and_add(&refs, 1); }
+  void Unref(void);
+  // Someone else holds a reference: don't write into it
+  bool Shared(void)    { return refs > 1; }
+};
+
+// --- cBDUnitPool ------------------------------------------------------
+
+// Buffers of one size, cut from 2 MB slabs (huge pages if available),
+// aligned to cache lines. Buffers are never returned to the system
+// before the pool is gone; the pool lives until its owner has called
+// Release() and all buffers are back.
+
+class cBDUnitPool {
+  friend class cBDUnit;
+private:
+  cBDMutex mutex;
+  int      unitSize;
+  bool     hugePages;
+  int      owners;              // owner + buffers out
+  cBDUnit *free;
+  struct sSlab { void *mem; size_t size; sSlab *next; } *slabs;
+  uint8_t *slabPos;
+  size_t   slabLeft;
+
+  ~cBDUnitPool();
+  bool NewSlab(void);
+  void Put(cBDUnit *Unit);
+  void Drop(void);
+
+public:
+  uint64_t allocated;           // buffers created
+  uint64_t gets;                // buffers handed out
+  int      out, peak;           // buffers in use
+
+  // HugePages: try MAP_HUGETLB slabs (reserved huge pages), else
+  // transparent huge pages
+  cBDUnitPool(int UnitSize, bool HugePages = false);
+  // The owner is done with the pool
+  void Release(void) { Drop(); }
+
+  // Buffer with one reference, NULL if out of memory
+  cBDUnit *Get(void);
+  int  UnitSize(void) { return unitSize; }
+};
+
+#endif //_BDUNIT_H
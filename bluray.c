@@ -10,18 +10,40 @@
 
 #include "discmgr.h"
 #include "discmenu.h"
+#include "bdexport.h"
+#include "bdlaunch.h"
 #include "bdplayer.h"
+#include "bdcore.h"
+#include "bdreadahead.h"
+#include "bdrecovery.h"
+#include "bdredraw.h"
+#include "bdsched.h"
+#include "bdstage.h"
+#include "bdserver.h"
+#include "bdstats.h"
+#include "bdtrace.h"
+#include "setupmenu.h"
 
 static const char *VERSION        = "0.0.1";
 static const char *DESCRIPTION    = "BluRay Player";
 static const char *MAINMENUENTRY  = "Play BluRay Disc";
 
+#ifdef BD_TRACE
+#define TRACE_STALL_MS  250   // default for --trace
+#define TRACE_OPTION    "t:"
+#else
+#define TRACE_OPTION
+#endif
+
 
 class cPluginBluray : public cPlugin {
 private:
   // Add any member variables or functions you may need here.
-  cDiscMgr mgr;
+  cDiscMgrs drives;
   cString  DiscLib;
+  cBDServer *server;
+
+  void StopServer(void);
 
 public:
   cPluginBluray(void);
@@ -30,8 +52,15 @@ public:
   virtual const char *Description(void) { return DESCRIPTION; }
   virtual const char *CommandLineHelp(void);
   virtual bool ProcessArgs(int argc, char *argv[]);
+  virtual bool Start(void);
+  virtual void Stop(void);
+  virtual void Housekeeping(void);
   virtual const char *MainMenuEntry(void) { return MAINMENUENTRY; }
   virtual cOsdObject *MainMenuAction(void);
+  virtual cMenuSetupPage *SetupMenu(void);
+  virtual bool SetupParse(const char *Name, const char *Value);
+  virtual const char **SVDRPHelpPages(void);
+  virtual cString SVDRPCommand(const char *Command, const char *Option, int &ReplyCode);
   };
 
 cPluginBluray::cPluginBluray(void)
@@ -39,6 +68,7 @@ cPluginBluray::cPluginBluray(void)
   // Initialize any member variables here.
   // DON'T DO ANYTHING ELSE THAT MAY HAVE SIDE EFFECTS, REQUIRE GLOBAL
   // VDR OBJECTS TO EXIST OR PRODUCE ANY OUTPUT!
+  server = NULL;
 }
 
 cPluginBluray::~cPluginBluray()
@@ -50,12 +80,41 @@ const char *cPluginBluray::CommandLineHelp(void)
 {
   // Return a string that describes all known command line options.
   return
-    "  -D DEV,    --device=DEV   device used for BluRay playback (default "DEFAULT_DEVICE")\n"
-    "  -p DIR,    --path=DIR     mount point for BluRay discs (default "DEFAULT_PATH")\n"
+    "  -D DEV,    --device=DEV   device used for BluRay playback (default "DEFAULT_DEVICE");\n"
+    "                            repeat for more drives\n"
+    "  -p DIR,    --path=DIR     mount point for BluRay discs (default "DEFAULT_PATH");\n"
+    "                            applies to the preceding --device\n"
     "  -m CMD,    --mount=CMD    program used to mount BluRay disc (default "DEFAULT_MOUNTER")\n"
     "  -u CMD,    --umount=CMD   program used to unmount BluRay disc (default "DEFAULT_UNMOUNTER")\n"
     "  -e CMD,    --eject=CMD    program used to eject BluRay disc (default "DEFAULT_EJECT")\n"
-    "  -l DIR,    --lib=DIR      directory to search for multiple BluRay discs (default: none)n";
+    "  -l DIR,    --lib=DIR      directory to search for multiple BluRay discs (default: none)\n"
+    "  -s FILE,   --stats=FILE   write playback statistics to FILE when playback ends\n"
+    "  -r MODE,   --recovery=MODE  on read errors: off (end playback, default), skip (skip\n"
+    "                            ahead) or entry (skip to the next entry point)\n"
+    "  -T MS,     --read-timeout=MS  regions read slower are remembered as bad (default 3000)\n"
+    "  -S N,      --retry-speed=N  retry bad regions in the background at drive speed N\n"
+    "                            (default 2, 0: no retries)\n"
+    "  -P SPEC,   --sched=SPEC   player thread scheduling: fifo:PRIO, rr:PRIO or nice:N\n"
+    "  -C LIST,   --cpus=LIST    run player thread on CPUs in LIST (e.g. 2 or 0,2-3)\n"
+    "  -I SPEC,   --ioprio=SPEC  player thread I/O priority: rt:LEVEL, be:LEVEL or idle\n"
+    "  -n,        --no-menus     play the main title instead of the disc menus\n"
+    "  -b SEC,    --buffer=SEC   read SEC seconds of playback ahead from disc folders, in\n"
+    "                            requests sized for the storage (NFS, SMB; default 0: off)\n"
+    "  -o N,      --osd-rate=N   redraw the progress display at most N times per second\n"
+    "                            (default 5, 0: on every change)\n"
+    "  -a N,      --aacs=N       decrypt AACS discs on N threads ahead of libbluray, with\n"
+    "                            the unit key from libaacs's KEYDB.cfg (default 0: off)\n"
+    "  -w SEC[:MB], --pause-buffer=SEC[:MB]\n"
+    "                            while paused, buffer SEC seconds of playback (in up to\n"
+    "                            MB, default 256) and let the drive spin down\n"
+    "  -c MB,     --stage=MB     copy the playing title to the plugin's cache directory in\n"
+    "                            the background, up to MB for all discs (default 0: off)\n"
+#ifdef BD_TRACE
+    "  -t FILE[:MS], --trace=FILE[:MS]\n"
+    "                            trace the playback pipeline, write the trace to FILE when\n"
+    "                            playback stalls for MS (default 250, 0: SVDRP TRCE only)\n"
+#endif
+    ;
 }
 
 bool cPluginBluray::ProcessArgs(int argc, char *argv[])
@@ -69,38 +128,145 @@ bool cPluginBluray::ProcessArgs(int argc, char *argv[])
     { "umount",   optional_argument, NULL, 'u' },
     { "eject",    optional_argument, NULL, 'e' },
     { "lib",      optional_argument, NULL, 'l' },
+    { "stats",    required_argument, NULL, 's' },
+    { "recovery", required_argument, NULL, 'r' },
+    { "read-timeout", required_argument, NULL, 'T' },
+    { "retry-speed",  required_argument, NULL, 'S' },
+    { "sched",    required_argument, NULL, 'P' },
+    { "cpus",     required_argument, NULL, 'C' },
+    { "ioprio",   required_argument, NULL, 'I' },
+    { "no-menus", no_argument,       NULL, 'n' },
+    { "buffer",   required_argument, NULL, 'b' },
+    { "osd-rate", required_argument, NULL, 'o' },
+    { "aacs",     required_argument, NULL, 'a' },
+    { "pause-buffer", required_argument, NULL, 'w' },
+    { "stage",    required_argument, NULL, 'c' },
+#ifdef BD_TRACE
+    { "trace",    required_argument, NULL, 't' },
+#endif
     { NULL,       no_argument,       NULL,  0  }
   };
 
   int c;
-  while ((c = getopt_long(argc, argv, "d:", long_options, NULL)) != -1) {
+  while ((c = getopt_long(argc, argv, "D:p:m:u:e:l:s:r:T:S:P:C:I:nb:o:a:w:c:" TRACE_OPTION, long_options, NULL)) != -1) {
     switch (c) {
       case 'D':
-        mgr.SetDevice(optarg);
+        drives.AddDevice(optarg);
         break;
       case 'p':
-        mgr.SetPath(optarg);
+        drives.SetPath(optarg);
         break;
       case 'm':
-        mgr.SetMountCmd(optarg);
+        drives.SetMountCmd(optarg);
         break;
       case 'u':
-        mgr.SetUnMountCmd(optarg);
+        drives.SetUnMountCmd(optarg);
         break;
       case 'e':
-        mgr.SetEjectCmd(optarg);
+        drives.SetEjectCmd(optarg);
         break;
       case 'l':
         DiscLib = optarg;
         break;
+      case 's':
+        cBDStats::SetDumpFile(optarg);
+        break;
+      case 'r':
+        if (!strcmp(optarg, "off"))
+          BDRecoveryConfig.mode = rmOff;
+        else if (!strcmp(optarg, "skip"))
+          BDRecoveryConfig.mode = rmSkip;
+        else if (!strcmp(optarg, "entry"))
+          BDRecoveryConfig.mode = rmEntryPoint;
+        else
+          return false;
+        break;
+      case 'T':
+        BDRecoveryConfig.readTimeoutMs = atoi(optarg);
+        break;
+      case 'S':
+        BDRecoveryConfig.retrySpeed = atoi(optarg);
+        break;
+      case 'P':
+        if (!BDParseSched(optarg, BDPlayerSched))
+          return false;
+        break;
+      case 'C':
+        if (!BDParseCpus(optarg, BDPlayerSched))
+          return false;
+        break;
+      case 'I':
+        if (!BDParseIoPrio(optarg, BDPlayerSched))
+          return false;
+        break;
+      case 'n':
+        cBDControl::SetMenus(false);
+        break;
+      case 'b':
+        BDReadAheadConfig.seconds = atoi(optarg);
+        break;
+      case 'o':
+        BDRedrawConfig.maxRate = atoi(optarg);
+        break;
+      case 'a':
+        BDReadAheadConfig.aacsThreads = atoi(optarg);
+        break;
+      case 'w':
+        BDReadAheadConfig.pauseSeconds = atoi(optarg);
+        BDReadAheadConfig.maxMB = strchr(optarg, ':') ? atoi(strchr(optarg, ':') + 1) : 256;
+        break;
+      case 'c':
+        BDStageConfig.maxMB = atoi(optarg);
+        break;
+#ifdef BD_TRACE
+      case 't': {
+        char *ms = strchr(optarg, ':');
+        cBDTrace::SetStallMs(ms ? atoi(ms + 1) : TRACE_STALL_MS);
+        if (ms)
+          *ms = 0;
+        cBDTrace::SetDumpFile(optarg);
+        cBDTrace::Enable(true);
+        break;
+      }
+#endif
       default:
         return false;
     }
   }
 
+  return drives.Check();
+}
+
+bool cPluginBluray::Start(void)
+{
+  // discs already in the drives are mounted and named in the background
+  drives.Probe();
   return true;
 }
 
+void cPluginBluray::Stop(void)
+{
+  cBDExport::Stop();
+  cBDLaunchMenu::Stop();
+  cDiscMenu::Stop();
+  StopServer();
+  drives.Stop();
+}
+
+void cPluginBluray::StopServer(void)
+{
+  for (cDiscMgr *d = drives.First(); d; d = drives.Next(d))
+    d->SetServer(NULL);
+  DELETENULL(server);
+}
+
+void cPluginBluray::Housekeeping(void)
+{
+  // a server that has sent the whole title gives the drive back
+  if (server && server->Done())
+    StopServer();
+}
+
 cOsdObject *cPluginBluray::MainMenuAction(void)
 {
   // Perform the action when selected from the main VDR menu.
@@ -109,19 +275,144 @@ cOsdObject *cPluginBluray::MainMenuAction(void)
     return NULL;
   }
 
-  if (*DiscLib) {
-    return new cDiscMenu(mgr, DiscLib);
+  if (*DiscLib || drives.Count() > 1) {
+    return new cDiscMenu(drives, DiscLib);
   }
 
-  if (!mgr.CheckDisc()) {
+  cDiscMgr *mgr = drives.First();
+  if (mgr->Served()) {
+    Skins.Message(mtError, tr("Disc is being served over HTTP"));
     return NULL;
   }
+  return new cBDLaunchMenu(mgr->GetPath(), mgr->GetDev(), mgr);
+}
+
+cMenuSetupPage *cPluginBluray::SetupMenu(void)
+{
+  return new cSetupMenu;
+}
+
+bool cPluginBluray::SetupParse(const char *Name, const char *Value)
+{
+  return BDSetupParse(Name, Value);
+}
+
+const char **cPluginBluray::SVDRPHelpPages(void)
+{
+  static const char *HelpPages[] = {
+    "STAT\n"
+    "    Print playback statistics (counters and latency histograms).",
+    "RSTS\n"
+    "    Reset playback statistics.",
+    "DUMP <file>\n"
+    "    Write playback statistics to <file>.",
+    "HTTP <port> [<address>]\n"
+    "    Serve the main title of the disc in the (first loaded) drive as MPEG-TS over HTTP\n"
+    "    (default address 127.0.0.1, 0.0.0.0 for all interfaces).",
+    "HTTP OFF\n"
+    "    Stop serving.",
+#ifdef BD_TRACE
+    "TRCE [<file>]\n"
+    "    Write the pipeline trace (Chrome trace-event JSON) to <file>, default: the --trace file.",
+#endif
+    NULL
+  };
+  return HelpPages;
+}
+
+cString cPluginBluray::SVDRPCommand(const char *Command, const char *Option, int &ReplyCode)
+{
+  if (strcasecmp(Command, "STAT") == 0) {
+    char *report = cBDStats::Report();
+    if (!report || !*report) {
+      free(report);
+      return "No statistics available";
+    }
+    int len = strlen(report);
+    if (len > 0 && report[len - 1] == '\n')
+      report[len - 1] = 0;
+    return cString(report, true);
+  }
+
+  if (strcasecmp(Command, "RSTS") == 0) {
+    cBDStats::Reset();
+    return "Statistics reset";
+  }
 
-  cControl::Shutdown();
+  if (strcasecmp(Command, "DUMP") == 0) {
+    if (!*Option) {
+      ReplyCode = 501;
+      return "Missing file name";
+    }
+    if (!cBDStats::Dump(Option)) {
+      ReplyCode = 550;
+      return cString::sprintf("Can't write statistics to %s", Option);
+    }
+    return cString::sprintf("Statistics written to %s", Option);
+  }
+
+#ifdef BD_TRACE
+  if (strcasecmp(Command, "TRCE") == 0) {
+    const char *file = *Option ? Option : cBDTrace::DumpFile();
+    if (!file) {
+      ReplyCode = 501;
+      return "Missing file name";
+    }
+    if (!cBDTrace::Enabled()) {
+      ReplyCode = 550;
+      return "Tracing is off (--trace)";
+    }
+    if (!cBDTrace::Dump(file)) {
+      ReplyCode = 550;
+      return cString::sprintf("Can't write trace to %s", file);
+    }
+    return cString::sprintf("Trace written to %s", file);
+  }
+#endif
 
-  cControl *control = cBDControl::Create(mgr.GetPath());
-  if (control) {
-    cControl::Launch(control);
+  if (strcasecmp(Command, "HTTP") == 0) {
+    if (server && server->Done())
+      StopServer();
+    if (strcasecmp(Option, "OFF") == 0) {
+      StopServer();
+      return "Server stopped";
+    }
+    char address[64] = "127.0.0.1";
+    int port = 0;
+    if (sscanf(Option, "%d %63s", &port, address) < 1 || port <= 0) {
+      ReplyCode = 501;
+      return "Missing port";
+    }
+    if (server) {
+      ReplyCode = 550;
+      return "Server already running (HTTP OFF stops it)";
+    }
+    // the player has the drive
+    if (cBDControl::Active()) {
+      ReplyCode = 550;
+      return "Playback active";
+    }
+    // mounting can take a while: not on the SVDRP thread, the drive mounts
+    // in the background
+    cDiscMgr *mgr = drives.Default();
+    if (!mgr->IsMounted()) {
+      mgr->Probe();
+      ReplyCode = 550;
+      return "No disc mounted, try again when the drive has mounted it";
+    }
+    cBDCore *core = cBDCore::Open(mgr->GetPath(), BDSetup.minTitleLength);
+    if (!core) {
+      ReplyCode = 550;
+      return "No playable title";
+    }
+    server = new cBDServer(core);
+    if (!server->Listen(strcmp(address, "0.0.0.0") ? address : NULL, port)) {
+      DELETENULL(server);
+      ReplyCode = 550;
+      return cString::sprintf("Can't listen on %s:%d", address, port);
+    }
+    mgr->SetServer(server);
+    return cString::sprintf("Serving on http://%s:%d/", address, port);
   }
 
   return NULL;
@@ -7,7 +7,13 @@
 
 #include <vdr/tools.h>
 #include <vdr/osdbase.h>
+#include <vdr/plugin.h>
+#include <vdr/skins.h>
 
+#include "bdcover.h"
+#include "bdlaunch.h"
+#include "bdlibrary.h"
+#include "bdmeta.h"
 #include "bdplayer.h"
 
 #include "discmenu.h"
@@ -26,36 +32,44 @@ static bool IsBluRayFolder(const char *fname)
   return false;
 }
 
-static cString GetMetaName(const char *Root)
+/*
+ * Cover thumbnails
+ *
+ * One cache for the lifetime of the plugin: thumbnails decoded while
+ * browsing stay in memory, the worker starts with the first request.
+ */
+
+static cBDCoverCache *cache = NULL;
+
+static cBDCoverCache *CoverCache(void)
 {
-  cString file = cString::sprintf("%s/BDMV/META/DL/bdmt_eng.xml", Root);
-  cString result(NULL);
-  struct stat st;
+  if (!cache) {
+    cString dir = cString::sprintf("%s/covers", cPlugin::CacheDirectory(PLUGIN_NAME_I18N));
+    if (!MakeDirs(dir, true))
+      dir = NULL;
+    cache = new cBDCoverCache(dir, I18nLanguageCode(I18nCurrentLanguage()));
+  }
+  return cache;
+}
 
-  if (stat(file, &st) == 0) {
-    FILE *fp = fopen(file, "rt");
-    if (fp) {
-      fseek(fp, 0, SEEK_END);
-      long len = ftell(fp);
-      if (len > 0 && len < 0xffff) {
-        fseek(fp, 0, SEEK_SET);
-        char buf[len+1];
-        if ((size_t)len == fread(buf, 1, len, fp)) {
-          buf[len] = 0;
-          char *p = strstr(buf, "<di:name>");
-          if (p) {
-            char *end = strstr(p, "</di:name>");
-            if (end) {
-              *end = 0;
-              result = p + 9;
-            }
-          }
-        }
-      }
-      fclose(fp);
-    }
+/*
+ * Disc titles
+ *
+ * Read from the meta files on a background thread, for the items on
+ * screen only; known titles are kept in the plugin's cache directory.
+ */
+
+static cBDMetaCache *titles = NULL;
+
+static cBDMetaCache *MetaCache(void)
+{
+  if (!titles) {
+    const char *dir = cPlugin::CacheDirectory(PLUGIN_NAME_I18N);
+    cString file = cString::sprintf("%s/titles", dir);
+    titles = new cBDMetaCache(MakeDirs(dir, true) ? *file : NULL,
+                              I18nLanguageCode(I18nCurrentLanguage()));
   }
-  return result;
+  return titles;
 }
 
 /*
@@ -66,67 +80,84 @@ class cDiscItem : public cOsdItem
 {
  private:
   cString Root;
+  cDiscMgr *Drive;
  public:
   cDiscItem(const char *title, const char *root);
-  cDiscItem(const char *title);
+  cDiscItem(const char *title, cDiscMgr *drive);
 
   const char *GetRoot() { return Root; }
-
-  virtual int Compare(const cListObject &ListObject) const {
-    const cDiscItem *o = (const cDiscItem *)&ListObject;
-    return strcmp(o->Root, Root);
-  }
+  cDiscMgr *GetDrive() { return Drive; }
 };
 
 cDiscItem::cDiscItem(const char *title, const char *root) :
 cOsdItem(title, osUser1)
 {
   Root = root;
+  Drive = NULL;
 }
 
-cDiscItem::cDiscItem(const char *title) :
+cDiscItem::cDiscItem(const char *title, cDiscMgr *drive) :
 cOsdItem(title, osUser2)
 {
+  Drive = drive;
 }
 
+#define PROBE_INTERVAL  10000   // ms, between drive checks
+
 /*
  * cDiscMenu
+ *
+ * The discs are kept in a cBDLibrary index; the menu only holds the
+ * items of the page on screen and builds the next page when the cursor
+ * leaves it. Positions 0 ... Drives() - 1 are the drives, the library
+ * view rows follow.
  */
 
-cDiscMenu::cDiscMenu(cDiscMgr& Mgr, cString& Root) :
-    cOsdMenu("BluRay Discs"),
-    mgr(Mgr)
+cDiscMenu::cDiscMenu(cDiscMgrs& Drives, cString& Root) :
+    cOsdMenu("BluRay Discs", 40),
+    drives(Drives)
 {
-  Scan(Root);
+  coverOsd = NULL;
+  coverGeneration = -1;
 
-  Sort();
+  first = 0;
+  titleFirst = -1;
+  // titles updated from here on are applied to the index
+  titleGeneration = MetaCache()->Generation();
+  resolveAll = false;
 
-  if (mgr.IsMounted()) {
-    cString title = GetMetaName(mgr.GetPath());
-    if (*title) {
-      title = cString::sprintf("%s (%s)", *title, mgr.GetDev());
-    } else {
-      title = cString::sprintf("BluRay disc (%s)", mgr.GetDev());
-    }
-    Ins(new cDiscItem(title));
-    //SetHelp("Eject");
-  } else {
-    Ins(new cDiscItem("(Disc not mounted)"));
-    //SetHelp("Mount");
-  }
+  if (*Root)
+    Scan(Root, "");
 
-  Display();
+  // the drives report back when they are done
+  driveGeneration = drives.Generation();
+  drives.Probe();
+  probeTimer.Set(PROBE_INTERVAL);
+
+  ShowPage(0, 0);
+}
+
+cDiscMenu::~cDiscMenu()
+{
+  HideCovers();
 }
 
-void cDiscMenu::Scan(cString& Root)
+void cDiscMenu::Stop(void)
 {
+  DELETENULL(cache);
+  DELETENULL(titles);
+}
+
+void cDiscMenu::Scan(const char *Root, const char *Folder)
+{
+  cBDMetaCache *meta = MetaCache();
   DIR *d = opendir(Root);
   if (d) {
     struct dirent *e;
     while ((e = readdir(d)) != NULL) {
       if (strcmp(e->d_name, ".") && strcmp(e->d_name, "..") &&
           e->d_name[0] != '.') {
-        cString buffer = cString::sprintf("%s/%s", *Root, e->d_name);
+        cString buffer = cString::sprintf("%s/%s", Root, e->d_name);
         struct stat st;
         if (stat(buffer, &st) == 0) {
 
@@ -142,11 +173,13 @@ void cDiscMenu::Scan(cString& Root)
 
             if (IsBluRayFolder(buffer)) {
 
-              cString s = GetMetaName(buffer);
-              Add(new cDiscItem(*s ? *s : e->d_name, buffer));
+              // cached title or the folder name, resolved when shown
+              char name[256];
+              library.Add(buffer, Folder, meta->Name(buffer, name, sizeof(name)) ? name : e->d_name,
+                          st.st_mtime, meta->Runtime(buffer));
 
             } else {
-              Scan(buffer);
+              Scan(buffer, *Folder ? *cString::sprintf("%s/%s", Folder, e->d_name) : e->d_name);
             }
           }
         }
@@ -156,24 +189,468 @@ void cDiscMenu::Scan(cString& Root)
   }
 }
 
+int cDiscMenu::PageSize(void)
+{
+  return DisplayMenu() ? max(DisplayMenu()->MaxItems(), 1) : 15;
+}
+
+int cDiscMenu::Position(void)
+{
+  return first + max(Current(), 0);
+}
+
+bool cDiscMenu::Selectable(int Position)
+{
+  return Position < Drives() || library.Row(Position - Drives()) >= 0;
+}
+
+cOsdItem *cDiscMenu::NewItem(int Position)
+{
+  if (Position < Drives()) {
+    cDiscMgr *drive = drives.Get(Position);
+    cString name = drive->Name();
+    const char *title;
+    switch (drive->State()) {
+      case dsMounted: title = *name ? *name : "BluRay disc"; break;
+      case dsEmpty:   title = tr("(No disc)"); break;
+      case dsError:   title = tr("(Drive not available)"); break;
+      default:        title = tr("(Checking disc...)"); break;
+    }
+    return new cDiscItem(cString::sprintf("%s (%s)", title, drive->GetDev()), drive);
+  }
+
+  int entry = library.Row(Position - Drives());
+  if (entry < 0)
+    return new cOsdItem(cString::sprintf("/%s", library.Folder(-1 - entry)), osUnknown, false);
+
+  const char *title = library.Title(entry);
+  switch (library.Sort()) {
+    case lsAdded:
+      return new cDiscItem(cString::sprintf("%s\t%s", title, *ShortDateString(library.Added(entry))), library.Root(entry));
+    case lsRuntime: {
+      int runtime = library.Runtime(entry);
+      if (runtime >= 0)
+        return new cDiscItem(cString::sprintf("%s\t%d:%02d", title, runtime / 3600, runtime / 60 % 60), library.Root(entry));
+      return new cDiscItem(cString::sprintf("%s\t?", title), library.Root(entry));
+    }
+    default:
+      return new cDiscItem(title, library.Root(entry));
+  }
+}
+
+void cDiscMenu::ShowPage(int First, int Position)
+{
+  int page = PageSize();
+  int positions = Positions();
+
+  Position = constrain(Position, 0, positions - 1);
+  First = constrain(First, 0, max(positions - page, 0));
+  if (Position < First)
+    First = Position;
+  else if (Position >= First + page)
+    First = Position - page + 1;
+
+  Clear();
+  for (int p = First; p < First + page && p < positions; p++)
+    Add(NewItem(p), p == Position);
+  first = First;
+
+  const char *search = library.Searching();
+  if (*search)
+    SetTitle(cString::sprintf("BluRay Discs: %s (%d)", search, library.Rows()));
+  else
+    SetTitle(cString::sprintf("BluRay Discs (%d)", library.Count()));
+
+  static const char *sorts[] = { trNOOP("By date"), trNOOP("By runtime"), trNOOP("By title") };
+  SetHelp(tr(sorts[library.Sort()]), library.Grouped() ? tr("All discs") : tr("Folders"));
+
+  Display();
+  UpdateTitles();
+}
+
+void cDiscMenu::ShowEntry(int Entry)
+{
+  int row = Entry >= 0 ? library.Find(Entry) : -1;
+  int position = row >= 0 ? row + Drives() : 0;
+  ShowPage(position - PageSize() / 2, position);
+}
+
+int cDiscMenu::CurrentEntry(void)
+{
+  int position = Position();
+  return position >= Drives() && Selectable(position) ? library.Row(position - Drives()) : -1;
+}
+
+void cDiscMenu::Step(int Direction)
+{
+  int positions = Positions();
+  int position = Position() + Direction;
+  while (position >= 0 && position < positions && !Selectable(position))
+    position += Direction;
+  if (position < 0 || position >= positions)
+    return;  // no wrap around at the ends of the list
+
+  int page = PageSize();
+  if (position >= first && position < first + page) {
+    if (Direction > 0)
+      CursorDown();
+    else
+      CursorUp();
+    return;
+  }
+
+  // scroll, the folder header stays with its first disc
+  if (Direction > 0)
+    ShowPage(position - page + 1, position);
+  else
+    ShowPage(position > 0 && !Selectable(position - 1) ? position - 1 : position, position);
+}
+
+void cDiscMenu::PageStep(int Direction)
+{
+  int page = PageSize();
+  int positions = Positions();
+  int position = constrain(Position() + Direction * page, 0, positions - 1);
+  for (int p = position; p >= 0 && p < positions; p += Direction) {
+    if (Selectable(p)) {
+      position = p;
+      break;
+    }
+  }
+  ShowPage(first + Direction * page, position);
+}
+
+eOSState cDiscMenu::Search(eKeys Key)
+{
+  cString search = library.Searching();
+  bool wider = Key == kBack;
+  if (wider) {
+    if (!*search)
+      return osUnknown;
+    search.Truncate(-1);
+  } else
+    search = cString::sprintf("%s%c", *search, '0' + Key - k0);
+
+  int entry = CurrentEntry();
+  if (!library.Search(search)) {
+    Skins.Message(mtWarning, tr("No matching disc"), 1);
+    return osContinue;
+  }
+
+  if (wider) {
+    ShowEntry(entry);
+    return osContinue;
+  }
+
+  // first match
+  int position = Drives();
+  while (position < Positions() && !Selectable(position))
+    position++;
+  ShowPage(0, position);
+  return osContinue;
+}
+
+void cDiscMenu::SetOrder(eBDLibrarySort Sort, bool Group)
+{
+  int entry = CurrentEntry();
+  library.SetOrder(Sort, Group);
+
+  // runtimes come from the playlists of each disc
+  if (Sort == lsRuntime && !resolveAll) {
+    cBDMetaCache *meta = MetaCache();
+    for (int i = 0; i < library.Count(); i++) {
+      if (library.Runtime(i) < 0)
+        meta->Resolve(library.Root(i));
+    }
+    resolveAll = true;
+    titleFirst = -1;  // the page on screen first
+  }
+
+  ShowEntry(entry);
+}
+
+void cDiscMenu::Redraw(void)
+{
+  // same item at the same place on the screen
+  int entry = CurrentEntry();
+  int row = entry >= 0 ? library.Find(entry) : -1;
+  if (row >= 0)
+    ShowPage(first + row + Drives() - Position(), row + Drives());
+  else
+    ShowPage(first, Position());
+}
+
+void cDiscMenu::UpdateDrives(void)
+{
+  // look for new and changed discs now and then, without waiting for the
+  // drives: a mounted drive is checked by the stamps of its disc
+  if (probeTimer.TimedOut()) {
+    for (cDiscMgr *drive = drives.First(); drive; drive = drives.Next(drive)) {
+      if (drive->State() != dsProbing)
+        drive->Probe();
+    }
+    probeTimer.Set(PROBE_INTERVAL);
+  }
+
+  int generation = drives.Generation();
+  if (generation != driveGeneration) {
+    driveGeneration = generation;
+    if (first < Drives())
+      Redraw();
+  }
+}
+
+void cDiscMenu::UpdateTitles(void)
+{
+  cBDMetaCache *meta = MetaCache();
+  int page = PageSize();
+
+  // the page on screen and the next one, from the bottom up: the latest
+  // requests are done first
+  if (first != titleFirst) {
+    titleFirst = first;
+    for (int p = min(first + 2 * page, Positions()) - 1; p >= Drives() && p >= first; p--) {
+      int entry = library.Row(p - Drives());
+      if (entry >= 0)
+        meta->Resolve(library.Root(entry));
+    }
+  }
+
+  // new titles and runtimes into the index, at most once a second, only
+  // those of the discs updated since the last time
+  if (meta->Generation() == titleGeneration || !titleRefresh.TimedOut())
+    return;
+  titleRefresh.Set(1000);
+
+  bool changed = false;
+  char root[4096], name[256];
+  while (meta->Changed(titleGeneration, root, sizeof(root))) {
+    int i = library.FindRoot(root);
+    if (i < 0)
+      continue;
+    if (meta->Name(root, name, sizeof(name)))
+      changed |= library.SetTitle(i, name);
+    int runtime = meta->Runtime(root);
+    if (runtime >= 0)
+      changed |= library.SetRuntime(i, runtime);
+  }
+
+  if (changed)
+    Redraw();
+}
+
+/*
+ * Cover view
+ *
+ * A strip of cover thumbnails (Info key) above the menu, the current
+ * item in the middle. Thumbnails come from the cover cache only; those
+ * not ready yet are drawn when the worker has finished them.
+ */
+
+#define COVER_GAP      20
+#define COVER_SLOTS    5
+#define COVER_BACK     0xC0000000
+#define COVER_EMPTY    0xFF404040
+
+const char *cDiscMenu::CoverRoot(int Position)
+{
+  if (Position >= 0 && Position < Drives()) {
+    cDiscMgr *drive = drives.Get(Position);
+    return drive->State() == dsMounted ? drive->GetPath() : NULL;
+  }
+  int entry = Position < Positions() ? library.Row(Position - Drives()) : -1;
+  return entry >= 0 ? library.Root(entry) : NULL;
+}
+
+void cDiscMenu::ShowCovers(void)
+{
+  if (coverOsd)
+    return;
+
+  if (!cOsdProvider::SupportsTrueColor()) {
+    Skins.Message(mtError, tr("Cover art needs a true color OSD"));
+    return;
+  }
+
+  // above the menu; the menu is inactive while the covers are shown
+  coverOsd = cOsdProvider::NewOsd(cOsd::OsdLeft(), cOsd::OsdTop(), OSD_LEVEL_DEFAULT + 1);
+  tArea area = { 0, 0, cOsd::OsdWidth() - 1, cOsd::OsdHeight() - 1, 32 };
+  if (!coverOsd || coverOsd->SetAreas(&area, 1) != oeOk) {
+    DELETENULL(coverOsd);
+    Skins.Message(mtError, tr("Cover art needs a true color OSD"));
+    return;
+  }
+
+  coverGeneration = -1;
+  DrawCovers();
+}
+
+void cDiscMenu::HideCovers(void)
+{
+  DELETENULL(coverOsd);
+}
+
+void cDiscMenu::DrawCovers(void)
+{
+  if (!coverOsd)
+    return;
+
+  cBDCoverCache *cache = CoverCache();
+  coverGeneration = cache->Generation();
+
+  const cFont *font = cFont::GetFont(fontOsd);
+  int width = coverOsd->Width(), height = coverOsd->Height();
+  int cellWidth = BD_COVER_WIDTH + COVER_GAP;
+  int slots = width / cellWidth;
+  if (slots > COVER_SLOTS)
+    slots = COVER_SLOTS;
+  if (slots % 2 == 0)
+    slots--;
+  if (slots < 1)
+    slots = 1;
+
+  int bandHeight = BD_COVER_HEIGHT + 3 * COVER_GAP + font->Height();
+  int y0 = (height - bandHeight) / 2;
+  int x0 = (width - slots * cellWidth) / 2;
+  int current = Position();
+
+  // queue the neighbours first: the visible covers are requested last
+  // and come first
+  for (int i = slots / 2 + slots; i > slots / 2; i--) {
+    for (int d = -1; d <= 1; d += 2) {
+      const char *root = CoverRoot(current + d * i);
+      if (root)
+        cache->Prefetch(root);
+    }
+  }
+
+  coverOsd->DrawRectangle(0, 0, width - 1, height - 1, clrTransparent);
+  coverOsd->DrawRectangle(0, y0, width - 1, y0 + bandHeight - 1, COVER_BACK);
+
+  for (int s = slots - 1; s >= 0; s--) {
+    // from the outside in, the current item last
+    int slot = s % 2 ? slots / 2 - (s + 1) / 2 : slots / 2 + s / 2;
+    int index = current - slots / 2 + slot;
+    if (index < 0 || index >= Positions() || !Selectable(index))
+      continue;
+    const char *root = CoverRoot(index);
+
+    int cx = x0 + slot * cellWidth + COVER_GAP / 2;
+    int cy = y0 + COVER_GAP;
+    if (index == current)
+      coverOsd->DrawRectangle(cx - 4, cy - 4, cx + BD_COVER_WIDTH + 3, cy + BD_COVER_HEIGHT + 3, clrWhite);
+
+    int w = 0, h = 0;
+    uint32_t *argb = root ? cache->Get(root, w, h) : NULL;
+    if (argb) {
+      coverOsd->DrawRectangle(cx, cy, cx + BD_COVER_WIDTH - 1, cy + BD_COVER_HEIGHT - 1, clrBlack);
+      coverOsd->DrawImage(cPoint(cx + (BD_COVER_WIDTH - w) / 2, cy + (BD_COVER_HEIGHT - h) / 2),
+                          cImage(cSize(w, h), argb));
+      free(argb);
+    } else
+      coverOsd->DrawRectangle(cx, cy, cx + BD_COVER_WIDTH - 1, cy + BD_COVER_HEIGHT - 1, COVER_EMPTY);
+  }
+
+  cOsdItem *item = Get(Current());
+  int entry = CurrentEntry();
+  const char *title = entry >= 0 ? library.Title(entry) : item ? item->Text() : NULL;
+  if (title)
+    coverOsd->DrawText(0, y0 + BD_COVER_HEIGHT + 2 * COVER_GAP, title, clrWhite, clrTransparent,
+                       font, width, font->Height(), taCenter);
+
+  coverOsd->Flush();
+}
+
+eOSState cDiscMenu::CoverKey(eKeys Key)
+{
+  switch (int(NORMALKEY(Key))) {
+    case kNone:
+      if (CoverCache()->Generation() != coverGeneration)
+        DrawCovers();
+      return osContinue;
+    case kLeft:
+    case kUp:
+      Step(-1);
+      DrawCovers();
+      return osContinue;
+    case kRight:
+    case kDown:
+      Step(1);
+      DrawCovers();
+      return osContinue;
+    case kOk:
+      HideCovers();
+      return osUnknown;   // play the disc
+    case kInfo:
+    case kBack:
+      HideCovers();
+      return osContinue;
+    default:
+      return osContinue;
+  }
+}
+
 eOSState cDiscMenu::ProcessKey(eKeys Key)
 {
+  // starting playback of the selected disc
+  if (HasSubMenu())
+    return cOsdMenu::ProcessKey(Key);
+
+  if (coverOsd) {
+    eOSState state = CoverKey(Key);
+    if (state != osUnknown)
+      return state;
+  } else {
+    switch (int(Key)) {
+      case kInfo:
+        ShowCovers();
+        return osContinue;
+      case kUp:
+      case kUp|k_Repeat:
+        Step(-1);
+        return osContinue;
+      case kDown:
+      case kDown|k_Repeat:
+        Step(1);
+        return osContinue;
+      case kLeft:
+      case kLeft|k_Repeat:
+        PageStep(-1);
+        return osContinue;
+      case kRight:
+      case kRight|k_Repeat:
+        PageStep(1);
+        return osContinue;
+      case k0 ... k9:
+      case kBack: {
+        eOSState state = Search(Key);
+        if (state != osUnknown)
+          return state;
+        break;
+      }
+      case kRed:
+        SetOrder(eBDLibrarySort((library.Sort() + 1) % BD_LIBRARY_SORTS), library.Grouped());
+        return osContinue;
+      case kGreen:
+        SetOrder(library.Sort(), !library.Grouped());
+        return osContinue;
+      default:
+        break;
+    }
+  }
+
   eOSState state = cOsdMenu::ProcessKey(Key);
+  if (state != osUser1 && state != osUser2) {
+    UpdateDrives();
+    UpdateTitles();
+  }
   switch (state) {
     case osUser1: {
       isyslog("disc select");
       cDiscItem *di = (cDiscItem*)Get(Current());
       if (di) {
         isyslog("- root %s", di->GetRoot());
-
-        cControl::Shutdown();
-
-        cControl *control = cBDControl::Create(di->GetRoot());
-        if (control) {
-          cControl::Launch(control);
-        }
-
-        return osEnd;
+        return AddSubMenu(new cBDLaunchMenu(di->GetRoot()));
       }
       break;
     }
@@ -181,18 +658,16 @@ eOSState cDiscMenu::ProcessKey(eKeys Key)
     case osUser2: {
       isyslog("device select");
 
-      if (!mgr.CheckDisc()) {
+      cDiscItem *di = (cDiscItem*)Get(Current());
+      cDiscMgr *drive = di ? di->GetDrive() : NULL;
+      if (!drive) {
         return osContinue;
       }
-
-      cControl::Shutdown();
-
-      cControl *control = cBDControl::Create(mgr.GetDev());
-      if (control) {
-        cControl::Launch(control);
-        return osEnd;
+      if (drive->Served()) {
+        Skins.Message(mtError, tr("Disc is being served over HTTP"));
+        return osContinue;
       }
-      break;
+      return AddSubMenu(new cBDLaunchMenu(drive->GetPath(), drive->GetDev(), drive));
     }
 
     default:      break;
@@ -10,18 +10,60 @@
 
 #include <vdr/menuitems.h>
 
+#include "bdlibrary.h"
 #include "discmgr.h"
 
 class cDiscMenu : public cOsdMenu {
  private:
-  void Scan(cString& Root);
+  void Scan(const char *Root, const char *Folder);
 
-  cDiscMgr& mgr;
+  cDiscMgrs& drives;
+  cBDLibrary library;
+  int first;                    // position of the first item on the page
+
+  int driveGeneration;
+  cTimeMs probeTimer;
+  void UpdateDrives(void);
+
+  int Drives(void) { return drives.Count(); }
+  int Positions(void) { return Drives() + library.Rows(); }
+  int PageSize(void);
+  int Position(void);
+  bool Selectable(int Position);
+  int CurrentEntry(void);
+  cOsdItem *NewItem(int Position);
+  void ShowPage(int First, int Position);
+  void ShowEntry(int Entry);
+  void Redraw(void);
+  void Step(int Direction);
+  void PageStep(int Direction);
+  eOSState Search(eKeys Key);
+  void SetOrder(eBDLibrarySort Sort, bool Group);
+
+  // titles from the meta cache
+  int titleFirst, titleGeneration;
+  cTimeMs titleRefresh;
+  bool resolveAll;
+  void UpdateTitles(void);
+
+  // cover view
+  cOsd *coverOsd;
+  int   coverGeneration;
+
+  const char *CoverRoot(int Position);
+  void ShowCovers(void);
+  void DrawCovers(void);
+  void HideCovers(void);
+  eOSState CoverKey(eKeys Key);
 
  public:
-  cDiscMenu(cDiscMgr& Mgr, cString& Root);
+  cDiscMenu(cDiscMgrs& Drives, cString& Root);
+  virtual ~cDiscMenu();
 
   virtual eOSState ProcessKey(eKeys Key);
+
+  // Stop the title and cover workers (plugin shutdown)
+  static void Stop(void);
 };
 
 #endif //_DISCMENU_H
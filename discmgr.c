@@ -7,10 +7,14 @@
 
 #include <unistd.h>
 
+#include <vdr/i18n.h>
 #include <vdr/thread.h>
 #include <vdr/tools.h>
 #include <vdr/skins.h>
 
+#include "bdmeta.h"
+#include "bdserver.h"
+
 #include "discmgr.h"
 
 
@@ -54,13 +58,35 @@ static bool PathOk(const char *DirName)
   return false;
 }
 
+/*
+ * cDiscMgr
+ */
+
 cDiscMgr::cDiscMgr()
+:cThread("BluRay drive probe")
 {
   Device     = DEFAULT_DEVICE;
   Path       = DEFAULT_PATH;
   MountCmd   = DEFAULT_MOUNTER;
   UnMountCmd = DEFAULT_UNMOUNTER;
   EjectCmd   = DEFAULT_EJECT;
+
+  probe      = false;
+  state      = dsUnknown;
+  nameStamp  = 0;
+  discStamp  = 0;
+  generation = 0;
+  server     = NULL;
+}
+
+cDiscMgr::~cDiscMgr()
+{
+  Cancel(3);
+}
+
+bool cDiscMgr::Served(void)
+{
+  return server && !server->Done();
 }
 
 bool cDiscMgr::IsMounted()
@@ -70,6 +96,8 @@ bool cDiscMgr::IsMounted()
 
 void cDiscMgr::Mount(bool Retry)
 {
+  cMutexLock lock(&mountMutex);
+
   cString cmd = cString::sprintf("%s \"%s\" \"%s\"", *MountCmd, *Device, *Path);
   isyslog("executing '%s'", *cmd);
   SystemExec(cmd);
@@ -107,30 +135,42 @@ void cDiscMgr::Eject()
   SystemExec(cmd);
 }
 
+// CheckDisc() runs on the launch thread, which can't show messages itself
+static void Message(eMessageType Type, const char *s)
+{
+  if (cThread::IsMainThread())
+    Skins.Message(Type, s);
+  else
+    Skins.QueueMessage(Type, s);
+}
+
 bool cDiscMgr::CheckDisc()
 {
+  // a probe may be mounting right now
+  cMutexLock lock(&mountMutex);
+
   if (!PathOk(Path)) {
-    Skins.Message(mtError, tr("Mount point does not exist!"));
+    Message(mtError, tr("Mount point does not exist!"));
     return false;
   }
 
   if (!IsMounted()) {
 
     if (!DeviceOk(Device)) {
-      Skins.Message(mtError, tr("Can't access device!"));
+      Message(mtError, tr("Can't access device!"));
       return false;
     }
 
     Mount(false);
 
     if (!IsMounted()) {
-      Skins.Message(mtWarning, tr("Failed to mount BluRay disc, retry..."));
+      Message(mtWarning, tr("Failed to mount BluRay disc, retry..."));
 
       CloseTray();
       Mount();
 
       if (!PathOk(cString::sprintf("%s/BDMV/", *Path))) {
-        Skins.Message(mtError, tr("Failed to mount BluRay disc!"));
+        Message(mtError, tr("Failed to mount BluRay disc!"));
 
         return false;
       }
@@ -139,3 +179,178 @@ bool cDiscMgr::CheckDisc()
 
   return true;
 }
+
+void cDiscMgr::SetState(eDiscState State, const char *Name)
+{
+  cMutexLock lock(&stateMutex);
+  if (State != state || (Name && (!*name || strcmp(Name, name))) || (!Name && *name)) {
+    state = State;
+    name = Name;
+    generation++;
+  }
+}
+
+eDiscState cDiscMgr::State(void)
+{
+  cMutexLock lock(&stateMutex);
+  return state;
+}
+
+cString cDiscMgr::Name(void)
+{
+  cMutexLock lock(&stateMutex);
+  return name;
+}
+
+void cDiscMgr::Probe(void)
+{
+  probe = true;
+  if (!Active())
+    Start();
+  probeWait.Signal();
+}
+
+void cDiscMgr::DoProbe(void)
+{
+  // a mounted drive is checked quietly, the menu is redrawn on changes only
+  if (State() != dsMounted)
+    SetState(dsProbing, Name());
+
+  if (!PathOk(Path)) {
+    SetState(dsError);
+    return;
+  }
+
+  if (!IsMounted()) {
+    if (!DeviceOk(Device)) {
+      SetState(dsError);
+      return;
+    }
+    // no retry and no tray closing: an empty drive just stays empty
+    Mount(false);
+    if (!IsMounted()) {
+      SetState(dsEmpty);
+      return;
+    }
+  }
+
+  // a swapped disc can leave the old mount behind
+  struct stat st;
+  if (stat(cString::sprintf("%s/BDMV/index.bdmv", *Path), &st) != 0) {
+    SetState(dsEmpty);
+    return;
+  }
+
+  // the title is read again only if the disc or its meta files changed
+  time_t stamp = BDMetaStamp(Path);
+  cString title = Name();
+  if (stamp != nameStamp || st.st_mtime != discStamp || !*title) {
+    char buf[256];
+    title = BDMetaName(Path, I18nLanguageCode(I18nCurrentLanguage()), buf, sizeof(buf)) ? buf : NULL;
+    nameStamp = stamp;
+    discStamp = st.st_mtime;
+  }
+  SetState(dsMounted, title);
+}
+
+void cDiscMgr::Action(void)
+{
+  while (Running()) {
+    if (probe) {
+      probe = false;
+      DoProbe();
+    }
+    probeWait.Wait(100);
+  }
+}
+
+/*
+ * cDiscMgrs
+ */
+
+cDiscMgrs::cDiscMgrs()
+{
+  defaults   = true;
+  MountCmd   = DEFAULT_MOUNTER;
+  UnMountCmd = DEFAULT_UNMOUNTER;
+  EjectCmd   = DEFAULT_EJECT;
+  Add(new cDiscMgr);
+}
+
+void cDiscMgrs::AddDevice(const char *Device)
+{
+  // the first --device replaces the default drive
+  cDiscMgr *mgr = defaults ? Last() : new cDiscMgr;
+  mgr->SetDevice(Device);
+  mgr->SetMountCmd(MountCmd);
+  mgr->SetUnMountCmd(UnMountCmd);
+  mgr->SetEjectCmd(EjectCmd);
+  if (!defaults)
+    Add(mgr);
+  defaults = false;
+}
+
+void cDiscMgrs::SetMountCmd(const char *M)
+{
+  MountCmd = M;
+  for (cDiscMgr *mgr = First(); mgr; mgr = Next(mgr))
+    mgr->SetMountCmd(M);
+}
+
+void cDiscMgrs::SetUnMountCmd(const char *U)
+{
+  UnMountCmd = U;
+  for (cDiscMgr *mgr = First(); mgr; mgr = Next(mgr))
+    mgr->SetUnMountCmd(U);
+}
+
+void cDiscMgrs::SetEjectCmd(const char *E)
+{
+  EjectCmd = E;
+  for (cDiscMgr *mgr = First(); mgr; mgr = Next(mgr))
+    mgr->SetEjectCmd(E);
+}
+
+bool cDiscMgrs::Check(void)
+{
+  for (cDiscMgr *mgr = First(); mgr; mgr = Next(mgr)) {
+    for (cDiscMgr *other = Next(mgr); other; other = Next(other)) {
+      if (!strcmp(mgr->GetPath(), other->GetPath())) {
+        esyslog("ERROR: BluRay drives %s and %s share the mount point %s, set --path for each --device",
+                mgr->GetDev(), other->GetDev(), mgr->GetPath());
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+cDiscMgr *cDiscMgrs::Default(void)
+{
+  for (cDiscMgr *mgr = First(); mgr; mgr = Next(mgr)) {
+    // the state may be older than a disc change
+    if (mgr->State() == dsMounted && mgr->IsMounted())
+      return mgr;
+  }
+  return First();
+}
+
+void cDiscMgrs::Probe(void)
+{
+  // each drive on its own thread: all drives in parallel
+  for (cDiscMgr *mgr = First(); mgr; mgr = Next(mgr))
+    mgr->Probe();
+}
+
+int cDiscMgrs::Generation(void)
+{
+  int generation = 0;
+  for (cDiscMgr *mgr = First(); mgr; mgr = Next(mgr))
+    generation += mgr->Generation();
+  return generation;
+}
+
+void cDiscMgrs::Stop(void)
+{
+  Clear();
+}
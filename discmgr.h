@@ -8,6 +8,7 @@
 #ifndef _DISCMGR_H
 #define _DISCMGR_H
 
+#include <vdr/thread.h>
 #include <vdr/tools.h>
 
 #define DEFAULT_DEVICE    "/dev/sr0"
@@ -16,18 +17,53 @@
 #define DEFAULT_UNMOUNTER "/bin/umount"
 #define DEFAULT_EJECT     "/usr/bin/eject"
 
-class cDiscMgr {
+class cBDServer;
+
+enum eDiscState {
+  dsUnknown,      // not probed yet
+  dsProbing,
+  dsEmpty,        // no (mountable) disc
+  dsMounted,
+  dsError         // device or mount point not usable
+};
+
+/*
+ * cDiscMgr
+ *
+ * One drive. Probe() checks the drive on the drive's own thread: a disc
+ * is mounted and its title read there, so a drive that is spinning up
+ * or has no disc never blocks the menu or the other drives.
+ */
+
+class cDiscMgr : public cListObject, public cThread {
 
 private:
 
   cString Device, Path, MountCmd, UnMountCmd, EjectCmd;
 
+  cMutex     mountMutex;        // mount commands of the probe and CheckDisc()
+  cMutex     stateMutex;
+  cCondWait  probeWait;
+  bool       probe;
+  eDiscState state;
+  cString    name;              // disc title, NULL if none
+  time_t     nameStamp;
+  time_t     discStamp;         // index.bdmv of the disc the title is of
+  int        generation;
+  cBDServer *server;            // serving the disc over HTTP, NULL if not
+
   void Mount(bool Retry = true);
   void UnMount(void);
   void CloseTray(void);
+  void SetState(eDiscState State, const char *Name = NULL);
+  void DoProbe(void);
+
+ protected:
+  virtual void Action(void);
 
  public:
   cDiscMgr();
+  virtual ~cDiscMgr();
 
   const char *GetDev(void)          { return Device; }
   const char *GetPath(void)         { return Path; }
@@ -42,6 +78,51 @@ private:
 
   bool CheckDisc(void);
   void Eject(void);
+
+  // Background probing
+  void Probe(void);
+  eDiscState State(void);
+  cString Name(void);
+  // Changes with the state or the disc title
+  int Generation(void)              { return generation; }
+
+  // The disc is served over HTTP by Server (NULL: not any more)
+  void SetServer(cBDServer *Server) { server = Server; }
+  // Serving the disc: the drive must not be launched
+  bool Served(void);
+};
+
+/*
+ * cDiscMgrs
+ *
+ * The drives of the plugin: the default drive, or one per --device.
+ * Mount, unmount and eject commands apply to all drives.
+ */
+
+class cDiscMgrs : public cList<cDiscMgr> {
+
+private:
+
+  bool defaults;                // only the default drive so far
+  cString MountCmd, UnMountCmd, EjectCmd;
+
+ public:
+  cDiscMgrs();
+
+  void AddDevice(const char *Device);
+  void SetPath(const char *Path)    { Last()->SetPath(Path); }
+  void SetMountCmd(const char *M);
+  void SetUnMountCmd(const char *U);
+  void SetEjectCmd(const char *E);
+  // Each drive needs a mount point of its own (--path), false if two share one
+  bool Check(void);
+
+  // First drive with a mounted disc, else the first drive
+  cDiscMgr *Default(void);
+
+  void Probe(void);
+  int  Generation(void);
+  void Stop(void);
 };
 
 #endif //_DISCMGR_H
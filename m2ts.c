@@ -0,0 +1,293 @@
+/*
+ * m2ts.c: BluRay m2ts packet helpers
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "bdstats.h"
+#include "bdtrace.h"
+#include "bdunit.h"
+
+#include "m2ts.h"
+
+// --- cM2tsFramer ------------------------------------------------------
+
+cM2tsFramer::cM2tsFramer(int Size)
+{
+  // room for one carried over packet in addition to Size
+  size = Size + M2TS_SIZE;
+  pool = new cBDUnitPool(size);
+  unit = NULL;
+  buffer = NULL;
+  head = tail = partial = 0;
+  pgPid = -1;
+  pgSink = NULL;
+  resyncs = carryOvers = droppedBytes = 0;
+  NewUnit(pool);
+}
+
+cM2tsFramer::~cM2tsFramer()
+{
+  if (unit)
+    unit->Unref();
+  pool->Release();
+}
+
+void cM2tsFramer::NewUnit(cBDUnitPool *Pool)
+{
+  cBDUnit *u = Pool->Get();
+  if (!u) {
+    syslog(LOG_ERR, "m2ts: out of memory for %d byte buffer", Pool->UnitSize());
+    return;
+  }
+
+  int n = tail - head;
+  if (n > 0) {
+    memcpy(u->Data(), buffer + head, n);
+    cBDStats::Count(bcCopiedBytes, n);
+  }
+  if (unit)
+    unit->Unref();
+  unit = u;
+  buffer = u->Data();
+  head = 0;
+  tail = n;
+}
+
+void cM2tsFramer::Resize(int Size)
+{
+  size = Size + M2TS_SIZE;
+  if (size < tail - head)
+    size = tail - head;
+
+  cBDUnitPool *old = pool;
+  pool = new cBDUnitPool(size);
+  NewUnit(pool);
+  old->Release();
+}
+
+uint8_t *cM2tsFramer::Space(int &Free)
+{
+  if (head > 0) {
+    int n = tail - head;
+    if (n > 0 && n < M2TS_SIZE) {
+      carryOvers++;
+      cBDStats::Count(bcCarryOvers);
+    }
+    if (unit->Shared()) {
+      // sinks still use the consumed packets
+      NewUnit(pool);
+    } else {
+      if (n > 0) {
+        memmove(buffer, buffer + head, n);
+        cBDStats::Count(bcCopiedBytes, n);
+      }
+      head = 0;
+      tail = n;
+    }
+  }
+
+  Free = unit && head == 0 ? size - tail : 0;
+  return buffer + tail;
+}
+
+void cM2tsFramer::Put(int Bytes)
+{
+  tail += Bytes;
+}
+
+bool cM2tsFramer::Resync(void)
+{
+  int start = head;
+
+  partial = 0;
+
+  // two consecutive sync bytes, or one if it is the last complete packet
+  for (; head + M2TS_SIZE <= tail; head++) {
+    if (Synced(head) && (head + 2 * M2TS_SIZE > tail || Synced(head + M2TS_SIZE)))
+      break;
+  }
+  if (head + M2TS_SIZE > tail) {
+    // keep the tail, it may start a packet
+    head = tail - M2TS_SIZE + 1;
+    if (head < start)
+      head = start;
+  }
+
+  int dropped = head - start;
+  if (dropped > 0) {
+    syslog(LOG_ERR, "m2ts: lost sync, %d bytes dropped", dropped);
+    resyncs++;
+    droppedBytes += dropped;
+    cBDStats::Count(bcResyncs);
+    cBDStats::Count(bcDroppedBytes, dropped);
+  }
+
+  return head + M2TS_SIZE <= tail;
+}
+
+const uint8_t *cM2tsFramer::Packets(int &Count)
+{
+  Count = 0;
+
+  if (head + M2TS_SIZE > tail)
+    return NULL;
+
+  if (!Synced(head) && !Resync())
+    return NULL;
+
+  int n = 1;
+  while (head + (n + 1) * M2TS_SIZE <= tail && Synced(head + n * M2TS_SIZE))
+    n++;
+
+  Count = n;
+  return buffer + head;
+}
+
+void cM2tsFramer::Consume(int Count)
+{
+  if (Count > 0) {
+    head += Count * M2TS_SIZE;
+    partial = 0;
+  }
+}
+
+int M2tsToTs(uint8_t *Data, int Count, bool DropGraphics)
+{
+  uint8_t *out = Data;
+
+  for (int i = 0; i < Count; i++) {
+    const uint8_t *pkt = Data + i * M2TS_SIZE;
+    ePidClass pc = M2tsPidClass(M2tsPid(pkt));
+    cBDStats::Count((eBDCounter)(bcPidVideo + pc));
+    if (DropGraphics && (pc == pcPG || pc == pcIG))
+      continue;
+    memmove(out, pkt + 4, TS_SIZE);
+    out += TS_SIZE;
+  }
+
+  cBDStats::Count(bcCopiedBytes, out - Data);
+  return out - Data;
+}
+
+static void CountPackets(const uint8_t *Packets, int Count)
+{
+  for (int i = 0; i < Count; i++)
+    cBDStats::Count((eBDCounter)(bcPidVideo + M2tsPidClass(M2tsPid(Packets + i * M2TS_SIZE))));
+  cBDStats::Count(bcPlayTsAccepted, Count);
+}
+
+bool cM2tsFramer::FeedUnits(cBDSink &Sink)
+{
+  int count;
+  const uint8_t *pkts;
+
+  while ((pkts = Packets(count)) != NULL) {
+
+    // runs of packets between PG and IG packets go to the sink by reference
+    int run = 0;
+    for (int i = 0; i <= count; i++) {
+
+      ePidClass pc = pcOther;
+      if (i < count) {
+        pc = M2tsPidClass(M2tsPid(pkts + i * M2TS_SIZE));
+        if (pc != pcPG && pc != pcIG)
+          continue;
+      }
+
+      int n = i - run;
+      if (n > 0) {
+        int w = Sink.FeedUnit(unit, pkts + run * M2TS_SIZE, n);
+        if (w < 0) {
+          syslog(LOG_ERR, "m2ts: sink error");
+          cBDStats::Count(bcPlayTsErrors);
+          return false;
+        }
+        CountPackets(pkts + run * M2TS_SIZE, w);
+        if (w < n) {
+          cBDStats::Count(w > 0 ? bcPlayTsPartial : bcPlayTsRejected);
+          Consume(run + w);
+          return true;
+        }
+      }
+      run = i + 1;
+
+      if (pc == pcPG) {
+        const uint8_t *pkt = pkts + i * M2TS_SIZE;
+        cBDStats::Count(bcPidPG);
+        if (pgSink && M2tsPid(pkt) == pgPid)
+          pgSink->Feed(pkt + 4, TS_SIZE);
+      } else if (pc == pcIG)
+        cBDStats::Count(bcPidIG);
+    }
+
+    Consume(count);
+  }
+
+  return true;
+}
+
+bool cM2tsFramer::Feed(cBDSink &Sink)
+{
+  int count;
+  const uint8_t *pkts;
+
+  BD_TRACE_SPAN(btPidFilter);
+
+  if (Sink.TakesUnits() && !partial)
+    return FeedUnits(Sink);
+
+  while ((pkts = Packets(count)) != NULL) {
+
+    for (int i = 0; i < count; i++) {
+
+      const uint8_t *pkt = pkts + i * M2TS_SIZE;
+      ePidClass pc = M2tsPidClass(M2tsPid(pkt));
+      if (pc == pcPG) {
+        // PG streams go to the subtitle decoder, if any
+        cBDStats::Count(bcPidPG);
+        if (pgSink && M2tsPid(pkt) == pgPid)
+          pgSink->Feed(pkt + 4, TS_SIZE);
+        continue;
+      }
+      if (pc == pcIG) {
+        // skip IG streams
+        cBDStats::Count(bcPidIG);
+        continue;
+      }
+
+      int w = Sink.Feed(pkt + 4 + partial, TS_SIZE - partial);
+
+      if (w == TS_SIZE - partial) {
+        cBDStats::Count((eBDCounter)(bcPidVideo + pc));
+        cBDStats::Count(bcPlayTsAccepted);
+        partial = 0;
+        continue;
+      } else if (w > 0) {
+        // continue with the rest of the packet when the sink has room again
+        cBDStats::Count(bcPlayTsPartial);
+        Consume(i);
+        partial += w;
+        return true;
+      } else if (w == 0) {
+        //syslog(LOG_ERR, "PlayTs() error: data not accepted");
+        cBDStats::Count(bcPlayTsRejected);
+        Consume(i);
+        return true;
+      } else {
+        syslog(LOG_ERR, "PlayTs() error");
+        cBDStats::Count(bcPlayTsErrors);
+        return false;
+      }
+    }
+
+    Consume(count);
+  }
+
+  return true;
+}
@@ -0,0 +1,132 @@
+/*
+ * m2ts.h: BluRay m2ts packet helpers
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _M2TS_H
+#define _M2TS_H
+
+#include <stdint.h>
+
+class cBDUnit;
+class cBDUnitPool;
+
+#define TS_SIZE            188
+#define M2TS_SIZE          (TS_SIZE + 4)       // size of m2ts packet
+#define ALIGNED_UNIT_SIZE  (32 * M2TS_SIZE)    // size of aligned unit (32 packets)
+
+// PID of m2ts packet (4 byte TP_extra_header + TS packet)
+static inline uint16_t M2tsPid(const uint8_t *Packet)
+{
+  return ((Packet[4 + 1] << 8) | Packet[4 + 2]) & 0x1fff;
+}
+
+// PID classes of BluRay main path / sub path streams
+enum ePidClass {
+  pcVideo,
+  pcAudio,
+  pcPG,
+  pcIG,
+  pcOther,
+  pcCount
+};
+
+static inline ePidClass M2tsPidClass(uint16_t Pid)
+{
+  if (Pid == 0x1011 || (Pid >= 0x1b00 && Pid < 0x1b20))
+    return pcVideo;
+  if ((Pid >= 0x1100 && Pid < 0x1120) || (Pid >= 0x1a00 && Pid < 0x1a20))
+    return pcAudio;
+  if (Pid >= 0x1200 && Pid < 0x1300)
+    return pcPG;
+  if (Pid >= 0x1400 && Pid < 0x1500)
+    return pcIG;
+  return pcOther;
+}
+
+// Convert Count m2ts packets at Data to TS packets in place, optionally
+// dropping PG and IG streams. Returns the number of TS bytes at Data.
+// The compaction is counted as copied bytes.
+int M2tsToTs(uint8_t *Data, int Count, bool DropGraphics);
+
+// --- cBDSink ----------------------------------------------------------
+
+// Destination of the filtered transport stream (output device, file, ...)
+
+class cBDSink {
+public:
+  virtual ~cBDSink() {}
+
+  // Returns number of bytes accepted, 0 if sink is full, < 0 on error
+  virtual int Feed(const uint8_t *Data, int Length) = 0;
+  // Wait until sink can accept more data
+  virtual bool Poll(int TimeoutMs) = 0;
+
+  // Sinks that keep data may take references to the read buffer instead
+  // of copies: FeedUnit() gets Count m2ts packets at Packets (TS packet
+  // at offset 4) inside Unit, and Ref()s Unit as long as it needs them.
+  // Returns number of packets accepted, 0 if sink is full, < 0 on error.
+  virtual bool TakesUnits(void) { return false; }
+  virtual int FeedUnit(cBDUnit *Unit, const uint8_t *Packets, int Count) { return -1; }
+};
+
+// --- cM2tsFramer ------------------------------------------------------
+
+// Reassembles m2ts packets from reads of arbitrary size.
+// Partial packets are carried over to the next read, lost sync is
+// recovered by searching for the 0x47 sync byte.
+// The buffer is a pool unit: sinks taking units keep references to it,
+// and the next read goes to a fresh unit while the old one is shared.
+
+class cM2tsFramer {
+private:
+  cBDUnitPool *pool;
+  cBDUnit *unit;
+  uint8_t *buffer;
+  int size;
+  int head;           // start of first unconsumed packet
+  int tail;           // end of data
+  int partial;        // bytes of the head packet already accepted by the sink
+  int pgPid;
+  cBDSink *pgSink;
+
+  bool Synced(int Offset) { return buffer[Offset + 4] == 0x47; }
+  bool Resync(void);
+  void NewUnit(cBDUnitPool *Pool);
+  bool FeedUnits(cBDSink &Sink);
+
+public:
+  uint64_t resyncs;
+  uint64_t carryOvers;
+  uint64_t droppedBytes;
+
+  cM2tsFramer(int Size);
+  ~cM2tsFramer();
+
+  // Free space for the next read. Moves carried over data to the start of the buffer.
+  uint8_t *Space(int &Free);
+  void Put(int Bytes);
+
+  // Complete, synced packets at the head of the buffer
+  const uint8_t *Packets(int &Count);
+  void Consume(int Count);
+
+  // Feed all complete packets to Sink, skipping PG and IG streams.
+  // Returns false on sink error.
+  bool Feed(cBDSink &Sink);
+  // Pass TS packets of PG stream Pid to Sink (-1 / NULL: off). Sink must not block.
+  void SetPgSink(int Pid, cBDSink *Sink) { pgPid = Pid; pgSink = Sink; }
+
+  // Change capacity, keeps buffered data
+  void Resize(int Size);
+  const cBDUnitPool *Pool(void) const { return pool; }
+
+  int  Capacity(void)  { return size - M2TS_SIZE; }
+  int  Available(void) { return tail - head; }
+  bool Pending(void)   { return tail - head >= M2TS_SIZE; }
+  void Clear(void)     { head = tail = partial = 0; }
+};
+
+#endif //_M2TS_H
@@ -0,0 +1,220 @@
+/*
+ * setupmenu.c: BluRay plugin setup
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <stdlib.h>
+#include <strings.h>
+
+#include <vdr/i18n.h>
+
+#include "bdplayer.h"
+#include "bdstats.h"
+
+#include "setupmenu.h"
+
+#define STATS_INTERVAL_MS  1000
+
+sBDSetup BDSetup = {
+  1,       // readUnits
+  180,     // minTitleLength
+};
+
+bool BDSetupParse(const char *Name, const char *Value)
+{
+  int v = atoi(Value);
+
+  if      (!strcasecmp(Name, "ReadUnits"))      BDSetup.readUnits = v;
+  else if (!strcasecmp(Name, "MinTitleLength")) BDSetup.minTitleLength = v;
+  else if (!strcasecmp(Name, "ReadAhead"))      BDReadAheadConfig.seconds = v;
+  else if (!strcasecmp(Name, "ReadAheadMB"))    BDReadAheadConfig.maxMB = v;
+  else if (!strcasecmp(Name, "PauseBuffer"))    BDReadAheadConfig.pauseSeconds = v;
+  else if (!strcasecmp(Name, "AacsThreads"))    BDReadAheadConfig.aacsThreads = v;
+  else if (!strcasecmp(Name, "StageMB"))        BDStageConfig.maxMB = v;
+  else if (!strcasecmp(Name, "OsdRate"))        BDRedrawConfig.maxRate = v;
+  else if (!strcasecmp(Name, "Recovery"))       BDRecoveryConfig.mode = v;
+  else if (!strcasecmp(Name, "ReadTimeout"))    BDRecoveryConfig.readTimeoutMs = v;
+  else if (!strcasecmp(Name, "RetrySpeed"))     BDRecoveryConfig.retrySpeed = v;
+  else if (!strcasecmp(Name, "SchedPolicy"))    BDPlayerSched.policy = v;
+  else if (!strcasecmp(Name, "SchedPriority"))  BDPlayerSched.priority = v;
+  else if (!strcasecmp(Name, "IoClass"))        BDPlayerSched.ioClass = v;
+  else if (!strcasecmp(Name, "IoLevel"))        BDPlayerSched.ioLevel = v;
+  else
+    return false;
+
+  // the same limits as the command line (the keys come in any order)
+  BDClampSched(BDPlayerSched);
+  return true;
+}
+
+/*
+ * cSetupMenu
+ */
+
+cSetupMenu::cSetupMenu(void)
+{
+  static const char *recoveryModes[3];
+  static const char *policies[4];
+  static const char *ioClasses[4];
+  recoveryModes[rmOff]        = tr("off");
+  recoveryModes[rmSkip]       = tr("skip");
+  recoveryModes[rmEntryPoint] = tr("next entry point");
+  policies[spDefault]         = tr("default");
+  policies[spNice]            = tr("nice");
+  policies[spFifo]            = tr("real-time FIFO");
+  policies[spRR]              = tr("real-time round robin");
+  ioClasses[icDefault]        = tr("default");
+  ioClasses[icRealtime]       = tr("real-time");
+  ioClasses[icBestEffort]     = tr("best effort");
+  ioClasses[icIdle]           = tr("idle");
+
+  setup = BDSetup;
+  readAhead = BDReadAheadConfig;
+  stage = BDStageConfig;
+  redraw = BDRedrawConfig;
+  recovery = BDRecoveryConfig;
+  sched = BDPlayerSched;
+
+  Group(tr("Reading"));
+  Add(new cMenuEditIntItem(tr("Aligned units per read"), &setup.readUnits, 1, 64));
+  Add(new cMenuEditIntItem(tr("Read-ahead (s)"), &readAhead.seconds, 0, 60, tr("off")));
+  Add(new cMenuEditIntItem(tr("Read-ahead memory (MB, next playback)"), &readAhead.maxMB, 4, 1024));
+  Add(new cMenuEditIntItem(tr("Minimum main title length (s)"), &setup.minTitleLength, 0, 3600));
+  readStats = Stats();
+
+  Group(tr("Pausing"));
+  Add(new cMenuEditIntItem(tr("Buffer while paused (s)"), &readAhead.pauseSeconds, 0, 600, tr("off")));
+  pauseStats = Stats();
+
+  Group(tr("Staging"));
+  Add(new cMenuEditIntItem(tr("Staging cache (MB)"), &stage.maxMB, 0, 1024 * 1024, tr("off")));
+  stageStats = Stats();
+
+  Group(tr("AACS"));
+  Add(new cMenuEditIntItem(tr("Decryption threads (next playback)"), &readAhead.aacsThreads, 0, 16, tr("libaacs")));
+  aacsStats = Stats();
+
+  Group(tr("Display"));
+  Add(new cMenuEditIntItem(tr("Progress redraws per second"), &redraw.maxRate, 0, 50, tr("no limit")));
+  osdStats = Stats();
+
+  Group(tr("Read errors"));
+  Add(new cMenuEditStraItem(tr("Recovery"), &recovery.mode, 3, recoveryModes));
+  Add(new cMenuEditIntItem(tr("Read timeout (ms)"), &recovery.readTimeoutMs, 0, 60000, tr("none")));
+  Add(new cMenuEditIntItem(tr("Retry speed (next playback)"), &recovery.retrySpeed, 0, 16, tr("no retries")));
+  recoveryStats = Stats();
+
+  Group(tr("Player thread"));
+  Add(new cMenuEditStraItem(tr("Scheduling"), &sched.policy, 4, policies));
+  Add(new cMenuEditIntItem(tr("Priority / nice value"), &sched.priority, -20, 99));
+  schedPolicy = sched.policy;
+  Add(new cMenuEditStraItem(tr("I/O class"), &sched.ioClass, 4, ioClasses));
+  Add(new cMenuEditIntItem(tr("I/O level"), &sched.ioLevel, 0, 7));
+  schedStats = Stats();
+
+  UpdateStats();
+}
+
+cOsdItem *cSetupMenu::Group(const char *Title)
+{
+  cOsdItem *item = new cOsdItem(cString::sprintf("--- %s ---", Title), osUnknown, false);
+  Add(item);
+  return item;
+}
+
+cOsdItem *cSetupMenu::Stats(void)
+{
+  cOsdItem *item = new cOsdItem("", osUnknown, false);
+  Add(item);
+  return item;
+}
+
+static double Percent(uint64_t Part, uint64_t Other)
+{
+  return Part + Other ? Part * 100.0 / (Part + Other) : 0;
+}
+
+void cSetupMenu::UpdateStats(void)
+{
+  // of the current (or last) playback
+  readStats->SetText(cString::sprintf("  %s: %.1f ms, %s: %llu MB, %llu %s",
+                     tr("read"), cBDStats::Average(bhRead) / 1000.0,
+                     tr("read ahead"), (unsigned long long)(cBDStats::Total(bcReadAheadBytes) >> 20),
+                     (unsigned long long)cBDStats::Total(bcReadAheadWaits), tr("waits")));
+  pauseStats->SetText(cString::sprintf("  %s: %.1f ms",
+                      tr("resume to data"), cBDStats::Average(bhResume) / 1000.0));
+  stageStats->SetText(cString::sprintf("  %s: %llu MB, %s: %.0f%%",
+                      tr("staged"), (unsigned long long)(cBDStats::Total(bcStagedBytes) >> 20),
+                      tr("reads from the cache"),
+                      Percent(cBDStats::Total(bcStageHitBytes), cBDStats::Total(bcStageMissBytes))));
+  aacsStats->SetText(cString::sprintf("  %s: %llu, %.1f ms %s",
+                     tr("units decrypted"), (unsigned long long)cBDStats::Total(bcAacsUnits),
+                     cBDStats::Average(bhDecrypt) / 1000.0, tr("per request")));
+  osdStats->SetText(cString::sprintf("  %s: %llu",
+                    tr("progress display flushes"), (unsigned long long)cBDStats::Total(bcProgressDraws)));
+  recoveryStats->SetText(cString::sprintf("  %s: %llu, %s: %llu",
+                         tr("read errors"), (unsigned long long)cBDStats::Total(bcReadErrors),
+                         tr("skipped"), (unsigned long long)cBDStats::Total(bcSkips)));
+  schedStats->SetText(cString::sprintf("  %s: %llu, %s: %.1f%%",
+                      tr("poll timeouts"), (unsigned long long)cBDStats::Total(bcPollTimeouts),
+                      tr("packets rejected"),
+                      Percent(cBDStats::Total(bcPlayTsRejected), cBDStats::Total(bcPlayTsAccepted))));
+
+  statsTimer.Set(STATS_INTERVAL_MS);
+}
+
+void cSetupMenu::Store(void)
+{
+  BDClampSched(sched);
+
+  BDSetup = setup;
+  BDReadAheadConfig = readAhead;
+  BDStageConfig = stage;
+  BDRedrawConfig = redraw;
+  BDRecoveryConfig = recovery;
+  BDPlayerSched.policy   = sched.policy;
+  BDPlayerSched.priority = sched.priority;
+  BDPlayerSched.ioClass  = sched.ioClass;
+  BDPlayerSched.ioLevel  = sched.ioLevel;
+
+  SetupStore("ReadUnits",      setup.readUnits);
+  SetupStore("MinTitleLength", setup.minTitleLength);
+  SetupStore("ReadAhead",      readAhead.seconds);
+  SetupStore("ReadAheadMB",    readAhead.maxMB);
+  SetupStore("PauseBuffer",    readAhead.pauseSeconds);
+  SetupStore("AacsThreads",    readAhead.aacsThreads);
+  SetupStore("StageMB",        stage.maxMB);
+  SetupStore("OsdRate",        redraw.maxRate);
+  SetupStore("Recovery",       recovery.mode);
+  SetupStore("ReadTimeout",    recovery.readTimeoutMs);
+  SetupStore("RetrySpeed",     recovery.retrySpeed);
+  SetupStore("SchedPolicy",    sched.policy);
+  SetupStore("SchedPriority",  sched.priority);
+  SetupStore("IoClass",        sched.ioClass);
+  SetupStore("IoLevel",        sched.ioLevel);
+
+  cBDControl::Reconfigure();
+}
+
+eOSState cSetupMenu::ProcessKey(eKeys Key)
+{
+  eOSState state = cMenuSetupPage::ProcessKey(Key);
+
+  // priority 1...99 for real-time policies, nice -20...19, none for default
+  if (sched.policy != schedPolicy) {
+    schedPolicy = sched.policy;
+    BDClampSched(sched);
+    Display();
+  }
+
+  if (Key == kNone && statsTimer.TimedOut()) {
+    UpdateStats();
+    cOsdItem *items[] = { readStats, pauseStats, stageStats, aacsStats, osdStats, recoveryStats, schedStats };
+    for (unsigned i = 0; i < sizeof(items) / sizeof(items[0]); i++)
+      DisplayItem(items[i]);
+  }
+
+  return state;
+}
@@ -0,0 +1,59 @@
+/*
+ * setupmenu.h: BluRay plugin setup
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _SETUPMENU_H
+#define _SETUPMENU_H
+
+#include <vdr/menuitems.h>
+#include <vdr/tools.h>
+
+#include "bdreadahead.h"
+#include "bdrecovery.h"
+#include "bdredraw.h"
+#include "bdsched.h"
+#include "bdstage.h"
+
+struct sBDSetup {
+  int readUnits;                // aligned units per libbluray read
+  int minTitleLength;           // seconds, shorter titles are not the main title
+};
+
+extern sBDSetup BDSetup;
+
+// Setup value from setup.conf (overrides the command line)
+bool BDSetupParse(const char *Name, const char *Value);
+
+// Settings are applied to a running player when stored. The statistics
+// of the current playback are shown below each group and kept up to date.
+
+class cSetupMenu : public cMenuSetupPage {
+ private:
+  sBDSetup setup;
+  sBDReadAheadConfig readAhead;
+  sBDStageConfig stage;
+  sBDRedrawConfig redraw;
+  sBDRecoveryConfig recovery;
+  sBDSchedParams sched;
+  int schedPolicy;              // shown, to clamp the priority when it changes
+
+  cOsdItem *readStats, *pauseStats, *stageStats, *aacsStats, *osdStats, *recoveryStats, *schedStats;
+  cTimeMs statsTimer;
+
+  cOsdItem *Group(const char *Title);
+  cOsdItem *Stats(void);
+  void UpdateStats(void);
+
+ protected:
+  virtual void Store(void);
+
+ public:
+  cSetupMenu(void);
+
+  virtual eOSState ProcessKey(eKeys Key);
+};
+
+#endif //_SETUPMENU_H
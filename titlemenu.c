@@ -9,7 +9,9 @@
 
 #include <vdr/tools.h>
 #include <vdr/osdbase.h>
+#include <vdr/skins.h>
 
+#include "bdexport.h"
 #include "bdplayer.h"
 
 #include "titlemenu.h"
@@ -53,6 +55,7 @@ cTitleMenu::cTitleMenu(cBDControl *Ctrl) :
     cOsdMenu("BluRay Titles")
 {
   ctrl = Ctrl;
+  progress = -2;
 
   /* load title list */
   BLURAY *bd = ctrl->BDHandle();
@@ -70,9 +73,27 @@ cTitleMenu::cTitleMenu(cBDControl *Ctrl) :
   }
 
   Sort();
+  SetCopyStatus();
   Display();
 }
 
+void cTitleMenu::SetCopyStatus(void)
+{
+  int p = cBDExport::Progress();
+  if (p == progress)
+    return;
+
+  if (p < 0) {
+    SetHelp(NULL, NULL, NULL, tr("Copy"));
+    SetStatus(NULL);
+  } else {
+    if (progress < 0)
+      SetHelp(NULL, NULL, NULL, tr("Stop copy"));
+    SetStatus(cString::sprintf(tr("Copying to recordings: %d.%d%%"), p / 10, p % 10));
+  }
+  progress = p;
+}
+
 eOSState cTitleMenu::ProcessKey(eKeys Key)
 {
   eOSState state = cOsdMenu::ProcessKey(Key);
@@ -89,5 +110,21 @@ eOSState cTitleMenu::ProcessKey(eKeys Key)
     default:      break;
   }
 
+  if (state == osUnknown && Key == kBlue) {
+    state = osContinue;
+    if (cBDExport::Progress() >= 0) {
+      cBDExport::Abort();
+    } else {
+      cTitleItem *ti = (cTitleItem*)Get(Current());
+      if (ti) {
+        if (cBDExport::Start(ctrl->Path(), ti->GetPlaylist(), ctrl->DiscName()))
+          return osBack;  // ends playback, the copy starts then
+        Skins.Message(mtError, tr("BluRay copy failed"));
+      }
+    }
+  }
+
+  SetCopyStatus();
+
   return state;
 }
@@ -15,6 +15,9 @@ class cBDControl;
 class cTitleMenu : public cOsdMenu {
  private:
   cBDControl *ctrl;
+  int progress;
+
+  void SetCopyStatus(void);
 
  public:
   cTitleMenu(cBDControl *Ctrl);